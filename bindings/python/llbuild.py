@@ -317,4 +317,121 @@ prior result."""
         libllbuild.llb_buildengine_task_is_complete(
             self._engine, task._task, value.key, force_change)
 
-__all__ = ['get_full_version', 'BuildEngine', 'Rule', 'Task']
+@ffi.callback("bool(void*, const llb_database_key_entry_t*)")
+def _database_visit_key(context, entry):
+    visitor = ffi.from_handle(context)
+
+    key = str(ffi.buffer(entry.key.data, entry.key.length))
+    result = None
+    if entry.hasResult:
+        result = DatabaseResult(
+            str(ffi.buffer(entry.value.data, entry.value.length)),
+            entry.signature | (entry.signatureHigh << 64),
+            entry.builtAt, entry.computedAt)
+    return bool(visitor(key, result))
+
+@ffi.callback("bool(void*, const llb_database_command_telemetry_t*)")
+def _database_visit_command_telemetry(context, entry):
+    visitor = ffi.from_handle(context)
+
+    key = str(ffi.buffer(entry.key.data, entry.key.length))
+    return bool(visitor(key, CommandTelemetry(
+        entry.iteration, entry.wallTime, entry.utime, entry.stime,
+        entry.maxrss, entry.outputSize, entry.status, entry.exitCode)))
+
+class DatabaseResult(object):
+    """A result stored in a build database."""
+    def __init__(self, value, signature, built_at, computed_at):
+        self.value = value
+        self.signature = signature
+        self.built_at = built_at
+        self.computed_at = computed_at
+
+class CommandTelemetry(object):
+    """The execution telemetry of a command, stored in a build database.
+
+    Times are in microseconds."""
+    def __init__(self, iteration, wall_time, utime, stime, maxrss,
+                 output_size, status, exit_code):
+        self.iteration = iteration
+        self.wall_time = wall_time
+        self.utime = utime
+        self.stime = stime
+        self.maxrss = maxrss
+        self.output_size = output_size
+        self.status = status
+        self.exit_code = exit_code
+
+class Database(object):
+    def __init__(self, path, client_schema_version=0, read_only=True):
+        """
+        Database(path, client_schema_version=0, read_only=True)
+
+        Open the build database at the given path. Read-only databases do not
+        lock the database, and can be inspected while a build is running.
+        """
+
+        error = ffi.new("llb_data_t*")
+        path = ffi.new("char[]", path)
+        if read_only:
+            open_fn = libllbuild.llb_database_open_read_only
+        else:
+            open_fn = libllbuild.llb_database_open
+        self._database = open_fn(path, client_schema_version, error)
+        if self._database == ffi.NULL:
+            raise IOError("unable to open database; %r" % (
+                str(ffi.buffer(error.data, error.length)),))
+
+    def visit_keys(self, visitor, prefix=None, include_results=False):
+        """\
+visit_keys(visitor, prefix=None, include_results=False)
+
+Visit the keys in the database without materializing them. The visitor is
+called as visitor(key, result), where result is a DatabaseResult (or None, if
+results were not requested or no result is stored), and returns False to stop
+the enumeration.
+
+If a prefix is given, only keys starting with it are visited; for build system
+keys, the first byte is the key kind code (e.g., "C" for commands)."""
+        prefix_data = None
+        if prefix is not None:
+            prefix_data = _Data(prefix)
+        error = ffi.new("llb_data_t*")
+        handle = ffi.new_handle(visitor)
+        if not libllbuild.llb_database_visit_keys(
+                self._database,
+                prefix_data.key if prefix_data else ffi.NULL,
+                include_results, handle, _database_visit_key, error):
+            raise IOError("unable to visit database keys; %r" % (
+                str(ffi.buffer(error.data, error.length)),))
+
+    def visit_command_telemetry(self, visitor, key=None):
+        """\
+visit_command_telemetry(visitor, key=None)
+
+Visit the recorded command telemetry, ordered by key and then from the most
+recent build. The visitor is called as visitor(key, telemetry), where telemetry
+is a CommandTelemetry, and returns False to stop the enumeration.
+
+If a key is given, only the telemetry for that command is visited."""
+        key_data = None
+        if key is not None:
+            key_data = _Data(key)
+        error = ffi.new("llb_data_t*")
+        handle = ffi.new_handle(visitor)
+        if not libllbuild.llb_database_visit_command_telemetry(
+                self._database,
+                key_data.key if key_data else ffi.NULL,
+                handle, _database_visit_command_telemetry, error):
+            raise IOError("unable to visit command telemetry; %r" % (
+                str(ffi.buffer(error.data, error.length)),))
+
+    def close(self):
+        """
+        close() -- Close the database connection.
+        """
+        libllbuild.llb_database_destroy(self._database)
+        self._database = None
+
+__all__ = ['get_full_version', 'BuildEngine', 'CommandTelemetry', 'Database',
+           'DatabaseResult', 'Rule', 'Task']
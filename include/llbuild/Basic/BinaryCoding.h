@@ -16,10 +16,16 @@
 #include "llbuild/Basic/Compiler.h"
 #include "llbuild/Basic/LLVM.h"
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/SwapByteOrder.h"
 
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 namespace llbuild {
@@ -31,6 +37,21 @@ struct BinaryCodingTraits {
   // static inline void decode(T&, BinaryDecoder&);
 };
 
+/// Whether the encoding of a type is identical to its in-memory representation
+/// on a little-endian host, so that arrays of it can be coded with a single
+/// copy (see \see BinaryEncoder::writeArray()).
+///
+/// This holds for the fixed-size unsigned integers, and may be specialized for
+/// structures made up only of them, with no padding, which are coded field by
+/// field in declaration order.
+template<typename T>
+struct BinaryCodingIsBitwise : std::false_type {};
+
+template<> struct BinaryCodingIsBitwise<uint8_t> : std::true_type {};
+template<> struct BinaryCodingIsBitwise<uint16_t> : std::true_type {};
+template<> struct BinaryCodingIsBitwise<uint32_t> : std::true_type {};
+template<> struct BinaryCodingIsBitwise<uint64_t> : std::true_type {};
+
 /// A basic binary encoding utility.
 ///
 /// This encoder is design for small, relatively efficient, in-memory coding of
@@ -50,6 +71,14 @@ private:
   // FIXME: Parameterize this size?
   llvm::SmallVector<uint8_t, 256> encdata;
 
+  template<typename T>
+  void writeLittleEndian(T value) {
+    if (llvm::sys::IsBigEndianHost)
+      value = llvm::sys::getSwappedBytes(value);
+    auto bytes = reinterpret_cast<const uint8_t*>(&value);
+    encdata.append(bytes, bytes + sizeof(T));
+  }
+
 public:
   /// Construct a new binary encoder.
   BinaryEncoder() {}
@@ -65,31 +94,57 @@ public:
   }
 
   /// Encode a value to the stream.
-  void write(uint16_t value) {
-    write(uint8_t(value >> 0));
-    write(uint8_t(value >> 8));
-  }
+  void write(uint16_t value) { writeLittleEndian(value); }
 
   /// Encode a value to the stream.
-  void write(uint32_t value) {
-    write(uint16_t(value >> 0));
-    write(uint16_t(value >> 16));
-  }
+  void write(uint32_t value) { writeLittleEndian(value); }
 
   /// Encode a value to the stream.
-  void write(uint64_t value) {
-    write(uint32_t(value >> 0));
-    write(uint32_t(value >> 32));
-  }
+  void write(uint64_t value) { writeLittleEndian(value); }
 
   /// Encode a value to the stream.
   ///
   /// We do not support encoding values larger than 4GB.
   void write(const std::string& value) {
+    writeString(value);
+  }
+
+  /// Encode a string to the stream, in the same form as a \see std::string
+  /// (and so it may be decoded as either).
+  void writeString(StringRef value) {
     uint32_t size = uint32_t(value.size());
     assert(size == value.size());
     write(size);
-    writeBytes(StringRef(value));
+    writeBytes(value);
+  }
+
+  /// Encode an integer to the stream in a variable number of bytes (seven bits
+  /// per byte, so values below 128 take a single byte).
+  void writeVarInt(uint64_t value) {
+    uint8_t bytes[10];
+    unsigned numBytes = 0;
+    while (value >= 0x80) {
+      bytes[numBytes++] = uint8_t(value) | 0x80;
+      value >>= 7;
+    }
+    bytes[numBytes++] = uint8_t(value);
+    encdata.append(bytes, bytes + numBytes);
+  }
+
+  /// Encode each of a sequence of values to the stream.
+  ///
+  /// The number of values is not encoded, so must be known to the decoder.
+  /// Values whose encoding is bitwise (\see BinaryCodingIsBitwise) are copied
+  /// in a single step on little-endian hosts.
+  template<typename T>
+  void writeArray(ArrayRef<T> values) {
+    if (BinaryCodingIsBitwise<T>::value && llvm::sys::IsLittleEndianHost) {
+      auto bytes = reinterpret_cast<const uint8_t*>(values.data());
+      encdata.append(bytes, bytes + values.size() * sizeof(T));
+      return;
+    }
+    for (const auto& value: values)
+      write(value);
   }
 
   /// Encode a sequence of bytes to the stream.
@@ -134,20 +189,20 @@ private:
   /// The current position in the stream.
   uint64_t pos = 0;
 
-  uint8_t read8() { return data[pos++]; }
-  uint16_t read16() {
-    uint16_t result = read8();
-    result |= uint16_t(read8()) << 8;
-    return result;
-  }
-  uint32_t read32() {
-    uint32_t result = read16();
-    result |= uint32_t(read16()) << 16;
-    return result;
-  }
-  uint64_t read64() {
-    uint64_t result = read32();
-    result |= uint64_t(read32()) << 32;
+  /// Whether a read ran past the end of the stream.
+  bool overran = false;
+
+  uint8_t read8() { return canRead(1) ? data[pos++] : 0; }
+
+  template<typename T>
+  T readLittleEndian() {
+    if (!canRead(sizeof(T)))
+      return 0;
+    T result;
+    memcpy(&result, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    if (llvm::sys::IsBigEndianHost)
+      result = llvm::sys::getSwappedBytes(result);
     return result;
   }
   
@@ -166,6 +221,31 @@ public:
   bool isEmpty() const {
     return pos == data.size();
   }
+
+  /// Get the number of bytes left to decode.
+  uint64_t getRemainingSize() const {
+    return data.size() - pos;
+  }
+
+  /// Check that \arg count more bytes can be read. Otherwise, mark the decoder
+  /// as having overrun the stream, and skip to its end (so that all further
+  /// reads produce zero values).
+  ///
+  /// \returns True if the bytes can be read.
+  bool canRead(uint64_t count) {
+    if (count <= data.size() - pos)
+      return true;
+    overran = true;
+    pos = data.size();
+    return false;
+  }
+
+  /// Check if a read ran past the end of the stream, in which case the values
+  /// decoded since are invalid. Clients decoding untrusted data must check
+  /// this before using the decoded values.
+  bool hasOverrun() const {
+    return overran;
+  }
   
   /// Decode a value from the stream.
   void read(bool& value) { value = read8() != 0; }
@@ -174,29 +254,70 @@ public:
   void read(uint8_t& value) { value = read8(); }
   
   /// Decode a value from the stream.
-  void read(uint16_t& value) { value = read16(); }
+  void read(uint16_t& value) { value = readLittleEndian<uint16_t>(); }
 
   /// Decode a value from the stream.
-  void read(uint32_t& value) { value = read32(); }
+  void read(uint32_t& value) { value = readLittleEndian<uint32_t>(); }
 
   /// Decode a value from the stream.
-  void read(uint64_t& value) { value = read64(); }
+  void read(uint64_t& value) { value = readLittleEndian<uint64_t>(); }
 
   /// Decode a value from the stream.
   void read(std::string& value) {
-    uint32_t size;
-    read(size);
     StringRef contents;
-    readBytes(size, contents);
+    readString(contents);
     value = contents.str();
   }
 
+  /// Decode a string from the stream, without copying it.
+  ///
+  /// NOTE: The return value points into the decode stream, and must be copied
+  /// by clients if it is to last longer than the lifetime of the decoder.
+  void readString(StringRef& value) {
+    uint32_t size;
+    read(size);
+    readBytes(size, value);
+  }
+
+  /// Decode an integer encoded by \see BinaryEncoder::writeVarInt().
+  void readVarInt(uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      uint8_t byte = read8();
+      if (shift < 64)
+        value |= uint64_t(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        break;
+    }
+  }
+
+  /// Decode a sequence of values encoded by \see BinaryEncoder::writeArray(),
+  /// filling the given array.
+  template<typename T>
+  void readArray(MutableArrayRef<T> values) {
+    if (BinaryCodingIsBitwise<T>::value && llvm::sys::IsLittleEndianHost) {
+      size_t numBytes = values.size() * sizeof(T);
+      if (!canRead(numBytes)) {
+        std::fill(values.begin(), values.end(), T());
+        return;
+      }
+      memcpy(static_cast<void*>(values.data()), data.data() + pos, numBytes);
+      pos += numBytes;
+      return;
+    }
+    for (auto& value: values)
+      read(value);
+  }
+
   /// Decode a byte string from the stream.
   ///
   /// NOTE: The return value points into the decode stream, and must be copied
   /// by clients if it is to last longer than the lifetime of the decoder.
   void readBytes(size_t count, StringRef& value) {
-    assert(pos + count <= data.size());
+    if (!canRead(count)) {
+      value = StringRef();
+      return;
+    }
     value = StringRef(data.begin() + pos, count);
     pos += count;
   }
@@ -209,7 +330,7 @@ public:
 
   /// Finish decoding and clean up.
   void finish() {
-    assert(isEmpty());
+    assert(!hasOverrun() && isEmpty());
   }
 };
 
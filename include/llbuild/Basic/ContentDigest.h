@@ -0,0 +1,200 @@
+//===- ContentDigest.h ------------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines support for tracking files by the digest of their
+// contents, rather than by their timestamps, so that a file which is rewritten
+// with the same contents is not considered changed.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_BASIC_CONTENTDIGEST_H
+#define LLBUILD_BASIC_CONTENTDIGEST_H
+
+#include "llbuild/Basic/Compiler.h"
+#include "llbuild/Basic/FileInfo.h"
+#include "llbuild/Basic/FileSystem.h"
+#include "llbuild/Basic/Hashing.h"
+#include "llbuild/Basic/LLVM.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llbuild {
+namespace basic {
+
+/// Memoizes the digests of file contents, so that unchanged files are not read
+/// again.
+///
+/// Each digest is recorded along with the information identifying the version
+/// of the file it was computed for (its device, inode, size and modification
+/// time), and is only reused while that information is unchanged. Files which
+/// were modified too recently are not recorded, since a further modification
+/// within the granularity of the file system's timestamps would go unnoticed.
+///
+/// The cache can be saved and loaded, to keep it across builds. This class is
+/// thread-safe.
+class ContentDigestCache {
+  struct Entry {
+    FileInfo info;
+    HashValue128 digest;
+  };
+
+  std::mutex mutex;
+
+  /// The recorded digests, by path.
+  llvm::StringMap<Entry> entries;
+
+  /// Whether the entries have changed since they were loaded or saved.
+  bool modified = false;
+
+  std::atomic<uint64_t> numHits{0};
+  std::atomic<uint64_t> numMisses{0};
+
+  ContentDigestCache(const ContentDigestCache&) LLBUILD_DELETED_FUNCTION;
+  void operator=(const ContentDigestCache&) LLBUILD_DELETED_FUNCTION;
+
+public:
+  ContentDigestCache() {}
+
+  /// Get the digest of the contents of a file.
+  ///
+  /// \param fileSystem The file system to read the file from, if needed.
+  /// \param info The current information for the file.
+  /// \returns True on success, or false if the file could not be read.
+  bool getDigest(FileSystem& fileSystem, const std::string& path,
+                 const FileInfo& info, HashValue128& digest_out);
+
+  /// Get the information to represent the contents of a file, for use in
+  /// place of its information (as returned by \see FileSystem::getFileInfo()).
+  ///
+  /// For a regular file, the device and inode numbers are cleared and the
+  /// modification time is replaced by the digest of its contents, so that the
+  /// result only compares unequal if the contents (or size) changed. Other
+  /// kinds of files (and files which cannot be read) are only made device
+  /// agnostic, as by \see DeviceAgnosticFileSystem.
+  ///
+  /// \param info The current information for the file.
+  FileInfo getContentInfo(FileSystem& fileSystem, const std::string& path,
+                          const FileInfo& info);
+
+  /// Load the digests saved at the given path, replacing any in the cache.
+  ///
+  /// \returns True on success (including when there is no saved cache), or
+  /// false (with a description of the error in \arg error_out) if the saved
+  /// cache is unreadable or malformed.
+  bool load(StringRef path, std::string* error_out);
+
+  /// Save the digests to the given path, if they changed since they were last
+  /// loaded or saved.
+  ///
+  /// \returns True on success, or false (with a description of the error in
+  /// \arg error_out).
+  bool save(StringRef path, std::string* error_out);
+
+  /// Discard all of the recorded digests.
+  void clear();
+
+  /// @name Statistics
+  /// @{
+
+  /// The number of digests answered from the cache.
+  uint64_t getNumHits() const { return numHits; }
+
+  /// The number of digests computed by reading the file.
+  uint64_t getNumMisses() const { return numMisses; }
+
+  /// The number of recorded digests.
+  size_t size();
+
+  /// @}
+};
+
+/// File system wrapper which represents files by the digest of their contents,
+/// rather than by their timestamps.
+///
+/// This is the companion of \see DeviceAgnosticFileSystem for clients wanting
+/// changes to be tracked by content: the information for each regular file is
+/// as returned by \see ContentDigestCache::getContentInfo(), so touching a
+/// file (or relocating the build tree) does not make it appear changed.
+class ContentDigestFileSystem : public FileSystem {
+private:
+  std::unique_ptr<FileSystem> impl;
+
+  ContentDigestCache digests;
+
+public:
+  explicit ContentDigestFileSystem(std::unique_ptr<FileSystem> fs)
+    : impl(std::move(fs))
+  {
+  }
+
+  ContentDigestFileSystem(const FileSystem&) LLBUILD_DELETED_FUNCTION;
+  void operator=(const ContentDigestFileSystem&) LLBUILD_DELETED_FUNCTION;
+  ContentDigestFileSystem &operator=(ContentDigestFileSystem&& rhs) LLBUILD_DELETED_FUNCTION;
+
+  /// Get the cache of digests, for example to load or save it.
+  ContentDigestCache& getDigestCache() { return digests; }
+
+  virtual bool
+  createDirectory(const std::string& path) override {
+    return impl->createDirectory(path);
+  }
+
+  virtual bool
+  createDirectories(const std::string& path) override {
+    return impl->createDirectories(path);
+  }
+
+  virtual std::unique_ptr<llvm::MemoryBuffer>
+  getFileContents(const std::string& path) override;
+
+  virtual bool remove(const std::string& path) override {
+    return impl->remove(path);
+  }
+
+  virtual std::vector<int>
+  removePaths(ArrayRef<std::string> paths) override {
+    return impl->removePaths(paths);
+  }
+
+  virtual FileInfo getFileInfo(const std::string& path) override {
+    return digests.getContentInfo(*impl, path, impl->getFileInfo(path));
+  }
+
+  virtual std::vector<FileInfo>
+  getFileInfos(ArrayRef<std::string> paths) override;
+
+  virtual FileInfo getLinkInfo(const std::string& path) override {
+    return digests.getContentInfo(*impl, path, impl->getLinkInfo(path));
+  }
+
+  virtual bool getFileDigest(const std::string& path,
+                             HashValue128& digest_out) override {
+    return digests.getDigest(*impl, path, impl->getFileInfo(path),
+                             digest_out);
+  }
+
+  virtual void invalidate(const std::string& path) override {
+    impl->invalidate(path);
+  }
+};
+
+}
+}
+
+#endif
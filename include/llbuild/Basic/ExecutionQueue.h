@@ -14,10 +14,13 @@
 #define LLBUILD_BASIC_EXECUTIONQUEUE_H
 
 #include "llbuild/Basic/Compiler.h"
+#include "llbuild/Basic/JobServer.h"
 #include "llbuild/Basic/LLVM.h"
 #include "llbuild/Basic/Subprocess.h"
 
 #include <cstdint>
+#include <functional>
+#include <string>
 
 namespace llbuild {
   namespace basic {
@@ -26,12 +29,43 @@ namespace llbuild {
     
     class ExecutionQueueDelegate;
 
+    /// A named pool of jobs, which limits how many of its jobs may run at once
+    /// (independently of the number of lanes).
+    class JobPool {
+      std::string name;
+      unsigned depth;
+
+    public:
+      JobPool(StringRef name, unsigned depth) : name(name), depth(depth) {}
+
+      StringRef getName() const { return name; }
+
+      /// Get the maximum number of the pool's jobs which may run at once.
+      unsigned getDepth() const { return depth; }
+    };
+
+    /// The resources a job is expected to use while it runs, used for
+    /// admission control (\see ResourceBudget).
+    struct JobResources {
+      /// The peak memory use of the job, in bytes, or 0 if unknown.
+      uint64_t memory = 0;
+
+      /// The number of CPUs the job keeps busy.
+      unsigned cpus = 1;
+
+      /// The pool the job belongs to, if any.
+      const JobPool* pool = nullptr;
+    };
+
     /// Description of the queue job, used for scheduling and diagnostics.
     class JobDescriptor {
     public:
       JobDescriptor() {}
       virtual ~JobDescriptor();
 
+      /// Get the resources the job is expected to use.
+      virtual JobResources getResources() const { return {}; }
+
       /// Get a name used for ordering this job
       virtual StringRef getOrdinalName() const = 0;
 
@@ -221,11 +255,108 @@ namespace llbuild {
       FIFO = 1
     };
 
+    /// The resources which may be used by the jobs running at once.
+    ///
+    /// Jobs are only started while the sum of their \see JobResources fits the
+    /// budget, except that a job is always started when no other job is
+    /// running.
+    struct ResourceBudget {
+      /// The memory budget, in bytes, or 0 for no limit.
+      ///
+      /// When set, the budget is further limited to the memory which is
+      /// currently available on the system, on platforms where it is known.
+      uint64_t memory = 0;
+
+      /// The number of CPUs, or 0 for no limit (other than the lane count).
+      unsigned cpus = 0;
+
+      /// The minimum number of jobs to run at once, making the number of
+      /// lanes in use elastic, or 0 to always use all of the lanes.
+      ///
+      /// When set, the number of lanes in use floats between this minimum and
+      /// the lane count, following the load on the system (on platforms where
+      /// it is known): it grows while jobs are waiting and the CPUs are idle
+      /// or threads are blocked on I/O, and shrinks while there are more
+      /// runnable threads than CPUs, or the load average exceeds \see maxLoad.
+      unsigned minLanes = 0;
+
+      /// The load average above which the number of lanes in use shrinks, or
+      /// 0 to only consider the number of runnable threads. Only used when
+      /// the number of lanes is elastic (\see minLanes).
+      double maxLoad = 0;
+
+      /// The function to sample the load on the system with, or null to use
+      /// \see sys::getSystemLoad() (for testing). It is given the load
+      /// average, and the numbers of runnable (including the caller) and
+      /// blocked threads, to fill in, and returns false if the load is
+      /// unknown.
+      std::function<bool(double& loadAverage, int& runnableThreads,
+                         int& blockedThreads)> sampleLoad;
+    };
+
+    /// The optional behaviors of a lane-based execution queue (\see
+    /// createLaneBasedExecutionQueue()).
+    struct LaneBasedExecutionQueueOptions {
+      /// Whether each lane keeps its own queue of ready jobs and steals from
+      /// the other lanes when it runs out, rather than all lanes sharing a
+      /// single queue. This reduces lock contention with many lanes and short
+      /// jobs, but the scheduler algorithm then only orders the jobs within
+      /// each individual queue.
+      bool workStealing = false;
+
+      /// The resources which may be used by the running jobs.
+      ResourceBudget budget;
+
+      /// Whether processes are supervised by a shared reactor thread rather
+      /// than by the thread which ran the job (if supported on this platform,
+      /// \see isProcessReactorSupported()). A job's lane remains in use until
+      /// its processes complete, but lanes no longer each need a thread, which
+      /// makes large lane counts practical. Process completion functions are
+      /// then run on the reactor thread.
+      bool useProcessReactor = false;
+
+      /// The jobserver to use, if any. A jobserver token is held by each
+      /// running job (for as long as it holds its lane), which limits the
+      /// number of jobs run at once together with the other participants. If
+      /// the queue's processes should share the jobserver (\see
+      /// JobServer::getMakeFlags()), it is advertised to them in MAKEFLAGS,
+      /// unless processes are launched by the spawn server (which does not
+      /// pass on the jobserver's descriptors).
+      std::unique_ptr<JobServer> jobServer;
+
+      /// Whether the processes of each lane are pinned to one of the CPUs the
+      /// client may run on, in turn (only supported on Linux).
+      bool pinLanes = false;
+    };
+
     /// Create an execution queue that schedules jobs to individual lanes with a
     /// capped limit on the number of concurrent lanes.
+    ///
+    /// Jobs which belong to a \see JobPool are only started while fewer than
+    /// the pool's depth of its jobs are running; waiting jobs do not occupy a
+    /// lane.
     ExecutionQueue* createLaneBasedExecutionQueue(
         ExecutionQueueDelegate& delegate, int numLanes, SchedulerAlgorithm alg,
-        const char* const* environment);
+        const char* const* environment,
+        LaneBasedExecutionQueueOptions options = {});
+
+    // MARK: Remote Execution Queue
+
+    /// Create an execution queue that runs processes on remote workers (see
+    /// RemoteExecution.h), with one lane for each execution slot the workers
+    /// advertise.
+    ///
+    /// Workers are expected to see the same file system tree as the client;
+    /// each request carries the digests of its inputs, which the worker
+    /// verifies before running the process.
+    ///
+    /// \param workerAddresses The addresses of the workers to connect to.
+    /// \returns The queue, or null on failure (with a description of the error
+    /// in \arg error_out).
+    ExecutionQueue* createRemoteExecutionQueue(
+        ExecutionQueueDelegate& delegate,
+        ArrayRef<std::string> workerAddresses, SchedulerAlgorithm alg,
+        const char* const* environment, std::string* error_out);
   }
 }
 
@@ -26,9 +26,13 @@
 #define LLBUILD_BASIC_FILEINFO_H
 
 #include "BinaryCoding.h"
+#include "llbuild/Basic/LLVM.h"
+
+#include "llvm/ADT/ArrayRef.h"
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace llbuild {
 namespace basic {
@@ -106,6 +110,14 @@ struct FileInfo {
   /// \returns The FileInfo for the given path, which will be missing if the
   /// path does not exist (or any error was encountered).
   static FileInfo getInfoForPath(const std::string& path, bool asLink = false);
+
+  /// Get the information for each of the given paths, as returned by \see
+  /// getInfoForPath().
+  ///
+  /// Where possible, paths in the same directory are examined relative to
+  /// that directory, and large batches are examined in parallel.
+  static std::vector<FileInfo> getInfoForPaths(ArrayRef<std::string> paths,
+                                               bool asLink = false);
 };
 
 template<>
@@ -138,6 +150,12 @@ struct BinaryCodingTraits<FileInfo> {
   }
 };
 
+// FileInfo arrays (such as the outputs of a command) are coded in bulk.
+template<> struct BinaryCodingIsBitwise<FileTimestamp> : std::true_type {};
+template<> struct BinaryCodingIsBitwise<FileInfo> : std::true_type {};
+static_assert(sizeof(FileInfo) == 6 * sizeof(uint64_t),
+              "unexpected padding in FileInfo");
+
 }
 }
 
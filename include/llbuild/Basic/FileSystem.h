@@ -15,11 +15,20 @@
 
 #include "llbuild/Basic/Compiler.h"
 #include "llbuild/Basic/FileInfo.h"
+#include "llbuild/Basic/Hashing.h"
 #include "llbuild/Basic/LLVM.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/Support/ErrorOr.h"
 
+#include <atomic>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace llvm {
 
@@ -30,6 +39,8 @@ class MemoryBuffer;
 namespace llbuild {
 namespace basic {
 
+class FileWatcher;
+
 // Abstract interface for interacting with a file system. This allows mocking of
 // operations for testing, and for clients to provide virtualized interfaces.
 class FileSystem  {
@@ -66,6 +77,16 @@ public:
   ///
   /// \returns True if the item was removed, false otherwise.
   virtual bool remove(const std::string& path) = 0;
+
+  /// Remove each of the given paths, as \see remove() would.
+  ///
+  /// File systems may remove batches more efficiently than individual paths
+  /// (for example, in parallel), so no path may be beneath another in the same
+  /// batch.
+  ///
+  /// \returns For each path, zero if it was removed, or otherwise the errno
+  /// value describing why it was not.
+  virtual std::vector<int> removePaths(ArrayRef<std::string> paths);
   
   /// Get the information to represent the state of the given path in the file
   /// system.
@@ -73,6 +94,13 @@ public:
   /// \returns The FileInfo for the given path, which will be missing if the
   /// path does not exist (or any error was encountered).
   virtual FileInfo getFileInfo(const std::string& path) = 0;
+
+  /// Get the information to represent the state of each of the given paths in
+  /// the file system, as returned by \see getFileInfo().
+  ///
+  /// File systems may answer batches more efficiently than individual
+  /// requests, so this should be preferred when many paths are needed at once.
+  virtual std::vector<FileInfo> getFileInfos(ArrayRef<std::string> paths);
   
   /// Get the information to represent the state of the given path in the file
   /// system, without looking through symbolic links.
@@ -80,6 +108,19 @@ public:
   /// \returns The FileInfo for the given path, which will be missing if the
   /// path does not exist (or any error was encountered).
   virtual FileInfo getLinkInfo(const std::string& path) = 0;
+
+  /// Compute a digest of the contents of the given file, as returned by \see
+  /// hashBytes128().
+  ///
+  /// \returns True on success, or false if the file could not be read.
+  virtual bool getFileDigest(const std::string& path, HashValue128& digest_out);
+
+  /// Discard any information the file system has cached about the given path,
+  /// which was modified by some other means (for example, by a subprocess).
+  ///
+  /// Information about anything beneath the path, and about its parent
+  /// directory, is also discarded.
+  virtual void invalidate(const std::string& path) {}
 };
 
 /// Create a FileSystem instance suitable for accessing the local filesystem.
@@ -121,6 +162,11 @@ public:
     return impl->remove(path);
   }
 
+  virtual std::vector<int>
+  removePaths(ArrayRef<std::string> paths) override {
+    return impl->removePaths(paths);
+  }
+
   virtual FileInfo getFileInfo(const std::string& path) override {
     auto info = impl->getFileInfo(path);
 
@@ -134,6 +180,16 @@ public:
     return info;
   }
 
+  virtual std::vector<FileInfo>
+  getFileInfos(ArrayRef<std::string> paths) override {
+    auto infos = impl->getFileInfos(paths);
+    for (auto& info: infos) {
+      info.device = 0;
+      info.inode = 0;
+    }
+    return infos;
+  }
+
   virtual FileInfo getLinkInfo(const std::string& path) override {
     auto info = impl->getLinkInfo(path);
 
@@ -142,6 +198,227 @@ public:
 
     return info;
   }
+
+  virtual bool getFileDigest(const std::string& path,
+                             HashValue128& digest_out) override {
+    return impl->getFileDigest(path, digest_out);
+  }
+
+  virtual void invalidate(const std::string& path) override {
+    impl->invalidate(path);
+  }
+};
+
+/// File system wrapper which remembers the directories which were created (or
+/// found to exist), so that requests to create them again, such as for the
+/// parent directories of each command's outputs, need no system calls.
+///
+/// Directories removed or invalidated through the wrapper (along with
+/// everything beneath them) are forgotten, and others are expected to be kept
+/// for at most a single build (\see clear()). This class is thread-safe.
+class DirectoryCachingFileSystem : public FileSystem {
+private:
+  std::unique_ptr<FileSystem> impl;
+
+  /// The mutex protecting the known directories.
+  std::mutex directoriesMutex;
+
+  /// The directories known to exist, ordered so that everything beneath a
+  /// directory can be found together.
+  std::set<std::string> knownDirectories;
+
+  /// The number of times known directories were discarded, which is used to
+  /// avoid recording a directory removed while it was being created.
+  uint64_t generation = 0;
+
+  std::atomic<uint64_t> numHits{0};
+
+  /// Check whether the given path is known to be a directory, counting a hit
+  /// if so.
+  bool isKnownDirectory(const std::string& path);
+
+  /// Get the current generation, before a directory may be created.
+  uint64_t getGeneration();
+
+  /// Record that the given path, and so each of its ancestors, is a directory,
+  /// unless directories were discarded since \arg lookupGeneration.
+  void addKnownDirectory(StringRef path, uint64_t lookupGeneration);
+
+  /// Forget the given path, and everything beneath it.
+  void eraseKnownDirectories(StringRef path);
+
+public:
+  explicit DirectoryCachingFileSystem(std::unique_ptr<FileSystem> fs);
+  ~DirectoryCachingFileSystem();
+
+  DirectoryCachingFileSystem(const FileSystem&) LLBUILD_DELETED_FUNCTION;
+  void operator=(const DirectoryCachingFileSystem&) LLBUILD_DELETED_FUNCTION;
+  DirectoryCachingFileSystem &operator=(DirectoryCachingFileSystem&& rhs) LLBUILD_DELETED_FUNCTION;
+
+  virtual bool
+  createDirectory(const std::string& path) override;
+
+  virtual bool
+  createDirectories(const std::string& path) override;
+
+  virtual std::unique_ptr<llvm::MemoryBuffer>
+  getFileContents(const std::string& path) override;
+
+  virtual bool remove(const std::string& path) override;
+
+  virtual std::vector<int>
+  removePaths(ArrayRef<std::string> paths) override;
+
+  virtual FileInfo getFileInfo(const std::string& path) override;
+
+  virtual std::vector<FileInfo>
+  getFileInfos(ArrayRef<std::string> paths) override;
+
+  virtual FileInfo getLinkInfo(const std::string& path) override {
+    return impl->getLinkInfo(path);
+  }
+
+  virtual bool getFileDigest(const std::string& path,
+                             HashValue128& digest_out) override {
+    return impl->getFileDigest(path, digest_out);
+  }
+
+  virtual void invalidate(const std::string& path) override;
+
+  /// Forget all of the known directories, for example at the start of a build.
+  void clear();
+
+  /// The number of requests to create a directory which were skipped because
+  /// it was known to exist, each of which saved at least one system call.
+  uint64_t getNumHits() const { return numHits; }
+};
+
+/// File system wrapper which memoizes the information for each path, for use
+/// over the course of a single build.
+///
+/// The cache is updated by the modifications made through the wrapper, and by
+/// explicit calls to \see invalidate() for the paths modified by other means.
+/// Paths are cached exactly as spelled, so must be invalidated using the same
+/// spelling. This class is thread-safe.
+///
+/// When watching is enabled, the cache is instead kept across builds, and
+/// updated with the changes reported by a \see FileWatcher.
+class StatCachingFileSystem : public FileSystem {
+private:
+  std::unique_ptr<FileSystem> impl;
+
+  /// The watcher reporting changes made to the cached paths, if enabled.
+  std::unique_ptr<FileWatcher> watcher;
+
+  struct CacheEntry {
+    llvm::Optional<FileInfo> fileInfo;
+    llvm::Optional<FileInfo> linkInfo;
+  };
+
+  /// The mutex protecting the cache.
+  std::mutex cacheMutex;
+
+  /// The cached information, ordered so that everything beneath a directory
+  /// can be found together.
+  std::map<std::string, CacheEntry> cache;
+
+  /// The number of invalidations, which is used to avoid caching information
+  /// read while an invalidation was in progress.
+  uint64_t generation = 0;
+
+  std::atomic<uint64_t> numHits{0};
+  std::atomic<uint64_t> numMisses{0};
+  std::atomic<uint64_t> numInvalidations{0};
+  std::atomic<uint64_t> numRescans{0};
+
+  FileInfo getCachedInfo(const std::string& path, bool isLink);
+
+  /// Remove the cached information for the given path, and for its parent
+  /// directory, with the mutex held.
+  ///
+  /// \param recursive Whether to also remove everything beneath the path.
+  void eraseCachedPath(StringRef path, bool recursive);
+
+  /// Check whether the given path is cached as a directory, with the mutex
+  /// held.
+  bool isCachedDirectory(StringRef path);
+
+public:
+  explicit StatCachingFileSystem(std::unique_ptr<FileSystem> fs);
+  ~StatCachingFileSystem();
+
+  StatCachingFileSystem(const FileSystem&) LLBUILD_DELETED_FUNCTION;
+  void operator=(const StatCachingFileSystem&) LLBUILD_DELETED_FUNCTION;
+  StatCachingFileSystem &operator=(StatCachingFileSystem&& rhs) LLBUILD_DELETED_FUNCTION;
+
+  virtual bool
+  createDirectory(const std::string& path) override;
+
+  virtual bool
+  createDirectories(const std::string& path) override;
+
+  virtual std::unique_ptr<llvm::MemoryBuffer>
+  getFileContents(const std::string& path) override;
+
+  virtual bool remove(const std::string& path) override;
+
+  virtual std::vector<int>
+  removePaths(ArrayRef<std::string> paths) override;
+
+  virtual FileInfo getFileInfo(const std::string& path) override {
+    return getCachedInfo(path, /*isLink=*/false);
+  }
+
+  virtual std::vector<FileInfo>
+  getFileInfos(ArrayRef<std::string> paths) override;
+
+  virtual FileInfo getLinkInfo(const std::string& path) override {
+    return getCachedInfo(path, /*isLink=*/true);
+  }
+
+  virtual bool getFileDigest(const std::string& path,
+                             HashValue128& digest_out) override {
+    return impl->getFileDigest(path, digest_out);
+  }
+
+  virtual void invalidate(const std::string& path) override;
+
+  /// Discard all of the cached information.
+  void clear();
+
+  /// Keep the cached information across builds, watching the file system for
+  /// changes to it.
+  ///
+  /// \returns True on success, or false (with a description of the error in
+  /// \arg error_out) if the file system cannot be watched.
+  bool enableWatching(std::string* error_out);
+
+  /// Bring the cached information up to date, for example at the start of a
+  /// build.
+  ///
+  /// If watching is enabled, the information for the paths which changed since
+  /// the last call is discarded (or all of it, if changes were lost).
+  /// Otherwise, all of the information is discarded.
+  void synchronize();
+
+  /// @name Statistics
+  /// @{
+
+  /// The number of lookups answered from the cache.
+  uint64_t getNumHits() const { return numHits; }
+
+  /// The number of lookups passed on to the underlying file system.
+  uint64_t getNumMisses() const { return numMisses; }
+
+  /// The number of paths invalidated, including those reported as changed by
+  /// the watcher.
+  uint64_t getNumInvalidations() const { return numInvalidations; }
+
+  /// The number of times all of the information was discarded because changes
+  /// reported by the watcher were lost.
+  uint64_t getNumRescans() const { return numRescans; }
+
+  /// @}
 };
 
 }
@@ -0,0 +1,117 @@
+//===- FileWatcher.h --------------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the file watcher, which reports the paths modified in the
+// file system so that a long-lived client can keep information it read about
+// them up to date, without examining each path again.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_BASIC_FILEWATCHER_H
+#define LLBUILD_BASIC_FILEWATCHER_H
+
+#include "llbuild/Basic/Compiler.h"
+#include "llbuild/Basic/LLVM.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace llbuild {
+namespace basic {
+
+/// Watches the file system for changes to the paths of interest.
+///
+/// Changes are detected by watching the directories containing each path, and
+/// each of their ancestors (so that renaming any ancestor is detected), using
+/// inotify on Linux. Paths which resolve through symbolic links are also
+/// watched at their resolved location, so that changes to the targets of the
+/// links are detected. Paths are reported as spelled when they were watched.
+/// This class is thread-safe.
+class FileWatcher {
+  /// The inotify descriptor.
+  int fd = -1;
+
+  std::mutex mutex;
+
+  /// The watched directories, by spelling.
+  llvm::StringMap<int> watchedDirectories;
+
+  /// The spellings of each watched directory, by watch descriptor.
+  std::unordered_map<int, std::vector<std::string>> watchSpellings;
+
+  /// The spellings of the watched paths which resolve through symbolic links,
+  /// by their resolved path.
+  std::map<std::string, std::vector<std::string>> linkedSpellings;
+
+  /// The working directory when the watcher was created, which relative paths
+  /// are resolved against.
+  std::string workingDir;
+
+  /// Whether changes may have been lost since they were last read.
+  bool changesLost = false;
+
+  FileWatcher() {}
+
+  /// Watch the given directory, with the mutex held.
+  ///
+  /// \returns False if the directory could not be watched because it does not
+  /// exist (or is not a directory).
+  bool watchDirectory(StringRef path);
+
+  /// Watch the given path and its ancestors, with the mutex held.
+  void watchPathAndAncestors(StringRef path);
+
+  /// Add the spellings of the watched paths which resolve to the given
+  /// changed path, or to a path beneath it, with the mutex held.
+  void addLinkedSpellings(StringRef changedPath,
+                          std::vector<std::string>& changedPaths_out);
+
+  FileWatcher(const FileWatcher&) LLBUILD_DELETED_FUNCTION;
+  void operator=(const FileWatcher&) LLBUILD_DELETED_FUNCTION;
+
+public:
+  ~FileWatcher();
+
+  /// Create a file watcher.
+  ///
+  /// \returns The file watcher, or null on failure (with a description of the
+  /// error in \arg error_out), including on platforms where watching files is
+  /// unsupported.
+  static std::unique_ptr<FileWatcher> create(std::string* error_out);
+
+  /// Start watching for changes to the given path, which may not exist yet.
+  ///
+  /// This should be called before the path is examined, so that no change is
+  /// missed in between.
+  void watchPath(StringRef path);
+
+  /// Read the changes reported since they were last read, without waiting.
+  ///
+  /// \param changedPaths_out On return, the paths which were modified, created
+  /// or removed. Anything beneath each path may also have changed.
+  /// \returns False if changes may have been lost, because too many were
+  /// reported at once or a path could not be watched, in which case any path
+  /// may have changed.
+  bool readChanges(std::vector<std::string>& changedPaths_out);
+};
+
+}
+}
+
+#endif
@@ -22,41 +22,95 @@
 namespace llbuild {
 namespace basic {
 
+/// Compute a hash of the given string.
+///
+/// The result is stable across processes and builds, as for \see
+/// hashBytes128().
 uint64_t hashString(StringRef value);
 
+/// A 128-bit hash value.
+struct HashValue128 {
+  uint64_t low = 0;
+  uint64_t high = 0;
+
+  bool operator==(const HashValue128& rhs) const {
+    return low == rhs.low && high == rhs.high;
+  }
+  bool operator!=(const HashValue128& rhs) const {
+    return !(*this == rhs);
+  }
+};
+
+/// Compute a 128-bit hash of the given bytes.
+///
+/// The result is stable across processes, builds and platforms, so it is
+/// suitable for persisting. Long inputs are hashed in 64-byte stripes, using
+/// SIMD instructions where available.
+///
+/// \param seed A value to vary the hash by, for independent uses.
+HashValue128 hashBytes128(StringRef data, uint64_t seed = 0);
+
+/// Computes the hash of a sequence of bytes taken in piece by piece, which is
+/// the same as \see hashBytes128() of all of them at once.
+class HashBuilder128 {
+  /// The accumulators, which take in each complete block.
+  alignas(16) uint64_t acc[8];
+
+  /// The bytes taken in since the last complete block.
+  unsigned char pending[1024];
+  size_t numPending = 0;
+
+  /// The total number of bytes taken in.
+  uint64_t length = 0;
+
+public:
+  explicit HashBuilder128(uint64_t seed = 0);
+
+  /// Take in the given bytes.
+  void update(StringRef data);
+
+  /// Get the hash of all of the bytes taken in so far.
+  HashValue128 getHash() const;
+};
+
+/// A signature of the definition of a command (or of other build state), used
+/// to detect when it changes.
+///
+/// Signatures are built up from 128-bit hashes (see \see hashBytes128()), so
+/// they are collision-resistant and the same in every process and build,
+/// which lets them be persisted and shared between machines.
 class CommandSignature {
 public:
   CommandSignature() = default;
-  CommandSignature(StringRef string) {
-    value = size_t(llvm::hash_value(string));
-  }
-  explicit CommandSignature(uint64_t sig) : value(sig) {}
+  CommandSignature(StringRef string) : value(hashBytes128(string)) {}
+  explicit CommandSignature(uint64_t sig) { value.low = sig; }
+  explicit CommandSignature(HashValue128 value) : value(value) {}
   CommandSignature(const CommandSignature& other) = default;
   CommandSignature(CommandSignature&& other) = default;
   CommandSignature& operator=(const CommandSignature& other) = default;
   CommandSignature& operator=(CommandSignature&& other) = default;
 
-  bool isNull() const { return value == 0; }
+  bool isNull() const { return value.low == 0 && value.high == 0; }
 
   bool operator==(const CommandSignature& other) const { return value == other.value; }
   bool operator!=(const CommandSignature& other) const { return value != other.value; }
 
-  CommandSignature& combine(StringRef string) {
-    // FIXME: Use a more appropriate hashing infrastructure.
-    value = llvm::hash_combine(value, string);
-    return *this;
-  }
+  /// Combine the given string into the signature.
+  CommandSignature& combine(StringRef string);
 
   CommandSignature& combine(const std::string &string) {
-    // FIXME: Use a more appropriate hashing infrastructure.
-    value = llvm::hash_combine(value, string);
-    return *this;
+    return combine(StringRef(string));
   }
 
+  CommandSignature& combine(const char* string) {
+    return combine(StringRef(string));
+  }
+
+  /// Combine the given integer into the signature.
+  CommandSignature& combine(uint64_t integer);
+
   CommandSignature& combine(bool b) {
-    // FIXME: Use a more appropriate hashing infrastructure.
-    value = llvm::hash_combine(value, b);
-    return *this;
+    return combine(uint64_t(b));
   }
 
   template <typename T>
@@ -67,7 +121,19 @@ public:
     return *this;
   }
 
-  uint64_t value = 0;
+  HashValue128 value;
+};
+
+template<>
+struct BinaryCodingTraits<HashValue128> {
+  static inline void encode(const HashValue128& value, BinaryEncoder& coder) {
+    coder.write(value.low);
+    coder.write(value.high);
+  }
+  static inline void decode(HashValue128& value, BinaryDecoder& coder) {
+    coder.read(value.low);
+    coder.read(value.high);
+  }
 };
 
 template<>
@@ -0,0 +1,128 @@
+//===- JobServer.h ----------------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the GNU make jobserver protocol, which limits the
+// number of jobs run at once by a tree of cooperating build tools.
+//
+// The jobserver is a pipe (or named fifo) holding one byte, or token, for each
+// job which may run in addition to the first. Each participating process may
+// always run one job using its implicit token, and must read a token from the
+// pipe before starting each additional job, writing it back once the job
+// completes. The pipe is advertised to subprocesses in the MAKEFLAGS
+// environment variable.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_BASIC_JOBSERVER_H
+#define LLBUILD_BASIC_JOBSERVER_H
+
+#include "llbuild/Basic/Compiler.h"
+#include "llbuild/Basic/LLVM.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llbuild {
+namespace basic {
+
+/// A participant in the GNU make jobserver protocol.
+///
+/// A job server is either connected to the jobserver of a parent process
+/// (\see connect()), or owns a new jobserver which it shares with its
+/// subprocesses (\see create()). In both cases, a token must be acquired
+/// before running each job. This class is thread-safe.
+class JobServer {
+  /// The descriptor tokens are read from, which does not block.
+  int readFd = -1;
+
+  /// The descriptor tokens are written back to.
+  int writeFd = -1;
+
+  /// The descriptor used to wake waiting threads, and its write end (which is
+  /// closed on cancellation).
+  int wakeFds[2] = { -1, -1 };
+
+  /// The descriptors to close on destruction.
+  std::vector<int> ownedFds;
+
+  /// The MAKEFLAGS arguments which advertise the jobserver, for a jobserver
+  /// we own.
+  std::string makeFlags;
+
+  std::mutex mutex;
+
+  /// Whether the implicit token is available.
+  bool implicitTokenAvailable = true;
+
+  /// The tokens read from the pipe and not yet returned.
+  std::vector<char> heldTokens;
+
+  bool cancelled = false;
+
+  JobServer() {}
+
+  bool initialize(std::string* error_out);
+
+  JobServer(const JobServer&) LLBUILD_DELETED_FUNCTION;
+  void operator=(const JobServer&) LLBUILD_DELETED_FUNCTION;
+
+public:
+  ~JobServer();
+
+  /// Connect to the jobserver advertised in the MAKEFLAGS variable of the
+  /// given environment, if any.
+  ///
+  /// Both the "--jobserver-auth=R,W" (and legacy "--jobserver-fds=R,W") form
+  /// and the "--jobserver-auth=fifo:PATH" form are supported.
+  ///
+  /// \param environment The null terminated environment to search.
+  /// \returns The job server, or null if there is no jobserver or it could
+  /// not be used (with a description of the problem in \arg error_out, which
+  /// is left empty if there was no jobserver).
+  static std::unique_ptr<JobServer> connect(const char* const* environment,
+                                            std::string* error_out);
+
+  /// Create a new jobserver allowing the given number of jobs, which is shared
+  /// with subprocesses inheriting \see getMakeFlags().
+  ///
+  /// \returns The job server, or null on failure (with a description of the
+  /// error in \arg error_out).
+  static std::unique_ptr<JobServer> create(unsigned numJobs,
+                                           std::string* error_out);
+
+  /// Get the MAKEFLAGS arguments which advertise the jobserver to
+  /// subprocesses, or an empty string if it was inherited (in which case the
+  /// inherited MAKEFLAGS already do).
+  StringRef getMakeFlags() const { return makeFlags; }
+
+  /// Acquire a token, waiting until one is available.
+  ///
+  /// \returns True if a token was acquired, which must then be passed back to
+  /// \see release(), or false if the job server was cancelled.
+  bool acquire();
+
+  /// Release a token acquired by \see acquire().
+  void release();
+
+  /// Cancel the job server, waking any waiting threads. Tokens which are
+  /// already held must still be released.
+  void cancel();
+};
+
+}
+}
+
+#endif
@@ -15,12 +15,19 @@
 
 #include "llbuild/Basic/LLVM.h"
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/ConvertUTF.h"
 
 #include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -36,6 +43,60 @@ template <> struct hash<llvm::StringRef> {
 namespace llbuild {
 namespace basic {
 
+/// An immutable, prebuilt environment, which can be shared by many \see
+/// POSIXEnvironment instances (on any thread).
+class EnvironmentBlock {
+  /// The underlying string storage.
+  std::vector<std::string> storage;
+
+  /// The assignments, in the "KEY=VALUE" form.
+  std::vector<const char*> assignments;
+
+  /// The index of the assignment to each key.
+  llvm::StringMap<unsigned> keyIndices;
+
+public:
+  /// Create a block from the given assignments, followed by those of the base
+  /// environment (if any) which are not overridden.
+  EnvironmentBlock(ArrayRef<std::pair<StringRef, StringRef>> assignments,
+                   const char* const* base);
+
+  /// Get the assignments, in the "KEY=VALUE" form.
+  ArrayRef<const char*> getAssignments() const { return assignments; }
+
+  /// Get the index of the assignment to \arg key, or -1 if there is none.
+  int find(StringRef key) const {
+    auto it = keyIndices.find(key);
+    return it == keyIndices.end() ? -1 : int(it->second);
+  }
+};
+
+/// An interning cache of environment blocks, keyed by their assignments.
+///
+/// Processes with identical environments (which is most of them, in a typical
+/// build) then share a single block, rather than each rebuilding it.
+class EnvironmentBlockCache {
+  /// The base environment.
+  const char* const* base;
+
+  /// The blocks, keyed by their assignments and whether they inherit the base
+  /// environment.
+  llvm::StringMap<std::shared_ptr<const EnvironmentBlock>> blocks;
+
+  /// The lock protecting `blocks`.
+  std::mutex blocksMutex;
+
+public:
+  /// Create a cache for blocks which (optionally) inherit \arg base, which
+  /// must remain valid for the lifetime of the cache.
+  explicit EnvironmentBlockCache(const char* const* base) : base(base) {}
+
+  /// Get the block with the given assignments, followed by those of the base
+  /// environment if \arg inheritBase is true.
+  std::shared_ptr<const EnvironmentBlock>
+  get(ArrayRef<std::pair<StringRef, StringRef>> assignments, bool inheritBase);
+};
+
 /// A helper class for constructing a POSIX-style environment.
 class POSIXEnvironment {
   /// The actual environment, this is only populated once frozen.
@@ -53,6 +114,9 @@ class POSIXEnvironment {
   /// The list of known keys in the environment.
   std::unordered_set<StringRef> keys{};
 
+  /// The shared block of assignments which follows ours, if any.
+  std::shared_ptr<const EnvironmentBlock> block;
+
   /// Whether the environment pointer has been vended, and assignments can no
   /// longer be mutated.
   bool isFrozen = false;
@@ -65,6 +129,8 @@ public:
   /// If the key has already been defined, it will **NOT** be inserted.
   void setIfMissing(StringRef key, StringRef value) {
     assert(!isFrozen);
+    if (block && block->find(key) >= 0)
+      return;
     if (keys.insert(key).second) {
       llvm::SmallString<256> assignment;
       assignment += key;
@@ -75,6 +141,43 @@ public:
     }
   }
 
+  /// Add the assignments of a shared block.
+  ///
+  /// The assignments take precedence over any added subsequently, but not
+  /// over those already added. At most one block may be added.
+  void addBlock(std::shared_ptr<const EnvironmentBlock> newBlock) {
+    assert(!isFrozen && !block);
+    block = std::move(newBlock);
+  }
+
+  /// Invoke \arg fn with each assignment in the final environment.
+  template<typename Fn>
+  void forEachAssignment(Fn fn) const {
+    for (const auto& entry : envStorage) {
+      fn(entry.c_str());
+    }
+    if (!block)
+      return;
+
+    // Skip the block's assignments to keys we have already assigned.
+    llvm::SmallVector<int, 4> skipped;
+    for (const auto& key : keys) {
+      int index = block->find(key);
+      if (index >= 0)
+        skipped.push_back(index);
+    }
+    std::sort(skipped.begin(), skipped.end());
+    auto assignments = block->getAssignments();
+    int start = 0;
+    for (int index : skipped) {
+      for (int i = start; i != index; ++i)
+        fn(assignments[i]);
+      start = index + 1;
+    }
+    for (int i = start, e = int(assignments.size()); i != e; ++i)
+      fn(assignments[i]);
+  }
+
 #if defined(_WIN32)
   /// Get a Windows style environment pointer.
   ///
@@ -88,11 +191,13 @@ public:
     // On Windows, the environment must be a contiguous null-terminated block
     // of null-terminated strings followed by an additional null terminator
     env.clear();
-    for (const auto& entry : envStorage) {
+    forEachAssignment([&](const char* entry) {
       llvm::SmallVector<llvm::UTF16, 20> wEntry;
-      llvm::convertUTF8ToUTF16String(entry, wEntry);
+      // Include the terminating null in the conversion.
+      llvm::convertUTF8ToUTF16String(StringRef(entry, strlen(entry) + 1),
+                                     wEntry);
       env.insert(env.end(), wEntry.begin(), wEntry.end());
-    }
+    });
     env.emplace_back(L'\0');
     auto envData = std::make_unique<wchar_t[]>(env.size());
     std::copy(env.begin(), env.end(), envData.get());
@@ -107,9 +212,9 @@ public:
 
     // Form the final environment.
     env.clear();
-    for (const auto& entry : envStorage) {
-      env.emplace_back(entry.c_str());
-    }
+    env.reserve(envStorage.size() +
+                (block ? block->getAssignments().size() : 0) + 1);
+    forEachAssignment([&](const char* entry) { env.push_back(entry); });
     env.emplace_back(nullptr);
     return env.data();
   }
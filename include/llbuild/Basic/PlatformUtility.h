@@ -59,6 +59,31 @@ std::string getPathSeparators();
 /// Returns: 0 on success, -1 on failure (check errno).
 int raiseOpenFileLimit(llbuild_rlim_t limit = 2048);
 
+/// Get the amount of memory which is available for starting new processes
+/// without swapping, in bytes (MemAvailable on Linux).
+///
+/// Returns: The available memory, or 0 if it is unknown.
+uint64_t getAvailableMemory();
+
+/// A sample of the load on the system.
+struct SystemLoad {
+  /// The one minute load average, or a negative value if unknown.
+  double loadAverage = -1;
+
+  /// The number of threads which are currently runnable (including the
+  /// caller), or -1 if unknown.
+  int runnableThreads = -1;
+
+  /// The number of threads which are currently blocked waiting for I/O, or -1
+  /// if unknown.
+  int blockedThreads = -1;
+};
+
+/// Sample the load on the system.
+///
+/// Returns: False if the load is unknown on this platform.
+bool getSystemLoad(SystemLoad& load_out);
+
 enum MATCH_RESULT { MATCH, NO_MATCH, MATCH_ERROR };
 // Test if a path or filename matches a wildcard pattern
 //
@@ -0,0 +1,104 @@
+//===- Probes.h -------------------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines static probes (USDT probes, as used by SystemTap, perf and
+// bpftrace) for observing a running build.
+//
+// The probes follow the conventions of <sys/sdt.h>, without depending on it:
+// each probe is a single nop instruction, which is described by an ELF note in
+// the ".note.stapsdt" section (giving its address, its "llbuild" provider and
+// name, and where to find its arguments). Tools attach to a probe by replacing
+// the nop, so there is no cost beyond making the arguments available when no
+// tool is attached. For example:
+//
+//   bpftrace -e 'usdt:/path/to/llbuild:llbuild:task_started { ... }'
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_BASIC_PROBES_H
+#define LLBUILD_BASIC_PROBES_H
+
+#if defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+
+#include <type_traits>
+
+#define LLBUILD_HAS_PROBES 1
+
+/// The size of a probe argument, negated for signed values (as given in the
+/// note describing the probe).
+#define LLBUILD_PROBE_ARG_SIZE(x) \
+  ((std::is_signed<typename std::decay<decltype(x)>::type>::value ? 1 : -1) * \
+   int(sizeof(x)))
+
+#define LLBUILD_PROBE_ARG(n, x) \
+  [size##n] "n" (LLBUILD_PROBE_ARG_SIZE(x)), [arg##n] "nor" (x)
+
+// The "%n" modifier negates the (negated) size back. Arguments are described
+// as "<size>@<operand>", so the constraints must leave them somewhere which
+// can be named in assembler syntax (a register, memory or an immediate).
+#define LLBUILD_PROBE_ARG_FORMAT(n) "%n[size" #n "]@%[arg" #n "]"
+
+#define LLBUILD_PROBE_IMPL(name, argFormats, ...)                             \
+  __asm__ __volatile__(                                                      \
+    "990: nop\n"                                                             \
+    ".pushsection .note.stapsdt,\"\",\"note\"\n"                             \
+    ".balign 4\n"                                                            \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                       \
+    "991: .asciz \"stapsdt\"\n"                                              \
+    "992: .balign 4\n"                                                       \
+    "993: .8byte 990b\n"                                                     \
+    ".8byte _.stapsdt.base\n"                                                \
+    ".8byte 0\n"                                                             \
+    ".asciz \"llbuild\"\n"                                                   \
+    ".asciz \"" #name "\"\n"                                                 \
+    ".asciz \"" argFormats "\"\n"                                            \
+    "994: .balign 4\n"                                                       \
+    ".popsection\n"                                                          \
+    ".ifndef _.stapsdt.base\n"                                               \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"  \
+    ".weak _.stapsdt.base\n"                                                 \
+    ".hidden _.stapsdt.base\n"                                               \
+    "_.stapsdt.base: .space 1\n"                                             \
+    ".size _.stapsdt.base, 1\n"                                              \
+    ".popsection\n"                                                          \
+    ".endif\n"                                                               \
+    :: __VA_ARGS__)
+
+/// Define a probe with the given name (an identifier) and integer (or pointer)
+/// arguments.
+#define LLBUILD_PROBE0(name) \
+  LLBUILD_PROBE_IMPL(name, "")
+#define LLBUILD_PROBE1(name, a1) \
+  LLBUILD_PROBE_IMPL(name, LLBUILD_PROBE_ARG_FORMAT(1), \
+                     LLBUILD_PROBE_ARG(1, a1))
+#define LLBUILD_PROBE2(name, a1, a2) \
+  LLBUILD_PROBE_IMPL(name, LLBUILD_PROBE_ARG_FORMAT(1) " " \
+                     LLBUILD_PROBE_ARG_FORMAT(2), \
+                     LLBUILD_PROBE_ARG(1, a1), LLBUILD_PROBE_ARG(2, a2))
+#define LLBUILD_PROBE3(name, a1, a2, a3) \
+  LLBUILD_PROBE_IMPL(name, LLBUILD_PROBE_ARG_FORMAT(1) " " \
+                     LLBUILD_PROBE_ARG_FORMAT(2) " " \
+                     LLBUILD_PROBE_ARG_FORMAT(3), \
+                     LLBUILD_PROBE_ARG(1, a1), LLBUILD_PROBE_ARG(2, a2), \
+                     LLBUILD_PROBE_ARG(3, a3))
+
+#else
+
+#define LLBUILD_PROBE0(name) do { } while (0)
+#define LLBUILD_PROBE1(name, a1) do { (void)(a1); } while (0)
+#define LLBUILD_PROBE2(name, a1, a2) do { (void)(a1); (void)(a2); } while (0)
+#define LLBUILD_PROBE3(name, a1, a2, a3) \
+  do { (void)(a1); (void)(a2); (void)(a3); } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,254 @@
+//===- RemoteExecution.h ----------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the protocol used to run processes on remote workers (see
+// \see createRemoteExecutionQueue()), and a simple worker implementation which
+// executes requests on the local machine.
+//
+// The protocol is a sequence of framed messages over a stream socket. Each
+// frame is a little-endian 32-bit payload length, a one byte message kind, and
+// a \see BinaryEncoder encoded payload. A client opens one connection per
+// execution slot, sends a \see RemoteMessageKind::Hello, and then issues one
+// \see RemoteMessageKind::Execute request at a time, to which the worker
+// replies with any number of Output and Error messages followed by exactly one
+// Result message.
+//
+// NOTE: The protocol is intended for use on a trusted network; workers execute
+// arbitrary commands on behalf of their clients.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_BASIC_REMOTEEXECUTION_H
+#define LLBUILD_BASIC_REMOTEEXECUTION_H
+
+#include "llbuild/Basic/BinaryCoding.h"
+#include "llbuild/Basic/Compiler.h"
+#include "llbuild/Basic/LLVM.h"
+#include "llbuild/Basic/Subprocess.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llbuild {
+namespace basic {
+
+/// The current version of the remote execution protocol.
+const uint32_t RemoteExecutionProtocolVersion = 1;
+
+enum class RemoteMessageKind : uint8_t {
+  /// Client to worker: the protocol version, sent once per connection.
+  Hello = 1,
+
+  /// Worker to client: the protocol version, the number of execution slots
+  /// available, and whether the worker shares the client's file system.
+  HelloReply,
+
+  /// Client to worker: a \see RemoteExecuteRequest.
+  Execute,
+
+  /// Client to worker: cancel the running request (if any).
+  Cancel,
+
+  /// Worker to client: output produced by the running process.
+  Output,
+
+  /// Worker to client: an error in the management of the running process.
+  Error,
+
+  /// Worker to client: a \see RemoteExecuteResult, completing a request.
+  Result,
+};
+
+/// The initial handshake response of a worker.
+struct RemoteHelloReply {
+  uint32_t version = RemoteExecutionProtocolVersion;
+
+  /// The number of processes the worker will run concurrently.
+  uint32_t numSlots = 0;
+
+  /// Whether the worker reads inputs from and writes outputs to the same file
+  /// system as the client. If false, output files are returned in the result.
+  bool sharedFileSystem = true;
+};
+
+/// A request to execute a process.
+struct RemoteExecuteRequest {
+  /// The command line to execute.
+  std::vector<std::string> commandLine;
+
+  /// The complete environment, as "KEY=VALUE" assignments.
+  std::vector<std::string> environment;
+
+  /// The working directory, if any.
+  std::string workingDir;
+
+  /// Whether the process can be safely interrupted on cancellation.
+  bool canSafelyInterrupt = true;
+
+  /// The input files of the process and the digests of their contents, which
+  /// the worker uses to verify it is seeing the same inputs as the client.
+  std::vector<std::pair<std::string, std::string>> inputs;
+
+  /// The output files the process is expected to produce.
+  std::vector<std::string> outputs;
+};
+
+/// An output file returned by a worker which does not share the client's file
+/// system.
+struct RemoteOutputFile {
+  std::string path;
+  uint32_t mode = 0;
+  std::string contents;
+};
+
+/// The result of executing a process.
+struct RemoteExecuteResult {
+  ProcessStatus status = ProcessStatus::Failed;
+  int32_t exitCode = -1;
+  uint64_t pid = 0;
+  uint64_t utime = 0;
+  uint64_t stime = 0;
+  uint64_t maxrss = 0;
+
+  /// The contents of the expected outputs, if they are not shared.
+  std::vector<RemoteOutputFile> outputs;
+
+  ProcessResult toProcessResult() const {
+    return ProcessResult(status, exitCode, llbuild_pid_t(pid), utime, stime,
+                         maxrss);
+  }
+};
+
+template<>
+struct BinaryCodingTraits<RemoteHelloReply> {
+  static void encode(const RemoteHelloReply& value, BinaryEncoder& coder);
+  static void decode(RemoteHelloReply& value, BinaryDecoder& coder);
+};
+
+template<>
+struct BinaryCodingTraits<RemoteExecuteRequest> {
+  static void encode(const RemoteExecuteRequest& value, BinaryEncoder& coder);
+  static void decode(RemoteExecuteRequest& value, BinaryDecoder& coder);
+};
+
+template<>
+struct BinaryCodingTraits<RemoteExecuteResult> {
+  static void encode(const RemoteExecuteResult& value, BinaryEncoder& coder);
+  static void decode(RemoteExecuteResult& value, BinaryDecoder& coder);
+};
+
+/// Decode a message payload received from a remote execution peer.
+///
+/// \returns True on success, or false if the payload is malformed (it is
+/// truncated, or has trailing data), in which case the value is invalid.
+template<typename T>
+bool decodeRemoteValue(StringRef payload, T& value_out) {
+  BinaryDecoder coder(payload);
+  coder.read(value_out);
+  return !coder.hasOverrun() && coder.isEmpty();
+}
+
+/// Compute the digest of the contents of the file at \arg path, in the form
+/// used for \see RemoteExecuteRequest::inputs.
+///
+/// \returns True on success.
+bool computeRemoteInputDigest(StringRef path, std::string& digest_out);
+
+/// A framed, bidirectional connection to a remote execution peer.
+///
+/// Sending is thread-safe; receiving must only be done from one thread at a
+/// time.
+class RemoteConnection {
+  RemoteConnection(const RemoteConnection&) LLBUILD_DELETED_FUNCTION;
+  void operator=(const RemoteConnection&) LLBUILD_DELETED_FUNCTION;
+
+  int fd;
+  std::mutex sendMutex;
+
+public:
+  explicit RemoteConnection(int fd) : fd(fd) {}
+  ~RemoteConnection();
+
+  /// Connect to the worker at the given address.
+  ///
+  /// \param address Either the path of a Unix domain socket (which must
+  /// contain a '/', or be prefixed with "unix:"), or a "HOST:PORT" pair.
+  static std::unique_ptr<RemoteConnection> connect(StringRef address,
+                                                   std::string* error_out);
+
+  /// Send a message.
+  ///
+  /// \returns True on success.
+  bool send(RemoteMessageKind kind, StringRef payload = {});
+
+  /// Send a message with an encoded payload.
+  template<typename T>
+  bool sendValue(RemoteMessageKind kind, const T& value) {
+    BinaryEncoder coder;
+    coder.write(value);
+    return send(kind, StringRef((const char*)coder.data(), coder.size()));
+  }
+
+  /// Receive the next message.
+  ///
+  /// \returns True on success, false if the connection was closed or failed.
+  bool receive(RemoteMessageKind& kind_out, std::string& payload_out);
+
+  /// Shut down the connection, unblocking any pending receive.
+  void shutdown();
+};
+
+/// A worker which executes remote execution requests on the local machine.
+///
+/// This is the implementation of the `llbuild-worker` tool, and can also be
+/// embedded for testing.
+class RemoteExecutionWorker {
+  RemoteExecutionWorker(const RemoteExecutionWorker&) LLBUILD_DELETED_FUNCTION;
+  void operator=(const RemoteExecutionWorker&) LLBUILD_DELETED_FUNCTION;
+
+  void* impl;
+
+public:
+  /// Create a worker.
+  ///
+  /// \param numSlots The number of processes to run concurrently.
+  /// \param sharedFileSystem If false, the worker returns the contents of
+  /// output files with each result (for clients on another machine).
+  RemoteExecutionWorker(unsigned numSlots, bool sharedFileSystem = true);
+  ~RemoteExecutionWorker();
+
+  /// Start listening on the given address (see \see
+  /// RemoteConnection::connect() for the format). A TCP port of 0 picks an
+  /// unused port.
+  ///
+  /// \param boundAddress_out If given, the address actually bound.
+  /// \returns True on success.
+  bool listen(StringRef address, std::string* error_out,
+              std::string* boundAddress_out = nullptr);
+
+  /// Serve connections until \see shutdown() is called.
+  void serve();
+
+  /// Stop serving, cancelling any running processes.
+  void shutdown();
+};
+
+}
+}
+
+#endif
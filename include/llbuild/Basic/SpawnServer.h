@@ -0,0 +1,121 @@
+//===- SpawnServer.h --------------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the spawn server, a small helper process which is forked
+// early in the life of the client and then launches subprocesses on its
+// behalf. Launching from the helper keeps the cost of each spawn independent
+// of the size (and thread count) of the client, and moves the work of reaping
+// processes out of the client.
+//
+// Requests are sent over a Unix datagram socket, passing the descriptors the
+// process should inherit. Each request also passes one end of a private status
+// socket. The client streams the arguments and environment over it (as they
+// can be far larger than a datagram), and the server replies on it with the
+// process ID once launched, and then with the wait status and resource usage
+// once the process exits.
+//
+// Since the server reaps the processes, the client signals them through the
+// server too, which only signals processes it has not yet reaped (whose IDs
+// therefore can't have been reused).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_BASIC_SPAWNSERVER_H
+#define LLBUILD_BASIC_SPAWNSERVER_H
+
+#include "llbuild/Basic/CrossPlatformCompatibility.h"
+#include "llbuild/Basic/LLVM.h"
+#include "llbuild/Basic/Subprocess.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+struct rusage;
+
+namespace llbuild {
+namespace basic {
+
+/// Start the spawn server, which is then used by \see spawnProcess() to launch
+/// all subsequent processes.
+///
+/// The server is forked from the client, so this should be called as early as
+/// possible, ideally before the client starts any threads. Starting the server
+/// when it is already running has no effect, other than requiring a matching
+/// call to \see stopSpawnServer().
+///
+/// \returns True on success, or false (with a description of the error in
+/// \arg error_out) if the server could not be started or is not supported on
+/// this platform.
+bool startSpawnServer(std::string* error_out);
+
+/// Stop the spawn server, once each successful call to \see
+/// startSpawnServer() has been matched by a call to this, after which
+/// processes are launched directly.
+///
+/// Processes which are already running are unaffected. The server must not be
+/// stopped while processes are being launched.
+void stopSpawnServer();
+
+/// Check whether the spawn server is running.
+///
+/// If the server has exited unexpectedly, this returns false, so that
+/// processes are launched directly instead.
+bool isSpawnServerRunning();
+
+/// Launch a process using the spawn server.
+///
+/// The process is launched with the same attributes as those used by \see
+/// spawnProcess(): in a new process group, with default signal handling, and
+/// with stdin opened on "/dev/null".
+///
+/// The scheduling attributes are applied before the process executes, so they
+/// are also inherited by any processes it starts.
+///
+/// \param args The null terminated argument vector.
+/// \param envp The null terminated environment.
+/// \param workingDir The working directory, or empty to use the current one.
+/// \param outputFd The descriptor to use as the process's stdout and stderr.
+/// \param controlFd A descriptor to pass to the process using the same
+/// descriptor number, or -1.
+/// \param qualityOfService The quality of service to run the process at.
+/// \param cpu The CPU to restrict the process to, or -1.
+/// \param pid_out On success, the process ID.
+/// \param statusFd_out On success, a descriptor which becomes readable once
+/// the process exits (\see readSpawnServerExitStatus()).
+/// \returns Zero on success, or an errno value (ESRCH if the server has
+/// exited, in which case the process was not launched).
+int spawnViaServer(ArrayRef<const char*> args, const char* const* envp,
+                   StringRef workingDir, int outputFd, int controlFd,
+                   QualityOfService qualityOfService, int cpu,
+                   llbuild_pid_t& pid_out, int& statusFd_out);
+
+/// Send a signal to the process group of a process launched by \see
+/// spawnViaServer(), unless it has already exited and been reaped.
+void signalViaServer(llbuild_pid_t pid, int signal);
+
+/// Wait for the exit status of a process launched by \see spawnViaServer(),
+/// and close its status descriptor.
+///
+/// Only the times and maximum resident set size of the resource usage are
+/// reported.
+///
+/// \returns True on success, or false (with errno set) if the status could not
+/// be read.
+bool readSpawnServerExitStatus(int statusFd, int& waitStatus_out,
+                               struct rusage& usage_out);
+
+}
+}
+
+#endif
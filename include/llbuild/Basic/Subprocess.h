@@ -18,12 +18,14 @@
 #include "llbuild/Basic/LLVM.h"
 #include "llbuild/Basic/POSIXEnvironment.h"
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/Optional.h"
 
 #include <inttypes.h>
 #include <condition_variable>
 #include <functional>
 #include <mutex>
+#include <string>
 #include <unordered_map>
 
 namespace llbuild {
@@ -50,6 +52,14 @@ namespace llbuild {
     QualityOfService getDefaultQualityOfService();
     void setDefaultQualityOfService(QualityOfService level);
 
+    /// Set the quality of service of the current thread.
+    ///
+    /// On Darwin, this sets the thread's QoS class. On Linux, the utility and
+    /// background levels lower the thread's nice value, use the SCHED_BATCH
+    /// and SCHED_IDLE scheduling policies respectively, and lower its I/O
+    /// priority (the idle I/O class is used for background work). Higher
+    /// levels leave the thread unchanged, since raising the priority again
+    /// generally requires privileges.
     void setCurrentThreadQualityOfService(QualityOfService level);
 
 
@@ -64,6 +74,10 @@ namespace llbuild {
     struct ProcessInfo {
       /// Whether the process can be safely interrupted.
       bool canSafelyInterrupt;
+
+      /// Whether the process was launched by the spawn server (and so must be
+      /// signalled through it).
+      bool viaSpawnServer = false;
     };
 
 
@@ -135,6 +149,9 @@ namespace llbuild {
       /// Max RSS (in bytes)
       uint64_t maxrss;
 
+      /// The number of bytes of output read from the process.
+      uint64_t outputSize = 0;
+
       ProcessResult(ProcessStatus status, int exitCode = -1,
                     llbuild_pid_t pid = (llbuild_pid_t)-1, uint64_t utime = 0,
                     uint64_t stime = 0, uint64_t maxrss = 0)
@@ -201,9 +218,14 @@ namespace llbuild {
 
       /// Called to report a command processes' (merged) standard output and error.
       ///
+      /// Output is coalesced, so each call may cover many writes by the
+      /// process (though output is never held back for more than a few
+      /// milliseconds).
+      ///
       /// \param ctx - Opaque context passed on to the delegate
       /// \param handle - The process handle.
-      /// \param data - The process output.
+      /// \param data - The process output. This refers to the process's output
+      /// buffer, and is only valid for the duration of the call.
       virtual void processHadOutput(ProcessContext* ctx, ProcessHandle handle,
                                     StringRef data) = 0;
 
@@ -235,6 +257,23 @@ namespace llbuild {
       /// If true, exposes a control file descriptor that may be used to
       /// communicate with the build system.
       bool controlEnabled = true;
+
+      /// The paths of the files the process is known to read, if available.
+      /// These are used by execution queues which run processes remotely.
+      ArrayRef<std::string> inputs = {};
+
+      /// The paths of the files the process is expected to produce, if
+      /// available.
+      ArrayRef<std::string> outputs = {};
+
+      /// The quality of service to run the process with, or None for the
+      /// default (\see getDefaultQualityOfService()). Supported on Darwin and
+      /// Linux (\see setCurrentThreadQualityOfService()).
+      llvm::Optional<QualityOfService> qualityOfService = llvm::None;
+
+      /// The CPU to pin the process to, or -1 to let it run on any CPU (only
+      /// supported on Linux).
+      int cpu = -1;
     };
 
     /// Execute the given command line.
@@ -278,6 +317,30 @@ namespace llbuild {
                       ProcessReleaseFn&& releaseFn,
                       ProcessCompletionFn&& completionFn);
 
+    /// Whether \see spawnProcessAsync() is able to supervise processes from
+    /// the shared process reactor on this platform.
+    bool isProcessReactorSupported();
+
+    /// Launch the given command line, without waiting for it to complete.
+    ///
+    /// The process's output and exit are handled by a single reactor thread
+    /// shared by all processes spawned this way, from which the delegate
+    /// methods and \arg completionFn are invoked. On platforms without a
+    /// reactor (\see isProcessReactorSupported()), this waits for the process
+    /// like \see spawnProcess().
+    ///
+    /// \param releaseFn Function called when the process asks to release its
+    /// execution lane; the process continues to be supervised afterwards.
+    void spawnProcessAsync(ProcessDelegate& delegate,
+                           ProcessContext* ctx,
+                           ProcessGroup& pgrp,
+                           ProcessHandle handle,
+                           ArrayRef<StringRef> commandLine,
+                           POSIXEnvironment environment,
+                           ProcessAttributes attributes,
+                           std::function<void()>&& releaseFn,
+                           ProcessCompletionFn&& completionFn);
+
     /// @}
 
   }
@@ -16,6 +16,8 @@
 #include "llbuild/Basic/CrossPlatformCompatibility.h"
 #include "llvm/ADT/StringRef.h"
 
+#include <string>
+
 // os_signpost is included in mac OS 10.14, if that header is not available, we don't trace at all.
 #if __has_include(<os/signpost.h>)
 #include <os/signpost.h>
@@ -57,6 +59,95 @@ if (__builtin_available(macOS 10.14, *)) os_signpost_interval_end(getLog(), sign
 if (__builtin_available(macOS 10.12, *)) os_log(getLog(), ##__VA_ARGS__); \
 }
 
+#elif defined(__linux__)
+
+#include <cstdint>
+#include <type_traits>
+
+#define LLBUILD_TRACING_TRACE_EVENTS 1
+
+namespace llbuild {
+namespace tracing {
+
+/// The kind of a trace event.
+enum class EventPhase : uint8_t {
+  IntervalBegin,
+  IntervalEnd,
+  Point,
+};
+
+/// A trace event, as recorded in the ring buffer of the thread it occurred on.
+///
+/// Events are only formatted (as Chrome trace event JSON, by \see
+/// TracingWriteEvents()) when they are written out, so the arguments are kept
+/// as raw integers, except for a single string argument which is copied (and
+/// truncated if long).
+struct Event {
+  /// The time of the event, in nanoseconds.
+  uint64_t timestamp;
+  /// The name of the event.
+  const char* name;
+  /// The printf-style format describing the arguments, as "label:%d;...".
+  const char* format;
+  uint64_t args[5];
+  EventPhase phase;
+  uint8_t numArgs;
+  /// The index of the string argument, if any.
+  uint8_t stringArg;
+  uint8_t stringLength;
+  char string[60];
+};
+
+/// Start recording an event in the calling thread's buffer, returning the event
+/// to add the arguments to.
+Event& beginEvent(EventPhase phase, const char* name, const char* format);
+
+/// Finish recording the event started by \see beginEvent().
+void endEvent();
+
+void addArgument(Event& event, const char* value);
+
+template<typename T>
+inline void addArgument(Event& event, T value) {
+  static_assert(std::is_integral<T>::value || std::is_enum<T>::value,
+                "unsupported trace argument");
+  if (event.numArgs == sizeof(event.args) / sizeof(event.args[0]))
+    return;
+  event.args[event.numArgs++] = uint64_t(value);
+}
+
+inline void recordEvent(EventPhase phase, const char* name) {
+  beginEvent(phase, name, nullptr);
+  endEvent();
+}
+
+template<typename... Args>
+inline void recordEvent(EventPhase phase, const char* name,
+                        const char* format, Args... args) {
+  Event& event = beginEvent(phase, name, format);
+  int expansion[] = { 0, (addArgument(event, args), 0)... };
+  (void)expansion;
+  endEvent();
+}
+
+}
+}
+
+/// Begin an interval if tracing is enabled.
+#define LLBUILD_TRACE_INTERVAL_BEGIN(name, ...) { \
+::llbuild::tracing::recordEvent(::llbuild::tracing::EventPhase::IntervalBegin, name, ##__VA_ARGS__); \
+}
+
+/// End an interval if tracing is enabled.
+#define LLBUILD_TRACE_INTERVAL_END(name, ...) { \
+::llbuild::tracing::recordEvent(::llbuild::tracing::EventPhase::IntervalEnd, name, ##__VA_ARGS__); \
+}
+
+/// Trace an event without duration at a point in time.
+#define LLBUILD_TRACE_POINT(name, ...) { \
+::llbuild::tracing::recordEvent(::llbuild::tracing::EventPhase::Point, name, ##__VA_ARGS__); \
+}
+
 #else
 
 // Define dummy definitions to do nothing
@@ -69,6 +160,19 @@ if (__builtin_available(macOS 10.12, *)) os_log(getLog(), ##__VA_ARGS__); \
 
 namespace llbuild {
 extern bool TracingEnabled;
+
+/// Write out the trace events recorded since they were last written out, if
+/// the platform's tracing backend records them in-process (otherwise, this
+/// does nothing).
+///
+/// On Linux, the events of every thread are written as Chrome trace event JSON
+/// (which can be loaded by chrome://tracing or Perfetto), to the path in the
+/// LLBUILD_TRACE_EVENTS environment variable (which also enables tracing at
+/// startup), or else to "llbuild-trace-<pid>.json" in the temporary directory.
+///
+/// \returns True on success, or false (with a description of the error in
+/// \arg error_out).
+bool TracingWriteEvents(std::string* error_out);
   
 struct TracingExecutionQueueJob {
   TracingExecutionQueueJob(int laneNumber, llvm::StringRef commandName) {
@@ -0,0 +1,154 @@
+//===- ActionCache.h --------------------------------------------*- C++ -*-===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLBUILD_BUILDSYSTEM_ACTIONCACHE_H
+#define LLBUILD_BUILDSYSTEM_ACTIONCACHE_H
+
+#include "llbuild/Basic/Compiler.h"
+#include "llbuild/Basic/FileInfo.h"
+#include "llbuild/Basic/Hashing.h"
+#include "llbuild/Basic/LLVM.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace llbuild {
+namespace basic {
+  class FileSystem;
+}
+
+namespace buildsystem {
+
+/// A local, content-addressed cache of command outputs.
+///
+/// The cache maps an *action key*, computed from a command signature and the
+/// contents of the command's inputs, to the contents of the outputs the
+/// command produced. It is independent of the build database, so results can
+/// be reused across branches and worktrees which share the cache directory.
+///
+/// Paths under the cache's root directory are keyed relative to it (\see
+/// relocate()), so that the same command in another checkout of the tree,
+/// rooted elsewhere, has the same key.
+///
+/// The cache directory has the layout:
+///
+///   objects/<digest>  -- output file contents, by content digest
+///   actions/<key>     -- the digest and mode of each output of an action
+///
+/// All entries are written atomically, so the cache may be shared by
+/// concurrent builds.
+class ActionCache {
+  /// The path of the cache directory.
+  std::string path;
+
+  /// The root directory which paths are keyed relative to, if any.
+  std::string rootPath;
+
+  /// Whether outputs are restored using hard links (when possible).
+  bool useHardLinks;
+
+  /// The memoized content digests of input files, with the file information
+  /// they were computed for.
+  llvm::StringMap<std::pair<basic::FileInfo, std::string>> inputDigests;
+
+  /// The mutex protecting \see inputDigests.
+  std::mutex inputDigestsMutex;
+
+  std::atomic<uint64_t> numHits{0};
+  std::atomic<uint64_t> numMisses{0};
+  std::atomic<uint64_t> numStores{0};
+
+  ActionCache(StringRef path, StringRef rootPath, bool useHardLinks)
+      : path(path), rootPath(rootPath), useHardLinks(useHardLinks) {}
+
+  /// Get the content digest of an input file, or None if it cannot be read.
+  llvm::Optional<std::string> getInputDigest(basic::FileSystem& fileSystem,
+                                             const std::string& path);
+
+  /// Store the given contents in the object store, and return its digest.
+  llvm::Optional<std::string> storeObject(StringRef contents, uint64_t mode);
+
+public:
+  ActionCache(const ActionCache&) LLBUILD_DELETED_FUNCTION;
+  void operator=(const ActionCache&) LLBUILD_DELETED_FUNCTION;
+
+  /// Create (or open) an action cache in the given directory.
+  ///
+  /// \param rootPath The root directory of the tree being built, which paths
+  /// are keyed relative to. If empty, the current working directory is used.
+  /// \param useHardLinks If true, outputs are restored by hard linking them
+  /// to the cached objects when possible, instead of copying them. The build
+  /// system removes the outputs of cacheable commands before running them, so
+  /// cached objects are never modified in place by well-behaved commands.
+  static std::unique_ptr<ActionCache> create(StringRef path,
+                                             StringRef rootPath,
+                                             bool useHardLinks,
+                                             std::string* error_out);
+
+  /// Get the root directory which paths are keyed relative to.
+  StringRef getRootPath() const { return rootPath; }
+
+  /// Replace each path under the root directory within \arg value (e.g., a
+  /// command line argument) by a spelling relative to the root, for use in
+  /// an action key.
+  std::string relocate(StringRef value) const;
+
+  /// Compute the action key for a command.
+  ///
+  /// \param signature The command signature, which should spell paths
+  /// relative to the root (\see relocate()) for the key to be shared by other
+  /// checkouts of the tree.
+  /// \param inputPaths The paths of the (regular file) inputs of the command.
+  /// \returns The action key, or None if an input could not be digested (in
+  /// which case the command is not cacheable).
+  llvm::Optional<std::string> computeActionKey(
+      basic::FileSystem& fileSystem, basic::CommandSignature signature,
+      ArrayRef<std::string> inputPaths);
+
+  /// Restore the outputs of an action from the cache.
+  ///
+  /// \returns True if the cache contained the action and all of its outputs
+  /// were restored.
+  bool restoreOutputs(StringRef actionKey, ArrayRef<std::string> outputPaths);
+
+  /// Record the outputs of an action, after it has run successfully.
+  ///
+  /// \returns True if the outputs were stored.
+  bool storeOutputs(basic::FileSystem& fileSystem, StringRef actionKey,
+                    ArrayRef<std::string> outputPaths);
+
+  /// @name Statistics
+  /// @{
+
+  /// The number of actions whose outputs were restored from the cache.
+  uint64_t getNumHits() const { return numHits; }
+
+  /// The number of lookups which did not find a (complete) cached action.
+  uint64_t getNumMisses() const { return numMisses; }
+
+  /// The number of actions whose outputs were stored in the cache.
+  uint64_t getNumStores() const { return numStores; }
+
+  /// @}
+};
+
+}
+}
+
+#endif
@@ -160,12 +160,28 @@ class Command : public basic::JobDescriptor {
     
   std::string name;
 
+  /// The peak memory use of the command, estimated from previous builds.
+  uint64_t estimatedMemory = 0;
+
+  /// The pool the command belongs to, if any.
+  const basic::JobPool* pool = nullptr;
+
 public:
   explicit Command(StringRef name) : name(name) {}
   virtual ~Command();
 
   StringRef getName() const { return name; }
 
+  /// Set the peak memory use of the command (in bytes), as estimated from
+  /// previous builds.
+  void setEstimatedMemory(uint64_t bytes) { estimatedMemory = bytes; }
+
+  /// Get the pool the command belongs to, if any.
+  const basic::JobPool* getPool() const { return pool; }
+
+  /// Set the pool the command belongs to.
+  void setPool(const basic::JobPool* value) { pool = value; }
+
   /// @name Command Information
   /// @{
   //
@@ -190,6 +206,12 @@ public:
   virtual void getVerboseDescription(SmallVectorImpl<char> &result) const override = 0;
 
   virtual basic::CommandSignature getSignature() const;
+
+  /// Get the resources the command is expected to use while executing.
+  ///
+  /// The default implementation uses the estimated memory and the pool, if
+  /// any.
+  virtual basic::JobResources getResources() const override;
   
   /// @}
 
@@ -288,6 +310,8 @@ public:
   // FIXME: This is an inefficent map, the string is duplicated.
   typedef llvm::StringMap<std::unique_ptr<Tool>> tool_set;
 
+  typedef llvm::StringMap<std::unique_ptr<basic::JobPool>> pool_set;
+
 private:
   node_set nodes;
 
@@ -297,6 +321,8 @@ private:
   
   tool_set tools;
 
+  pool_set pools;
+
   /// The default target.
   std::string defaultTarget;
 
@@ -334,6 +360,12 @@ public:
   /// Get the set of all tools used by the file.
   const tool_set& getTools() const { return tools; }
 
+  /// Get the set of declared pools for the file.
+  pool_set& getPools() { return pools; }
+
+  /// Get the set of declared pools for the file.
+  const pool_set& getPools() const { return pools; }
+
   /// @}
   /// @name Construction Helpers.
   /// @{
@@ -361,6 +393,12 @@ public:
     getTools()[value->getName()] = std::move(value);
     return result;
   }
+
+  basic::JobPool& addPool(std::unique_ptr<basic::JobPool> value) {
+    auto& result = *value.get();
+    getPools()[value->getName()] = std::move(value);
+    return result;
+  }
   
   /// @}
 };
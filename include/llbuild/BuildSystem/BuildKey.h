@@ -65,6 +65,11 @@ public:
   };
   static StringRef stringForKind(Kind);
 
+  /// Get the kind code, i.e., the first byte of the encoded key data, for keys
+  /// of the given kind. This can be used as a prefix to enumerate all keys of a
+  /// kind in the database (\see core::BuildDB::visitKeys()).
+  static char kindCodeForKind(Kind);
+
 private:
   /// The actual key data.
   KeyType key;
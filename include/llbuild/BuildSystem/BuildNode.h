@@ -55,6 +55,12 @@ class BuildNode : public Node {
   /// cannot be safely used to track *output* file state.
   bool mutated = false;
 
+  /// Whether this node is compared by its contents.
+  ///
+  /// When set, an input file whose contents are unchanged (for example, one
+  /// which was regenerated or touched) is not considered changed.
+  bool contentCompared = false;
+
   /// Exclusion filters for directory listings
   ///
   /// Items matching these filter strings are not considered as part of the
@@ -80,6 +86,8 @@ public:
 
   bool isMutated() const { return mutated; }
 
+  bool isContentCompared() const { return contentCompared; }
+
   const basic::StringList& contentExclusionPatterns() const {
     return exclusionPatterns;
   }
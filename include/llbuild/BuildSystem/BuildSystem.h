@@ -27,12 +27,15 @@
 
 namespace llbuild {
 namespace basic {
+  class DirectoryCachingFileSystem;
   class ExecutionQueue;
   class FileSystem;
+  class StatCachingFileSystem;
 }
 
 namespace buildsystem {
 
+class ActionCache;
 class BuildDescription;
 class BuildKey;
 class BuildValue;
@@ -40,7 +43,7 @@ class Command;
 class Node;
 class Tool;
 
-bool pathIsPrefixedByPath(std::string path, std::string prefixPath);
+bool pathIsPrefixedByPath(StringRef path, StringRef prefixPath);
   
 class BuildSystemDelegate {
   // DO NOT COPY
@@ -204,6 +207,15 @@ public:
   /// because multiple commands are producing it.
   virtual void cannotBuildNodeDueToMultipleProducers(Node* output,
                std::vector<Command*>) = 0;
+
+  /// Called by the build system to report the result of looking up a
+  /// command's outputs in the action cache (\see BuildSystem::enableActionCache).
+  ///
+  /// On a hit, the outputs have been restored and the command will not be run
+  /// (and there will be no \see commandStarted() call for it).
+  ///
+  /// \param hit - Whether the outputs were restored from the cache.
+  virtual void commandActionCacheLookup(Command*, bool hit) {}
 };
 
 /// The BuildSystem class is used to perform builds using the native build
@@ -240,14 +252,64 @@ public:
   
   /// Attach (or create) the database at the given path.
   ///
+  /// \param useWAL If true, the database uses write-ahead logging and commits
+  /// results in periodic batches, so it can be read while a build is running.
   /// \returns True on success.
-  bool attachDB(StringRef path, std::string* error_out);
+  bool attachDB(StringRef path, std::string* error_out, bool useWAL = false);
 
   /// Enable low-level engine tracing into the given output file.
   ///
   /// \returns True on success.
   bool enableTracing(StringRef path, std::string* error_out);
 
+  /// Enable the local action cache in the given directory (which is created if
+  /// necessary).
+  ///
+  /// When enabled, the outputs of cacheable commands are stored in the cache,
+  /// keyed by the command signature and the contents of the command's inputs,
+  /// and restored from it instead of running commands whose key matches a
+  /// previous execution.
+  ///
+  /// \param rootPath The root directory of the tree being built. Paths under
+  /// it are keyed relative to it, so that other checkouts of the tree can
+  /// share the cache. If empty, the current working directory is used.
+  /// \param useHardLinks If true, outputs are restored using hard links to
+  /// the cached objects when possible, instead of copies.
+  /// \returns True on success.
+  bool enableActionCache(StringRef path, StringRef rootPath,
+                         bool useHardLinks, std::string* error_out);
+
+  /// Get the action cache, if enabled.
+  ActionCache* getActionCache();
+
+  /// Enable memoizing the file information read during each build.
+  ///
+  /// Information is discarded at the start of each build (or only for the
+  /// paths which changed, if the cache is watching the file system), when it
+  /// is modified through the file system, and for the outputs of each command
+  /// once it completes.
+  void enableStatCache();
+
+  /// Get the stat cache, if enabled.
+  basic::StatCachingFileSystem* getStatCache();
+
+  /// Get the file system wrapper which remembers the directories known to
+  /// exist during each build, so that they are not created again.
+  basic::DirectoryCachingFileSystem& getDirectoryCache();
+
+  /// Set the number of builds for which per-command execution telemetry
+  /// (wall time, CPU time, peak memory, output size and exit status) is
+  /// retained in the build database.
+  ///
+  /// \param numBuilds The number of builds to retain, or 0 to disable
+  /// recording telemetry. The default is 10.
+  void setCommandTelemetryHistory(unsigned numBuilds);
+
+  /// Estimate the peak memory use of commands which do not declare it from
+  /// their recorded telemetry, for use in admission control by the execution
+  /// queue (see \see basic::ResourceBudget).
+  void enableCommandResourceEstimation();
+
   /// Build the named target.
   ///
   /// A build description *must* have been loaded before calling this method.
@@ -25,15 +25,18 @@ class QueueJob;
 namespace core {
 
 class BuildEngine;
+struct CommandTelemetry;
 class Task;
 
 }
 
 namespace buildsystem {
 
+class ActionCache;
 class BuildKey;
 class BuildSystemDelegate;
 class BuildValue;
+class Command;
 class ShellCommandHandler;
 class ShellCommand;
 
@@ -82,6 +85,16 @@ public:
   /// Add a job to be executed.
   virtual void addJob(basic::QueueJob&&) = 0;
 
+  /// Get the action cache, or null if it is not enabled.
+  virtual ActionCache* getActionCache() = 0;
+
+  /// Record the execution telemetry for a command in the build database (if
+  /// one is attached).
+  ///
+  /// The \arg telemetry iteration is filled in by the build system.
+  virtual void recordCommandTelemetry(Command* command,
+                                      core::CommandTelemetry telemetry) = 0;
+
   /// @}
 
   /// @name BuildSystem Extensions API
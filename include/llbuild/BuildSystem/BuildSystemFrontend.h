@@ -63,6 +63,9 @@ class BuildSystemFrontend {
   std::unique_ptr<basic::FileSystem> fileSystem;
   llvm::Optional<BuildSystem> buildSystem;
 
+  /// Whether the frontend started the spawn server (which it then stops).
+  bool startedSpawnServer = false;
+
 private:
 
   bool setupBuild();
@@ -71,6 +74,7 @@ public:
   BuildSystemFrontend(BuildSystemFrontendDelegate& delegate,
                       const BuildSystemInvocation& invocation,
                       std::unique_ptr<basic::FileSystem> fileSystem);
+  ~BuildSystemFrontend();
 
   /// @name Accessors
   /// @{
@@ -79,6 +83,11 @@ public:
   const BuildSystemFrontendDelegate& getDelegate() const { return delegate; }
 
   const BuildSystemInvocation& getInvocation() { return invocation; }
+
+  /// Get the build system, or null if it has not been initialized.
+  BuildSystem* getBuildSystem() {
+    return buildSystem.hasValue() ? buildSystem.getPointer() : nullptr;
+  }
   
   /// @}
 
@@ -356,6 +365,13 @@ public:
   /// The path of the database file to use, if any.
   std::string dbPath = "build.db";
 
+  /// Whether the database should use write-ahead logging, allowing it to be
+  /// read by other processes while a build is running.
+  bool dbUseWAL = false;
+
+  /// The number of builds of per-command telemetry to retain in the database.
+  unsigned telemetryHistory = 10;
+
   /// The path of a directory to change into before anything else, if any.
   std::string chdirPath = "";
 
@@ -365,9 +381,62 @@ public:
   /// The path of the build trace output file to use, if any.
   std::string traceFilePath = "";
 
+  /// The path of the action cache directory to use, if any.
+  std::string actionCachePath = "";
+
+  /// The root directory which the action cache keys paths relative to, or
+  /// empty for the current working directory.
+  std::string actionCacheRootPath = "";
+
+  /// Whether to restore outputs from the action cache using hard links.
+  bool actionCacheUseHardLinks = false;
+
+  /// Whether to memoize the file information read during each build.
+  bool useStatCache = false;
+
+  /// Whether to keep the memoized file information between builds, watching
+  /// the file system for changes to it. Implies \see useStatCache.
+  bool useFileWatcher = false;
+
+  /// The addresses of the remote workers to execute commands on, if any.
+  std::vector<std::string> remoteWorkers;
+
   basic::SchedulerAlgorithm schedulerAlgorithm =
       basic::SchedulerAlgorithm::NamePriority;
 
+  /// Whether lanes should use work stealing, rather than a shared queue.
+  bool useWorkStealing = false;
+
+  /// Whether subprocesses should be supervised by a shared reactor thread,
+  /// rather than by the lane which launched them.
+  bool useProcessReactor = false;
+
+  /// Whether subprocesses should be launched by a pre-forked spawn server.
+  bool useSpawnServer = false;
+
+  /// Whether concurrency should be limited by the GNU make jobserver inherited
+  /// in MAKEFLAGS, or otherwise by a new jobserver shared with subprocesses.
+  bool useJobServer = false;
+
+  /// Whether the subprocesses of each lane should be pinned to a CPU.
+  bool pinLanes = false;
+
+  /// The memory budget for concurrently running commands, in bytes, or 0 for
+  /// no limit.
+  uint64_t memoryBudget = 0;
+
+  /// The number of CPUs which concurrently running commands may use, or 0
+  /// for no limit.
+  unsigned cpuBudget = 0;
+
+  /// The minimum number of concurrently running commands, when it floats with
+  /// the load on the system, or 0 to always use all of the lanes.
+  unsigned minLanes = 0;
+
+  /// The load average above which fewer commands are run concurrently, or 0
+  /// for no limit. Implies a minimum of one lane, if none is set.
+  double maxLoad = 0;
+
   uint32_t schedulerLanes = 0;
 
   /// The base environment to use when executing subprocesses.
@@ -441,9 +441,10 @@ inline buildsystem::BuildValue::BuildValue(basic::BinaryDecoder& coder) {
     coder.read(numOutputInfos);
     if (numOutputInfos > 1) {
       valueData.asOutputInfos = new FileInfo[numOutputInfos];
-    }
-    for (uint32_t i = 0; i != numOutputInfos; ++i) {
-      coder.read(getNthOutputInfo(i));
+      coder.readArray(MutableArrayRef<FileInfo>(valueData.asOutputInfos,
+                                                numOutputInfos));
+    } else if (numOutputInfos == 1) {
+      coder.read(valueData.asOutputInfo);
     }
   }
   if (kindHasStringList()) {
@@ -459,8 +460,11 @@ inline core::ValueType buildsystem::BuildValue::toData() const {
     coder.write(signature);
   if (kindHasOutputInfo()) {
     coder.write(numOutputInfos);
-    for (uint32_t i = 0; i != numOutputInfos; ++i) {
-      coder.write(getNthOutputInfo(i));
+    if (numOutputInfos > 1) {
+      coder.writeArray(ArrayRef<FileInfo>(valueData.asOutputInfos,
+                                          numOutputInfos));
+    } else if (numOutputInfos == 1) {
+      coder.write(valueData.asOutputInfo);
     }
   }
   if (kindHasStringList()) {
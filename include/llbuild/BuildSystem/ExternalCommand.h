@@ -13,6 +13,7 @@
 #ifndef LLBUILD_BUILDSYSTEM_EXTERNALCOMMAND_H
 #define LLBUILD_BUILDSYSTEM_EXTERNALCOMMAND_H
 
+#include "llbuild/Basic/Subprocess.h"
 #include "llbuild/BuildSystem/BuildDescription.h"
 #include "llbuild/BuildSystem/BuildSystem.h"
 #include "llbuild/BuildSystem/BuildValue.h"
@@ -34,6 +35,7 @@ namespace llbuild {
   
 namespace buildsystem {
 
+class ActionCache;
 class BuildNode;
 class BuildSystem;
 class ExternalCommandHandler;
@@ -61,6 +63,20 @@ class ExternalCommand : public Command {
   /// Whether to treat the command as always being out-of-date.
   bool alwaysOutOfDate = false;
 
+  /// Whether the outputs of the command may be stored in and restored from
+  /// the action cache (if the command otherwise supports it).
+  bool cacheable = true;
+
+  /// The declared peak memory use of the command in bytes, or 0 if the
+  /// estimate from previous builds should be used.
+  uint64_t declaredMemory = 0;
+
+  /// The declared number of CPUs used by the command, or 0 for the default.
+  unsigned declaredCPUs = 0;
+
+  /// The quality of service to run the command's processes with, if declared.
+  llvm::Optional<basic::QualityOfService> qualityOfService;
+
   /// If not None, the command should be skipped with the provided BuildValue.
   llvm::Optional<BuildValue> skipValue;
 
@@ -74,6 +90,17 @@ class ExternalCommand : public Command {
   /// Whether a prior result has been found.
   bool hasPriorResult = false;
   
+  /// Get the file information for each of the outputs of the command, using a
+  /// single batched request.
+  ///
+  /// \returns The information for each output, in order, which is empty for
+  /// virtual outputs.
+  std::vector<basic::FileInfo> getOutputInfos(basic::FileSystem& fileSystem);
+
+  /// Discard any cached file information for the outputs of the command,
+  /// which it may have modified.
+  void invalidateOutputs(BuildSystemCommandInterface& bsci);
+
   /// Compute the output result for the command.
   BuildValue computeCommandResult(BuildSystemCommandInterface& bsci);
 
@@ -81,6 +108,12 @@ class ExternalCommand : public Command {
   /// because the outputs are newer than all of the inputs.
   bool canUpdateIfNewerWithResult(const BuildValue& result);
 
+  /// Get the input and output file paths to use with the action cache.
+  ///
+  /// \returns False if the command cannot use the action cache.
+  bool getActionCachePaths(std::vector<std::string>& inputPaths_out,
+                           std::vector<std::string>& outputPaths_out);
+
 protected:
   const std::vector<BuildNode*>& getInputs() const { return inputs; }
   
@@ -91,6 +124,35 @@ protected:
   /// This function must be overriden by subclasses for any additional keys.
   virtual basic::CommandSignature getSignature() const override;
 
+  /// Get the signature of the command to use in its action cache key.
+  ///
+  /// Subclasses may override this to spell the paths within their signature
+  /// relative to the cache's root (\see ActionCache::relocate), so that other
+  /// checkouts of the tree can reuse their outputs. The default is the command
+  /// signature.
+  virtual basic::CommandSignature
+  getActionSignature(const ActionCache& actionCache) const;
+
+  /// Get the part of the command signature defined by this class, with paths
+  /// relative to the root of \arg actionCache (if given).
+  basic::CommandSignature
+  getExternalSignature(const ActionCache* actionCache) const;
+
+  virtual basic::JobResources getResources() const override;
+
+  /// Get the quality of service to run the command's processes with, or None
+  /// for the build's default.
+  llvm::Optional<basic::QualityOfService> getQualityOfService() const {
+    return qualityOfService;
+  }
+
+  /// Check whether the outputs of the command are completely determined by its
+  /// signature and the contents of its declared inputs, so that they can be
+  /// restored from the action cache.
+  ///
+  /// Subclasses must opt in to caching; the default returns false.
+  virtual bool canCacheOutputs() const { return false; }
+
   /// Extension point for subclasses, to actually execute the command.
   virtual void executeExternalCommand(
       BuildSystemCommandInterface& bsci,
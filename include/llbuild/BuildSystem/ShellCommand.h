@@ -23,7 +23,7 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/MemoryBuffer.h"
 
-#include <atomic>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -84,7 +84,11 @@ class ShellCommand : public ExternalCommand {
   bool controlEnabled = true;
 
   /// The cached signature, once computed -- 0 is used as a sentinel value.
-  mutable std::atomic<basic::CommandSignature> cachedSignature{ };
+  ///
+  /// A 128-bit signature cannot be updated atomically everywhere, so this is
+  /// guarded by a mutex.
+  mutable basic::CommandSignature cachedSignature{ };
+  mutable std::mutex cachedSignatureMutex;
 
   /// The handler to use for this command, if present.
   ShellCommandHandler* handler;
@@ -97,6 +101,16 @@ class ShellCommand : public ExternalCommand {
   
   virtual basic::CommandSignature getSignature() const override;
 
+  virtual basic::CommandSignature
+  getActionSignature(const ActionCache& actionCache) const override;
+
+  /// Compute the command signature, with paths relative to the root of
+  /// \arg actionCache (if given).
+  basic::CommandSignature
+  computeSignature(const ActionCache* actionCache) const;
+
+  virtual bool canCacheOutputs() const override;
+
   bool processDiscoveredDependencies(BuildSystemCommandInterface& bsci,
                                      core::Task* task,
                                      basic::QueueJobContext* context);
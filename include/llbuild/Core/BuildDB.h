@@ -14,6 +14,7 @@
 #define LLBUILD_CORE_BUILDDB_H
 
 #include "llbuild/Basic/LLVM.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringRef.h"
 
 #include "llbuild/Core/BuildEngine.h"
@@ -28,6 +29,60 @@ namespace core {
 struct Result;
 class Rule;
 
+/// A view of a key stored in the database, and (optionally) of its stored
+/// result, as provided by \see BuildDB::visitKeys().
+///
+/// The referenced data is owned by the database and is only valid for the
+/// duration of the visitor callback.
+struct BuildDBKeyEntry {
+  /// The key.
+  StringRef key;
+
+  /// Whether the database has a stored result for the key. The result fields
+  /// below are only valid if this is true (and results were requested).
+  bool hasResult = false;
+
+  /// The stored result value.
+  StringRef value;
+
+  /// The signature of the stored result.
+  basic::CommandSignature signature;
+
+  /// The iteration the result was last built at.
+  uint64_t builtAt = 0;
+
+  /// The iteration the result was last computed at.
+  uint64_t computedAt = 0;
+};
+
+/// The execution telemetry of a single run of a command, as recorded by \see
+/// BuildDB::recordCommandTelemetry().
+struct CommandTelemetry {
+  /// The build iteration the command ran in.
+  uint64_t iteration = 0;
+
+  /// The wall clock time of the command (in us).
+  uint64_t wallTime = 0;
+
+  /// The user time of the command's process (in us).
+  uint64_t utime = 0;
+
+  /// The system time of the command's process (in us).
+  uint64_t stime = 0;
+
+  /// The peak resident set size of the command's process (in bytes).
+  uint64_t maxrss = 0;
+
+  /// The number of bytes of output the command produced.
+  uint64_t outputSize = 0;
+
+  /// The final status of the command (a \see basic::ProcessStatus).
+  uint32_t status = 0;
+
+  /// The exit status of the command's process.
+  int32_t exitCode = 0;
+};
+
 /// Delegate interface for use with the build database
 class BuildDBDelegate {
 public:
@@ -129,20 +184,85 @@ public:
   /// \param error_out [out] Error string if return value is false.
   virtual bool getKeys(std::vector<KeyType>& keys_out, std::string* error_out) = 0;
 
+  /// Visit the keys known by the database (and optionally, their results)
+  /// without materializing them.
+  ///
+  /// The visitor is invoked with the database locked, and must not call back
+  /// into the database.
+  ///
+  /// \param prefix If non-empty, only keys starting with this prefix are
+  /// visited (e.g., the kind code of a build system key).
+  /// \param includeResults Whether the stored results should be provided.
+  /// \param visitor The visitor, which returns false to stop the enumeration.
+  /// \param error_out [out] Error string if return value is false.
+  virtual bool visitKeys(StringRef prefix, bool includeResults,
+                         llvm::function_ref<bool(const BuildDBKeyEntry&)> visitor,
+                         std::string* error_out);
+
+  /// Record the execution telemetry of a command.
+  ///
+  /// The database keeps a rolling history of the most recent runs of each
+  /// command. The default implementation discards the telemetry.
+  ///
+  /// \param key The key of the command.
+  /// \param telemetry The telemetry, for the iteration it names.
+  /// \param historyLimit The number of runs of the command to retain.
+  /// \param error_out [out] Error string if return value is false.
+  virtual bool recordCommandTelemetry(const KeyType& key,
+                                      const CommandTelemetry& telemetry,
+                                      unsigned historyLimit,
+                                      std::string* error_out);
+
+  /// Visit the recorded execution telemetry of commands.
+  ///
+  /// Entries are visited in key order, and for each key, from the most recent
+  /// run to the oldest. The visitor is invoked with the database locked, and
+  /// must not call back into the database.
+  ///
+  /// \param key If non-empty, only the telemetry of this key is visited.
+  /// \param visitor The visitor, which returns false to stop the enumeration.
+  /// \param error_out [out] Error string if return value is false.
+  virtual bool visitCommandTelemetry(
+      StringRef key,
+      llvm::function_ref<bool(StringRef, const CommandTelemetry&)> visitor,
+      std::string* error_out);
+
   /// Dump a debug view of the database contents
   virtual void dump(raw_ostream& os) { (void)os; }
 };
 
+/// The journaling and locking behavior of a SQLite3 backed BuildDB.
+enum class SQLiteBuildDBMode {
+  /// Perform each build inside a single exclusive transaction. No other
+  /// connection can access the database until the build completes.
+  Exclusive = 0,
+
+  /// Use write-ahead logging and commit the results of a build periodically in
+  /// batches. Other connections may read the database (and will observe the
+  /// committed batches) while a build is in progress, but only one build may
+  /// write to it at a time.
+  WAL,
+
+  /// Open an existing database for inspection only. The database is never
+  /// created or recreated, mutation operations fail, and \see buildStarted()
+  /// does not acquire any lock.
+  ReadOnly,
+};
+
 /// Create a BuildDB instance backed by a SQLite3 database.
 ///
 /// \param clientSchemaVersion An uninterpreted version number for use by the
 /// client to allow batch changes to the stored build results; if the stored
 /// schema does not match the provided version the database will be cleared upon
 /// opening; to avoid this behavior, pass `false` for `recreateUnmatchedVersion`.
+/// \param mode The journaling and locking behavior to use, \see
+/// SQLiteBuildDBMode.
 std::unique_ptr<BuildDB> createSQLiteBuildDB(StringRef path,
                                              uint32_t clientSchemaVersion,
                                              bool recreateUnmatchedVersion,
-                                             std::string* error_out);
+                                             std::string* error_out,
+                                             SQLiteBuildDBMode mode =
+                                               SQLiteBuildDBMode::Exclusive);
 
 }
 }
@@ -0,0 +1,222 @@
+//===-- ContentDigest.cpp -------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/ContentDigest.h"
+
+#include "llbuild/Basic/BinaryCoding.h"
+#include "llbuild/Basic/Stat.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+namespace {
+
+/// The identifier at the start of a saved cache.
+const char* const savedCacheMagic = "llbuild-content-digests-v1";
+
+/// The number of seconds after its modification before a file's digest is
+/// recorded, which covers the coarsest timestamp granularity in common use.
+const uint64_t racyInterval = 2;
+
+/// Check whether a file modified at the given time may still be modified
+/// without its timestamp changing.
+bool isRecentlyModified(const FileTimestamp& modTime) {
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  return uint64_t(now) < modTime.seconds + racyInterval;
+}
+
+}
+
+// MARK: ContentDigestCache
+
+bool ContentDigestCache::getDigest(FileSystem& fileSystem,
+                                   const std::string& path,
+                                   const FileInfo& info,
+                                   HashValue128& digest_out) {
+  if (info.isMissing() || !S_ISREG(info.mode))
+    return false;
+
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto it = entries.find(path);
+    if (it != entries.end() && it->getValue().info == info &&
+        it->getValue().info.mode == info.mode) {
+      ++numHits;
+      digest_out = it->getValue().digest;
+      return true;
+    }
+  }
+
+  ++numMisses;
+  if (!fileSystem.getFileDigest(path, digest_out))
+    return false;
+
+  if (!isRecentlyModified(info.modTime)) {
+    std::lock_guard<std::mutex> guard(mutex);
+    entries[path] = Entry{ info, digest_out };
+    modified = true;
+  }
+  return true;
+}
+
+FileInfo ContentDigestCache::getContentInfo(FileSystem& fileSystem,
+                                            const std::string& path,
+                                            const FileInfo& info) {
+  if (info.isMissing())
+    return info;
+
+  FileInfo result = info;
+  result.device = 0;
+  result.inode = 0;
+
+  HashValue128 digest;
+  if (getDigest(fileSystem, path, info, digest)) {
+    result.modTime.seconds = digest.low;
+    result.modTime.nanoseconds = digest.high;
+  }
+  return result;
+}
+
+bool ContentDigestCache::load(StringRef path, std::string* error_out) {
+  auto buffer = llvm::MemoryBuffer::getFile(path, /*FileSize=*/-1,
+                                            /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    if (buffer.getError() == std::errc::no_such_file_or_directory)
+      return true;
+    *error_out = ("unable to read '" + path + "': " +
+                  buffer.getError().message()).str();
+    return false;
+  }
+
+  // The contents are followed by their digest, which is checked before
+  // decoding them (so that the decoder is never given truncated data).
+  StringRef data = (*buffer)->getBuffer();
+  StringRef magic(savedCacheMagic);
+  auto malformed = [&]() {
+    *error_out = ("malformed content digest cache '" + path + "'").str();
+    return false;
+  };
+  if (data.size() < magic.size() + 8 + 16 || !data.startswith(magic))
+    return malformed();
+  StringRef contents = data.drop_back(16);
+  HashValue128 checksum;
+  BinaryDecoder checksumDecoder(data.take_back(16));
+  checksumDecoder.read(checksum);
+  if (checksum != hashBytes128(contents))
+    return malformed();
+
+  BinaryDecoder decoder(contents.drop_front(magic.size()));
+  uint64_t numEntries;
+  decoder.read(numEntries);
+  llvm::StringMap<Entry> loaded;
+  for (uint64_t i = 0; i != numEntries; ++i) {
+    if (decoder.isEmpty())
+      return malformed();
+    std::string entryPath;
+    Entry entry;
+    decoder.read(entryPath);
+    decoder.read(entry.info);
+    decoder.read(entry.digest);
+    loaded[entryPath] = entry;
+  }
+  if (!decoder.isEmpty())
+    return malformed();
+
+  std::lock_guard<std::mutex> guard(mutex);
+  entries = std::move(loaded);
+  modified = false;
+  return true;
+}
+
+bool ContentDigestCache::save(StringRef path, std::string* error_out) {
+  BinaryEncoder encoder;
+  encoder.writeBytes(savedCacheMagic);
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!modified)
+      return true;
+    encoder.write(uint64_t(entries.size()));
+    for (const auto& it: entries) {
+      encoder.write(it.getKey().str());
+      encoder.write(it.getValue().info);
+      encoder.write(it.getValue().digest);
+    }
+    modified = false;
+  }
+  StringRef contents(reinterpret_cast<const char*>(encoder.data()),
+                     encoder.size());
+  encoder.write(hashBytes128(contents));
+
+  // Write the cache atomically, so that a reader never sees it partially
+  // written.
+  auto failed = [&](const Twine& message) {
+    *error_out = ("unable to write '" + path + "': " + message).str();
+    std::lock_guard<std::mutex> guard(mutex);
+    modified = true;
+    return false;
+  };
+  int fd;
+  SmallString<256> tempPath;
+  if (auto ec = llvm::sys::fs::createUniqueFile(path + ".tmp-%%%%%%%%", fd,
+                                                tempPath))
+    return failed(ec.message());
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os.write(reinterpret_cast<const char*>(encoder.data()), encoder.size());
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      (void) llvm::sys::fs::remove(tempPath);
+      return failed("write failed");
+    }
+  }
+  if (auto ec = llvm::sys::fs::rename(tempPath, path)) {
+    (void) llvm::sys::fs::remove(tempPath);
+    return failed(ec.message());
+  }
+  return true;
+}
+
+void ContentDigestCache::clear() {
+  std::lock_guard<std::mutex> guard(mutex);
+  modified = modified || !entries.empty();
+  entries.clear();
+}
+
+size_t ContentDigestCache::size() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return entries.size();
+}
+
+// MARK: ContentDigestFileSystem
+
+std::unique_ptr<llvm::MemoryBuffer>
+ContentDigestFileSystem::getFileContents(const std::string& path) {
+  return impl->getFileContents(path);
+}
+
+std::vector<FileInfo>
+ContentDigestFileSystem::getFileInfos(ArrayRef<std::string> paths) {
+  auto infos = impl->getFileInfos(paths);
+  for (size_t i = 0; i != paths.size(); ++i)
+    infos[i] = digests.getContentInfo(*impl, paths[i], infos[i]);
+  return infos;
+}
@@ -14,8 +14,18 @@
 
 #include "llbuild/Basic/Stat.h"
 
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace llbuild;
 using namespace llbuild::basic;
@@ -24,17 +34,12 @@ bool FileInfo::isDirectory() const {
   return (mode & S_IFDIR) != 0;
 }
 
-/// Get the information to represent the state of the given node in the file
-/// system.
-///
-/// \param info_out [out] On success, the important path information.
-/// \returns True if information on the path was found.
-FileInfo FileInfo::getInfoForPath(const std::string& path, bool asLink) {
+namespace {
+
+/// Get the information to represent the result of a stat call.
+FileInfo getInfoForStat(int statResult, const sys::StatStruct& buf) {
   FileInfo result;
 
-  sys::StatStruct buf;
-  auto statResult =
-    asLink ? sys::lstat(path.c_str(), &buf) : sys::stat(path.c_str(), &buf);
   if (statResult != 0) {
     memset(&result, 0, sizeof(result));
     assert(result.isMissing());
@@ -66,3 +71,143 @@ FileInfo FileInfo::getInfoForPath(const std::string& path, bool asLink) {
 
   return result;
 }
+
+#if !defined(_WIN32)
+/// The minimum number of paths examined by each thread, for large batches.
+const size_t minPathsPerThread = 256;
+
+/// The maximum number of threads used to examine a batch.
+const unsigned maxThreads = 4;
+
+/// The paths in a batch which share a parent directory.
+struct DirectoryGroup {
+  /// The parent directory, or empty if the paths cannot be examined relative
+  /// to it.
+  StringRef parent;
+
+  /// The indices of the paths.
+  std::vector<size_t> indices;
+};
+
+/// Examine the paths in the given groups.
+void getInfoForGroups(ArrayRef<std::string> paths,
+                      ArrayRef<DirectoryGroup> groups, bool asLink,
+                      std::vector<FileInfo>& infos) {
+  sys::StatStruct buf;
+  for (const auto& group: groups) {
+    // Opening the directory only pays off once it is shared.
+    int dirFd = -1;
+    if (!group.parent.empty() && group.indices.size() > 1) {
+#if defined(O_PATH)
+      int flags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+#else
+      int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+#endif
+      dirFd = ::open(group.parent.str().c_str(), flags);
+    }
+
+    for (size_t index: group.indices) {
+      const std::string& path = paths[index];
+      int statResult;
+      if (dirFd != -1) {
+        // The name is the null terminated tail of the path.
+        const char* name = path.c_str() + group.parent.size() + 1;
+        statResult = ::fstatat(dirFd, name, &buf,
+                               asLink ? AT_SYMLINK_NOFOLLOW : 0);
+      } else {
+        statResult = asLink ? sys::lstat(path.c_str(), &buf)
+                            : sys::stat(path.c_str(), &buf);
+      }
+      infos[index] = getInfoForStat(statResult, buf);
+    }
+
+    if (dirFd != -1)
+      ::close(dirFd);
+  }
+}
+#endif
+
+}
+
+/// Get the information to represent the state of the given node in the file
+/// system.
+///
+/// \param info_out [out] On success, the important path information.
+/// \returns True if information on the path was found.
+FileInfo FileInfo::getInfoForPath(const std::string& path, bool asLink) {
+  sys::StatStruct buf;
+  auto statResult =
+    asLink ? sys::lstat(path.c_str(), &buf) : sys::stat(path.c_str(), &buf);
+  return getInfoForStat(statResult, buf);
+}
+
+std::vector<FileInfo> FileInfo::getInfoForPaths(ArrayRef<std::string> paths,
+                                                bool asLink) {
+  std::vector<FileInfo> infos(paths.size());
+
+#if defined(_WIN32)
+  for (size_t i = 0, e = paths.size(); i != e; ++i)
+    infos[i] = getInfoForPath(paths[i], asLink);
+#else
+  // Group the paths by their parent directory. Paths whose last component is
+  // not a plain name (like "dir/" or "dir/..") are examined directly.
+  std::vector<DirectoryGroup> groups;
+  llvm::StringMap<size_t> groupIndices;
+  size_t directGroup = ~size_t(0);
+  for (size_t i = 0, e = paths.size(); i != e; ++i) {
+    StringRef path = paths[i];
+    StringRef parent = llvm::sys::path::parent_path(path);
+    StringRef name = llvm::sys::path::filename(path);
+    bool isRelative = !parent.empty() && name != "." && name != ".." &&
+      path.size() == parent.size() + 1 + name.size() &&
+      path[parent.size()] == '/';
+    if (!isRelative) {
+      if (directGroup == ~size_t(0)) {
+        directGroup = groups.size();
+        groups.emplace_back();
+      }
+      groups[directGroup].indices.push_back(i);
+      continue;
+    }
+
+    auto it = groupIndices.insert({parent, groups.size()});
+    if (it.second) {
+      groups.emplace_back();
+      groups.back().parent = parent;
+    }
+    groups[it.first->second].indices.push_back(i);
+  }
+
+  // Examine large batches in parallel, dividing the groups between the
+  // threads.
+  unsigned numThreads = std::min<size_t>(
+      std::min(maxThreads, std::max(std::thread::hardware_concurrency(), 1u)),
+      std::max<size_t>(paths.size() / minPathsPerThread, 1));
+  if (numThreads == 1) {
+    getInfoForGroups(paths, groups, asLink, infos);
+    return infos;
+  }
+
+  std::vector<std::thread> threads;
+  ArrayRef<DirectoryGroup> remaining = groups;
+  size_t pathsPerThread = (paths.size() + numThreads - 1) / numThreads;
+  while (!remaining.empty()) {
+    size_t numGroups = 0, numPaths = 0;
+    while (numGroups != remaining.size() && numPaths < pathsPerThread)
+      numPaths += remaining[numGroups++].indices.size();
+    auto chunk = remaining.take_front(numGroups);
+    remaining = remaining.drop_front(numGroups);
+    if (remaining.empty()) {
+      getInfoForGroups(paths, chunk, asLink, infos);
+    } else {
+      threads.emplace_back([paths, chunk, asLink, &infos]() {
+        getInfoForGroups(paths, chunk, asLink, infos);
+      });
+    }
+  }
+  for (auto& thread: threads)
+    thread.join();
+#endif
+
+  return infos;
+}
@@ -11,16 +11,26 @@
 //===----------------------------------------------------------------------===//
 
 #include "llbuild/Basic/FileSystem.h"
+#include "llbuild/Basic/FileWatcher.h"
 #include "llbuild/Basic/PlatformUtility.h"
 #include "llbuild/Basic/Stat.h"
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/MemoryBuffer.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cstring>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // Cribbed from llvm, where it's been since removed.
 namespace {
@@ -130,6 +140,36 @@ bool FileSystem::createDirectories(const std::string& path) {
   return createDirectories(parent) && createDirectory(path);
 }
 
+std::vector<FileInfo>
+FileSystem::getFileInfos(ArrayRef<std::string> paths) {
+  std::vector<FileInfo> infos;
+  infos.reserve(paths.size());
+  for (const auto& path: paths)
+    infos.push_back(getFileInfo(path));
+  return infos;
+}
+
+std::vector<int> FileSystem::removePaths(ArrayRef<std::string> paths) {
+  std::vector<int> errors;
+  errors.reserve(paths.size());
+  for (const auto& path: paths) {
+    errno = 0;
+    if (remove(path))
+      errors.push_back(0);
+    else
+      errors.push_back(errno ? errno : EIO);
+  }
+  return errors;
+}
+
+bool FileSystem::getFileDigest(const std::string& path,
+                               HashValue128& digest_out) {
+  auto contents = getFileContents(path);
+  if (!contents)
+    return false;
+  digest_out = hashBytes128(contents->getBuffer());
+  return true;
+}
 
 std::unique_ptr<llvm::MemoryBuffer>
 DeviceAgnosticFileSystem::getFileContents(const std::string& path) {
@@ -137,7 +177,72 @@ DeviceAgnosticFileSystem::getFileContents(const std::string& path) {
 }
 namespace {
 
+#if !defined(_WIN32)
+/// The minimum number of paths removed by each thread, for large batches.
+const size_t minRemovalsPerThread = 64;
+
+/// The maximum number of threads used to remove a batch.
+const unsigned maxRemovalThreads = 8;
+#endif
+
 class LocalFileSystem : public FileSystem {
+#if !defined(_WIN32)
+  /// The paths in a batch which share a parent directory.
+  struct RemovalGroup {
+    /// The parent directory, or empty if the paths cannot be removed relative
+    /// to it.
+    StringRef parent;
+
+    /// The indices of the paths.
+    std::vector<size_t> indices;
+  };
+
+  /// Remove the paths in the given groups, recording the errno value for each.
+  void removeGroups(ArrayRef<std::string> paths,
+                    ArrayRef<RemovalGroup> groups, std::vector<int>& errors) {
+    for (const auto& group: groups) {
+      int dirFd = -1;
+      if (!group.parent.empty()) {
+        dirFd = ::open(group.parent.str().c_str(),
+                       O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      }
+
+      for (size_t index: group.indices) {
+        const std::string& path = paths[index];
+        if (dirFd == -1) {
+          errno = 0;
+          errors[index] = remove(path) ? 0 : (errno ? errno : EIO);
+          continue;
+        }
+
+        // The name is the null terminated tail of the path. Directories are
+        // removed directly when they are empty, and otherwise recursively.
+        const char* name = path.c_str() + group.parent.size() + 1;
+        if (::unlinkat(dirFd, name, 0) == 0) {
+          errors[index] = 0;
+          continue;
+        }
+        int error = errno;
+        if (error != EPERM && error != EISDIR) {
+          errors[index] = error;
+          continue;
+        }
+        if (::unlinkat(dirFd, name, AT_REMOVEDIR) == 0) {
+          errors[index] = 0;
+        } else if (errno == ENOTEMPTY || errno == EEXIST) {
+          errors[index] = rm_tree(path.c_str()) ? 0 : EIO;
+        } else {
+          // Not a directory after all.
+          errors[index] = errno == ENOTDIR ? error : errno;
+        }
+      }
+
+      if (dirFd != -1)
+        ::close(dirFd);
+    }
+  }
+#endif
+
 public:
   LocalFileSystem() {}
 
@@ -200,13 +305,151 @@ public:
     return false;
   }
   
+#if !defined(_WIN32)
+  virtual std::vector<int>
+  removePaths(ArrayRef<std::string> paths) override {
+    std::vector<int> errors(paths.size());
+
+    // Group the paths by their parent directory, so that each is only opened
+    // once. Paths whose last component is not a plain name (like "dir/") are
+    // removed directly.
+    std::vector<RemovalGroup> groups;
+    llvm::StringMap<size_t> groupIndices;
+    size_t directGroup = ~size_t(0);
+    for (size_t i = 0, e = paths.size(); i != e; ++i) {
+      StringRef path = paths[i];
+      StringRef parent = llvm::sys::path::parent_path(path);
+      StringRef name = llvm::sys::path::filename(path);
+      bool isRelative = !parent.empty() && name != "." && name != ".." &&
+        path.size() == parent.size() + 1 + name.size() &&
+        path[parent.size()] == '/';
+      if (!isRelative) {
+        if (directGroup == ~size_t(0)) {
+          directGroup = groups.size();
+          groups.emplace_back();
+        }
+        groups[directGroup].indices.push_back(i);
+        continue;
+      }
+
+      auto it = groupIndices.insert({parent, groups.size()});
+      if (it.second) {
+        groups.emplace_back();
+        groups.back().parent = parent;
+      }
+      groups[it.first->second].indices.push_back(i);
+    }
+
+    // Remove large batches in parallel, dividing the groups between the
+    // threads.
+    unsigned numThreads = std::min<size_t>(
+        std::min(maxRemovalThreads,
+                 std::max(std::thread::hardware_concurrency(), 1u)),
+        std::max<size_t>(paths.size() / minRemovalsPerThread, 1));
+    if (numThreads == 1) {
+      removeGroups(paths, groups, errors);
+      return errors;
+    }
+
+    std::vector<std::thread> threads;
+    ArrayRef<RemovalGroup> remaining = groups;
+    size_t pathsPerThread = (paths.size() + numThreads - 1) / numThreads;
+    while (!remaining.empty()) {
+      size_t numGroups = 0, numPaths = 0;
+      while (numGroups != remaining.size() && numPaths < pathsPerThread)
+        numPaths += remaining[numGroups++].indices.size();
+      auto chunk = remaining.take_front(numGroups);
+      remaining = remaining.drop_front(numGroups);
+      if (remaining.empty()) {
+        removeGroups(paths, chunk, errors);
+      } else {
+        threads.emplace_back([this, paths, chunk, &errors]() {
+          removeGroups(paths, chunk, errors);
+        });
+      }
+    }
+    for (auto& thread: threads)
+      thread.join();
+    return errors;
+  }
+#endif
+
   virtual FileInfo getFileInfo(const std::string& path) override {
     return FileInfo::getInfoForPath(path);
   }
+
+  virtual std::vector<FileInfo>
+  getFileInfos(ArrayRef<std::string> paths) override {
+    return FileInfo::getInfoForPaths(paths);
+  }
   
   virtual FileInfo getLinkInfo(const std::string& path) override {
     return FileInfo::getInfoForPath(path, /*isLink:*/ true);
   }
+
+#if !defined(_WIN32)
+  virtual bool getFileDigest(const std::string& path,
+                             HashValue128& digest_out) override {
+    // Files are read in chunks, rather than mapped, so that one which is
+    // truncated while it is hashed is reported as unreadable (instead of
+    // raising SIGBUS). Small files are hashed from a single chunk.
+    const size_t chunkSize = 64 * 1024;
+    const size_t smallFileSize = 16 * 1024;
+
+    // Opening without blocking avoids waiting on a fifo, which is rejected
+    // below.
+    int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1)
+      return false;
+    struct stat statbuf;
+    if (::fstat(fd, &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) {
+      ::close(fd);
+      return false;
+    }
+
+    // Read exactly the given number of bytes, failing if the file is shorter.
+    auto readFully = [fd](char* buffer, size_t size) {
+      size_t numRead = 0;
+      while (numRead < size) {
+        ssize_t result = ::read(fd, buffer + numRead, size - numRead);
+        if (result == -1 && errno == EINTR)
+          continue;
+        if (result <= 0)
+          return false;
+        numRead += result;
+      }
+      return true;
+    };
+
+    uint64_t size = statbuf.st_size;
+    if (size <= smallFileSize) {
+      char buffer[smallFileSize];
+      bool success = readFully(buffer, size);
+      ::close(fd);
+      if (!success)
+        return false;
+      digest_out = hashBytes128(StringRef(buffer, size));
+      return true;
+    }
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+    (void)::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    std::unique_ptr<char[]> buffer(new char[chunkSize]);
+    HashBuilder128 builder;
+    for (uint64_t offset = 0; offset < size; offset += chunkSize) {
+      size_t numBytes = std::min(uint64_t(chunkSize), size - offset);
+      if (!readFully(buffer.get(), numBytes)) {
+        ::close(fd);
+        return false;
+      }
+      builder.update(StringRef(buffer.get(), numBytes));
+    }
+    ::close(fd);
+    digest_out = builder.getHash();
+    return true;
+  }
+#endif
 };
   
 }
@@ -219,3 +462,327 @@ std::unique_ptr<FileSystem>
 basic::DeviceAgnosticFileSystem::from(std::unique_ptr<FileSystem> fs) {
   return llvm::make_unique<DeviceAgnosticFileSystem>(std::move(fs));
 }
+
+// MARK: DirectoryCachingFileSystem
+
+DirectoryCachingFileSystem::DirectoryCachingFileSystem(
+    std::unique_ptr<FileSystem> fs)
+  : impl(std::move(fs))
+{
+}
+
+DirectoryCachingFileSystem::~DirectoryCachingFileSystem() {}
+
+bool DirectoryCachingFileSystem::isKnownDirectory(const std::string& path) {
+  std::lock_guard<std::mutex> guard(directoriesMutex);
+  if (!knownDirectories.count(path))
+    return false;
+  ++numHits;
+  return true;
+}
+
+uint64_t DirectoryCachingFileSystem::getGeneration() {
+  std::lock_guard<std::mutex> guard(directoriesMutex);
+  return generation;
+}
+
+void DirectoryCachingFileSystem::addKnownDirectory(StringRef path,
+                                                   uint64_t lookupGeneration) {
+  std::lock_guard<std::mutex> guard(directoriesMutex);
+  if (generation != lookupGeneration)
+    return;
+
+  // The ancestors of a known directory are always known.
+  for (StringRef dir = path; !dir.empty();
+       dir = llvm::sys::path::parent_path(dir)) {
+    if (!knownDirectories.insert(dir).second)
+      break;
+  }
+}
+
+void DirectoryCachingFileSystem::eraseKnownDirectories(StringRef path) {
+  std::string prefix = path;
+  if (!prefix.empty() && prefix.back() != '/')
+    prefix += '/';
+
+  std::lock_guard<std::mutex> guard(directoriesMutex);
+  ++generation;
+  knownDirectories.erase(path);
+  auto it = knownDirectories.lower_bound(prefix);
+  while (it != knownDirectories.end() && StringRef(*it).startswith(prefix))
+    it = knownDirectories.erase(it);
+}
+
+bool DirectoryCachingFileSystem::createDirectory(const std::string& path) {
+  if (isKnownDirectory(path))
+    return true;
+
+  uint64_t lookupGeneration = getGeneration();
+  bool result = impl->createDirectory(path);
+  if (result)
+    addKnownDirectory(path, lookupGeneration);
+  return result;
+}
+
+bool DirectoryCachingFileSystem::createDirectories(const std::string& path) {
+  if (isKnownDirectory(path))
+    return true;
+
+  uint64_t lookupGeneration = getGeneration();
+  bool result = impl->createDirectories(path);
+  if (result)
+    addKnownDirectory(path, lookupGeneration);
+  return result;
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+DirectoryCachingFileSystem::getFileContents(const std::string& path) {
+  return impl->getFileContents(path);
+}
+
+bool DirectoryCachingFileSystem::remove(const std::string& path) {
+  bool result = impl->remove(path);
+  eraseKnownDirectories(path);
+  return result;
+}
+
+std::vector<int>
+DirectoryCachingFileSystem::removePaths(ArrayRef<std::string> paths) {
+  auto errors = impl->removePaths(paths);
+  for (const auto& path: paths)
+    eraseKnownDirectories(path);
+  return errors;
+}
+
+FileInfo DirectoryCachingFileSystem::getFileInfo(const std::string& path) {
+  // Directories seen by lookups are also known.
+  uint64_t lookupGeneration = getGeneration();
+  auto info = impl->getFileInfo(path);
+  if (info.isDirectory())
+    addKnownDirectory(path, lookupGeneration);
+  return info;
+}
+
+std::vector<FileInfo>
+DirectoryCachingFileSystem::getFileInfos(ArrayRef<std::string> paths) {
+  uint64_t lookupGeneration = getGeneration();
+  auto infos = impl->getFileInfos(paths);
+  for (size_t i = 0, e = paths.size(); i != e; ++i) {
+    if (infos[i].isDirectory())
+      addKnownDirectory(paths[i], lookupGeneration);
+  }
+  return infos;
+}
+
+void DirectoryCachingFileSystem::invalidate(const std::string& path) {
+  impl->invalidate(path);
+  eraseKnownDirectories(path);
+}
+
+void DirectoryCachingFileSystem::clear() {
+  std::lock_guard<std::mutex> guard(directoriesMutex);
+  ++generation;
+  knownDirectories.clear();
+}
+
+// MARK: StatCachingFileSystem
+
+StatCachingFileSystem::StatCachingFileSystem(std::unique_ptr<FileSystem> fs)
+  : impl(std::move(fs))
+{
+}
+
+StatCachingFileSystem::~StatCachingFileSystem() {}
+
+void StatCachingFileSystem::eraseCachedPath(StringRef path, bool recursive) {
+  ++generation;
+  cache.erase(path);
+  if (recursive) {
+    std::string prefix = path;
+    if (!prefix.empty() && prefix.back() != '/')
+      prefix += '/';
+    auto it = cache.lower_bound(prefix);
+    while (it != cache.end() && StringRef(it->first).startswith(prefix))
+      it = cache.erase(it);
+  }
+
+  // The contents of the parent directory have also changed.
+  StringRef parent = llvm::sys::path::parent_path(path);
+  if (!parent.empty())
+    cache.erase(parent);
+}
+
+FileInfo StatCachingFileSystem::getCachedInfo(const std::string& path,
+                                              bool isLink) {
+  uint64_t lookupGeneration;
+  {
+    std::lock_guard<std::mutex> guard(cacheMutex);
+    auto it = cache.find(path);
+    if (it != cache.end()) {
+      auto& info = isLink ? it->second.linkInfo : it->second.fileInfo;
+      if (info.hasValue()) {
+        ++numHits;
+        return info.getValue();
+      }
+    }
+    lookupGeneration = generation;
+  }
+
+  ++numMisses;
+  if (watcher)
+    watcher->watchPath(path);
+  FileInfo info = isLink ? impl->getLinkInfo(path) : impl->getFileInfo(path);
+
+  // Only cache the information if the path could not have been modified while
+  // it was read.
+  std::lock_guard<std::mutex> guard(cacheMutex);
+  if (generation == lookupGeneration) {
+    auto& entry = cache[path];
+    (isLink ? entry.linkInfo : entry.fileInfo) = info;
+  }
+  return info;
+}
+
+std::vector<FileInfo>
+StatCachingFileSystem::getFileInfos(ArrayRef<std::string> paths) {
+  std::vector<FileInfo> infos(paths.size());
+  std::vector<size_t> missIndices;
+  std::vector<std::string> missPaths;
+  uint64_t lookupGeneration;
+  {
+    std::lock_guard<std::mutex> guard(cacheMutex);
+    for (size_t i = 0, e = paths.size(); i != e; ++i) {
+      auto it = cache.find(paths[i]);
+      if (it != cache.end() && it->second.fileInfo.hasValue()) {
+        infos[i] = it->second.fileInfo.getValue();
+      } else {
+        missIndices.push_back(i);
+        missPaths.push_back(paths[i]);
+      }
+    }
+    lookupGeneration = generation;
+  }
+  numHits += paths.size() - missPaths.size();
+  if (missPaths.empty())
+    return infos;
+
+  numMisses += missPaths.size();
+  if (watcher) {
+    for (const auto& path: missPaths)
+      watcher->watchPath(path);
+  }
+  auto missInfos = impl->getFileInfos(missPaths);
+
+  std::lock_guard<std::mutex> guard(cacheMutex);
+  bool canCache = generation == lookupGeneration;
+  for (size_t i = 0, e = missIndices.size(); i != e; ++i) {
+    infos[missIndices[i]] = missInfos[i];
+    if (canCache)
+      cache[missPaths[i]].fileInfo = missInfos[i];
+  }
+  return infos;
+}
+
+bool StatCachingFileSystem::isCachedDirectory(StringRef path) {
+  auto it = cache.find(path);
+  return it != cache.end() && it->second.fileInfo.hasValue() &&
+    it->second.fileInfo.getValue().isDirectory();
+}
+
+bool StatCachingFileSystem::createDirectory(const std::string& path) {
+  bool result = impl->createDirectory(path);
+
+  // A directory which was already cached as one was not created.
+  std::lock_guard<std::mutex> guard(cacheMutex);
+  if (!result || !isCachedDirectory(path))
+    eraseCachedPath(path, /*recursive=*/false);
+  return result;
+}
+
+bool StatCachingFileSystem::createDirectories(const std::string& path) {
+  bool result = impl->createDirectories(path);
+
+  // Any of the ancestors beneath the first one cached as a directory may have
+  // been created.
+  std::lock_guard<std::mutex> guard(cacheMutex);
+  for (StringRef ancestor = path; !ancestor.empty();
+       ancestor = llvm::sys::path::parent_path(ancestor)) {
+    if (result && isCachedDirectory(ancestor))
+      break;
+    bool parentIsCached =
+      result && isCachedDirectory(llvm::sys::path::parent_path(ancestor));
+    eraseCachedPath(ancestor, /*recursive=*/false);
+    if (parentIsCached)
+      break;
+  }
+  return result;
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+StatCachingFileSystem::getFileContents(const std::string& path) {
+  return impl->getFileContents(path);
+}
+
+bool StatCachingFileSystem::remove(const std::string& path) {
+  bool result = impl->remove(path);
+  std::lock_guard<std::mutex> guard(cacheMutex);
+  eraseCachedPath(path, /*recursive=*/true);
+  return result;
+}
+
+std::vector<int>
+StatCachingFileSystem::removePaths(ArrayRef<std::string> paths) {
+  auto errors = impl->removePaths(paths);
+  std::lock_guard<std::mutex> guard(cacheMutex);
+  for (const auto& path: paths)
+    eraseCachedPath(path, /*recursive=*/true);
+  return errors;
+}
+
+void StatCachingFileSystem::invalidate(const std::string& path) {
+  impl->invalidate(path);
+
+  ++numInvalidations;
+  std::lock_guard<std::mutex> guard(cacheMutex);
+  eraseCachedPath(path, /*recursive=*/true);
+}
+
+void StatCachingFileSystem::clear() {
+  std::lock_guard<std::mutex> guard(cacheMutex);
+  ++generation;
+  cache.clear();
+}
+
+bool StatCachingFileSystem::enableWatching(std::string* error_out) {
+  if (watcher)
+    return true;
+  auto newWatcher = FileWatcher::create(error_out);
+  if (!newWatcher)
+    return false;
+
+  // Nothing read so far is watched.
+  std::lock_guard<std::mutex> guard(cacheMutex);
+  ++generation;
+  cache.clear();
+  watcher = std::move(newWatcher);
+  return true;
+}
+
+void StatCachingFileSystem::synchronize() {
+  if (!watcher) {
+    clear();
+    return;
+  }
+
+  std::vector<std::string> changedPaths;
+  if (!watcher->readChanges(changedPaths)) {
+    ++numRescans;
+    clear();
+    return;
+  }
+
+  numInvalidations += changedPaths.size();
+  std::lock_guard<std::mutex> guard(cacheMutex);
+  for (const auto& path: changedPaths)
+    eraseCachedPath(path, /*recursive=*/true);
+}
@@ -0,0 +1,222 @@
+//===-- FileWatcher.cpp ---------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/FileWatcher.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+#if defined(__linux__)
+namespace {
+
+/// The events which indicate a change to a directory entry.
+const uint32_t entryEvents = IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MODIFY |
+  IN_MOVED_FROM | IN_MOVED_TO;
+
+/// The events which indicate a change to the watched directory itself.
+const uint32_t selfEvents = IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT |
+  IN_IGNORED;
+
+}
+
+FileWatcher::~FileWatcher() {
+  if (fd != -1)
+    close(fd);
+}
+
+std::unique_ptr<FileWatcher> FileWatcher::create(std::string* error_out) {
+  std::unique_ptr<FileWatcher> watcher(new FileWatcher);
+  watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watcher->fd == -1) {
+    *error_out = std::string("unable to create inotify instance: ") +
+      strerror(errno);
+    return nullptr;
+  }
+  char buffer[PATH_MAX];
+  if (getcwd(buffer, sizeof(buffer)))
+    watcher->workingDir = buffer;
+  return watcher;
+}
+
+bool FileWatcher::watchDirectory(StringRef path) {
+  if (watchedDirectories.count(path))
+    return true;
+
+  // The working directory is spelled as empty.
+  std::string directory = path.empty() ? "." : path.str();
+  int wd = inotify_add_watch(fd, directory.c_str(),
+                             entryEvents | selfEvents | IN_ONLYDIR);
+  if (wd == -1) {
+    if (errno == ENOENT || errno == ENOTDIR)
+      return false;
+
+    // Otherwise (for example, if we ran out of watches) changes to the path
+    // will go unnoticed.
+    changesLost = true;
+    return true;
+  }
+
+  watchedDirectories[path] = wd;
+  watchSpellings[wd].push_back(path);
+  return true;
+}
+
+void FileWatcher::watchPathAndAncestors(StringRef path) {
+  // Watch the path itself, in case it is a directory (whose information
+  // changes along with its entries), and then its ancestors, up to the root
+  // or (for relative paths) the working directory.
+  (void)watchDirectory(path);
+  StringRef ancestor = path;
+  while (!ancestor.empty()) {
+    StringRef parent = llvm::sys::path::parent_path(ancestor);
+    if (parent.empty() && llvm::sys::path::is_absolute(ancestor))
+      break;
+    ancestor = parent;
+    (void)watchDirectory(ancestor);
+  }
+}
+
+void FileWatcher::watchPath(StringRef path) {
+  // Find where the path resolves to, if it goes through symbolic links (which
+  // are followed when the path is examined).
+  std::string resolvedPath;
+  char buffer[PATH_MAX];
+  if (realpath(path.str().c_str(), buffer)) {
+    llvm::SmallString<256> absolutePath(path);
+    if (!llvm::sys::path::is_absolute(absolutePath) && !workingDir.empty()) {
+      absolutePath = workingDir;
+      llvm::sys::path::append(absolutePath, path);
+    }
+    llvm::sys::path::remove_dots(absolutePath, /*remove_dot_dot=*/true);
+    if (absolutePath != buffer)
+      resolvedPath = buffer;
+  }
+
+  std::lock_guard<std::mutex> guard(mutex);
+  watchPathAndAncestors(path);
+  if (resolvedPath.empty())
+    return;
+  auto& spellings = linkedSpellings[resolvedPath];
+  if (std::find(spellings.begin(), spellings.end(), path) == spellings.end())
+    spellings.push_back(path);
+  watchPathAndAncestors(resolvedPath);
+}
+
+void FileWatcher::addLinkedSpellings(
+    StringRef changedPath, std::vector<std::string>& changedPaths_out) {
+  for (auto it = linkedSpellings.lower_bound(changedPath),
+         ie = linkedSpellings.end(); it != ie; ++it) {
+    StringRef resolvedPath = it->first;
+    if (!resolvedPath.startswith(changedPath))
+      break;
+    if (resolvedPath.size() != changedPath.size() &&
+        resolvedPath[changedPath.size()] != '/')
+      continue;
+    changedPaths_out.insert(changedPaths_out.end(), it->second.begin(),
+                            it->second.end());
+  }
+}
+
+bool FileWatcher::readChanges(std::vector<std::string>& changedPaths_out) {
+  std::lock_guard<std::mutex> guard(mutex);
+
+  alignas(struct inotify_event) char buffer[65536];
+  while (true) {
+    ssize_t numBytes = read(fd, buffer, sizeof(buffer));
+    if (numBytes == -1) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        changesLost = true;
+      break;
+    }
+
+    for (char* p = buffer; p < buffer + numBytes;) {
+      auto* event = reinterpret_cast<struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        changesLost = true;
+        continue;
+      }
+
+      auto it = watchSpellings.find(event->wd);
+      if (it == watchSpellings.end())
+        continue;
+
+      // Report the entry which changed, or the directory itself, along with
+      // the paths which resolve through symbolic links to (or beneath) it.
+      size_t firstChange = changedPaths_out.size();
+      if (event->len != 0) {
+        for (const auto& spelling: it->second) {
+          changedPaths_out.push_back(
+              spelling.empty() ? event->name : spelling + "/" + event->name);
+        }
+      } else if (event->mask & selfEvents) {
+        for (const auto& spelling: it->second)
+          changedPaths_out.push_back(spelling);
+      }
+      if (!linkedSpellings.empty()) {
+        size_t lastChange = changedPaths_out.size();
+        for (size_t i = firstChange; i != lastChange; ++i) {
+          std::string changedPath = changedPaths_out[i];
+          addLinkedSpellings(changedPath, changedPaths_out);
+        }
+      }
+
+      // The watch is gone, so the directory must be watched again (if it is
+      // recreated) when next examined.
+      if (event->mask & IN_IGNORED) {
+        for (const auto& spelling: it->second)
+          watchedDirectories.erase(spelling);
+        watchSpellings.erase(it);
+      }
+    }
+  }
+
+  bool result = !changesLost;
+  changesLost = false;
+  return result;
+}
+
+#else
+
+FileWatcher::~FileWatcher() {}
+
+std::unique_ptr<FileWatcher> FileWatcher::create(std::string* error_out) {
+  *error_out = "watching files is unsupported on this platform";
+  return nullptr;
+}
+
+bool FileWatcher::watchDirectory(StringRef path) { return false; }
+
+void FileWatcher::watchPath(StringRef path) {}
+
+bool FileWatcher::readChanges(std::vector<std::string>& changedPaths_out) {
+  return false;
+}
+
+#endif
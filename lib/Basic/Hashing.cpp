@@ -14,13 +14,323 @@
 
 #include "llbuild/Basic/LLVM.h"
 
-#include "llvm/ADT/Hashing.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace llbuild {
 namespace basic {
 
+// MARK: 128-bit Hashing
+
+namespace {
+
+// The 128-bit hash follows the structure of XXH3: eight 64-bit accumulators
+// take in 64-byte stripes, each combining the data with its own keys using a
+// 32x32-bit multiply, and are scrambled after every block of stripes. The
+// accumulation is a series of independent lane operations, which map directly
+// onto SIMD instructions.
+
+const unsigned stripeSize = 64;
+const unsigned numLanes = stripeSize / 8;
+const unsigned stripesPerBlock = 16;
+const size_t blockSize = stripeSize * stripesPerBlock;
+
+/// The keys, from which each stripe of a block uses a window (of eight keys)
+/// starting at its index, followed by the keys for scrambling.
+alignas(16) const uint64_t secret[stripesPerBlock + numLanes * 2] = {
+  0x32e230e18071ab94ULL, 0x22d9514ae4861dbeULL, 0x8957dd2e0bf84e5aULL,
+  0xce61d882046f88e2ULL, 0x1c24b1f0e86e8a68ULL, 0x155314f9ef497726ULL,
+  0x4e71ad5f672adc4fULL, 0xbfd1678d0872054dULL, 0x8f7d7af8f034d9cbULL,
+  0xd7f1c4c7eacd12cfULL, 0x294f03f704290016ULL, 0xa424c0d375b4476dULL,
+  0x2755c3d9a40b8090ULL, 0xc90ec492305520b1ULL, 0x067d2a73bb1ae85aULL,
+  0xa573bb19fbe4fadfULL, 0x1f0b83a9a5beec68ULL, 0xbd2a3f8c9ce14f7dULL,
+  0x5f027a155123a1bbULL, 0xf65205798aaf0b2eULL, 0x48d62c92b38a0497ULL,
+  0xdb6664fe81534960ULL, 0x57c0a761f63a183eULL, 0xd230ffb963b33b58ULL,
+  0x441e41a5328b80d1ULL, 0x0429e6f35c0c86d2ULL, 0x46a82e080daeff6dULL,
+  0xf0927997784d10ffULL, 0xe1de4a5b25fe4bc6ULL, 0x8dc576edd489d4bbULL,
+  0xdb932129bfc204a3ULL, 0xd09a3a709db530ccULL,
+};
+const uint64_t* scrambleKeys = secret + stripesPerBlock + numLanes;
+
+const uint64_t prime32_1 = 0x9E3779B1ULL;
+const uint64_t prime32_2 = 0x85EBCA77ULL;
+const uint64_t prime32_3 = 0xC2B2AE3DULL;
+const uint64_t prime64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t prime64_3 = 0x165667B19E3779F9ULL;
+const uint64_t prime64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t prime64_5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t readLittleEndian64(const unsigned char* p) {
+  return (uint64_t(p[0]) | uint64_t(p[1]) << 8 | uint64_t(p[2]) << 16 |
+          uint64_t(p[3]) << 24 | uint64_t(p[4]) << 32 | uint64_t(p[5]) << 40 |
+          uint64_t(p[6]) << 48 | uint64_t(p[7]) << 56);
+}
+
+/// Multiply two 64-bit values, and fold the 128-bit product into 64 bits.
+inline uint64_t multiplyFold64(uint64_t lhs, uint64_t rhs) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t product = __uint128_t(lhs) * rhs;
+  return uint64_t(product) ^ uint64_t(product >> 64);
+#else
+  uint64_t lhsLow = lhs & 0xFFFFFFFF, lhsHigh = lhs >> 32;
+  uint64_t rhsLow = rhs & 0xFFFFFFFF, rhsHigh = rhs >> 32;
+  uint64_t lowLow = lhsLow * rhsLow;
+  uint64_t highLow = lhsHigh * rhsLow;
+  uint64_t lowHigh = lhsLow * rhsHigh;
+  uint64_t highHigh = lhsHigh * rhsHigh;
+  uint64_t cross = (lowLow >> 32) + (highLow & 0xFFFFFFFF) + lowHigh;
+  uint64_t upper = (highLow >> 32) + (cross >> 32) + highHigh;
+  uint64_t lower = (cross << 32) | (lowLow & 0xFFFFFFFF);
+  return lower ^ upper;
+#endif
+}
+
+inline uint64_t avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= 0x165667919E3779F9ULL;
+  h ^= h >> 32;
+  return h;
+}
+
+#if defined(__SSE2__)
+
+/// Accumulate the given stripes, using SSE2 (which is always available on
+/// x86-64).
+void accumulateStripes(uint64_t* acc, const unsigned char* data,
+                       size_t numStripes, const uint64_t* keys) {
+  __m128i* lanes = reinterpret_cast<__m128i*>(acc);
+  for (size_t n = 0; n != numStripes; ++n) {
+    const unsigned char* stripe = data + n * stripeSize;
+    const uint64_t* stripeKeys = keys + n;
+    for (unsigned i = 0; i != numLanes / 2; ++i) {
+      __m128i value = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(stripe) + i);
+      __m128i key = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(stripeKeys) + i);
+      __m128i keyed = _mm_xor_si128(value, key);
+      // Multiply the low and high halves of each keyed 64-bit lane.
+      __m128i product = _mm_mul_epu32(
+          keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+      // Add the data to the neighboring lane.
+      __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+      __m128i sum = _mm_add_epi64(_mm_load_si128(lanes + i), swapped);
+      _mm_store_si128(lanes + i, _mm_add_epi64(sum, product));
+    }
+  }
+}
+
+void scramble(uint64_t* acc) {
+  __m128i* lanes = reinterpret_cast<__m128i*>(acc);
+  const __m128i prime = _mm_set1_epi32(uint32_t(prime32_1));
+  for (unsigned i = 0; i != numLanes / 2; ++i) {
+    __m128i lane = _mm_load_si128(lanes + i);
+    lane = _mm_xor_si128(lane, _mm_srli_epi64(lane, 47));
+    lane = _mm_xor_si128(lane, _mm_loadu_si128(
+                             reinterpret_cast<const __m128i*>(scrambleKeys) + i));
+    // Multiply each 64-bit lane by the 32-bit prime, in two halves.
+    __m128i low = _mm_mul_epu32(lane, prime);
+    __m128i high = _mm_mul_epu32(_mm_srli_epi64(lane, 32), prime);
+    _mm_store_si128(lanes + i, _mm_add_epi64(low, _mm_slli_epi64(high, 32)));
+  }
+}
+
+#else
+
+void accumulateStripes(uint64_t* acc, const unsigned char* data,
+                       size_t numStripes, const uint64_t* keys) {
+  for (size_t n = 0; n != numStripes; ++n) {
+    const unsigned char* stripe = data + n * stripeSize;
+    const uint64_t* stripeKeys = keys + n;
+    for (unsigned i = 0; i != numLanes; ++i) {
+      uint64_t value = readLittleEndian64(stripe + i * 8);
+      uint64_t keyed = value ^ stripeKeys[i];
+      acc[i ^ 1] += value;
+      acc[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+    }
+  }
+}
+
+void scramble(uint64_t* acc) {
+  for (unsigned i = 0; i != numLanes; ++i) {
+    uint64_t lane = acc[i];
+    lane ^= lane >> 47;
+    lane ^= scrambleKeys[i];
+    acc[i] = lane * prime32_1;
+  }
+}
+
+#endif
+
+/// Combine the accumulators into one half of the result.
+uint64_t mergeAccumulators(const uint64_t* acc, const uint64_t* keys,
+                           uint64_t start) {
+  uint64_t result = start;
+  for (unsigned i = 0; i != numLanes; i += 2)
+    result += multiplyFold64(acc[i] ^ keys[i], acc[i + 1] ^ keys[i + 1]);
+  return avalanche(result);
+}
+
+/// Initialize the accumulators for the given seed.
+void initializeAccumulators(uint64_t* acc, uint64_t seed) {
+  const uint64_t initialValues[numLanes] = {
+    prime32_3, prime64_1, prime64_2, prime64_3,
+    prime64_4, prime32_2, prime64_5, prime32_1
+  };
+  for (unsigned i = 0; i != numLanes; ++i)
+    acc[i] = initialValues[i] + ((i & 1) ? -seed : seed);
+}
+
+/// Take in each complete block of the given bytes, and return the number of
+/// bytes taken in.
+size_t accumulateBlocks(uint64_t* acc, const unsigned char* bytes,
+                        size_t length) {
+  size_t numBlocks = length / blockSize;
+  for (size_t n = 0; n != numBlocks; ++n) {
+    accumulateStripes(acc, bytes + n * blockSize, stripesPerBlock, secret);
+    scramble(acc);
+  }
+  return numBlocks * blockSize;
+}
+
+/// Take in the bytes following the last complete block, and compute the hash
+/// of \arg length bytes in total.
+HashValue128 finishHash(uint64_t* acc, const unsigned char* bytes,
+                        size_t numBytes, uint64_t length) {
+  // Take in the remaining complete stripes.
+  size_t numStripes = numBytes / stripeSize;
+  accumulateStripes(acc, bytes, numStripes, secret);
+  size_t offset = numStripes * stripeSize;
+
+  // Take in any remaining bytes as a zero-padded stripe (the length, which is
+  // merged in below, distinguishes the padding), which is also the only stripe
+  // of short inputs.
+  if (offset != numBytes || length == 0) {
+    alignas(16) unsigned char last[stripeSize] = {};
+    memcpy(last, bytes + offset, numBytes - offset);
+    accumulateStripes(acc, last, 1, secret + numStripes);
+  }
+
+  HashValue128 result;
+  result.low = mergeAccumulators(acc, secret + numLanes,
+                                 length * prime64_1);
+  result.high = mergeAccumulators(acc, secret + stripesPerBlock,
+                                  ~(length * prime64_2));
+  return result;
+}
+
+}
+
+HashValue128 hashBytes128(StringRef data, uint64_t seed) {
+  alignas(16) uint64_t acc[numLanes];
+  initializeAccumulators(acc, seed);
+
+  auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+  size_t length = data.size();
+  size_t offset = accumulateBlocks(acc, bytes, length);
+  return finishHash(acc, bytes + offset, length - offset, length);
+}
+
+HashBuilder128::HashBuilder128(uint64_t seed) {
+  static_assert(sizeof(acc) == numLanes * sizeof(uint64_t) &&
+                sizeof(pending) == blockSize, "unexpected hash state size");
+  initializeAccumulators(acc, seed);
+}
+
+void HashBuilder128::update(StringRef data) {
+  auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+  size_t size = data.size();
+  length += size;
+
+  // Complete any pending block first.
+  if (numPending != 0) {
+    size_t numCopied = std::min(size, blockSize - numPending);
+    memcpy(pending + numPending, bytes, numCopied);
+    numPending += numCopied;
+    bytes += numCopied;
+    size -= numCopied;
+    if (numPending != blockSize)
+      return;
+    accumulateBlocks(acc, pending, blockSize);
+    numPending = 0;
+  }
+
+  size_t offset = accumulateBlocks(acc, bytes, size);
+  memcpy(pending, bytes + offset, size - offset);
+  numPending = size - offset;
+}
+
+HashValue128 HashBuilder128::getHash() const {
+  alignas(16) uint64_t finalAcc[numLanes];
+  memcpy(finalAcc, acc, sizeof(finalAcc));
+  return finishHash(finalAcc, pending, numPending, length);
+}
+
 uint64_t hashString(StringRef value) {
-  return hash_value(value);
+  return hashBytes128(value).low;
+}
+
+// MARK: CommandSignature
+
+namespace {
+
+/// The value combined in place of the high half of a hash, for integers.
+const uint64_t integerTag = 0x9FB21C651E98DF25ULL;
+
+/// Mix the given 128-bit value into the signature.
+///
+/// As in the 128-bit merge of XXH3, each half of the signature takes in a
+/// multiply-fold of the value with its own keys, along with the other half of
+/// the value itself. The prior state is added rather than multiplied, and the
+/// halves are then mixed together by invertible steps, so no value can cancel
+/// it: distinct signatures always remain distinct.
+HashValue128 mixSignature(const HashValue128& signature,
+                          const HashValue128& value) {
+  uint64_t low = signature.low +
+    multiplyFold64(value.low ^ secret[0], value.high ^ secret[1]);
+  uint64_t high = signature.high +
+    multiplyFold64(value.low ^ secret[2], value.high ^ secret[3]);
+  low ^= value.high;
+  high ^= value.low;
+  high ^= avalanche(low);
+  low += high * prime64_3;
+  HashValue128 result;
+  result.low = avalanche(low);
+  result.high = avalanche(high);
+  return result;
+}
+
+}
+
+CommandSignature& CommandSignature::combine(StringRef string) {
+  // Short strings (the bulk of most command lines) are mixed in directly, with
+  // their length in the top byte, rather than being hashed first. The length
+  // keeps them distinct from each other, and from integers.
+  if (string.size() < 16) {
+    unsigned char bytes[16] = {};
+    memcpy(bytes, string.data(), string.size());
+    bytes[15] = uint8_t(string.size());
+    HashValue128 stringValue;
+    stringValue.low = readLittleEndian64(bytes);
+    stringValue.high = readLittleEndian64(bytes + 8);
+    value = mixSignature(value, stringValue);
+    return *this;
+  }
+
+  value = mixSignature(value, hashBytes128(string));
+  return *this;
+}
+
+CommandSignature& CommandSignature::combine(uint64_t integer) {
+  HashValue128 integerValue;
+  integerValue.low = integer;
+  integerValue.high = integerTag;
+  value = mixSignature(value, integerValue);
+  return *this;
 }
 
 }
@@ -0,0 +1,337 @@
+//===-- JobServer.cpp -----------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/JobServer.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Twine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+#if !defined(_WIN32)
+namespace {
+
+/// The maximum number of tokens placed in a jobserver we create, which keeps
+/// the writes filling it from blocking.
+const unsigned maxTokens = 4096;
+
+/// The token placed in a jobserver we create, as used by GNU make.
+const char defaultToken = '+';
+
+bool setFlags(int fd, int fdFlags, int statusFlags) {
+  if (fdFlags && fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | fdFlags) == -1)
+    return false;
+  if (statusFlags && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | statusFlags) == -1)
+    return false;
+  return true;
+}
+
+/// Open a non-blocking descriptor for reading the given pipe.
+///
+/// Non-blocking mode belongs to the open pipe, which is shared with the other
+/// participants, so it cannot be set on the descriptor itself. Where possible,
+/// the pipe is opened again instead, giving an independent open pipe.
+int openNonBlockingReader(int fd) {
+#if defined(__linux__)
+  int reopened = open(("/proc/self/fd/" + Twine(fd)).str().c_str(),
+                      O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (reopened != -1)
+    return reopened;
+#endif
+
+  // Otherwise, fall back to a blocking descriptor. Reads are only attempted
+  // once the pipe is readable, but may then still block if another process
+  // takes the token first.
+  int result = dup(fd);
+  if (result != -1)
+    setFlags(result, FD_CLOEXEC, 0);
+  return result;
+}
+
+/// Find the jobserver arguments in the given MAKEFLAGS value.
+///
+/// \returns The value of the last "--jobserver-auth" (or "--jobserver-fds")
+/// argument, or an empty string if there is none.
+StringRef findJobServerAuth(StringRef makeFlags) {
+  StringRef result;
+  SmallVector<StringRef, 8> args;
+  makeFlags.split(args, ' ', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (auto arg: args) {
+    if (arg.consume_front("--jobserver-auth=") ||
+        arg.consume_front("--jobserver-fds=")) {
+      result = arg;
+    }
+  }
+  return result;
+}
+
+}
+
+JobServer::~JobServer() {
+  // Return any tokens which are still held, so they are not lost to the other
+  // participants.
+  for (char token: heldTokens) {
+    while (write(writeFd, &token, 1) == -1 && errno == EINTR) {}
+  }
+  for (int fd: ownedFds)
+    close(fd);
+  for (int fd: wakeFds) {
+    if (fd != -1)
+      close(fd);
+  }
+}
+
+bool JobServer::initialize(std::string* error_out) {
+  if (::pipe(wakeFds) != 0 ||
+      !setFlags(wakeFds[0], FD_CLOEXEC, O_NONBLOCK) ||
+      !setFlags(wakeFds[1], FD_CLOEXEC, O_NONBLOCK)) {
+    *error_out = std::string("unable to create pipe: ") + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<JobServer> JobServer::connect(const char* const* environment,
+                                              std::string* error_out) {
+  error_out->clear();
+
+  StringRef makeFlags;
+  for (auto envp = environment; envp && *envp; ++envp) {
+    StringRef entry(*envp);
+    if (entry.consume_front("MAKEFLAGS="))
+      makeFlags = entry;
+  }
+  StringRef auth = findJobServerAuth(makeFlags);
+  if (auth.empty())
+    return nullptr;
+
+  std::unique_ptr<JobServer> server(new JobServer);
+  if (!server->initialize(error_out))
+    return nullptr;
+
+  if (auth.consume_front("fifo:")) {
+    // The fifo is opened for reading and writing, so that it stays usable
+    // (and non-blocking opens succeed) whoever else has it open.
+    int fd = open(auth.str().c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1) {
+      *error_out = (Twine("unable to open jobserver fifo '") + auth + "': " +
+                    strerror(errno)).str();
+      return nullptr;
+    }
+    server->ownedFds.push_back(fd);
+    server->readFd = fd;
+    server->writeFd = fd;
+    return server;
+  }
+
+  StringRef readStr, writeStr;
+  std::tie(readStr, writeStr) = auth.split(',');
+  int readFd, writeFd;
+  if (readStr.getAsInteger(10, readFd) || writeStr.getAsInteger(10, writeFd) ||
+      readFd < 0 || writeFd < 0) {
+    *error_out = ("invalid jobserver '" + auth + "' in MAKEFLAGS").str();
+    return nullptr;
+  }
+
+  // The parent may not have passed the descriptors to us (GNU make only does
+  // so for recipes it knows to be recursive).
+  if (fcntl(readFd, F_GETFD) == -1 || fcntl(writeFd, F_GETFD) == -1) {
+    *error_out = ("jobserver descriptors '" + auth + "' from MAKEFLAGS are "
+                  "not open (is the command marked as recursive, with '+', "
+                  "in the makefile?)").str();
+    return nullptr;
+  }
+
+  server->readFd = openNonBlockingReader(readFd);
+  if (server->readFd == -1) {
+    *error_out = std::string("unable to open jobserver: ") + strerror(errno);
+    return nullptr;
+  }
+  server->ownedFds.push_back(server->readFd);
+  server->writeFd = writeFd;
+  return server;
+}
+
+std::unique_ptr<JobServer> JobServer::create(unsigned numJobs,
+                                             std::string* error_out) {
+  std::unique_ptr<JobServer> server(new JobServer);
+  if (!server->initialize(error_out))
+    return nullptr;
+
+  // The pipe is deliberately inherited by subprocesses.
+  int fds[2];
+  if (::pipe(fds) != 0) {
+    *error_out = std::string("unable to create pipe: ") + strerror(errno);
+    return nullptr;
+  }
+  server->ownedFds.push_back(fds[0]);
+  server->ownedFds.push_back(fds[1]);
+
+  // The first job uses the implicit token.
+  std::string tokens(std::min(std::max(numJobs, 1u) - 1, maxTokens),
+                     defaultToken);
+  if (!tokens.empty() &&
+      write(fds[1], tokens.data(), tokens.size()) != ssize_t(tokens.size())) {
+    *error_out = std::string("unable to fill jobserver: ") + strerror(errno);
+    return nullptr;
+  }
+
+  server->readFd = openNonBlockingReader(fds[0]);
+  if (server->readFd == -1) {
+    *error_out = std::string("unable to open jobserver: ") + strerror(errno);
+    return nullptr;
+  }
+  server->ownedFds.push_back(server->readFd);
+  server->writeFd = fds[1];
+  server->makeFlags = ("-j" + Twine(std::max(numJobs, 1u)) +
+                       " --jobserver-auth=" + Twine(fds[0]) + "," +
+                       Twine(fds[1])).str();
+  return server;
+}
+
+bool JobServer::acquire() {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (cancelled)
+      return false;
+    if (implicitTokenAvailable) {
+      implicitTokenAvailable = false;
+      return true;
+    }
+  }
+
+  while (true) {
+    struct pollfd fds[2] = {
+      { readFd, POLLIN, 0 },
+      { wakeFds[0], POLLIN, 0 }
+    };
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+
+    // Check whether the implicit token was released, or we were cancelled.
+    if (fds[1].revents) {
+      char byte;
+      (void)read(wakeFds[0], &byte, 1);
+
+      std::lock_guard<std::mutex> guard(mutex);
+      if (cancelled)
+        return false;
+      if (implicitTokenAvailable) {
+        implicitTokenAvailable = false;
+        return true;
+      }
+    }
+
+    if (fds[0].revents) {
+      // Another participant may take the token first, in which case we just
+      // wait again.
+      char token;
+      ssize_t result = read(readFd, &token, 1);
+      if (result == 1) {
+        std::lock_guard<std::mutex> guard(mutex);
+        heldTokens.push_back(token);
+        return true;
+      }
+      if (result == 0 || (result == -1 && errno != EAGAIN &&
+                          errno != EWOULDBLOCK && errno != EINTR)) {
+        // The jobserver is gone, so only our implicit token remains.
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!cancelled && !implicitTokenAvailable) {
+          lock.unlock();
+          struct pollfd wakeFd = { wakeFds[0], POLLIN, 0 };
+          (void)poll(&wakeFd, 1, -1);
+          char byte;
+          (void)read(wakeFds[0], &byte, 1);
+          lock.lock();
+        }
+        if (cancelled)
+          return false;
+        implicitTokenAvailable = false;
+        return true;
+      }
+    }
+  }
+}
+
+void JobServer::release() {
+  char token;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (heldTokens.empty()) {
+      implicitTokenAvailable = true;
+      if (wakeFds[1] != -1) {
+        char byte = 0;
+        (void)write(wakeFds[1], &byte, 1);
+      }
+      return;
+    }
+    token = heldTokens.back();
+    heldTokens.pop_back();
+  }
+
+  while (write(writeFd, &token, 1) == -1 && errno == EINTR) {}
+}
+
+void JobServer::cancel() {
+  std::lock_guard<std::mutex> guard(mutex);
+  if (cancelled)
+    return;
+  cancelled = true;
+
+  // Closing the write end leaves the wake pipe readable for good, which wakes
+  // all current and future waiters.
+  close(wakeFds[1]);
+  wakeFds[1] = -1;
+}
+
+#else
+
+JobServer::~JobServer() {}
+
+bool JobServer::initialize(std::string* error_out) {
+  *error_out = "the jobserver is unsupported on this platform";
+  return false;
+}
+
+std::unique_ptr<JobServer> JobServer::connect(const char* const* environment,
+                                              std::string* error_out) {
+  error_out->clear();
+  return nullptr;
+}
+
+std::unique_ptr<JobServer> JobServer::create(unsigned numJobs,
+                                             std::string* error_out) {
+  *error_out = "the jobserver is unsupported on this platform";
+  return nullptr;
+}
+
+bool JobServer::acquire() { return true; }
+
+void JobServer::release() {}
+
+void JobServer::cancel() {}
+
+#endif
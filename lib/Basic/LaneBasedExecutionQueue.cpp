@@ -12,6 +12,10 @@
 
 #include "llbuild/Basic/ExecutionQueue.h"
 
+#include "llbuild/Basic/PlatformUtility.h"
+#include "llbuild/Basic/POSIXEnvironment.h"
+#include "llbuild/Basic/Probes.h"
+#include "llbuild/Basic/SpawnServer.h"
 #include "llbuild/Basic/Tracing.h"
 
 #include "llvm/ADT/ArrayRef.h"
@@ -20,11 +24,17 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/Twine.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <future>
+#include <mutex>
 #include <queue>
 #include <random>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <signal.h>
@@ -32,6 +42,9 @@
 #ifdef __APPLE__
 #include <pthread/spawn.h>
 #endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
 
 using namespace llbuild;
 using namespace llbuild::basic;
@@ -46,15 +59,39 @@ struct QueueJobLess {
 
 namespace {
 
+/// A job whose lane is held until both the job and the processes it handed
+/// to the process reactor have completed.
+struct RunningJob {
+  QueueJob job;
+  JobResources resources;
+  unsigned laneNumber;
+
+  /// Whether the job holds a jobserver token.
+  bool hasJobToken;
+
+  /// The number of outstanding references (the job itself, and each of its
+  /// running processes).
+  std::atomic<unsigned> refCount{1};
+
+  RunningJob(const QueueJob& job, const JobResources& resources,
+             unsigned laneNumber, bool hasJobToken)
+      : job(job), resources(resources), laneNumber(laneNumber),
+        hasJobToken(hasJobToken) {}
+};
+
 struct LaneBasedExecutionQueueJobContext : public QueueJobContext {
   uint64_t jobID;
   uint64_t laneNumber;
 
   QueueJob& job;
 
+  /// The running job state, when processes are run by the process reactor.
+  RunningJob* running;
+
   LaneBasedExecutionQueueJobContext(
-      uint64_t jobID, uint64_t laneNumber, QueueJob& job)
-          : jobID(jobID), laneNumber(laneNumber), job(job) {}
+      uint64_t jobID, uint64_t laneNumber, QueueJob& job,
+      RunningJob* running = nullptr)
+          : jobID(jobID), laneNumber(laneNumber), job(job), running(running) {}
 
   unsigned laneID() const override { return laneNumber; }
 };
@@ -72,6 +109,513 @@ public:
   static std::unique_ptr<Scheduler> make(SchedulerAlgorithm alg);
 };
 
+/// The set of jobs which are ready to be executed by the lanes.
+class ReadyQueue {
+public:
+  virtual ~ReadyQueue() { }
+
+  /// Add a job to the queue.
+  ///
+  /// \param fromLane The lane adding the job, or -1 if it is being added from
+  /// outside of the queue's lanes.
+  /// \returns The number of ready jobs after adding the job.
+  virtual uint64_t addJob(QueueJob job, int fromLane) = 0;
+
+  /// Take the next job for the given lane, waiting until one is available.
+  ///
+  /// \param readyJobsCount_out On return, the number of remaining ready jobs.
+  /// \returns The job, or an empty job once the queue has been shut down and
+  /// all of its jobs have been taken.
+  virtual QueueJob takeJob(unsigned laneNumber,
+                           uint64_t& readyJobsCount_out) = 0;
+
+  /// Wake up all of the waiting lanes, and stop waiting for new jobs.
+  virtual void shutdown() = 0;
+};
+
+/// A ready queue shared by all lanes, protected by a single lock.
+///
+/// This strictly follows the order of the scheduler algorithm.
+class SharedReadyQueue : public ReadyQueue {
+  std::unique_ptr<Scheduler> readyJobs;
+  std::mutex readyJobsMutex;
+  std::condition_variable readyJobsCondition;
+  bool isShutdown { false };
+
+public:
+  SharedReadyQueue(SchedulerAlgorithm alg) : readyJobs(Scheduler::make(alg)) {}
+
+  uint64_t addJob(QueueJob job, int) override {
+    std::lock_guard<std::mutex> guard(readyJobsMutex);
+    readyJobs->addJob(job);
+    readyJobsCondition.notify_one();
+    return readyJobs->size();
+  }
+
+  QueueJob takeJob(unsigned, uint64_t& readyJobsCount_out) override {
+    std::unique_lock<std::mutex> lock(readyJobsMutex);
+
+    // While the queue is empty, wait for an item.
+    while (!isShutdown && readyJobs->empty()) {
+      readyJobsCondition.wait(lock);
+    }
+    if (isShutdown && readyJobs->empty())
+      return {};
+
+    // Take an item according to the chosen policy.
+    QueueJob job = readyJobs->getNextJob();
+    readyJobsCount_out = readyJobs->size();
+    return job;
+  }
+
+  void shutdown() override {
+    std::lock_guard<std::mutex> guard(readyJobsMutex);
+    isShutdown = true;
+    readyJobsCondition.notify_all();
+  }
+};
+
+/// A work stealing ready queue.
+///
+/// Each lane has its own queue of jobs, to which the jobs it adds are
+/// pushed. Jobs added from outside of the lanes go to a global injection
+/// queue, from which lanes take a share of the jobs at a time. Lanes which run
+/// out of jobs steal them from the other lanes, starting at a random victim.
+///
+/// Each individual queue is ordered by the scheduler algorithm, but there is
+/// no global order across lanes.
+class WorkStealingReadyQueue : public ReadyQueue {
+  struct JobQueue {
+    std::mutex mutex;
+    std::unique_ptr<Scheduler> jobs;
+
+    /// The number of jobs in the queue, used to skip empty queues without
+    /// taking their lock.
+    std::atomic<uint64_t> size{0};
+
+    /// The random number generator used for choosing victims (only used by
+    /// the owning lane).
+    std::minstd_rand rng;
+
+    JobQueue(SchedulerAlgorithm alg, unsigned seed)
+        : jobs(Scheduler::make(alg)), rng(seed) {}
+
+    void push(QueueJob job) {
+      std::lock_guard<std::mutex> guard(mutex);
+      jobs->addJob(job);
+      ++size;
+    }
+
+    bool tryPop(QueueJob& job_out) {
+      if (size == 0)
+        return false;
+      std::lock_guard<std::mutex> guard(mutex);
+      if (jobs->empty())
+        return false;
+      job_out = jobs->getNextJob();
+      --size;
+      return true;
+    }
+  };
+
+  /// The queue for jobs added from outside of the lanes.
+  JobQueue injectionQueue;
+
+  /// The queue for each lane.
+  std::vector<std::unique_ptr<JobQueue>> laneQueues;
+
+  /// The total number of ready jobs, across all queues.
+  std::atomic<uint64_t> numReadyJobs{0};
+
+  /// The number of lanes waiting for jobs.
+  std::atomic<unsigned> numIdleLanes{0};
+
+  /// The number of lanes which are awake and looking for a job.
+  std::atomic<unsigned> numSearchingLanes{0};
+
+  std::atomic<bool> isShutdown{false};
+  std::mutex idleMutex;
+  std::condition_variable idleCondition;
+
+  /// Take a job from the injection queue, moving a share of the remaining
+  /// jobs to the lane's queue.
+  bool tryTakeInjected(unsigned laneNumber, QueueJob& job_out) {
+    if (injectionQueue.size == 0)
+      return false;
+    std::lock_guard<std::mutex> guard(injectionQueue.mutex);
+    if (injectionQueue.jobs->empty())
+      return false;
+    job_out = injectionQueue.jobs->getNextJob();
+    --injectionQueue.size;
+
+    // The maximum number of jobs to move at a time.
+    const uint64_t maxBatchSize = 16;
+    uint64_t batchSize = std::min(
+        injectionQueue.jobs->size() / laneQueues.size(), maxBatchSize);
+    if (batchSize != 0) {
+      auto& laneQueue = *laneQueues[laneNumber];
+      std::lock_guard<std::mutex> laneGuard(laneQueue.mutex);
+      for (uint64_t i = 0; i != batchSize; ++i) {
+        laneQueue.jobs->addJob(injectionQueue.jobs->getNextJob());
+      }
+      injectionQueue.size -= batchSize;
+      laneQueue.size += batchSize;
+    }
+    return true;
+  }
+
+  void wakeIdleLane() {
+    if (numIdleLanes == 0)
+      return;
+    std::lock_guard<std::mutex> guard(idleMutex);
+    idleCondition.notify_one();
+  }
+
+  /// Steal a job from another lane.
+  bool trySteal(unsigned laneNumber, QueueJob& job_out) {
+    unsigned numLanes = laneQueues.size();
+    unsigned start = laneQueues[laneNumber]->rng() % numLanes;
+    for (unsigned i = 0; i != numLanes; ++i) {
+      unsigned victim = (start + i) % numLanes;
+      if (victim != laneNumber && laneQueues[victim]->tryPop(job_out))
+        return true;
+    }
+    return false;
+  }
+
+public:
+  WorkStealingReadyQueue(SchedulerAlgorithm alg, unsigned numLanes)
+      : injectionQueue(alg, 0) {
+    for (unsigned i = 0; i != numLanes; ++i) {
+      laneQueues.push_back(llvm::make_unique<JobQueue>(alg, i + 1));
+    }
+  }
+
+  uint64_t addJob(QueueJob job, int fromLane) override {
+    if (fromLane >= 0) {
+      laneQueues[fromLane]->push(job);
+    } else {
+      injectionQueue.push(job);
+    }
+    uint64_t readyJobsCount = ++numReadyJobs;
+
+    // Wake up a lane, unless one is already looking for work (in which case it
+    // is responsible for waking another lane once it finds a job).
+    if (numSearchingLanes == 0)
+      wakeIdleLane();
+    return readyJobsCount;
+  }
+
+  QueueJob takeJob(unsigned laneNumber,
+                   uint64_t& readyJobsCount_out) override {
+    QueueJob job{};
+    ++numSearchingLanes;
+    while (!laneQueues[laneNumber]->tryPop(job) &&
+           !tryTakeInjected(laneNumber, job) &&
+           !trySteal(laneNumber, job)) {
+      // Wait until there is a new job, or we are shut down.
+      //
+      // NOTE: The idle count is incremented before checking the ready count,
+      // under the idle mutex, so that a concurrent addJob() either sees the
+      // idle lane or is seen by it.
+      std::unique_lock<std::mutex> lock(idleMutex);
+      ++numIdleLanes;
+      --numSearchingLanes;
+      while (!isShutdown && numReadyJobs == 0) {
+        idleCondition.wait(lock);
+      }
+      --numIdleLanes;
+      if (isShutdown && numReadyJobs == 0)
+        return {};
+      ++numSearchingLanes;
+    }
+    --numSearchingLanes;
+    readyJobsCount_out = --numReadyJobs;
+
+    // If there is more work, make sure another lane is looking for it.
+    if (readyJobsCount_out != 0 && numSearchingLanes == 0)
+      wakeIdleLane();
+    return job;
+  }
+
+  void shutdown() override {
+    isShutdown = true;
+    std::lock_guard<std::mutex> guard(idleMutex);
+    idleCondition.notify_all();
+  }
+};
+
+/// Admission control for jobs, based on their expected resource use and
+/// pools.
+///
+/// Jobs which do not fit the budget (or whose pool is full) are held until
+/// the running jobs release enough resources, without occupying a lane while
+/// they wait. Waiting jobs are admitted in the order they arrived, as the
+/// resources they need become available, and are then made ready again (to
+/// run without being checked again). Jobs waiting for a slot in their pool are
+/// only considered when a job from the same pool completes.
+class ResourceAdmission {
+  ResourceBudget budget;
+
+  /// Whether a budget is in use (otherwise, only pooled jobs are tracked).
+  bool hasBudget;
+
+  std::mutex mutex;
+
+  /// The maximum number of jobs to admit at once, or 0 for no limit.
+  unsigned laneLimit = 0;
+
+  /// The resources used by the admitted jobs.
+  uint64_t admittedMemory = 0;
+  unsigned admittedCPUs = 0;
+  unsigned numAdmittedJobs = 0;
+
+  /// The number of admitted jobs in each pool.
+  std::unordered_map<const JobPool*, unsigned> admittedPoolJobs;
+
+  /// A job waiting for resources to be released.
+  struct WaitingJob {
+    QueueJob job;
+    JobResources resources;
+  };
+
+  /// The jobs waiting for resources other than a slot in their pool to be
+  /// released, in the order they arrived.
+  std::deque<WaitingJob> waitingJobs;
+
+  /// The jobs waiting for a slot in each pool, in the order they arrived.
+  std::unordered_map<const JobPool*, std::deque<WaitingJob>> poolWaitingJobs;
+
+  /// The jobs which were admitted while waiting, and have been made ready
+  /// again, by their descriptor.
+  std::unordered_multiset<const JobDescriptor*> admittedWaitingJobs;
+
+  /// The most recently sampled system available memory, and when it was
+  /// sampled.
+  uint64_t availableMemory = 0;
+  std::chrono::steady_clock::time_point availableMemoryTime;
+
+  /// Get the current memory budget.
+  uint64_t getMemoryBudget() {
+    // Sample the available memory at most every 100ms.
+    auto now = std::chrono::steady_clock::now();
+    if (availableMemoryTime == std::chrono::steady_clock::time_point() ||
+        now - availableMemoryTime > std::chrono::milliseconds(100)) {
+      availableMemory = sys::getAvailableMemory();
+      availableMemoryTime = now;
+    }
+
+    // The memory in use by the admitted jobs is (partially) accounted for by
+    // the available memory, so this is conservative.
+    if (availableMemory == 0)
+      return budget.memory;
+    return std::min(budget.memory, admittedMemory + availableMemory);
+  }
+
+  bool isPoolFull(const JobPool* pool) {
+    return admittedPoolJobs[pool] >= pool->getDepth();
+  }
+
+  bool fits(const JobResources& resources) {
+    if (resources.pool && isPoolFull(resources.pool))
+      return false;
+    if (numAdmittedJobs == 0)
+      return true;
+    if (laneLimit != 0 && numAdmittedJobs >= laneLimit)
+      return false;
+    if (budget.cpus != 0 && admittedCPUs + resources.cpus > budget.cpus)
+      return false;
+    if (budget.memory != 0 && resources.memory != 0 &&
+        admittedMemory + resources.memory > getMemoryBudget())
+      return false;
+    return true;
+  }
+
+  /// Check whether the job with the given resources is subject to admission
+  /// control.
+  bool isTracked(const JobResources& resources) const {
+    return hasBudget || resources.pool;
+  }
+
+  void admit(const JobResources& resources) {
+    admittedMemory += resources.memory;
+    admittedCPUs += resources.cpus;
+    ++numAdmittedJobs;
+    if (resources.pool)
+      ++admittedPoolJobs[resources.pool];
+  }
+
+  /// Admit a waiting job, which should then be made ready again.
+  void admitWaitingJob(WaitingJob& waiting,
+                       std::vector<QueueJob>& admittedJobs_out) {
+    admit(waiting.resources);
+    admittedWaitingJobs.insert(waiting.job.getDescriptor());
+    admittedJobs_out.push_back(std::move(waiting.job));
+  }
+
+  /// Hold a job which does not fit until the resources it waits for are
+  /// released.
+  void park(WaitingJob waiting) {
+    if (waiting.resources.pool && isPoolFull(waiting.resources.pool)) {
+      poolWaitingJobs[waiting.resources.pool].push_back(std::move(waiting));
+    } else {
+      waitingJobs.push_back(std::move(waiting));
+    }
+  }
+
+  /// Admit the jobs at the head of the given pool's waiting jobs which now
+  /// fit.
+  void admitPoolWaitingJobs(const JobPool* pool,
+                            std::vector<QueueJob>& admittedJobs_out) {
+    auto it = poolWaitingJobs.find(pool);
+    if (it == poolWaitingJobs.end())
+      return;
+    auto& jobs = it->second;
+    while (!jobs.empty() && !isPoolFull(pool)) {
+      WaitingJob waiting = std::move(jobs.front());
+      jobs.pop_front();
+      if (!fits(waiting.resources)) {
+        // The job now waits for other resources.
+        waitingJobs.push_back(std::move(waiting));
+        break;
+      }
+      admitWaitingJob(waiting, admittedJobs_out);
+    }
+  }
+
+  /// Admit the jobs at the head of the waiting jobs which now fit.
+  void admitWaitingJobs(std::vector<QueueJob>& admittedJobs_out) {
+    while (!waitingJobs.empty()) {
+      WaitingJob& waiting = waitingJobs.front();
+      const JobPool* pool = waiting.resources.pool;
+      if (pool && isPoolFull(pool)) {
+        // The job's pool filled up while it waited, so it waits for a slot
+        // again (ahead of the jobs which arrived later).
+        poolWaitingJobs[pool].push_front(std::move(waiting));
+      } else if (fits(waiting.resources)) {
+        admitWaitingJob(waiting, admittedJobs_out);
+      } else {
+        break;
+      }
+      waitingJobs.pop_front();
+    }
+  }
+
+public:
+  ResourceAdmission(ResourceBudget budget)
+      : budget(budget), hasBudget(budget.memory != 0 || budget.cpus != 0 ||
+                                  budget.minLanes != 0) {}
+
+  /// Admit the job if its resources fit the budget, otherwise hold it until
+  /// resources are released.
+  ///
+  /// \param resources On return, the resources of the job, which should be
+  /// passed to \see release() (the job descriptor may no longer be valid once
+  /// the job has finished).
+  /// \returns True if the job was admitted and should be run.
+  bool tryAdmit(const QueueJob& job, JobResources& resources) {
+    resources = job.getDescriptor()->getResources();
+    if (!isTracked(resources))
+      return true;
+
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!admittedWaitingJobs.empty()) {
+      auto it = admittedWaitingJobs.find(job.getDescriptor());
+      if (it != admittedWaitingJobs.end()) {
+        admittedWaitingJobs.erase(it);
+        return true;
+      }
+    }
+    if (!fits(resources)) {
+      park({ job, resources });
+      return false;
+    }
+    admit(resources);
+    return true;
+  }
+
+  /// Release the resources of a completed job.
+  ///
+  /// \param admittedJobs_out On return, the waiting jobs which were admitted
+  /// with the released resources, which should be made ready again.
+  void release(const JobResources& resources,
+               std::vector<QueueJob>& admittedJobs_out) {
+    if (!isTracked(resources))
+      return;
+
+    std::lock_guard<std::mutex> guard(mutex);
+    admittedMemory -= resources.memory;
+    admittedCPUs -= resources.cpus;
+    --numAdmittedJobs;
+    if (resources.pool) {
+      --admittedPoolJobs[resources.pool];
+      admitPoolWaitingJobs(resources.pool, admittedJobs_out);
+    }
+    admitWaitingJobs(admittedJobs_out);
+  }
+
+  /// Change the maximum number of jobs to admit at once.
+  ///
+  /// \param admittedJobs_out On return, the waiting jobs which were admitted
+  /// if the limit grew, which should be made ready again.
+  void setLaneLimit(unsigned limit, std::vector<QueueJob>& admittedJobs_out) {
+    std::lock_guard<std::mutex> guard(mutex);
+    bool grew = laneLimit != 0 && (limit == 0 || limit > laneLimit);
+    laneLimit = limit;
+    if (grew)
+      admitWaitingJobs(admittedJobs_out);
+  }
+
+  /// Check whether any jobs are waiting to be admitted, other than for a slot
+  /// in their pool.
+  bool hasWaitingJobs() {
+    std::lock_guard<std::mutex> guard(mutex);
+    return !waitingJobs.empty();
+  }
+};
+
+/// Compute the number of lanes to use next, when the number of lanes is
+/// elastic (\see ResourceBudget::minLanes).
+///
+/// \param runnableThreads The (smoothed) number of runnable threads on the
+/// system, excluding the sampling thread, or a negative value if unknown.
+/// \param blockedThreads The (smoothed) number of threads blocked on I/O, or
+/// a negative value if unknown.
+unsigned computeElasticLaneLimit(unsigned current, unsigned minLanes,
+                                 unsigned maxLanes, unsigned numCPUs,
+                                 double maxLoad, double loadAverage,
+                                 double runnableThreads, double blockedThreads,
+                                 bool hasWaitingJobs) {
+  // Shrink under contention.
+  bool overloaded = false;
+  if (runnableThreads >= 0 && runnableThreads > numCPUs + 0.5)
+    overloaded = true;
+  if (maxLoad > 0 && loadAverage > maxLoad)
+    overloaded = true;
+  if (overloaded)
+    return current > minLanes ? current - 1 : minLanes;
+
+  // Grow while jobs are waiting, by the number of idle CPUs and of threads
+  // blocked on I/O (which leave their CPU idle).
+  if (!hasWaitingJobs)
+    return current;
+  double spare;
+  if (runnableThreads >= 0) {
+    spare = numCPUs - runnableThreads + std::max(blockedThreads, 0.0);
+  } else if (loadAverage >= 0) {
+    spare = numCPUs - loadAverage;
+  } else {
+    return current;
+  }
+  if (spare < 1)
+    return current;
+  return std::min(maxLanes, current + unsigned(spare));
+}
+
+/// The queue and number of the lane running on the current thread, if any.
+static thread_local const void* currentLaneQueue = nullptr;
+static thread_local unsigned currentLaneNumber = 0;
+
 /// Build execution queue.
 //
 // FIXME: Consider trying to share this with the Ninja implementation.
@@ -82,15 +626,47 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
   /// The number of lanes the queue was configured with.
   unsigned numLanes;
 
-  /// A thread for each lane.
+  /// Whether processes are handed off to the process reactor.
+  ///
+  /// When set, a job's lane is held until its processes complete, but the
+  /// thread which ran the job is free to run other jobs in the meantime, so
+  /// there may be fewer threads than lanes.
+  bool useProcessReactor;
+
+  /// The number of threads running jobs.
+  unsigned numThreads;
+
+  /// The threads running jobs (one for each lane, unless using the process
+  /// reactor).
   std::vector<std::unique_ptr<std::thread>> lanes;
 
+  /// The lanes not in use by any job, when using the process reactor.
+  std::mutex freeLanesMutex;
+  std::condition_variable freeLanesCondition;
+  std::vector<unsigned> freeLanes;
+
   /// The ready queue of jobs to execute.
-  std::unique_ptr<Scheduler> readyJobs;
-  std::mutex readyJobsMutex;
-  std::condition_variable readyJobsCondition;
-  bool cancelled { false };
-  bool shutdown { false };
+  std::unique_ptr<ReadyQueue> readyJobs;
+
+  /// The admission control for jobs.
+  ResourceAdmission admission;
+
+  /// The jobserver, if any.
+  std::unique_ptr<JobServer> jobServer;
+
+  /// The thread adjusting the number of lanes in use to the load on the
+  /// system, when the number of lanes is elastic.
+  std::unique_ptr<std::thread> laneLimitThread;
+  std::mutex laneLimitMutex;
+  std::condition_variable laneLimitCondition;
+  bool laneLimitStopped = false;
+
+  /// The MAKEFLAGS which advertise the jobserver to processes, if any.
+  std::string jobServerMakeFlags;
+
+  /// The CPUs to pin the processes of the lanes to, in turn, if requested.
+  std::vector<int> laneCPUs;
+  std::atomic<bool> cancelled { false };
 
   ProcessGroup spawnedProcesses;
 
@@ -106,20 +682,60 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
   std::atomic<unsigned> backgroundTaskCount{0};
 
 
-  /// The base environment.
-  const char* const* environment;
+  /// The environments of processes, which inherit the base environment.
+  EnvironmentBlockCache environmentBlocks;
+
+  /// Take a free lane, waiting for one if necessary.
+  unsigned acquireLane() {
+    std::unique_lock<std::mutex> lock(freeLanesMutex);
+    while (freeLanes.empty())
+      freeLanesCondition.wait(lock);
+    unsigned laneNumber = freeLanes.back();
+    freeLanes.pop_back();
+    return laneNumber;
+  }
+
+  void releaseLane(unsigned laneNumber) {
+    std::lock_guard<std::mutex> guard(freeLanesMutex);
+    freeLanes.push_back(laneNumber);
+    freeLanesCondition.notify_all();
+  }
+
+  /// Release a job's resources, and make ready the waiting jobs admitted
+  /// with them.
+  void releaseJobResources(const JobResources& resources) {
+    std::vector<QueueJob> admittedJobs;
+    admission.release(resources, admittedJobs);
+    for (auto& admittedJob: admittedJobs) {
+      readyJobs->addJob(admittedJob, -1);
+    }
+  }
+
+  /// Drop a reference to a running job, completing it once all of its
+  /// references are gone.
+  void releaseRunningJob(RunningJob* running) {
+    if (--running->refCount != 0)
+      return;
+
+    getDelegate().queueJobFinished(running->job.getDescriptor());
+    if (running->hasJobToken)
+      jobServer->release();
+    releaseJobResources(running->resources);
+    releaseLane(running->laneNumber);
+    delete running;
+  }
 
-  void executeLane(uint32_t buildID, uint32_t laneNumber) {
+  void executeLane(uint32_t buildID, uint32_t threadNumber) {
     // Set the thread name, if available.
 #if defined(__APPLE__)
     pthread_setname_np(
         (llvm::Twine("org.swift.llbuild Lane-") +
-         llvm::Twine(laneNumber)).str().c_str());
+         llvm::Twine(threadNumber)).str().c_str());
 #elif defined(__linux__)
     pthread_setname_np(
         pthread_self(),
         (llvm::Twine("org.swift.llbuild Lane-") +
-         llvm::Twine(laneNumber)).str().c_str());
+         llvm::Twine(threadNumber)).str().c_str());
 #endif
 
     // Set the QoS class, if available.
@@ -130,36 +746,52 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
     // count is placed in the lower order 16 bits. These are not strictly
     // guaranteed to be unique, but should be close enough for common use cases.
     uint32_t jobCount = 0;
-    uint64_t laneID = (((uint64_t)buildID & 0xFFFF) << 32) + (((uint64_t)laneNumber & 0xFFFF) << 16);
+    uint64_t laneID = (((uint64_t)buildID & 0xFFFF) << 32) + (((uint64_t)threadNumber & 0xFFFF) << 16);
+
+    // Allow jobs added by this lane to be identified.
+    currentLaneQueue = this;
+    currentLaneNumber = threadNumber;
 
     // Execute items from the queue until shutdown.
     while (true) {
       // Take a job from the ready queue.
-      QueueJob job{};
-      uint64_t readyJobsCount;
-      {
-        std::unique_lock<std::mutex> lock(readyJobsMutex);
-
-        // While the queue is empty, wait for an item.
-        while (!shutdown && readyJobs->empty()) {
-          readyJobsCondition.wait(lock);
-        }
-        if (shutdown && readyJobs->empty())
-          return;
-
-        // Take an item according to the chosen policy.
-        job = readyJobs->getNextJob();
-        readyJobsCount = readyJobs->size();
-      }
+      uint64_t readyJobsCount = 0;
+      QueueJob job = readyJobs->takeJob(threadNumber, readyJobsCount);
 
       // If we got an empty job, the queue is shutting down.
       if (!job.getDescriptor())
         break;
 
+      // If the job's resources are not available, it will be made ready again
+      // once another job completes.
+      JobResources resources;
+      if (!admission.tryAdmit(job, resources))
+        continue;
+
+      // When using the process reactor, the job's lane is held until its
+      // processes complete, independently of this thread.
+      unsigned laneNumber = threadNumber;
+      RunningJob* running = nullptr;
+      if (useProcessReactor)
+        laneNumber = acquireLane();
+
+      // Take a jobserver token for as long as the job holds its lane. This
+      // includes any processes it runs, unless they release the lane (using
+      // the control protocol), in which case they no longer count against the
+      // jobserver either.
+      //
+      // Once the queue is cancelled, jobs run without a token (they no longer
+      // launch processes).
+      bool hasJobToken = jobServer && jobServer->acquire();
+
+      if (useProcessReactor)
+        running = new RunningJob(job, resources, laneNumber, hasJobToken);
+
       // Process the job.
       jobCount++;
       uint64_t jobID = laneID + jobCount;
-      LaneBasedExecutionQueueJobContext context{ jobID, laneNumber, job };
+      LaneBasedExecutionQueueJobContext context{ jobID, laneNumber, job,
+                                                 running };
       {
         TracingExecutionQueueDepth(readyJobsCount);
 
@@ -167,10 +799,63 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
         job.getDescriptor()->getShortDescription(description);
         TracingExecutionQueueJob t(context.laneNumber, description.str());
 
+        LLBUILD_PROBE2(job_started, jobID, context.laneNumber);
         getDelegate().queueJobStarted(job.getDescriptor());
         job.execute(reinterpret_cast<QueueJobContext*>(&context));
-        getDelegate().queueJobFinished(job.getDescriptor());
+        if (!running)
+          getDelegate().queueJobFinished(job.getDescriptor());
+        LLBUILD_PROBE2(job_finished, jobID, context.laneNumber);
       }
+
+      if (running) {
+        releaseRunningJob(running);
+      } else {
+        if (hasJobToken)
+          jobServer->release();
+        releaseJobResources(resources);
+      }
+    }
+  }
+
+  void adjustLaneLimit(ResourceBudget budget, unsigned limit) {
+    unsigned numCPUs = std::max(std::thread::hardware_concurrency(), 1u);
+    auto sampleLoad = [&budget](sys::SystemLoad& load) {
+      if (!budget.sampleLoad)
+        return sys::getSystemLoad(load);
+      return budget.sampleLoad(load.loadAverage, load.runnableThreads,
+                               load.blockedThreads);
+    };
+    std::vector<QueueJob> admittedJobs;
+
+    // Sample the load every 250ms, smoothing out the instantaneous counts.
+    double runnableThreads = -1, blockedThreads = -1;
+    std::unique_lock<std::mutex> lock(laneLimitMutex);
+    while (!laneLimitCondition.wait_for(lock, std::chrono::milliseconds(250),
+                                        [this] { return laneLimitStopped; })) {
+      sys::SystemLoad load;
+      if (!sampleLoad(load))
+        continue;
+      auto smooth = [](double average, int sample) {
+        if (sample < 0)
+          return -1.0;
+        return average < 0 ? sample : (average + sample) / 2;
+      };
+      // The runnable threads include this one.
+      runnableThreads = smooth(runnableThreads, load.runnableThreads - 1);
+      blockedThreads = smooth(blockedThreads, load.blockedThreads);
+
+      unsigned newLimit = computeElasticLaneLimit(
+          limit, budget.minLanes, numLanes, numCPUs, budget.maxLoad,
+          load.loadAverage, runnableThreads, blockedThreads,
+          admission.hasWaitingJobs());
+      if (newLimit == limit)
+        continue;
+      limit = newLimit;
+      admission.setLaneLimit(limit, admittedJobs);
+      for (auto& admittedJob: admittedJobs) {
+        readyJobs->addJob(admittedJob, -1);
+      }
+      admittedJobs.clear();
     }
   }
 
@@ -196,10 +881,47 @@ class LaneBasedExecutionQueue : public ExecutionQueue {
 public:
   LaneBasedExecutionQueue(ExecutionQueueDelegate& delegate,
                           unsigned numLanes, SchedulerAlgorithm alg,
-                          const char* const* environment)
+                          const char* const* environment,
+                          LaneBasedExecutionQueueOptions options)
   : ExecutionQueue(delegate), buildID(std::random_device()()), numLanes(numLanes),
-        readyJobs(Scheduler::make(alg)), environment(environment)
+        useProcessReactor(options.useProcessReactor &&
+                          isProcessReactorSupported()),
+        numThreads(numLanes), admission(options.budget),
+        jobServer(std::move(options.jobServer)),
+        environmentBlocks(environment)
   {
+    const ResourceBudget& budget = options.budget;
+    // Advertise a jobserver we own to processes, appending to any MAKEFLAGS
+    // they inherit (the last jobserver argument takes precedence). Processes
+    // only share its descriptors when launched directly, and Darwin closes
+    // all descriptors which are not explicitly inherited.
+#if !defined(__APPLE__)
+    if (this->jobServer && !this->jobServer->getMakeFlags().empty() &&
+        !isSpawnServerRunning()) {
+      for (auto envp = environment; *envp; ++envp) {
+        StringRef entry(*envp);
+        if (entry.consume_front("MAKEFLAGS="))
+          jobServerMakeFlags = entry.str() + " ";
+      }
+      jobServerMakeFlags += this->jobServer->getMakeFlags();
+    }
+#endif
+
+    // With the process reactor, threads are only busy while jobs do their own
+    // work, so there is no need for more of them than CPUs.
+    if (this->useProcessReactor) {
+      unsigned numCPUs = std::max(std::thread::hardware_concurrency(), 4u);
+      numThreads = std::min(numLanes, numCPUs);
+      for (unsigned i = numLanes; i != 0; --i)
+        freeLanes.push_back(i - 1);
+    }
+
+    if (options.workStealing && numThreads > 1) {
+      readyJobs = llvm::make_unique<WorkStealingReadyQueue>(alg, numThreads);
+    } else {
+      readyJobs = llvm::make_unique<SharedReadyQueue>(alg);
+    }
+
     // Configure the background task maximum. We currently support an
     // environmental override for experimentation pursposes, but otherwise limit
     // to a small multiple of the core count, since we currently burn one thread
@@ -211,7 +933,29 @@ public:
       backgroundTaskMax = numLanes * 16;
     }
             
-    for (unsigned i = 0; i != numLanes; ++i) {
+    // Find the CPUs to pin lanes to, if requested.
+#if defined(__linux__)
+    cpu_set_t cpus;
+    if (options.pinLanes && sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+      for (int cpu = 0; cpu != CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &cpus))
+          laneCPUs.push_back(cpu);
+      }
+    }
+#endif
+
+    // Float the number of lanes in use with the load, if requested, starting
+    // from one for each CPU.
+    if (budget.minLanes != 0 && budget.minLanes < numLanes) {
+      unsigned numCPUs = std::max(std::thread::hardware_concurrency(), 1u);
+      unsigned limit = std::max(budget.minLanes, std::min(numCPUs, numLanes));
+      std::vector<QueueJob> admittedJobs;
+      admission.setLaneLimit(limit, admittedJobs);
+      laneLimitThread = llvm::make_unique<std::thread>(
+          &LaneBasedExecutionQueue::adjustLaneLimit, this, budget, limit);
+    }
+
+    for (unsigned i = 0; i != numThreads; ++i) {
       lanes.push_back(std::unique_ptr<std::thread>(
                           new std::thread(
                               &LaneBasedExecutionQueue::executeLane, this, buildID, i)));
@@ -219,14 +963,28 @@ public:
   }
 
   virtual ~LaneBasedExecutionQueue() {
-    // Shut down the lanes.
-    {
-      std::unique_lock<std::mutex> lock(readyJobsMutex);
-      shutdown = true;
-      readyJobsCondition.notify_all();
+    // Stop adjusting the number of lanes in use (jobs which are waiting still
+    // run as the running jobs complete).
+    if (laneLimitThread) {
+      {
+        std::lock_guard<std::mutex> guard(laneLimitMutex);
+        laneLimitStopped = true;
+        laneLimitCondition.notify_all();
+      }
+      laneLimitThread->join();
     }
 
-    for (unsigned i = 0; i != numLanes; ++i) {
+    // Wait for the jobs whose processes are still running.
+    if (useProcessReactor) {
+      std::unique_lock<std::mutex> lock(freeLanesMutex);
+      while (freeLanes.size() != numLanes)
+        freeLanesCondition.wait(lock);
+    }
+
+    // Shut down the lanes.
+    readyJobs->shutdown();
+
+    for (unsigned i = 0; i != numThreads; ++i) {
       lanes[i]->join();
     }
 
@@ -244,26 +1002,24 @@ public:
   }
 
   virtual void addJob(QueueJob job) override {
-    uint64_t readyJobsCount;
-    {
-      std::lock_guard<std::mutex> guard(readyJobsMutex);
-      readyJobs->addJob(job);
-      readyJobsCondition.notify_one();
-      readyJobsCount = readyJobs->size();
-    }
+    int fromLane = currentLaneQueue == this ? int(currentLaneNumber) : -1;
+    uint64_t readyJobsCount = readyJobs->addJob(job, fromLane);
+    LLBUILD_PROBE2(job_queued, readyJobsCount, fromLane);
     TracingExecutionQueueDepth(readyJobsCount);
   }
 
   virtual void cancelAllJobs() override {
     {
-      std::lock_guard<std::mutex> lock(readyJobsMutex);
       std::lock_guard<std::mutex> guard(spawnedProcesses.mutex);
       if (cancelled) return;
       cancelled = true;
       spawnedProcesses.close();
-      readyJobsCondition.notify_all();
     }
 
+    // Wake the lanes waiting for jobserver tokens.
+    if (jobServer)
+      jobServer->cancel();
+
     spawnedProcesses.signalAll(SIGINT);
     {
       std::lock_guard<std::mutex> guard(killAfterTimeoutThreadMutex);
@@ -287,14 +1043,11 @@ public:
     context.job.getDescriptor()->getShortDescription(description);
     TracingExecutionQueueSubprocessStart(context.laneNumber, description.str());
 
-    {
-      std::unique_lock<std::mutex> lock(readyJobsMutex);
-      // Do not execute new processes anymore after cancellation.
-      if (cancelled) {
-        if (completionFn.hasValue())
-          completionFn.getValue()(ProcessResult::makeCancelled());
-        return;
-      }
+    // Do not execute new processes anymore after cancellation.
+    if (cancelled) {
+      if (completionFn.hasValue())
+        completionFn.getValue()(ProcessResult::makeCancelled());
+      return;
     }
 
     // Form the complete environment.
@@ -307,21 +1060,24 @@ public:
     posixEnv.setIfMissing("LLBUILD_BUILD_ID", Twine(buildID).str());
     posixEnv.setIfMissing("LLBUILD_LANE_ID", Twine(context.laneNumber).str());
 
-    // Add the requested environment.
-    for (const auto& entry: environment) {
-      posixEnv.setIfMissing(entry.first, entry.second);
+    // Share the jobserver, if we own one, unless the process was given its
+    // own MAKEFLAGS.
+    if (!jobServerMakeFlags.empty() &&
+        std::none_of(environment.begin(), environment.end(),
+                     [](const std::pair<StringRef, StringRef>& entry) {
+                       return entry.first == "MAKEFLAGS";
+                     })) {
+      posixEnv.setIfMissing("MAKEFLAGS", jobServerMakeFlags);
     }
 
-    // Inherit the base environment, if desired.
-    //
-    // FIXME: This involves a lot of redundant allocation, currently. We could
-    // cache this for the common case of a directly inherited environment.
-    if (inheritEnvironment) {
-      for (const char* const* p = this->environment; *p != nullptr; ++p) {
-        auto pair = StringRef(*p).split('=');
-        posixEnv.setIfMissing(pair.first, pair.second);
-      }
-    }
+    // Add the requested environment, and inherit the base environment if
+    // desired. Most processes share the same environment, so these are built
+    // once and shared.
+    posixEnv.addBlock(environmentBlocks.get(environment, inheritEnvironment));
+
+    // Pin the process to the lane's CPU, if requested.
+    if (!laneCPUs.empty())
+      attributes.cpu = laneCPUs[context.laneNumber % laneCPUs.size()];
 
     // Assign a process handle, which just needs to be unique for as long as we
     // are communicating with the delegate.
@@ -354,11 +1110,36 @@ public:
       [completionFn, lane=context.laneNumber](ProcessResult result) mutable {
         TracingExecutionQueueSubprocessResult(lane, result.pid, result.utime,
                                               result.stime, result.maxrss);
+        LLBUILD_PROBE3(process_exited, lane, result.pid, result.exitCode);
         if (completionFn.hasValue())
           completionFn.getValue()(result);
       }
     };
 
+    if (RunningJob* running = context.running) {
+      // Hold the job's lane until the process completes, or asks to release
+      // it.
+      ++running->refCount;
+      auto released = std::make_shared<bool>(false);
+      std::function<void()> reactorReleaseFn = [this, running, released]() {
+        *released = true;
+        releaseRunningJob(running);
+      };
+      ProcessCompletionFn reactorCompletionFn{
+        [this, running, released, laneCompletionFn](ProcessResult result) {
+          laneCompletionFn(result);
+          if (!*released)
+            releaseRunningJob(running);
+        }
+      };
+      spawnProcessAsync(
+          getDelegate(),
+          reinterpret_cast<ProcessContext*>(context.job.getDescriptor()),
+          spawnedProcesses, handle, commandLine, posixEnv, attributes,
+          std::move(reactorReleaseFn), std::move(reactorCompletionFn));
+      return;
+    }
+
     spawnProcess(
         getDelegate(),
         reinterpret_cast<ProcessContext*>(context.job.getDescriptor()),
@@ -443,11 +1224,12 @@ extern "C" {
 
 ExecutionQueue* llbuild::basic::createLaneBasedExecutionQueue(
     ExecutionQueueDelegate& delegate, int numLanes, SchedulerAlgorithm alg,
-    const char* const* environment
+    const char* const* environment, LaneBasedExecutionQueueOptions options
 ) {
   if (!environment) {
     environment = const_cast<const char* const*>(environ);
   }
-  return new LaneBasedExecutionQueue(delegate, numLanes, alg, environment);
+  return new LaneBasedExecutionQueue(delegate, numLanes, alg, environment,
+                                     std::move(options));
 }
 
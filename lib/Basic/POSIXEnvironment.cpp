@@ -0,0 +1,79 @@
+//===-- POSIXEnvironment.cpp ----------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/POSIXEnvironment.h"
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+EnvironmentBlock::EnvironmentBlock(
+    ArrayRef<std::pair<StringRef, StringRef>> assignments,
+    const char* const* base) {
+  auto add = [&](StringRef key, StringRef value) {
+    if (!keyIndices.insert(std::make_pair(key, storage.size())).second)
+      return;
+    std::string assignment;
+    assignment.reserve(key.size() + value.size() + 1);
+    assignment += key;
+    assignment += '=';
+    assignment += value;
+    storage.emplace_back(std::move(assignment));
+  };
+  for (const auto& entry: assignments) {
+    add(entry.first, entry.second);
+  }
+  if (base) {
+    for (const char* const* p = base; *p != nullptr; ++p) {
+      auto pair = StringRef(*p).split('=');
+      add(pair.first, pair.second);
+    }
+  }
+
+  // Only take pointers to the strings once they are in their final location.
+  this->assignments.reserve(storage.size());
+  for (const auto& assignment: storage) {
+    this->assignments.push_back(assignment.c_str());
+  }
+}
+
+std::shared_ptr<const EnvironmentBlock>
+EnvironmentBlockCache::get(ArrayRef<std::pair<StringRef, StringRef>> assignments,
+                           bool inheritBase) {
+  // The most blocks to cache; there are normally only a handful of distinct
+  // environments, so this only guards against pathological cases.
+  const unsigned maxBlocks = 1024;
+
+  llvm::SmallString<256> key;
+  key += inheritBase ? '1' : '0';
+  for (const auto& entry: assignments) {
+    key += entry.first;
+    key += '\0';
+    key += entry.second;
+    key += '\0';
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(blocksMutex);
+    auto it = blocks.find(key);
+    if (it != blocks.end())
+      return it->second;
+  }
+
+  // Build the block outside the lock; if we race with another thread, the
+  // first block to be inserted wins.
+  auto block = std::make_shared<const EnvironmentBlock>(
+      assignments, inheritBase ? base : nullptr);
+  std::lock_guard<std::mutex> guard(blocksMutex);
+  if (blocks.size() >= maxBlocks)
+    blocks.clear();
+  return blocks.insert(std::make_pair(key, std::move(block))).first->second;
+}
@@ -21,6 +21,7 @@
 #include <time.h>
 #else
 #include <fnmatch.h>
+#include <stdlib.h>
 #include <unistd.h>
 #if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
 #include <dlfcn.h>
@@ -259,6 +260,56 @@ sys::MATCH_RESULT sys::filenameMatch(const std::string& pattern,
 #endif
 }
 
+uint64_t sys::getAvailableMemory() {
+#if defined(__linux__)
+  FILE* fp = ::fopen("/proc/meminfo", "r");
+  if (!fp)
+    return 0;
+  char line[256];
+  unsigned long long availableKB = 0;
+  while (::fgets(line, sizeof(line), fp)) {
+    if (::sscanf(line, "MemAvailable: %llu kB", &availableKB) == 1)
+      break;
+  }
+  ::fclose(fp);
+  return uint64_t(availableKB) * 1024;
+#else
+  return 0;
+#endif
+}
+
+bool sys::getSystemLoad(SystemLoad& load_out) {
+  load_out = SystemLoad();
+#if defined(__linux__)
+  // The load average is followed by the number of runnable threads.
+  FILE* fp = ::fopen("/proc/loadavg", "r");
+  if (!fp)
+    return false;
+  int runnable;
+  if (::fscanf(fp, "%lf %*f %*f %d", &load_out.loadAverage, &runnable) == 2)
+    load_out.runnableThreads = runnable;
+  ::fclose(fp);
+
+  fp = ::fopen("/proc/stat", "r");
+  if (fp) {
+    char line[256];
+    int blocked;
+    while (::fgets(line, sizeof(line), fp)) {
+      if (::sscanf(line, "procs_blocked %d", &blocked) == 1) {
+        load_out.blockedThreads = blocked;
+        break;
+      }
+    }
+    ::fclose(fp);
+  }
+  return load_out.loadAverage >= 0;
+#elif !defined(_WIN32)
+  return ::getloadavg(&load_out.loadAverage, 1) == 1;
+#else
+  return false;
+#endif
+}
+
 void sys::sleep(int seconds) {
 #if defined(_WIN32)
   // Uses milliseconds
@@ -0,0 +1,835 @@
+//===-- RemoteExecution.cpp -----------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/RemoteExecution.h"
+
+#include "llbuild/Basic/POSIXEnvironment.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+#include <signal.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+#pragma mark - Message Coding
+
+template<typename T>
+static void writeList(BinaryEncoder& coder, const std::vector<T>& values) {
+  coder.write(uint32_t(values.size()));
+  for (const auto& value: values) {
+    coder.write(value);
+  }
+}
+
+template<typename T>
+static void readList(BinaryDecoder& coder, std::vector<T>& values) {
+  uint32_t count;
+  coder.read(count);
+
+  // Every value takes at least a byte, so don't trust a count (which came
+  // from the network) beyond what is left of the message.
+  if (!coder.canRead(count)) {
+    values.clear();
+    return;
+  }
+  values.resize(count);
+  for (auto& value: values) {
+    coder.read(value);
+  }
+}
+
+namespace llbuild {
+namespace basic {
+
+template<>
+struct BinaryCodingTraits<std::pair<std::string, std::string>> {
+  static void encode(const std::pair<std::string, std::string>& value,
+                     BinaryEncoder& coder) {
+    coder.write(value.first);
+    coder.write(value.second);
+  }
+  static void decode(std::pair<std::string, std::string>& value,
+                     BinaryDecoder& coder) {
+    coder.read(value.first);
+    coder.read(value.second);
+  }
+};
+
+template<>
+struct BinaryCodingTraits<RemoteOutputFile> {
+  static void encode(const RemoteOutputFile& value, BinaryEncoder& coder) {
+    coder.write(value.path);
+    coder.write(value.mode);
+    coder.write(value.contents);
+  }
+  static void decode(RemoteOutputFile& value, BinaryDecoder& coder) {
+    coder.read(value.path);
+    coder.read(value.mode);
+    coder.read(value.contents);
+  }
+};
+
+}
+}
+
+void BinaryCodingTraits<RemoteHelloReply>::encode(
+    const RemoteHelloReply& value, BinaryEncoder& coder) {
+  coder.write(value.version);
+  coder.write(value.numSlots);
+  coder.write(value.sharedFileSystem);
+}
+
+void BinaryCodingTraits<RemoteHelloReply>::decode(
+    RemoteHelloReply& value, BinaryDecoder& coder) {
+  coder.read(value.version);
+  coder.read(value.numSlots);
+  coder.read(value.sharedFileSystem);
+}
+
+void BinaryCodingTraits<RemoteExecuteRequest>::encode(
+    const RemoteExecuteRequest& value, BinaryEncoder& coder) {
+  writeList(coder, value.commandLine);
+  writeList(coder, value.environment);
+  coder.write(value.workingDir);
+  coder.write(value.canSafelyInterrupt);
+  writeList(coder, value.inputs);
+  writeList(coder, value.outputs);
+}
+
+void BinaryCodingTraits<RemoteExecuteRequest>::decode(
+    RemoteExecuteRequest& value, BinaryDecoder& coder) {
+  readList(coder, value.commandLine);
+  readList(coder, value.environment);
+  coder.read(value.workingDir);
+  coder.read(value.canSafelyInterrupt);
+  readList(coder, value.inputs);
+  readList(coder, value.outputs);
+}
+
+void BinaryCodingTraits<RemoteExecuteResult>::encode(
+    const RemoteExecuteResult& value, BinaryEncoder& coder) {
+  coder.write(uint8_t(value.status));
+  coder.write(uint32_t(value.exitCode));
+  coder.write(value.pid);
+  coder.write(value.utime);
+  coder.write(value.stime);
+  coder.write(value.maxrss);
+  writeList(coder, value.outputs);
+}
+
+void BinaryCodingTraits<RemoteExecuteResult>::decode(
+    RemoteExecuteResult& value, BinaryDecoder& coder) {
+  uint8_t status;
+  coder.read(status);
+  value.status = ProcessStatus(status);
+  uint32_t exitCode;
+  coder.read(exitCode);
+  value.exitCode = int32_t(exitCode);
+  coder.read(value.pid);
+  coder.read(value.utime);
+  coder.read(value.stime);
+  coder.read(value.maxrss);
+  readList(coder, value.outputs);
+}
+
+bool llbuild::basic::computeRemoteInputDigest(StringRef path,
+                                              std::string& digest_out) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer)
+    return false;
+
+  llvm::MD5 hash;
+  hash.update(buffer.get()->getBuffer());
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  digest_out = result.digest().str();
+  return true;
+}
+
+#pragma mark - RemoteConnection
+
+#if !defined(_WIN32)
+
+/// The maximum accepted message size, as a sanity check on the stream.
+static const uint32_t maxMessageSize = 1u << 30;
+
+static void setCloseOnExec(int fd) {
+  (void) ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+static void setNoSigPipe(int fd) {
+#if defined(SO_NOSIGPIPE)
+  int one = 1;
+  (void) ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#else
+  (void) fd;
+#endif
+}
+
+/// Parse a socket address.
+///
+/// \returns True if the address names a Unix domain socket (with the path in
+/// \arg path_out), or false for a TCP address.
+static bool parseAddress(StringRef address, std::string& path_out,
+                         std::string& host_out, std::string& port_out) {
+  if (address.startswith("unix:")) {
+    path_out = address.drop_front(5);
+    return true;
+  }
+  if (address.find('/') != StringRef::npos) {
+    path_out = address;
+    return true;
+  }
+  auto pos = address.rfind(':');
+  if (pos == StringRef::npos) {
+    host_out = "localhost";
+    port_out = address;
+  } else {
+    host_out = address.substr(0, pos);
+    port_out = address.substr(pos + 1);
+  }
+  if (host_out.empty())
+    host_out = "localhost";
+  return false;
+}
+
+static bool makeUnixAddress(StringRef path, sockaddr_un& addr,
+                            std::string* error_out) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    *error_out = "socket path too long: '" + path.str() + "'";
+    return false;
+  }
+  memcpy(addr.sun_path, path.data(), path.size());
+  return true;
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+  while (size != 0) {
+#if defined(MSG_NOSIGNAL)
+    ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+#else
+    ssize_t n = ::send(fd, data, size, 0);
+#endif
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool readAll(int fd, char* data, size_t size) {
+  while (size != 0) {
+    ssize_t n = ::read(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (n == 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+RemoteConnection::~RemoteConnection() {
+  ::close(fd);
+}
+
+std::unique_ptr<RemoteConnection>
+RemoteConnection::connect(StringRef address, std::string* error_out) {
+  std::string path, host, port;
+  if (parseAddress(address, path, host, port)) {
+    sockaddr_un addr;
+    if (!makeUnixAddress(path, addr, error_out))
+      return nullptr;
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      *error_out = std::string("unable to create socket: ") + strerror(errno);
+      return nullptr;
+    }
+    setCloseOnExec(fd);
+    setNoSigPipe(fd);
+    if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+      *error_out = "unable to connect to '" + path + "': " + strerror(errno);
+      ::close(fd);
+      return nullptr;
+    }
+    return llvm::make_unique<RemoteConnection>(fd);
+  }
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addrs = nullptr;
+  if (int err = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs)) {
+    *error_out = "unable to resolve '" + address.str() + "': " +
+      gai_strerror(err);
+    return nullptr;
+  }
+
+  int fd = -1;
+  int lastErrno = 0;
+  for (auto* ai = addrs; ai; ai = ai->ai_next) {
+    fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      lastErrno = errno;
+      continue;
+    }
+    if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+    lastErrno = errno;
+    ::close(fd);
+    fd = -1;
+  }
+  ::freeaddrinfo(addrs);
+  if (fd < 0) {
+    *error_out = "unable to connect to '" + address.str() + "': " +
+      strerror(lastErrno);
+    return nullptr;
+  }
+
+  setCloseOnExec(fd);
+  setNoSigPipe(fd);
+  int one = 1;
+  (void) ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return llvm::make_unique<RemoteConnection>(fd);
+}
+
+bool RemoteConnection::send(RemoteMessageKind kind, StringRef payload) {
+  if (payload.size() > maxMessageSize)
+    return false;
+
+  char header[5];
+  uint32_t size = uint32_t(payload.size());
+  for (unsigned i = 0; i != 4; ++i) {
+    header[i] = char((size >> (8 * i)) & 0xFF);
+  }
+  header[4] = char(kind);
+
+  std::lock_guard<std::mutex> guard(sendMutex);
+  return writeAll(fd, header, sizeof(header)) &&
+    writeAll(fd, payload.data(), payload.size());
+}
+
+bool RemoteConnection::receive(RemoteMessageKind& kind_out,
+                               std::string& payload_out) {
+  unsigned char header[5];
+  if (!readAll(fd, (char*)header, sizeof(header)))
+    return false;
+
+  uint32_t size = 0;
+  for (unsigned i = 0; i != 4; ++i) {
+    size |= uint32_t(header[i]) << (8 * i);
+  }
+  if (size > maxMessageSize)
+    return false;
+
+  kind_out = RemoteMessageKind(header[4]);
+  payload_out.resize(size);
+  return readAll(fd, &payload_out[0], size);
+}
+
+void RemoteConnection::shutdown() {
+  (void) ::shutdown(fd, SHUT_RDWR);
+}
+
+#else // defined(_WIN32)
+
+RemoteConnection::~RemoteConnection() {}
+
+std::unique_ptr<RemoteConnection>
+RemoteConnection::connect(StringRef address, std::string* error_out) {
+  *error_out = "remote execution is not supported on this platform";
+  return nullptr;
+}
+
+bool RemoteConnection::send(RemoteMessageKind, StringRef) { return false; }
+
+bool RemoteConnection::receive(RemoteMessageKind&, std::string&) {
+  return false;
+}
+
+void RemoteConnection::shutdown() {}
+
+#endif
+
+#pragma mark - RemoteExecutionWorker
+
+namespace {
+
+#if !defined(_WIN32)
+
+/// Forwards the process status of a worker connection to its client.
+class WorkerProcessDelegate : public ProcessDelegate {
+  RemoteConnection& connection;
+
+public:
+  WorkerProcessDelegate(RemoteConnection& connection)
+      : connection(connection) {}
+
+  virtual void processStarted(ProcessContext*, ProcessHandle) override {}
+
+  virtual void processHadError(ProcessContext*, ProcessHandle,
+                               const Twine& message) override {
+    (void) connection.sendValue(RemoteMessageKind::Error, message.str());
+  }
+
+  virtual void processHadOutput(ProcessContext*, ProcessHandle,
+                                StringRef data) override {
+    (void) connection.sendValue(RemoteMessageKind::Output, data.str());
+  }
+
+  virtual void processFinished(ProcessContext*, ProcessHandle,
+                               const ProcessResult&) override {}
+};
+
+class RemoteExecutionWorkerImpl {
+  /// The number of concurrent processes.
+  unsigned numSlots;
+
+  /// Whether we share the client file system.
+  bool sharedFileSystem;
+
+  /// The listening socket.
+  int listenFD = -1;
+
+  /// The path of the Unix domain socket we created, if any.
+  std::string socketPath;
+
+  /// Pipe used to wake up the accept loop on shutdown.
+  int wakeFDs[2] = { -1, -1 };
+
+  /// The available slots.
+  unsigned numFreeSlots;
+  std::mutex slotsMutex;
+  std::condition_variable slotsCondition;
+
+  /// The active connections, and their threads.
+  struct ConnectionState {
+    std::unique_ptr<RemoteConnection> connection;
+    ProcessGroup processes;
+    std::thread thread;
+
+    /// Whether the connection has been handled, and its thread can be
+    /// joined.
+    std::atomic<bool> isFinished{ false };
+  };
+  std::vector<std::unique_ptr<ConnectionState>> connections;
+  std::mutex connectionsMutex;
+  bool isShutdown = false;
+
+  bool acquireSlot() {
+    std::unique_lock<std::mutex> lock(slotsMutex);
+    while (numFreeSlots == 0 && !isShutdown) {
+      slotsCondition.wait(lock);
+    }
+    if (isShutdown)
+      return false;
+    --numFreeSlots;
+    return true;
+  }
+
+  void releaseSlot() {
+    std::lock_guard<std::mutex> guard(slotsMutex);
+    ++numFreeSlots;
+    slotsCondition.notify_one();
+  }
+
+  void execute(ConnectionState& state, const RemoteExecuteRequest& request) {
+    auto& connection = *state.connection;
+    RemoteExecuteResult result;
+
+    if (!acquireSlot()) {
+      result.status = ProcessStatus::Cancelled;
+      (void) connection.sendValue(RemoteMessageKind::Result, result);
+      return;
+    }
+
+    // Verify we are seeing the same inputs as the client.
+    for (const auto& input: request.inputs) {
+      std::string digest;
+      if (!computeRemoteInputDigest(input.first, digest) ||
+          digest != input.second) {
+        (void) connection.sendValue(
+            RemoteMessageKind::Error,
+            "input '" + input.first + "' does not match the client's contents");
+        (void) connection.sendValue(RemoteMessageKind::Result, result);
+        releaseSlot();
+        return;
+      }
+    }
+
+    POSIXEnvironment environment;
+    for (const auto& entry: request.environment) {
+      auto assignment = StringRef(entry).split('=');
+      environment.setIfMissing(assignment.first, assignment.second);
+    }
+    std::vector<StringRef> commandLine(request.commandLine.begin(),
+                                       request.commandLine.end());
+
+    WorkerProcessDelegate delegate(connection);
+    ProcessResult processResult = ProcessResult::makeFailed();
+    spawnProcess(
+        delegate, /*ctx=*/nullptr, state.processes, ProcessHandle{ 0 },
+        commandLine, environment,
+        { request.canSafelyInterrupt, request.workingDir,
+          /*controlEnabled=*/false },
+        /*releaseFn=*/[](std::function<void()>&& processWait) {
+          processWait();
+        },
+        /*completionFn=*/[&processResult](ProcessResult value) {
+          processResult = value;
+        });
+    releaseSlot();
+
+    result.status = processResult.status;
+    result.exitCode = processResult.exitCode;
+    result.pid = uint64_t(processResult.pid);
+    result.utime = processResult.utime;
+    result.stime = processResult.stime;
+    result.maxrss = processResult.maxrss;
+
+    // Return the outputs, if the client can't see them.
+    if (!sharedFileSystem && result.status == ProcessStatus::Succeeded) {
+      for (const auto& path: request.outputs) {
+        llvm::sys::fs::file_status status;
+        auto buffer = llvm::MemoryBuffer::getFile(path);
+        if (!buffer || llvm::sys::fs::status(path, status))
+          continue;
+        RemoteOutputFile output;
+        output.path = path;
+        output.mode = uint32_t(status.permissions());
+        output.contents = buffer.get()->getBuffer();
+        result.outputs.push_back(std::move(output));
+      }
+    }
+
+    (void) connection.sendValue(RemoteMessageKind::Result, result);
+  }
+
+  void handleConnection(ConnectionState& state) {
+    auto& connection = *state.connection;
+    RemoteMessageKind kind;
+    std::string payload;
+
+    // Perform the handshake.
+    if (!connection.receive(kind, payload) ||
+        kind != RemoteMessageKind::Hello || payload.size() != 4)
+      return;
+    uint32_t version;
+    if (!decodeRemoteValue(payload, version))
+      return;
+    RemoteHelloReply reply;
+    reply.numSlots = numSlots;
+    reply.sharedFileSystem = sharedFileSystem;
+    if (!connection.sendValue(RemoteMessageKind::HelloReply, reply) ||
+        version != RemoteExecutionProtocolVersion)
+      return;
+
+    // Process requests; the requests themselves are executed on separate
+    // threads, so that we can continue to receive cancellation requests (and
+    // further requests) while they run.
+    struct RequestState {
+      std::thread thread;
+      std::atomic<bool> isFinished{ false };
+    };
+    std::vector<std::unique_ptr<RequestState>> requests;
+    while (connection.receive(kind, payload)) {
+      if (kind == RemoteMessageKind::Execute) {
+        // Reap the requests which have completed.
+        requests.erase(
+            std::remove_if(requests.begin(), requests.end(),
+                           [](const std::unique_ptr<RequestState>& request) {
+              if (!request->isFinished)
+                return false;
+              request->thread.join();
+              return true;
+            }), requests.end());
+
+        // A malformed request is a protocol error, which ends the connection.
+        RemoteExecuteRequest request;
+        if (!decodeRemoteValue(payload, request))
+          break;
+        requests.emplace_back(new RequestState);
+        auto& requestState = *requests.back();
+        requestState.thread = std::thread(
+            [this, &state, &requestState, request=std::move(request)]() {
+              execute(state, request);
+              requestState.isFinished = true;
+            });
+      } else if (kind == RemoteMessageKind::Cancel) {
+        state.processes.signalAll(SIGINT);
+      } else {
+        break;
+      }
+    }
+
+    // The client went away, kill anything it left running.
+    state.processes.signalAll(SIGKILL);
+    for (auto& request: requests)
+      request->thread.join();
+  }
+
+public:
+  RemoteExecutionWorkerImpl(unsigned numSlots, bool sharedFileSystem)
+      : numSlots(numSlots), sharedFileSystem(sharedFileSystem),
+        numFreeSlots(numSlots) {}
+
+  ~RemoteExecutionWorkerImpl() {
+    shutdown();
+
+    for (auto& state: connections) {
+      if (state->thread.joinable())
+        state->thread.join();
+    }
+    if (listenFD >= 0)
+      ::close(listenFD);
+    if (!socketPath.empty())
+      ::unlink(socketPath.c_str());
+    for (int fd: wakeFDs) {
+      if (fd >= 0)
+        ::close(fd);
+    }
+  }
+
+  bool listen(StringRef address, std::string* error_out,
+              std::string* boundAddress_out) {
+    if (::pipe(wakeFDs) < 0) {
+      *error_out = std::string("unable to create pipe: ") + strerror(errno);
+      return false;
+    }
+    setCloseOnExec(wakeFDs[0]);
+    setCloseOnExec(wakeFDs[1]);
+
+    std::string path, host, port;
+    if (parseAddress(address, path, host, port)) {
+      sockaddr_un addr;
+      if (!makeUnixAddress(path, addr, error_out))
+        return false;
+
+      listenFD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      if (listenFD < 0) {
+        *error_out = std::string("unable to create socket: ") +
+          strerror(errno);
+        return false;
+      }
+      setCloseOnExec(listenFD);
+
+      // Remove any stale socket.
+      ::unlink(path.c_str());
+      if (::bind(listenFD, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        *error_out = "unable to bind '" + path + "': " + strerror(errno);
+        return false;
+      }
+      socketPath = path;
+      if (boundAddress_out)
+        *boundAddress_out = path;
+    } else {
+      addrinfo hints;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      hints.ai_flags = AI_PASSIVE;
+      addrinfo* addrs = nullptr;
+      if (int err = ::getaddrinfo(host.c_str(), port.c_str(), &hints,
+                                  &addrs)) {
+        *error_out = "unable to resolve '" + address.str() + "': " +
+          gai_strerror(err);
+        return false;
+      }
+      int lastErrno = 0;
+      for (auto* ai = addrs; ai; ai = ai->ai_next) {
+        listenFD = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (listenFD < 0) {
+          lastErrno = errno;
+          continue;
+        }
+        int one = 1;
+        (void) ::setsockopt(listenFD, SOL_SOCKET, SO_REUSEADDR, &one,
+                            sizeof(one));
+        if (::bind(listenFD, ai->ai_addr, ai->ai_addrlen) == 0)
+          break;
+        lastErrno = errno;
+        ::close(listenFD);
+        listenFD = -1;
+      }
+      ::freeaddrinfo(addrs);
+      if (listenFD < 0) {
+        *error_out = "unable to bind '" + address.str() + "': " +
+          strerror(lastErrno);
+        return false;
+      }
+      setCloseOnExec(listenFD);
+
+      if (boundAddress_out) {
+        sockaddr_storage bound;
+        socklen_t boundSize = sizeof(bound);
+        char boundPort[NI_MAXSERV];
+        if (::getsockname(listenFD, (sockaddr*)&bound, &boundSize) == 0 &&
+            ::getnameinfo((sockaddr*)&bound, boundSize, nullptr, 0,
+                          boundPort, sizeof(boundPort), NI_NUMERICSERV) == 0) {
+          *boundAddress_out = host + ":" + boundPort;
+        } else {
+          *boundAddress_out = address;
+        }
+      }
+    }
+
+    if (::listen(listenFD, SOMAXCONN) < 0) {
+      *error_out = "unable to listen on '" + address.str() + "': " +
+        strerror(errno);
+      return false;
+    }
+    return true;
+  }
+
+  void serve() {
+    while (true) {
+      pollfd fds[2] = {
+        { listenFD, POLLIN, 0 },
+        { wakeFDs[0], POLLIN, 0 },
+      };
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR)
+          continue;
+        return;
+      }
+      if (fds[1].revents)
+        return;
+      if (!(fds[0].revents & POLLIN))
+        continue;
+
+      int fd = ::accept(listenFD, nullptr, nullptr);
+      if (fd < 0)
+        continue;
+      setCloseOnExec(fd);
+      setNoSigPipe(fd);
+
+      std::lock_guard<std::mutex> guard(connectionsMutex);
+      if (isShutdown) {
+        ::close(fd);
+        return;
+      }
+
+      // Reap the connections which have been closed.
+      connections.erase(
+          std::remove_if(connections.begin(), connections.end(),
+                         [](const std::unique_ptr<ConnectionState>& state) {
+            if (!state->isFinished)
+              return false;
+            state->thread.join();
+            return true;
+          }), connections.end());
+
+      connections.emplace_back(new ConnectionState);
+      auto& state = *connections.back();
+      state.connection = llvm::make_unique<RemoteConnection>(fd);
+      state.thread = std::thread([this, &state]() {
+        handleConnection(state);
+        state.isFinished = true;
+      });
+    }
+  }
+
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> guard(connectionsMutex);
+      std::lock_guard<std::mutex> slotsGuard(slotsMutex);
+      if (isShutdown)
+        return;
+      isShutdown = true;
+      slotsCondition.notify_all();
+      for (auto& state: connections) {
+        state->processes.signalAll(SIGKILL);
+        state->connection->shutdown();
+      }
+    }
+    if (wakeFDs[1] >= 0) {
+      char byte = 0;
+      (void) ::write(wakeFDs[1], &byte, 1);
+    }
+  }
+};
+
+#else // defined(_WIN32)
+
+class RemoteExecutionWorkerImpl {
+public:
+  RemoteExecutionWorkerImpl(unsigned, bool) {}
+
+  bool listen(StringRef, std::string* error_out, std::string*) {
+    *error_out = "remote execution is not supported on this platform";
+    return false;
+  }
+
+  void serve() {}
+
+  void shutdown() {}
+};
+
+#endif
+
+}
+
+RemoteExecutionWorker::RemoteExecutionWorker(unsigned numSlots,
+                                             bool sharedFileSystem)
+    : impl(new RemoteExecutionWorkerImpl(numSlots, sharedFileSystem)) {}
+
+RemoteExecutionWorker::~RemoteExecutionWorker() {
+  delete static_cast<RemoteExecutionWorkerImpl*>(impl);
+}
+
+bool RemoteExecutionWorker::listen(StringRef address, std::string* error_out,
+                                   std::string* boundAddress_out) {
+  return static_cast<RemoteExecutionWorkerImpl*>(impl)->listen(
+      address, error_out, boundAddress_out);
+}
+
+void RemoteExecutionWorker::serve() {
+  static_cast<RemoteExecutionWorkerImpl*>(impl)->serve();
+}
+
+void RemoteExecutionWorker::shutdown() {
+  static_cast<RemoteExecutionWorkerImpl*>(impl)->shutdown();
+}
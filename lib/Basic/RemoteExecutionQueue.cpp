@@ -0,0 +1,378 @@
+//===-- RemoteExecutionQueue.cpp ------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/ExecutionQueue.h"
+
+#include "llbuild/Basic/FileInfo.h"
+#include "llbuild/Basic/RemoteExecution.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+namespace {
+
+/// The context of a job running on the remote queue.
+struct RemoteExecutionQueueJobContext : public QueueJobContext {
+  unsigned laneNumber;
+
+  JobDescriptor* desc;
+
+  RemoteExecutionQueueJobContext(unsigned laneNumber, JobDescriptor* desc)
+      : laneNumber(laneNumber), desc(desc) {}
+
+  unsigned laneID() const override { return laneNumber; }
+};
+
+/// Execution queue which runs processes on remote workers.
+///
+/// Scheduling is delegated to a lane based queue with one lane per remote
+/// execution slot, each of which owns a dedicated connection to its worker.
+class RemoteExecutionQueue : public ExecutionQueue {
+  /// The connection for each lane.
+  std::vector<std::unique_ptr<RemoteConnection>> connections;
+
+  /// Whether each lane's worker shares our file system.
+  std::vector<bool> sharedFileSystems;
+
+  /// The queue used to schedule jobs onto lanes.
+  std::unique_ptr<ExecutionQueue> laneQueue;
+
+  /// The base environment.
+  const char* const* environment;
+
+  /// The next process handle to assign.
+  std::atomic<uint64_t> nextHandleID{0};
+
+  /// Whether the queue has been cancelled.
+  std::atomic<bool> cancelled{false};
+
+  /// The memoized input digests, with the file information they were computed
+  /// for.
+  llvm::StringMap<std::pair<FileInfo, std::string>> inputDigests;
+  std::mutex inputDigestsMutex;
+
+  bool getInputDigest(const std::string& path, std::string& digest_out) {
+    auto info = FileInfo::getInfoForPath(path);
+    if (info.isMissing() || info.isDirectory())
+      return false;
+
+    {
+      std::lock_guard<std::mutex> guard(inputDigestsMutex);
+      auto it = inputDigests.find(path);
+      if (it != inputDigests.end() && it->second.first == info) {
+        digest_out = it->second.second;
+        return true;
+      }
+    }
+
+    if (!computeRemoteInputDigest(path, digest_out))
+      return false;
+
+    std::lock_guard<std::mutex> guard(inputDigestsMutex);
+    inputDigests[path] = std::make_pair(info, digest_out);
+    return true;
+  }
+
+  /// Write the output files returned by a worker, which must be among the
+  /// outputs of the request.
+  bool writeOutputs(const RemoteExecuteRequest& request,
+                    const RemoteExecuteResult& result, std::string& error) {
+    for (const auto& output: result.outputs) {
+      if (std::find(request.outputs.begin(), request.outputs.end(),
+                    output.path) == request.outputs.end()) {
+        error = "worker returned unexpected output '" + output.path + "'";
+        return false;
+      }
+
+      std::error_code ec;
+      {
+        llvm::raw_fd_ostream os(output.path, ec, llvm::sys::fs::F_None);
+        if (!ec) {
+          os << output.contents;
+          os.close();
+          if (os.has_error()) {
+            os.clear_error();
+            ec = std::make_error_code(std::errc::io_error);
+          }
+        }
+      }
+      if (!ec && output.mode != 0) {
+        ec = llvm::sys::fs::setPermissions(
+            output.path,
+            llvm::sys::fs::perms(output.mode & llvm::sys::fs::all_perms));
+      }
+      if (ec) {
+        error = "unable to write output '" + output.path + "': " +
+          ec.message();
+        return false;
+      }
+    }
+    return true;
+  }
+
+public:
+  RemoteExecutionQueue(ExecutionQueueDelegate& delegate,
+                       std::vector<std::unique_ptr<RemoteConnection>>&& conns,
+                       std::vector<bool>&& sharedFileSystems,
+                       SchedulerAlgorithm alg, const char* const* environment)
+      : ExecutionQueue(delegate), connections(std::move(conns)),
+        sharedFileSystems(std::move(sharedFileSystems)),
+        laneQueue(createLaneBasedExecutionQueue(delegate, connections.size(),
+                                                alg, environment)),
+        environment(environment) {}
+
+  virtual ~RemoteExecutionQueue() {
+    // Shut down the lanes before the connections they use.
+    laneQueue.reset();
+  }
+
+  virtual void addJob(QueueJob job) override {
+    laneQueue->addJob(QueueJob(job.getDescriptor(),
+                               [job](QueueJobContext* laneContext) mutable {
+      RemoteExecutionQueueJobContext context{
+        laneContext->laneID(), job.getDescriptor() };
+      job.execute(&context);
+    }));
+  }
+
+  virtual void cancelAllJobs() override {
+    if (cancelled.exchange(true))
+      return;
+
+    laneQueue->cancelAllJobs();
+    for (auto& connection: connections) {
+      (void) connection->send(RemoteMessageKind::Cancel);
+    }
+  }
+
+  virtual void executeProcess(
+      QueueJobContext* opaqueContext,
+      ArrayRef<StringRef> commandLine,
+      ArrayRef<std::pair<StringRef, StringRef>> environment,
+      bool inheritEnvironment,
+      ProcessAttributes attributes,
+      llvm::Optional<ProcessCompletionFn> completionFn) override {
+    auto& context =
+      *static_cast<RemoteExecutionQueueJobContext*>(opaqueContext);
+    auto* ctx = reinterpret_cast<ProcessContext*>(context.desc);
+    auto complete = [&](ProcessResult result) {
+      if (completionFn.hasValue())
+        completionFn.getValue()(result);
+    };
+
+    // Do not execute new processes anymore after cancellation.
+    if (cancelled) {
+      complete(ProcessResult::makeCancelled());
+      return;
+    }
+
+    // Form the request.
+    //
+    // NOTE: We construct the environment in order of precedence, so
+    // overridden keys should be defined first.
+    RemoteExecuteRequest request;
+    for (auto arg: commandLine) {
+      request.commandLine.push_back(arg);
+    }
+    {
+      POSIXEnvironment posixEnv;
+      posixEnv.setIfMissing("LLBUILD_LANE_ID",
+                            Twine(context.laneNumber).str());
+      for (const auto& entry: environment) {
+        posixEnv.setIfMissing(entry.first, entry.second);
+      }
+      if (inheritEnvironment) {
+        for (const char* const* p = this->environment; *p != nullptr; ++p) {
+          auto pair = StringRef(*p).split('=');
+          posixEnv.setIfMissing(pair.first, pair.second);
+        }
+      }
+      for (const char* const* p = posixEnv.getEnvp(); *p != nullptr; ++p) {
+        request.environment.push_back(*p);
+      }
+    }
+    if (!attributes.workingDir.empty()) {
+      request.workingDir = attributes.workingDir;
+    } else {
+      SmallString<256> cwd;
+      if (!llvm::sys::fs::current_path(cwd))
+        request.workingDir = cwd.str();
+    }
+    request.canSafelyInterrupt = attributes.canSafelyInterrupt;
+    for (const auto& input: attributes.inputs) {
+      // Inputs we can't digest (missing files, directories) are not verified.
+      std::string digest;
+      if (getInputDigest(input, digest))
+        request.inputs.emplace_back(input, std::move(digest));
+    }
+    request.outputs = attributes.outputs;
+
+    ProcessHandle handle{ nextHandleID++ };
+    auto& connection = *connections[context.laneNumber];
+    if (!connection.sendValue(RemoteMessageKind::Execute, request)) {
+      getDelegate().processStarted(ctx, handle);
+      getDelegate().processHadError(ctx, handle,
+                                    "unable to send request to worker");
+      ProcessResult result = ProcessResult::makeFailed();
+      getDelegate().processFinished(ctx, handle, result);
+      complete(result);
+      return;
+    }
+    getDelegate().processStarted(ctx, handle);
+
+    // Relay the worker's messages until we have the result.
+    RemoteMessageKind kind;
+    std::string payload;
+    uint64_t outputSize = 0;
+    bool malformed = false;
+    while (!malformed && connection.receive(kind, payload)) {
+      switch (kind) {
+      case RemoteMessageKind::Output: {
+        std::string data;
+        if (!decodeRemoteValue(payload, data)) {
+          malformed = true;
+          break;
+        }
+        outputSize += data.size();
+        getDelegate().processHadOutput(ctx, handle, data);
+        break;
+      }
+      case RemoteMessageKind::Error: {
+        std::string message;
+        if (!decodeRemoteValue(payload, message)) {
+          malformed = true;
+          break;
+        }
+        getDelegate().processHadError(ctx, handle, message);
+        break;
+      }
+      case RemoteMessageKind::Result: {
+        RemoteExecuteResult remoteResult;
+        if (!decodeRemoteValue(payload, remoteResult)) {
+          malformed = true;
+          break;
+        }
+        ProcessResult result = remoteResult.toProcessResult();
+        result.outputSize = outputSize;
+        std::string error;
+        if (!sharedFileSystems[context.laneNumber] &&
+            !writeOutputs(request, remoteResult, error)) {
+          getDelegate().processHadError(ctx, handle, error);
+          result = ProcessResult::makeFailed();
+        }
+        getDelegate().processFinished(ctx, handle, result);
+        complete(result);
+        return;
+      }
+      default:
+        break;
+      }
+    }
+
+    // The connection is no longer usable after a protocol error.
+    if (malformed)
+      connection.shutdown();
+    getDelegate().processHadError(ctx, handle, malformed ?
+                                  "malformed message from remote worker" :
+                                  "lost connection to remote worker");
+    ProcessResult result = ProcessResult::makeFailed();
+    getDelegate().processFinished(ctx, handle, result);
+    complete(result);
+  }
+};
+
+}
+
+#if !defined(_WIN32)
+extern "C" {
+  extern char **environ;
+}
+#endif
+
+ExecutionQueue* llbuild::basic::createRemoteExecutionQueue(
+    ExecutionQueueDelegate& delegate, ArrayRef<std::string> workerAddresses,
+    SchedulerAlgorithm alg, const char* const* environment,
+    std::string* error_out) {
+#if defined(_WIN32)
+  *error_out = "remote execution is not supported on this platform";
+  return nullptr;
+#else
+  if (!environment) {
+    environment = const_cast<const char* const*>(environ);
+  }
+
+  // Connect to each worker, and then open a connection for each of its slots.
+  std::vector<std::unique_ptr<RemoteConnection>> connections;
+  std::vector<bool> sharedFileSystems;
+  for (const auto& address: workerAddresses) {
+    BinaryEncoder hello;
+    hello.write(RemoteExecutionProtocolVersion);
+    StringRef helloPayload((const char*)hello.data(), hello.size());
+
+    unsigned numSlots = 1;
+    for (unsigned i = 0; i != numSlots; ++i) {
+      auto connection = RemoteConnection::connect(address, error_out);
+      if (!connection)
+        return nullptr;
+
+      RemoteMessageKind kind;
+      std::string payload;
+      if (!connection->send(RemoteMessageKind::Hello, helloPayload) ||
+          !connection->receive(kind, payload) ||
+          kind != RemoteMessageKind::HelloReply) {
+        *error_out = "unable to handshake with worker '" + address + "'";
+        return nullptr;
+      }
+      RemoteHelloReply reply;
+      if (!decodeRemoteValue(payload, reply)) {
+        *error_out = "unable to handshake with worker '" + address + "'";
+        return nullptr;
+      }
+      if (reply.version != RemoteExecutionProtocolVersion) {
+        *error_out = "worker '" + address +
+          "' uses an unsupported protocol version";
+        return nullptr;
+      }
+
+      // The first connection tells us how many slots to use.
+      if (i == 0)
+        numSlots = reply.numSlots;
+      if (numSlots == 0)
+        break;
+
+      connections.push_back(std::move(connection));
+      sharedFileSystems.push_back(reply.sharedFileSystem);
+    }
+  }
+  if (connections.empty()) {
+    *error_out = "no remote execution slots available";
+    return nullptr;
+  }
+
+  return new RemoteExecutionQueue(delegate, std::move(connections),
+                                  std::move(sharedFileSystems), alg,
+                                  environment);
+#endif
+}
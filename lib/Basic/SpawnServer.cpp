@@ -0,0 +1,663 @@
+//===-- SpawnServer.cpp ---------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/SpawnServer.h"
+
+#include "llbuild/Basic/BinaryCoding.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+#if defined(__linux__)
+namespace {
+
+/// The kinds of requests sent to the server.
+enum class RequestKind : uint8_t {
+  /// Launch a process, passing its status socket, output and (optionally)
+  /// control pipe descriptors.
+  Spawn = 0,
+
+  /// Signal the process group of a process the server launched.
+  Signal = 1,
+};
+
+/// The reply sent once a process has been launched.
+struct SpawnReply {
+  int32_t error;
+  int32_t pid;
+};
+
+/// The message sent once a process has exited.
+struct ExitMessage {
+  int32_t waitStatus;
+  int64_t utime;
+  int64_t stime;
+  int64_t maxrss;
+};
+
+/// The maximum number of descriptors passed with a request.
+const int maxRequestFds = 3;
+
+/// The maximum size of the description of a process to launch (which is
+/// well beyond what the system allows for the arguments and environment).
+const uint64_t maxSpawnRequestSize = 64 << 20;
+
+/// The client's end of the server socket, or -1.
+std::atomic<int> serverSocket{-1};
+
+/// Whether the server has exited unexpectedly.
+std::atomic<bool> serverExited{false};
+
+/// The number of unmatched calls to \see startSpawnServer().
+std::mutex serverUsersMutex;
+unsigned numServerUsers = 0;
+
+/// Send a request to the server.
+///
+/// \returns Zero on success, or an errno value (ESRCH if the server has
+/// exited).
+int sendRequest(int sock, const BinaryEncoder& coder, const int* fds,
+                int numFds) {
+  char control[CMSG_SPACE(sizeof(int) * maxRequestFds)] = {};
+  iovec iov{const_cast<uint8_t*>(coder.data()), coder.size()};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (numFds != 0) {
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * numFds);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * numFds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * numFds);
+  }
+
+  ssize_t result;
+  do {
+    result = ::sendmsg(sock, &msg, MSG_NOSIGNAL);
+  } while (result < 0 && errno == EINTR);
+  if (result >= 0)
+    return 0;
+  if (errno == EPIPE || errno == ECONNRESET || errno == ENOTCONN) {
+    serverExited = true;
+    return ESRCH;
+  }
+  return errno;
+}
+
+bool readFully(int fd, void* data, size_t size) {
+  char* p = static_cast<char*>(data);
+  while (size != 0) {
+    ssize_t numBytes = ::read(fd, p, size);
+    if (numBytes < 0 && errno == EINTR)
+      continue;
+    if (numBytes <= 0) {
+      if (numBytes == 0)
+        errno = EPIPE;
+      return false;
+    }
+    p += numBytes;
+    size -= numBytes;
+  }
+  return true;
+}
+
+/// Write all of the given data to a socket.
+///
+/// \returns True on success, or false (with errno set) on failure.
+bool writeFully(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size != 0) {
+    ssize_t numBytes = ::send(fd, p, size, MSG_NOSIGNAL);
+    if (numBytes < 0 && errno == EINTR)
+      continue;
+    if (numBytes <= 0)
+      return false;
+    p += numBytes;
+    size -= numBytes;
+  }
+  return true;
+}
+
+/// The state of the server process.
+class SpawnServer {
+  /// The server socket.
+  int sock;
+
+  /// The descriptor on which child exit signals are received.
+  int signalFd;
+
+  /// The status socket of each running process.
+  std::unordered_map<pid_t, int> statusFds;
+
+  /// The signals which are reset to their default behavior in processes.
+  sigset_t mostSignals;
+
+  /// Close all descriptors inherited from the client, other than the standard
+  /// ones and the server socket, so they don't leak into processes.
+  void closeInheritedDescriptors() {
+    std::vector<int> fds;
+    if (DIR* dir = ::opendir("/proc/self/fd")) {
+      while (struct dirent* entry = ::readdir(dir)) {
+        int fd = atoi(entry->d_name);
+        if (fd > 2 && fd != sock && fd != ::dirfd(dir))
+          fds.push_back(fd);
+      }
+      ::closedir(dir);
+    }
+    for (int fd: fds)
+      ::close(fd);
+  }
+
+  /// Launch the process described by a request.
+  ///
+  /// \returns Zero on success, or an errno value.
+  int spawn(StringRef payload, int outputFd, int& controlFd, pid_t& pid) {
+    BinaryDecoder coder(payload);
+    uint32_t numArgs, numEnv, controlFdNumber, qualityOfService, cpu;
+    std::vector<std::string> argsStorage, envStorage;
+    std::string workingDir;
+    coder.read(numArgs);
+    if (!coder.canRead(numArgs))
+      return EINVAL;
+    for (uint32_t i = 0; i != numArgs; ++i) {
+      argsStorage.emplace_back();
+      coder.read(argsStorage.back());
+    }
+    coder.read(numEnv);
+    if (!coder.canRead(numEnv))
+      return EINVAL;
+    for (uint32_t i = 0; i != numEnv; ++i) {
+      envStorage.emplace_back();
+      coder.read(envStorage.back());
+    }
+    coder.read(workingDir);
+    coder.read(controlFdNumber);
+    coder.read(qualityOfService);
+    coder.read(cpu);
+    if (coder.hasOverrun() || !coder.isEmpty() || argsStorage.empty() ||
+        qualityOfService > uint32_t(QualityOfService::Background))
+      return EINVAL;
+
+    std::vector<char*> args, env;
+    for (auto& arg: argsStorage)
+      args.push_back(&arg[0]);
+    args.push_back(nullptr);
+    for (auto& entry: envStorage)
+      env.push_back(&entry[0]);
+    env.push_back(nullptr);
+
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t noSignals;
+    sigemptyset(&noSignals);
+    posix_spawnattr_setsigmask(&attributes, &noSignals);
+    posix_spawnattr_setsigdefault(&attributes, &mostSignals);
+    posix_spawnattr_setpgroup(&attributes, 0);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK |
+                             POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+
+    // All of our descriptors are close-on-exec, so the process only inherits
+    // those installed here.
+    posix_spawn_file_actions_t fileActions;
+    posix_spawn_file_actions_init(&fileActions);
+    posix_spawn_file_actions_addopen(&fileActions, 0, "/dev/null", O_RDONLY,
+                                     0);
+    posix_spawn_file_actions_adddup2(&fileActions, outputFd, 1);
+    posix_spawn_file_actions_adddup2(&fileActions, outputFd, 2);
+    if (controlFd >= 0) {
+      // Duplicating a descriptor onto itself would leave it close-on-exec.
+      if (controlFd == int(controlFdNumber)) {
+        int fd = ::fcntl(controlFd, F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+          return errno;
+        ::close(controlFd);
+        controlFd = fd;
+      }
+      posix_spawn_file_actions_adddup2(&fileActions, controlFd,
+                                       int(controlFdNumber));
+    }
+
+    // The server only launches one process at a time, so it can simply change
+    // its own working directory around the spawn.
+    int result = 0;
+    int cwdFd = -1;
+    if (!workingDir.empty()) {
+      cwdFd = ::open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (cwdFd < 0 || ::chdir(workingDir.c_str()) != 0)
+        result = errno;
+    }
+    auto launch = [&]() {
+      result = posix_spawn(&pid, args[0], &fileActions, &attributes,
+                           args.data(), env.data());
+    };
+    auto level = QualityOfService(qualityOfService);
+    if (result == 0 && level == QualityOfService::Normal && int32_t(cpu) < 0) {
+      launch();
+    } else if (result == 0) {
+      // The scheduling attributes are per thread, and are inherited by the
+      // process when it is created, so set them on a thread which launches the
+      // process (the server itself could not raise its priority back again).
+      std::thread thread([&]() {
+        setCurrentThreadQualityOfService(level);
+        if (int32_t(cpu) >= 0 && int32_t(cpu) < CPU_SETSIZE) {
+          cpu_set_t cpus;
+          CPU_ZERO(&cpus);
+          CPU_SET(cpu, &cpus);
+          (void) ::sched_setaffinity(0, sizeof(cpus), &cpus);
+        }
+        launch();
+      });
+      thread.join();
+    }
+    if (cwdFd >= 0) {
+      (void) ::fchdir(cwdFd);
+      ::close(cwdFd);
+    }
+
+    posix_spawn_file_actions_destroy(&fileActions);
+    posix_spawnattr_destroy(&attributes);
+    return result;
+  }
+
+  /// Signal the process group of one of our processes.
+  void signalProcess(StringRef payload) {
+    BinaryDecoder coder(payload);
+    uint32_t pid, signal;
+    coder.read(pid);
+    coder.read(signal);
+    coder.finish();
+
+    // Processes which have been reaped are no longer ours (and their process
+    // ID may have been reused), but a process which has exited and not yet
+    // been reaped still holds on to its process group.
+    if (statusFds.count(pid_t(pid)))
+      ::kill(-pid_t(pid), int(signal));
+  }
+
+  /// Handle a request from the client.
+  ///
+  /// \returns False if the client has closed the server socket.
+  bool handleRequest() {
+    // Size the buffer for the complete request.
+    ssize_t size = ::recv(sock, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+    if (size < 0)
+      return errno == EINTR || errno == EAGAIN;
+    std::vector<char> payload(std::max(ssize_t(1), size));
+
+    char control[CMSG_SPACE(sizeof(int) * maxRequestFds)];
+    iovec iov{payload.data(), payload.size()};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t numBytes = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (numBytes <= 0)
+      return numBytes < 0 && errno == EINTR;
+
+    int fds[maxRequestFds] = { -1, -1, -1 };
+    int numFds = 0;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        continue;
+      int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (int i = 0; i != count; ++i) {
+        int fd;
+        memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        if (numFds != maxRequestFds)
+          fds[numFds++] = fd;
+        else
+          ::close(fd);
+      }
+    }
+
+    StringRef request(payload.data(), numBytes);
+    auto kind = RequestKind(request[0]);
+    request = request.drop_front();
+    if (kind == RequestKind::Signal) {
+      for (int i = 0; i != numFds; ++i)
+        ::close(fds[i]);
+      signalProcess(request);
+      return true;
+    }
+
+    // The descriptors are the status socket, the output, and optionally the
+    // control pipe.
+    int statusFd = fds[0], outputFd = fds[1], controlFd = fds[2];
+    if (kind != RequestKind::Spawn || statusFd < 0 || outputFd < 0 ||
+        request.size() != sizeof(uint64_t)) {
+      for (int i = 0; i != numFds; ++i)
+        ::close(fds[i]);
+      return true;
+    }
+
+    // The description of the process follows on the status socket (since it
+    // may not fit in a datagram).
+    uint64_t descriptionSize;
+    {
+      BinaryDecoder coder(request);
+      coder.read(descriptionSize);
+    }
+    std::vector<char> description;
+    pid_t pid = -1;
+    SpawnReply reply;
+    reply.error = 0;
+    if (descriptionSize > maxSpawnRequestSize) {
+      reply.error = E2BIG;
+    } else {
+      description.resize(descriptionSize);
+      if (!readFully(statusFd, description.data(), descriptionSize))
+        reply.error = errno;
+    }
+    if (reply.error == 0)
+      reply.error = spawn(StringRef(description.data(), descriptionSize),
+                          outputFd, controlFd, pid);
+    reply.pid = reply.error == 0 ? pid : -1;
+    ::close(outputFd);
+    if (controlFd >= 0)
+      ::close(controlFd);
+
+    writeFully(statusFd, &reply, sizeof(reply));
+    if (reply.error == 0)
+      statusFds[pid] = statusFd;
+    else
+      ::close(statusFd);
+    return true;
+  }
+
+  /// Reap all exited processes, and report their status.
+  void reapProcesses() {
+    signalfd_siginfo info;
+    while (::read(signalFd, &info, sizeof(info)) > 0)
+      continue;
+
+    int waitStatus;
+    struct rusage usage;
+    pid_t pid;
+    while ((pid = ::wait4(-1, &waitStatus, WNOHANG, &usage)) > 0) {
+      auto it = statusFds.find(pid);
+      if (it == statusFds.end())
+        continue;
+
+      ExitMessage message;
+      message.waitStatus = waitStatus;
+      message.utime = int64_t(usage.ru_utime.tv_sec) * 1000000 +
+        usage.ru_utime.tv_usec;
+      message.stime = int64_t(usage.ru_stime.tv_sec) * 1000000 +
+        usage.ru_stime.tv_usec;
+      message.maxrss = usage.ru_maxrss;
+      writeFully(it->second, &message, sizeof(message));
+      ::close(it->second);
+      statusFds.erase(it);
+    }
+  }
+
+public:
+  SpawnServer(int sock) : sock(sock) {
+    sigemptyset(&mostSignals);
+    for (int i = 1; i < SIGSYS; ++i) {
+      if (i == SIGKILL || i == SIGSTOP) continue;
+      sigaddset(&mostSignals, i);
+    }
+  }
+
+  void run() {
+    closeInheritedDescriptors();
+
+    // Stay out of the client's process group, so that interrupts delivered
+    // to it don't reach us; the client is responsible for cancelling the
+    // processes.
+    (void) ::setpgid(0, 0);
+    ::signal(SIGINT, SIG_IGN);
+    ::signal(SIGQUIT, SIG_IGN);
+    ::signal(SIGPIPE, SIG_IGN);
+
+    sigset_t childSignals;
+    sigemptyset(&childSignals);
+    sigaddset(&childSignals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignals, nullptr);
+    signalFd = ::signalfd(-1, &childSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signalFd < 0)
+      ::_exit(1);
+
+    // Serve until the client goes away and all of our processes have exited.
+    bool clientConnected = true;
+    while (clientConnected || !statusFds.empty()) {
+      pollfd fds[] = {
+        { signalFd, POLLIN, 0 },
+        { clientConnected ? sock : -1, POLLIN, 0 }
+      };
+      if (::poll(fds, 2, -1) < 0)
+        continue;
+      if (fds[0].revents)
+        reapProcesses();
+      if (fds[1].revents && !handleRequest())
+        clientConnected = false;
+    }
+    ::_exit(0);
+  }
+};
+
+}
+#endif
+
+bool llbuild::basic::startSpawnServer(std::string* error_out) {
+#if defined(__linux__)
+  std::lock_guard<std::mutex> guard(serverUsersMutex);
+  if (serverSocket >= 0) {
+    ++numServerUsers;
+    return true;
+  }
+
+  int sockets[2];
+  if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) < 0) {
+    *error_out = std::string("unable to create socket (") + strerror(errno) +
+      ")";
+    return false;
+  }
+
+  pid_t pid = ::fork();
+  if (pid < 0) {
+    *error_out = std::string("unable to fork spawn server (") +
+      strerror(errno) + ")";
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+    return false;
+  }
+  if (pid == 0) {
+    SpawnServer(sockets[1]).run();
+    ::_exit(0);
+  }
+
+  ::close(sockets[1]);
+  serverExited = false;
+  serverSocket = sockets[0];
+  ++numServerUsers;
+  return true;
+#else
+  *error_out = "the spawn server is not supported on this platform";
+  return false;
+#endif
+}
+
+void llbuild::basic::stopSpawnServer() {
+#if defined(__linux__)
+  std::lock_guard<std::mutex> guard(serverUsersMutex);
+  if (numServerUsers == 0 || --numServerUsers != 0)
+    return;
+
+  // The server exits once its running processes have exited.
+  int sock = serverSocket.exchange(-1);
+  if (sock >= 0)
+    ::close(sock);
+#endif
+}
+
+bool llbuild::basic::isSpawnServerRunning() {
+#if defined(__linux__)
+  int sock = serverSocket;
+  if (sock < 0 || serverExited)
+    return false;
+
+  // Check the server hasn't gone away (the socket is only closed once it is
+  // stopped, since other threads may be using it).
+  pollfd fd{ sock, 0, 0 };
+  if (::poll(&fd, 1, 0) > 0 && (fd.revents & (POLLHUP | POLLERR))) {
+    serverExited = true;
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+int llbuild::basic::spawnViaServer(ArrayRef<const char*> args,
+                                   const char* const* envp,
+                                   StringRef workingDir, int outputFd,
+                                   int controlFd,
+                                   QualityOfService qualityOfService, int cpu,
+                                   llbuild_pid_t& pid_out,
+                                   int& statusFd_out) {
+#if defined(__linux__)
+  int sock = serverSocket;
+  if (sock < 0 || serverExited)
+    return ESRCH;
+
+  BinaryEncoder coder;
+  uint32_t numArgs = 0;
+  while (numArgs != args.size() && args[numArgs])
+    ++numArgs;
+  coder.write(numArgs);
+  for (uint32_t i = 0; i != numArgs; ++i)
+    coder.writeString(args[i]);
+  uint32_t numEnv = 0;
+  for (const char* const* p = envp; *p; ++p)
+    ++numEnv;
+  coder.write(numEnv);
+  for (uint32_t i = 0; i != numEnv; ++i)
+    coder.writeString(envp[i]);
+  coder.writeString(workingDir);
+  coder.write(uint32_t(controlFd));
+  coder.write(uint32_t(qualityOfService));
+  coder.write(uint32_t(cpu));
+  if (coder.size() > maxSpawnRequestSize)
+    return E2BIG;
+
+  int statusSockets[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, statusSockets) < 0)
+    return errno;
+
+  // The request only carries the size of the description of the process,
+  // which is then streamed on the status socket, since the arguments and
+  // environment may be much larger than a datagram can be.
+  BinaryEncoder request;
+  request.write(uint8_t(RequestKind::Spawn));
+  request.write(uint64_t(coder.size()));
+  int fds[maxRequestFds] = { statusSockets[1], outputFd, controlFd };
+  int sendError = sendRequest(sock, request, fds, controlFd >= 0 ? 3 : 2);
+  ::close(statusSockets[1]);
+  if (sendError != 0) {
+    ::close(statusSockets[0]);
+    return sendError;
+  }
+  if (!writeFully(statusSockets[0], coder.data(), coder.size())) {
+    // The server closes the socket if it exits before reading the request.
+    int writeError = errno == EPIPE ? ESRCH : errno;
+    ::close(statusSockets[0]);
+    return writeError;
+  }
+
+  SpawnReply reply;
+  if (!readFully(statusSockets[0], &reply, sizeof(reply))) {
+    int readError = errno;
+    ::close(statusSockets[0]);
+    return readError;
+  }
+  if (reply.error != 0) {
+    ::close(statusSockets[0]);
+    return reply.error;
+  }
+
+  pid_out = reply.pid;
+  statusFd_out = statusSockets[0];
+  return 0;
+#else
+  return ENOSYS;
+#endif
+}
+
+void llbuild::basic::signalViaServer(llbuild_pid_t pid, int signal) {
+#if defined(__linux__)
+  int sock = serverSocket;
+  if (sock < 0 || serverExited)
+    return;
+
+  BinaryEncoder coder;
+  coder.write(uint8_t(RequestKind::Signal));
+  coder.write(uint32_t(pid));
+  coder.write(uint32_t(signal));
+  (void) sendRequest(sock, coder, nullptr, 0);
+#endif
+}
+
+bool llbuild::basic::readSpawnServerExitStatus(int statusFd,
+                                               int& waitStatus_out,
+                                               struct rusage& usage_out) {
+#if defined(__linux__)
+  ExitMessage message;
+  bool success = readFully(statusFd, &message, sizeof(message));
+  int readError = errno;
+  ::close(statusFd);
+  if (!success) {
+    errno = readError;
+    return false;
+  }
+
+  memset(&usage_out, 0, sizeof(usage_out));
+  usage_out.ru_utime.tv_sec = message.utime / 1000000;
+  usage_out.ru_utime.tv_usec = message.utime % 1000000;
+  usage_out.ru_stime.tv_sec = message.stime / 1000000;
+  usage_out.ru_stime.tv_usec = message.stime % 1000000;
+  usage_out.ru_maxrss = message.maxrss;
+  waitStatus_out = message.waitStatus;
+  return true;
+#else
+  errno = ENOSYS;
+  return false;
+#endif
+}
@@ -14,7 +14,9 @@
 
 #include "llbuild/Basic/CrossPlatformCompatibility.h"
 #include "llbuild/Basic/PlatformUtility.h"
+#include "llbuild/Basic/Probes.h"
 #include "llbuild/Basic/ShellUtility.h"
+#include "llbuild/Basic/SpawnServer.h"
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
@@ -23,13 +25,25 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Program.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include <fcntl.h>
 #if !defined(_WIN32)
 #include <poll.h>
 #endif
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif
 #include <signal.h>
 #if defined(_WIN32)
 #include <process.h>
@@ -103,7 +117,7 @@ namespace {
 
 #if defined(__APPLE__)
   qos_class_t _getDarwinQOSClass(QualityOfService level) {
-    switch (getDefaultQualityOfService()) {
+    switch (level) {
       case QualityOfService::Normal:
         return QOS_CLASS_DEFAULT;
       case QualityOfService::UserInitiated:
@@ -120,6 +134,90 @@ namespace {
 
 #endif
 
+#if defined(__linux__)
+  // The I/O priority interface, which glibc does not wrap.
+  const int ioprioWhoProcess = 1;
+  const int ioprioClassShift = 13;
+  const int ioprioClassBestEffort = 2;
+  const int ioprioClassIdle = 3;
+
+  /// The Linux scheduling settings used for a quality of service level.
+  struct LinuxSchedulingClass {
+    /// The nice value.
+    int niceness;
+
+    /// The scheduling policy.
+    int policy;
+
+    /// The I/O priority, or 0 to leave it unchanged.
+    int ioprio;
+  };
+
+  /// Get the Linux scheduling settings for the given level, or None if the
+  /// level should leave the settings unchanged.
+  llvm::Optional<LinuxSchedulingClass>
+  _getLinuxSchedulingClass(QualityOfService level) {
+    switch (level) {
+      case QualityOfService::Normal:
+      case QualityOfService::UserInitiated:
+        return llvm::None;
+      case QualityOfService::Utility:
+        return LinuxSchedulingClass{
+          10, SCHED_BATCH, (ioprioClassBestEffort << ioprioClassShift) | 7 };
+      case QualityOfService::Background:
+        return LinuxSchedulingClass{
+          19, SCHED_IDLE, ioprioClassIdle << ioprioClassShift };
+      default:
+        assert(0 && "unknown quality of service");
+        return llvm::None;
+    }
+  }
+
+  /// Apply the given level to a thread (or the main thread of a process).
+  ///
+  /// This is best effort: failures (e.g., when the thread has already exited,
+  /// or a higher priority would require privileges) are ignored.
+  void _setLinuxThreadQualityOfService(pid_t tid, QualityOfService level) {
+    auto schedulingClass = _getLinuxSchedulingClass(level);
+    if (!schedulingClass)
+      return;
+    (void)setpriority(PRIO_PROCESS, tid, schedulingClass->niceness);
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    (void)sched_setscheduler(tid, schedulingClass->policy, &param);
+    if (schedulingClass->ioprio != 0) {
+      (void)syscall(SYS_ioprio_set, ioprioWhoProcess, tid,
+                    schedulingClass->ioprio);
+    }
+  }
+#endif
+
+#if !defined(_WIN32)
+  /// Apply the scheduling attributes of a process launched directly.
+  ///
+  /// On Linux, this can only be done once posix_spawn() has returned, by which
+  /// time the process may already be running its executable with the
+  /// attributes of the client. Any processes it starts before then keep those
+  /// attributes, and since the attributes are per thread, only the main thread
+  /// of the process is changed (threads it has already started are not, while
+  /// those it starts later inherit the new attributes). Processes launched by
+  /// the spawn server don't have this problem, since the server applies the
+  /// attributes before the process is created.
+  void applyProcessScheduling(llbuild_pid_t pid,
+                              const ProcessAttributes& attr) {
+#if defined(__linux__)
+    _setLinuxThreadQualityOfService(
+        pid, attr.qualityOfService.getValueOr(getDefaultQualityOfService()));
+    if (attr.cpu >= 0 && attr.cpu < CPU_SETSIZE) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(attr.cpu, &cpus);
+      (void)sched_setaffinity(pid, sizeof(cpus), &cpus);
+    }
+#endif
+  }
+#endif
+
 }
 
 QualityOfService llbuild::basic::getDefaultQualityOfService() {
@@ -132,10 +230,10 @@ void llbuild::basic::setDefaultQualityOfService(QualityOfService level) {
 
 void llbuild::basic::setCurrentThreadQualityOfService(QualityOfService level) {
 #if defined(__APPLE__)
-  pthread_set_qos_class_self_np(
-      _getDarwinQOSClass(getDefaultQualityOfService()), 0);
+  pthread_set_qos_class_self_np(_getDarwinQOSClass(level), 0);
+#elif defined(__linux__)
+  _setLinuxThreadQualityOfService(pid_t(syscall(SYS_gettid)), level);
 #endif
-
 }
 
 ProcessDelegate::~ProcessDelegate() {
@@ -164,7 +262,10 @@ void ProcessGroup::signalAll(int signal) {
 #if defined(_WIN32)
     TerminateProcess(it.first, signal);
 #else
-    ::kill(-it.first, signal);
+    if (it.second.viaSpawnServer)
+      signalViaServer(it.first, signal);
+    else
+      ::kill(-it.first, signal);
 #endif
   }
 }
@@ -245,14 +346,108 @@ public:
   bool shouldRelease() const { return releaseSeen; }
 };
 
+/// Coalesces the output of a process into fewer, larger deliveries to its
+/// delegate.
+///
+/// Output is read directly into a buffer (which grows as needed, up to a
+/// limit) and delivered once the buffer is full, or once the oldest pending
+/// output has waited for \see flushDelay, so chatty processes result in far
+/// fewer delegate calls without delaying their output noticeably.
+class OutputCoalescer {
+  /// The initial buffer size.
+  static const size_t initialCapacity = 4096;
+
+  /// The maximum buffer size, i.e., the most output delivered at once.
+  static const size_t maxCapacity = 65536;
+
+  /// The longest output is kept pending.
+  static constexpr std::chrono::milliseconds flushDelay{10};
+
+  std::unique_ptr<char[]> buffer;
+  size_t capacity = 0;
+  size_t size = 0;
+
+  /// The time the oldest pending output was read.
+  std::chrono::steady_clock::time_point pendingSince;
+
+public:
+  bool hasPending() const { return size != 0; }
+
+  /// Read from \arg fd into the buffer.
+  ///
+  /// \returns The result of the read, i.e. the number of bytes read, zero at
+  /// EOF, or -1 on error.
+  ssize_t readFrom(FD fd) {
+    if (size == capacity) {
+      assert(capacity < maxCapacity && "buffer must be flushed when full");
+      size_t newCapacity = capacity ? capacity * 2 : initialCapacity;
+      std::unique_ptr<char[]> newBuffer(new char[newCapacity]);
+      if (size)
+        memcpy(newBuffer.get(), buffer.get(), size);
+      buffer = std::move(newBuffer);
+      capacity = newCapacity;
+    }
+
+    ssize_t numBytes = sys::FileDescriptorTraits<>::Read(
+        fd, buffer.get() + size, capacity - size);
+    if (numBytes > 0) {
+      if (size == 0)
+        pendingSince = std::chrono::steady_clock::now();
+      size += numBytes;
+    }
+    return numBytes;
+  }
+
+  /// Check whether the pending output should be delivered now.
+  bool isDue() const {
+    if (size == 0)
+      return false;
+    return size == maxCapacity ||
+      std::chrono::steady_clock::now() - pendingSince >= flushDelay;
+  }
+
+  /// Get the number of milliseconds until the pending output is due, or -1 if
+  /// there is none.
+  int getFlushTimeout() const {
+    if (size == 0)
+      return -1;
+    auto elapsed = std::chrono::steady_clock::now() - pendingSince;
+    if (elapsed >= flushDelay)
+      return 0;
+    return int(std::chrono::duration_cast<std::chrono::milliseconds>(
+                   flushDelay - elapsed).count()) + 1;
+  }
+
+  /// Deliver the pending output, if any.
+  void flush(ProcessDelegate& delegate, ProcessContext* ctx,
+             ProcessHandle handle) {
+    if (size == 0)
+      return;
+    delegate.processHadOutput(ctx, handle, StringRef(buffer.get(), size));
+    size = 0;
+  }
+};
+
+constexpr std::chrono::milliseconds OutputCoalescer::flushDelay;
+
 // Helper function to collect subprocess output
 static void captureExecutedProcessOutput(ProcessDelegate& delegate,
                                          FD outputPipe, ProcessHandle handle,
-                                         ProcessContext* ctx) {
+                                         ProcessContext* ctx,
+                                         uint64_t& outputSize) {
+  OutputCoalescer output;
   while (true) {
-    char buf[4096];
-    ssize_t numBytes =
-        sys::FileDescriptorTraits<>::Read(outputPipe, buf, sizeof(buf));
+#if !defined(_WIN32)
+    // If we have output pending, only wait for more until it is due.
+    if (output.hasPending()) {
+      pollfd readfd{ outputPipe, POLLIN, 0 };
+      if (poll(&readfd, 1, output.getFlushTimeout()) == 0) {
+        output.flush(delegate, ctx, handle);
+        continue;
+      }
+    }
+#endif
+    ssize_t numBytes = output.readFrom(outputPipe);
     if (numBytes < 0) {
       int err = errno;
       delegate.processHadError(ctx, handle,
@@ -264,9 +459,13 @@ static void captureExecutedProcessOutput(ProcessDelegate& delegate,
     if (numBytes == 0)
       break;
 
-    // Notify the client of the output.
-    delegate.processHadOutput(ctx, handle, StringRef(buf, numBytes));
+    // Notify the client of the output, once due.
+    outputSize += numBytes;
+    if (output.isDue())
+      output.flush(delegate, ctx, handle);
   }
+  output.flush(delegate, ctx, handle);
+
   // We have receieved the zero byte read that indicates an EOF. Go ahead and
   // close the pipe.
   sys::FileDescriptorTraits<>::Close(outputPipe);
@@ -278,7 +477,8 @@ static void cleanUpExecutedProcess(ProcessDelegate& delegate,
                                    ProcessGroup& pgrp, llbuild_pid_t pid,
                                    ProcessHandle handle, ProcessContext* ctx,
                                    ProcessCompletionFn&& completionFn,
-                                   FD releaseFd) {
+                                   FD releaseFd, uint64_t outputSize,
+                                   int statusFd = -1) {
 #if defined(_WIN32)
   FILETIME creationTime;
   FILETIME exitTime;
@@ -300,10 +500,18 @@ static void cleanUpExecutedProcess(ProcessDelegate& delegate,
   }
 #else
   // Wait for the command to complete.
+  //
+  // Processes launched by the spawn server are not our children, so the
+  // server reports their status instead.
   struct rusage usage;
-  int exitCode, result = wait4(pid, &exitCode, 0, &usage);
-  while (result == -1 && errno == EINTR)
+  int exitCode = 0, result;
+  if (statusFd >= 0) {
+    result = readSpawnServerExitStatus(statusFd, exitCode, usage) ? pid : -1;
+  } else {
     result = wait4(pid, &exitCode, 0, &usage);
+    while (result == -1 && errno == EINTR)
+      result = wait4(pid, &exitCode, 0, &usage);
+  }
 #endif
   // Close the release pipe
   //
@@ -342,9 +550,6 @@ static void cleanUpExecutedProcess(ProcessDelegate& delegate,
   //   - sys time, in µs
   //   - memory usage, in bytes
 
-  // FIXME: We should report a statistic for how much output we read from the
-  // subprocess (probably as a new point sample).
-
   // Notify of the process completion.
   ProcessStatus processStatus =
       (exitCode == 0) ? ProcessStatus::Succeeded : ProcessStatus::Failed;
@@ -369,21 +574,414 @@ static void cleanUpExecutedProcess(ProcessDelegate& delegate,
                     uint64_t(usage.ru_utime.tv_usec));
   uint64_t stime = (uint64_t(usage.ru_stime.tv_sec) * 1000000 +
                     uint64_t(usage.ru_stime.tv_usec));
-
-  // FIXME: We should report a statistic for how much output we read from the
-  // subprocess (probably as a new point sample).
+  uint64_t maxrss = uint64_t(usage.ru_maxrss);
+#if !defined(__APPLE__)
+  // The peak RSS is reported in kilobytes.
+  maxrss *= 1024;
+#endif
 
   // Notify of the process completion.
   bool cancelled = WIFSIGNALED(exitCode) && (WTERMSIG(exitCode) == SIGINT || WTERMSIG(exitCode) == SIGKILL);
   ProcessStatus processStatus = cancelled ? ProcessStatus::Cancelled : (exitCode == 0) ? ProcessStatus::Succeeded : ProcessStatus::Failed;
   ProcessResult processResult(processStatus, exitCode, pid, utime, stime,
-                              usage.ru_maxrss);
+                              maxrss);
 #endif // else !defined(_WIN32)
+  processResult.outputSize = outputSize;
   delegate.processFinished(ctx, handle, processResult);
   completionFn(processResult);
 }
 
-void llbuild::basic::spawnProcess(
+#if defined(__linux__)
+namespace {
+
+/// Supervises spawned processes from a single shared thread, multiplexing
+/// their output and control pipes with epoll and detecting their exit via a
+/// pidfd (on kernels which support them; otherwise, processes whose output
+/// has closed are polled until they exit).
+///
+/// All processes are owned by the reactor thread once handed to it, and their
+/// delegate and completion callbacks are invoked from that thread.
+class ProcessReactor {
+  struct Process;
+
+  /// The kind of file descriptor being watched.
+  enum class WatchKind { Output, Control, Exit };
+
+  struct Watch {
+    Process* process;
+    WatchKind kind;
+  };
+
+  struct Process {
+    ProcessDelegate& delegate;
+    ProcessContext* ctx;
+    ProcessGroup& pgrp;
+    llbuild_pid_t pid;
+    ProcessHandle handle;
+    int outputFd;
+    int controlFd;
+    int statusFd;
+    int pidFd = -1;
+    ControlProtocolState control;
+    std::function<void()> releaseFn;
+    ProcessCompletionFn completionFn;
+    OutputCoalescer output;
+    uint64_t outputSize = 0;
+
+    /// Whether each descriptor is still registered with the reactor.
+    bool watchingOutput = false;
+    bool watchingControl = false;
+    bool watchingExit = false;
+
+    /// Whether the process is known to have exited.
+    bool exited = false;
+
+    /// Whether the process is in the list of those with pending output.
+    bool outputPending = false;
+
+    Watch outputWatch{this, WatchKind::Output};
+    Watch controlWatch{this, WatchKind::Control};
+    Watch exitWatch{this, WatchKind::Exit};
+
+    Process(ProcessDelegate& delegate, ProcessContext* ctx, ProcessGroup& pgrp,
+            llbuild_pid_t pid, ProcessHandle handle, int outputFd,
+            int controlFd, int statusFd, const std::string& controlID,
+            std::function<void()>&& releaseFn,
+            ProcessCompletionFn&& completionFn)
+        : delegate(delegate), ctx(ctx), pgrp(pgrp), pid(pid), handle(handle),
+          outputFd(outputFd), controlFd(controlFd), statusFd(statusFd),
+          control(controlID),
+          releaseFn(std::move(releaseFn)),
+          completionFn(std::move(completionFn)) {}
+  };
+
+  /// The epoll instance.
+  int epollFd;
+
+  /// The event used to wake the reactor when processes are added.
+  int wakeFd;
+
+  /// The processes added since the reactor last woke up.
+  std::mutex newProcessesMutex;
+  std::vector<Process*> newProcesses;
+
+  /// The processes without a pidfd which are waiting to exit.
+  std::vector<Process*> exitPolledProcesses;
+
+  /// The processes completed while handling the current batch of events,
+  /// which may still have pending events in the batch.
+  std::vector<Process*> completedProcesses;
+
+  /// The processes with output waiting to be delivered.
+  std::vector<Process*> outputPendingProcesses;
+
+  /// The buffer used for reading control messages.
+  char buffer[4096];
+
+  ProcessReactor(int epollFd, int wakeFd) : epollFd(epollFd), wakeFd(wakeFd) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    (void) epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+    // The reactor is never destroyed, so its thread is never joined.
+    std::thread(&ProcessReactor::run, this).detach();
+  }
+
+  bool watch(int fd, Watch* watch) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = watch;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+  }
+
+  void unwatch(int fd) {
+    (void) epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+  }
+
+  void registerProcess(Process* process) {
+    process->watchingOutput = watch(process->outputFd, &process->outputWatch);
+    if (process->controlFd >= 0)
+      process->watchingControl = watch(process->controlFd,
+                                       &process->controlWatch);
+    if (process->statusFd >= 0) {
+      // The spawn server reports the exit of its processes.
+      process->watchingExit = watch(process->statusFd, &process->exitWatch);
+    }
+#if defined(SYS_pidfd_open)
+    if (process->statusFd < 0)
+      process->pidFd = int(::syscall(SYS_pidfd_open, process->pid, 0));
+    if (process->pidFd >= 0) {
+      process->watchingExit = watch(process->pidFd, &process->exitWatch);
+      if (!process->watchingExit) {
+        ::close(process->pidFd);
+        process->pidFd = -1;
+      }
+    }
+#endif
+    if (!process->watchingOutput) {
+      // Without output to wait for, the process can only be waited on.
+      checkCompletion(process);
+    }
+  }
+
+  void handleOutput(Process* process) {
+    ssize_t numBytes = process->output.readFrom(process->outputFd);
+    if (numBytes < 0) {
+      if (errno == EAGAIN || errno == EINTR)
+        return;
+      process->delegate.processHadError(
+          process->ctx, process->handle,
+          Twine("unable to read process output (") + strerror(errno) + ")");
+    }
+    if (numBytes > 0) {
+      process->outputSize += numBytes;
+      if (process->output.isDue()) {
+        process->output.flush(process->delegate, process->ctx,
+                              process->handle);
+      } else if (!process->outputPending) {
+        process->outputPending = true;
+        outputPendingProcesses.push_back(process);
+      }
+      return;
+    }
+
+    // We have reached EOF (or an error); deliver the remaining output and stop
+    // watching it.
+    process->output.flush(process->delegate, process->ctx, process->handle);
+    if (process->outputPending) {
+      outputPendingProcesses.erase(
+          std::find(outputPendingProcesses.begin(),
+                    outputPendingProcesses.end(), process));
+      process->outputPending = false;
+    }
+    unwatch(process->outputFd);
+    process->watchingOutput = false;
+    checkCompletion(process);
+  }
+
+  /// Deliver the pending output which is due.
+  void flushPendingOutput() {
+    auto it = std::remove_if(
+        outputPendingProcesses.begin(), outputPendingProcesses.end(),
+        [](Process* process) {
+          if (process->output.hasPending() && !process->output.isDue())
+            return false;
+          process->output.flush(process->delegate, process->ctx,
+                                process->handle);
+          process->outputPending = false;
+          return true;
+        });
+    outputPendingProcesses.erase(it, outputPendingProcesses.end());
+  }
+
+  /// Get the time until the next pending output is due, in milliseconds, or -1
+  /// if there is none.
+  int getFlushTimeout() const {
+    int timeout = -1;
+    for (auto* process: outputPendingProcesses) {
+      int processTimeout = process->output.getFlushTimeout();
+      if (processTimeout >= 0 && (timeout < 0 || processTimeout < timeout))
+        timeout = processTimeout;
+    }
+    return timeout;
+  }
+
+  void handleControl(Process* process) {
+    ssize_t numBytes = ::read(process->controlFd, buffer, sizeof(buffer));
+    if (numBytes < 0 && (errno == EAGAIN || errno == EINTR))
+      return;
+
+    bool done = numBytes <= 0;
+    if (numBytes > 0) {
+      std::string errstr;
+      int ret = process->control.read(StringRef(buffer, numBytes), &errstr);
+      if (ret < 0) {
+        process->delegate.processHadError(
+            process->ctx, process->handle,
+            Twine("control protocol error" + errstr));
+      }
+      done = ret != 0;
+    }
+    if (!done)
+      return;
+
+    // We halt receiving anything after the first control message, but keep
+    // the pipe open until the process has finished (see
+    // cleanUpExecutedProcess()).
+    unwatch(process->controlFd);
+    process->watchingControl = false;
+    if (process->control.shouldRelease() && process->releaseFn)
+      process->releaseFn();
+  }
+
+  void handleExit(Process* process) {
+    unwatch(process->statusFd >= 0 ? process->statusFd : process->pidFd);
+    process->watchingExit = false;
+    process->exited = true;
+    checkCompletion(process);
+  }
+
+  /// Complete the process, if its output has been fully read and it has
+  /// exited.
+  void checkCompletion(Process* process) {
+    if (process->watchingOutput)
+      return;
+
+    if (!process->exited && process->watchingExit)
+      return;
+
+    // If we have no pidfd, check for exit without reaping the process. (A
+    // process from the spawn server is simply waited on.)
+    if (!process->exited && process->statusFd < 0) {
+      siginfo_t info;
+      info.si_pid = 0;
+      int result = ::waitid(P_PID, process->pid, &info,
+                            WEXITED | WNOHANG | WNOWAIT);
+      if (result == 0 && info.si_pid == 0) {
+        if (std::find(exitPolledProcesses.begin(), exitPolledProcesses.end(),
+                      process) == exitPolledProcesses.end())
+          exitPolledProcesses.push_back(process);
+        return;
+      }
+      process->exited = true;
+    }
+
+    if (process->pidFd >= 0)
+      ::close(process->pidFd);
+    if (process->watchingControl) {
+      unwatch(process->controlFd);
+      process->watchingControl = false;
+    }
+    ::close(process->outputFd);
+
+    // The process has exited, so this will reap it without blocking.
+    cleanUpExecutedProcess(process->delegate, process->pgrp, process->pid,
+                           process->handle, process->ctx,
+                           std::move(process->completionFn),
+                           process->controlFd, process->outputSize,
+                           process->statusFd);
+    completedProcesses.push_back(process);
+  }
+
+  void run() {
+    pthread_setname_np(pthread_self(), "org.swift.llbuild Reactor");
+
+    const int maxEvents = 64;
+    epoll_event events[maxEvents];
+    while (true) {
+      int timeout = getFlushTimeout();
+      if (!exitPolledProcesses.empty() && (timeout < 0 || timeout > 10))
+        timeout = 10;
+      int numEvents = epoll_wait(epollFd, events, maxEvents, timeout);
+      if (numEvents < 0) {
+        if (errno == EINTR)
+          continue;
+        numEvents = 0;
+      }
+
+      for (int i = 0; i != numEvents; ++i) {
+        auto* watch = static_cast<Watch*>(events[i].data.ptr);
+        if (!watch) {
+          // Register the newly added processes.
+          uint64_t value;
+          (void) ::read(wakeFd, &value, sizeof(value));
+          std::vector<Process*> processes;
+          {
+            std::lock_guard<std::mutex> guard(newProcessesMutex);
+            std::swap(processes, newProcesses);
+          }
+          for (auto* process: processes)
+            registerProcess(process);
+          continue;
+        }
+
+        switch (watch->kind) {
+        case WatchKind::Output:
+          if (watch->process->watchingOutput)
+            handleOutput(watch->process);
+          break;
+        case WatchKind::Control:
+          if (watch->process->watchingControl)
+            handleControl(watch->process);
+          break;
+        case WatchKind::Exit:
+          if (watch->process->watchingExit)
+            handleExit(watch->process);
+          break;
+        }
+      }
+
+      if (!outputPendingProcesses.empty())
+        flushPendingOutput();
+
+      // Check the processes we are polling for exit.
+      if (!exitPolledProcesses.empty()) {
+        std::vector<Process*> processes;
+        std::swap(processes, exitPolledProcesses);
+        for (auto* process: processes)
+          checkCompletion(process);
+      }
+
+      for (auto* process: completedProcesses)
+        delete process;
+      completedProcesses.clear();
+    }
+  }
+
+public:
+  /// Get the shared reactor, or null if it could not be created.
+  static ProcessReactor* get() {
+    static ProcessReactor* reactor = []() -> ProcessReactor* {
+      int epollFd = epoll_create1(EPOLL_CLOEXEC);
+      if (epollFd < 0)
+        return nullptr;
+      int wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+      if (wakeFd < 0) {
+        ::close(epollFd);
+        return nullptr;
+      }
+      return new ProcessReactor(epollFd, wakeFd);
+    }();
+    return reactor;
+  }
+
+  /// Hand a launched process to the reactor.
+  void addProcess(ProcessDelegate& delegate, ProcessContext* ctx,
+                  ProcessGroup& pgrp, llbuild_pid_t pid, ProcessHandle handle,
+                  int outputFd, int controlFd, int statusFd,
+                  const std::string& controlID,
+                  std::function<void()>&& releaseFn,
+                  ProcessCompletionFn&& completionFn) {
+    (void) ::fcntl(outputFd, F_SETFL, ::fcntl(outputFd, F_GETFL) | O_NONBLOCK);
+    if (controlFd >= 0) {
+      (void) ::fcntl(controlFd, F_SETFL,
+                     ::fcntl(controlFd, F_GETFL) | O_NONBLOCK);
+    }
+    auto* process = new Process(delegate, ctx, pgrp, pid, handle, outputFd,
+                                controlFd, statusFd, controlID,
+                                std::move(releaseFn), std::move(completionFn));
+    {
+      std::lock_guard<std::mutex> guard(newProcessesMutex);
+      newProcesses.push_back(process);
+    }
+    uint64_t value = 1;
+    (void) ::write(wakeFd, &value, sizeof(value));
+  }
+};
+
+}
+#endif
+
+bool llbuild::basic::isProcessReactorSupported() {
+#if defined(__linux__)
+  return ProcessReactor::get() != nullptr;
+#else
+  return false;
+#endif
+}
+
+static void spawnProcessImpl(
     ProcessDelegate& delegate,
     ProcessContext* ctx,
     ProcessGroup& pgrp,
@@ -392,6 +990,7 @@ void llbuild::basic::spawnProcess(
     POSIXEnvironment environment,
     ProcessAttributes attr,
     ProcessReleaseFn&& releaseFn,
+    std::function<void()>* asyncReleaseFn,
     ProcessCompletionFn&& completionFn
 ) {
   // Whether or not we are capturing output.
@@ -483,10 +1082,12 @@ void llbuild::basic::spawnProcess(
   flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
 #endif
 
-  // On Darwin, set the QOS of launched processes to the global default.
+  // On Darwin, set the QOS of launched processes (on other platforms, this is
+  // done once the process is launched).
 #ifdef __APPLE__
   posix_spawnattr_set_qos_class_np(
-      &attributes, _getDarwinQOSClass(defaultQualityOfService));
+      &attributes, _getDarwinQOSClass(
+          attr.qualityOfService.getValueOr(getDefaultQualityOfService())));
 #endif
 
   posix_spawnattr_setflags(&attributes, flags);
@@ -609,6 +1210,7 @@ void llbuild::basic::spawnProcess(
 
   // Spawn the command.
   llbuild_pid_t pid = (llbuild_pid_t)-1;
+  int statusFd = -1;
   bool wasCancelled;
   {
     // We need to hold the spawn processes lock when we spawn, to ensure that
@@ -623,7 +1225,8 @@ void llbuild::basic::spawnProcess(
       bool workingDirectoryUnsupported = false;
 
 #if !defined(_WIN32)
-      if (usePosixSpawnChdirFallback) {
+      const bool useSpawnServer = isSpawnServerRunning();
+      if (usePosixSpawnChdirFallback && !useSpawnServer) {
 #ifdef __APPLE__
         thread_local std::string threadWorkingDir;
 
@@ -664,10 +1267,24 @@ void llbuild::basic::spawnProcess(
                                                   : (LPWSTR)u16Cwd.data(),
             &startupInfo, &processInfo);
 #else
-        result =
+        if (useSpawnServer) {
+          result = spawnViaServer(
+              args, environment.getEnvp(), workingDir, outputPipe[1],
+              controlPipe[1],
+              attr.qualityOfService.getValueOr(getDefaultQualityOfService()),
+              attr.cpu, pid, statusFd);
+        }
+
+        // Launch the process directly if the spawn server has gone away
+        // (unless we would need to change the working directory ourselves).
+        if (!useSpawnServer ||
+            (result == ESRCH &&
+             !(usePosixSpawnChdirFallback && !workingDir.empty()))) {
+          result =
             posix_spawn(&pid, args[0], /*file_actions=*/&fileActions,
                         /*attrp=*/&attributes, const_cast<char**>(args.data()),
                         const_cast<char* const*>(environment.getEnvp()));
+        }
 #endif
       }
 
@@ -687,8 +1304,14 @@ void llbuild::basic::spawnProcess(
       } else {
 #if defined(_WIN32)
         pid = processInfo.hProcess;
+#else
+        // The spawn server applies the scheduling attributes itself.
+        if (statusFd < 0)
+          applyProcessScheduling(pid, attr);
+        LLBUILD_PROBE2(process_spawned, handle.id, pid);
 #endif
         ProcessInfo info{ attr.canSafelyInterrupt };
+        info.viaSpawnServer = statusFd >= 0;
         pgrp.add(std::move(guard), pid, info);
       }
     }
@@ -718,6 +1341,20 @@ void llbuild::basic::spawnProcess(
     return;
   }
 
+#if defined(__linux__)
+  // If requested, hand the process to the reactor rather than waiting for it.
+  if (asyncReleaseFn) {
+    if (auto* reactor = ProcessReactor::get()) {
+      // Close the write end of the output pipe.
+      sys::FileDescriptorTraits<>::Close(outputPipe[1]);
+      reactor->addProcess(delegate, ctx, pgrp, pid, handle, outputPipe[0],
+                          controlPipe[0], statusFd, taskID.str(),
+                          std::move(*asyncReleaseFn), std::move(completionFn));
+      return;
+    }
+  }
+#endif
+
 #if !defined(_WIN32)
   // Set up our select() structures
   pollfd readfds[] = {
@@ -728,6 +1365,7 @@ void llbuild::basic::spawnProcess(
 #endif
   const int nfds = 2;
   ControlProtocolState control(taskID.str());
+  uint64_t outputSize = 0;
   std::function<bool (StringRef)> readCbs[] = {
     // control callback handle
     [&delegate, &control, ctx, handle](StringRef buf) mutable -> bool {
@@ -740,8 +1378,9 @@ void llbuild::basic::spawnProcess(
       return (ret == 0);
     },
     // output capture callback
-    [&delegate, ctx, handle](StringRef buf) -> bool {
+    [&delegate, &outputSize, ctx, handle](StringRef buf) -> bool {
       // Notify the client of the output.
+      outputSize += buf.size();
       delegate.processHadOutput(ctx, handle, buf);
       return true;
     }
@@ -778,12 +1417,15 @@ void llbuild::basic::spawnProcess(
       if (control.shouldRelease()) {
         releaseFn([&delegate, &pgrp, pid, handle, ctx, shouldCaptureOutput,
                    outputFd = outputPipe[0], controlFd = controlPipe[0],
+                   outputSize = outputSize,
                    completionFn = std::move(completionFn)]() mutable {
           if (shouldCaptureOutput)
-            captureExecutedProcessOutput(delegate, outputFd, handle, ctx);
+            captureExecutedProcessOutput(delegate, outputFd, handle, ctx,
+                                         outputSize);
 
           cleanUpExecutedProcess(delegate, pgrp, pid, handle, ctx,
-                                 std::move(completionFn), controlFd);
+                                 std::move(completionFn), controlFd,
+                                 outputSize);
         });
         return;
       }
@@ -832,27 +1474,34 @@ void llbuild::basic::spawnProcess(
         ctx, handle, Twine("failed to poll (") + sys::strerror(err) + ")");
   }
 #else  // !defined(_WIN32)
+  // The output is read directly into the coalescing buffer, and delivered
+  // from there (rather than via `readCbs`).
+  OutputCoalescer output;
   while (activeEvents) {
     char buf[4096];
     activeEvents = 0;
 
-    if (poll(readfds, nfds, -1) == -1) {
+    int numEvents = poll(readfds, nfds, output.getFlushTimeout());
+    if (numEvents == -1) {
       int err = errno;
       delegate.processHadError(ctx, handle,
           Twine("failed to poll (") + strerror(err) + ")");
       break;
     }
 
-
     for (int i = 0; i < nfds; i++) {
       if (readfds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
-        ssize_t numBytes = read(readfds[i].fd, buf, sizeof(buf));
+        ssize_t numBytes = (i == 1) ? output.readFrom(readfds[i].fd)
+                                    : read(readfds[i].fd, buf, sizeof(buf));
         if (numBytes < 0) {
           int err = errno;
           delegate.processHadError(ctx, handle,
               Twine("unable to read process output (") + strerror(err) + ")");
         }
-        if (numBytes <= 0 || !readCbs[i](StringRef(buf, numBytes))) {
+        if (i == 1 && numBytes > 0)
+          outputSize += numBytes;
+        if (numBytes <= 0 ||
+            (i == 0 && !readCbs[i](StringRef(buf, numBytes)))) {
           readfds[i].events = 0;
           continue;
         }
@@ -860,22 +1509,32 @@ void llbuild::basic::spawnProcess(
       activeEvents |= readfds[i].events;
     }
 
+    if (output.isDue())
+      output.flush(delegate, ctx, handle);
+
     if (control.shouldRelease()) {
+      // Deliver any pending output before handing the rest off.
+      output.flush(delegate, ctx, handle);
       releaseFn([
                  &delegate, &pgrp, pid, handle, ctx,
                  outputFd=outputPipe[0],
                  controlFd=controlPipe[0],
+                 statusFd,
+                 outputSize=outputSize,
                  completionFn=std::move(completionFn)
                  ]() mutable {
         if (shouldCaptureOutput)
-          captureExecutedProcessOutput(delegate, outputFd, handle, ctx);
+          captureExecutedProcessOutput(delegate, outputFd, handle, ctx,
+                                       outputSize);
 
         cleanUpExecutedProcess(delegate, pgrp, pid, handle, ctx,
-                               std::move(completionFn), controlFd);
+                               std::move(completionFn), controlFd,
+                               outputSize, statusFd);
       });
       return;
     }
   }
+  output.flush(delegate, ctx, handle);
 #endif // else !defined(_WIN32)
   if (shouldCaptureOutput) {
     // If we have reached here, both the control and read pipes have given us
@@ -884,5 +1543,46 @@ void llbuild::basic::spawnProcess(
     sys::FileDescriptorTraits<>::Close(outputPipe[0]);
   }
   cleanUpExecutedProcess(delegate, pgrp, pid, handle, ctx,
-                         std::move(completionFn), controlPipe[0]);
+                         std::move(completionFn), controlPipe[0], outputSize,
+                         statusFd);
+}
+
+void llbuild::basic::spawnProcess(
+    ProcessDelegate& delegate,
+    ProcessContext* ctx,
+    ProcessGroup& pgrp,
+    ProcessHandle handle,
+    ArrayRef<StringRef> commandLine,
+    POSIXEnvironment environment,
+    ProcessAttributes attr,
+    ProcessReleaseFn&& releaseFn,
+    ProcessCompletionFn&& completionFn
+) {
+  spawnProcessImpl(delegate, ctx, pgrp, handle, commandLine,
+                   std::move(environment), attr, std::move(releaseFn),
+                   /*asyncReleaseFn=*/nullptr, std::move(completionFn));
+}
+
+void llbuild::basic::spawnProcessAsync(
+    ProcessDelegate& delegate,
+    ProcessContext* ctx,
+    ProcessGroup& pgrp,
+    ProcessHandle handle,
+    ArrayRef<StringRef> commandLine,
+    POSIXEnvironment environment,
+    ProcessAttributes attr,
+    std::function<void()>&& releaseFn,
+    ProcessCompletionFn&& completionFn
+) {
+  // Without a reactor, the process is waited on by the caller, and releasing
+  // it just continues waiting.
+  ProcessReleaseFn syncReleaseFn =
+    [&releaseFn](std::function<void()>&& processWait) {
+      if (releaseFn)
+        releaseFn();
+      processWait();
+    };
+  spawnProcessImpl(delegate, ctx, pgrp, handle, commandLine,
+                   std::move(environment), attr, std::move(syncReleaseFn),
+                   &releaseFn, std::move(completionFn));
 }
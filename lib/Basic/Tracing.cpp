@@ -1,8 +1,8 @@
-//===-- Hashing.cpp -------------------------------------------------------===//
+//===-- Tracing.cpp -------------------------------------------------------===//
 //
 // This source file is part of the Swift.org open source project
 //
-// Copyright (c) 2014 - 2015 Apple Inc. and the Swift project authors
+// Copyright (c) 2014 - 2019 Apple Inc. and the Swift project authors
 // Licensed under Apache License v2.0 with Runtime Library Exception
 //
 // See http://swift.org/LICENSE.txt for license information
@@ -12,8 +12,320 @@
 
 #include "llbuild/Basic/Tracing.h"
 
+#if defined(LLBUILD_TRACING_TRACE_EVENTS)
+
+#include "llbuild/Basic/LLVM.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#endif
+
 namespace llbuild {
 
+#if defined(LLBUILD_TRACING_TRACE_EVENTS)
+
+namespace {
+
+/// The environment variable naming the path to write trace events to, which
+/// also enables tracing at startup.
+const char* const traceEventsPathVariable = "LLBUILD_TRACE_EVENTS";
+
+}
+
+bool TracingEnabled = ::getenv(traceEventsPathVariable) != nullptr;
+
+namespace tracing {
+
+namespace {
+
+/// The number of events kept by each thread (32MB worth, although the memory
+/// is only touched as events are recorded); once full, the oldest events are
+/// overwritten.
+const uint64_t eventsPerThread = 1 << 18;
+
+static_assert(sizeof(Event) == 128, "unexpected trace event size");
+
+/// The ring buffer of the events recorded by a thread.
+///
+/// Only the owning thread writes events, so recording is lock-free; the
+/// buffers are read when the events are written out, which is expected to be
+/// when the build is quiescent.
+struct ThreadBuffer {
+  /// The kernel's identifier for the thread.
+  uint64_t threadID;
+
+  std::unique_ptr<Event[]> events{ new Event[eventsPerThread] };
+
+  /// The total number of events recorded.
+  std::atomic<uint64_t> numEvents{ 0 };
+
+  /// The number of events written out (or dropped) so far, with the registry
+  /// mutex held.
+  uint64_t numWrittenEvents = 0;
+
+  /// Whether the thread has exited.
+  std::atomic<bool> hasExited{ false };
+};
+
+/// The buffers of all threads which have recorded events.
+///
+/// Buffers are kept after their thread exits (as lanes do at the end of each
+/// build), until its events have been written out.
+struct ThreadBufferRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+ThreadBufferRegistry& getRegistry() {
+  static ThreadBufferRegistry* registry = new ThreadBufferRegistry;
+  return *registry;
+}
+
+thread_local ThreadBuffer* currentBuffer = nullptr;
+
+/// Marks the current thread's buffer once the thread exits.
+struct ThreadExitObserver {
+  ThreadBuffer* buffer = nullptr;
+
+  ~ThreadExitObserver() {
+    if (buffer)
+      buffer->hasExited.store(true, std::memory_order_release);
+  }
+};
+
+thread_local ThreadExitObserver threadExitObserver;
+
+ThreadBuffer& getCurrentBuffer() {
+  if (currentBuffer)
+    return *currentBuffer;
+
+  auto buffer = llvm::make_unique<ThreadBuffer>();
+  buffer->threadID = uint64_t(::syscall(SYS_gettid));
+  currentBuffer = buffer.get();
+  threadExitObserver.buffer = buffer.get();
+  auto& registry = getRegistry();
+  std::lock_guard<std::mutex> guard(registry.mutex);
+  registry.buffers.push_back(std::move(buffer));
+  return *currentBuffer;
+}
+
+uint64_t getTimestamp() {
+  struct timespec now;
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+  return uint64_t(now.tv_sec) * 1000000000 + uint64_t(now.tv_nsec);
+}
+
+}
+
+Event& beginEvent(EventPhase phase, const char* name, const char* format) {
+  auto& buffer = getCurrentBuffer();
+  auto index = buffer.numEvents.load(std::memory_order_relaxed);
+  auto& event = buffer.events[index % eventsPerThread];
+  event.timestamp = getTimestamp();
+  event.name = name;
+  event.format = format;
+  event.phase = phase;
+  event.numArgs = 0;
+  event.stringArg = UINT8_MAX;
+  event.stringLength = 0;
+  return event;
+}
+
+void endEvent() {
+  auto& buffer = *currentBuffer;
+  buffer.numEvents.store(buffer.numEvents.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_release);
+}
+
+void addArgument(Event& event, const char* value) {
+  if (event.numArgs == sizeof(event.args) / sizeof(event.args[0]))
+    return;
+  if (event.stringArg == UINT8_MAX && value) {
+    size_t length = std::min(strlen(value), sizeof(event.string));
+    memcpy(event.string, value, length);
+    event.stringArg = event.numArgs;
+    event.stringLength = uint8_t(length);
+  }
+  event.args[event.numArgs++] = 0;
+}
+
+}
+
+namespace {
+
+void writeJSONString(llvm::raw_ostream& os, StringRef value) {
+  os << '"';
+  for (unsigned char c: value) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (c < 0x20) {
+      char escape[8];
+      snprintf(escape, sizeof(escape), "\\u%04x", c);
+      os << escape;
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+/// Write the arguments of an event, as described by its format.
+///
+/// The formats used by the tracing points are sequences of "label:%<spec>"
+/// separated by ';', which are written as a JSON object from each label to
+/// its argument.
+void writeArguments(llvm::raw_ostream& os, const tracing::Event& event) {
+  os << '{';
+  StringRef remaining(event.format);
+  unsigned argIndex = 0;
+  while (!remaining.empty() && argIndex != event.numArgs) {
+    StringRef field;
+    std::tie(field, remaining) = remaining.split(';');
+    StringRef label, spec;
+    std::tie(label, spec) = field.split(':');
+    if (!spec.startswith("%"))
+      continue;
+
+    if (argIndex != 0)
+      os << ',';
+    writeJSONString(os, label);
+    os << ':';
+    if (spec.endswith("s")) {
+      StringRef string;
+      if (argIndex == event.stringArg)
+        string = StringRef(event.string, event.stringLength);
+      writeJSONString(os, string);
+    } else if (spec.endswith("d")) {
+      if (spec.contains('l'))
+        os << int64_t(event.args[argIndex]);
+      else
+        os << int32_t(event.args[argIndex]);
+    } else {
+      os << event.args[argIndex];
+    }
+    ++argIndex;
+  }
+  os << '}';
+}
+
+void writeEvent(llvm::raw_ostream& os, const tracing::Event& event,
+                uint64_t processID, uint64_t threadID) {
+  const char* phase = "i";
+  switch (event.phase) {
+  case tracing::EventPhase::IntervalBegin: phase = "B"; break;
+  case tracing::EventPhase::IntervalEnd: phase = "E"; break;
+  case tracing::EventPhase::Point: phase = "i"; break;
+  }
+
+  // Timestamps are in microseconds.
+  char timestamp[32];
+  snprintf(timestamp, sizeof(timestamp), "%llu.%03llu",
+           (unsigned long long)(event.timestamp / 1000),
+           (unsigned long long)(event.timestamp % 1000));
+
+  os << "{\"name\":";
+  writeJSONString(os, event.name);
+  os << ",\"cat\":\"llbuild\",\"ph\":\"" << phase << "\",\"ts\":" << timestamp
+     << ",\"pid\":" << processID << ",\"tid\":" << threadID;
+  if (event.phase == tracing::EventPhase::Point)
+    os << ",\"s\":\"t\"";
+  if (event.format) {
+    os << ",\"args\":";
+    writeArguments(os, event);
+  }
+  os << '}';
+}
+
+}
+
+bool TracingWriteEvents(std::string* error_out) {
+  SmallString<256> path;
+  if (const char* value = ::getenv(traceEventsPathVariable)) {
+    path = value;
+  } else {
+    llvm::sys::path::system_temp_directory(/*ErasedOnReboot=*/true, path);
+    llvm::sys::path::append(path, "llbuild-trace-" +
+                            llvm::Twine(::getpid()) + ".json");
+  }
+
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_Text);
+  if (ec) {
+    *error_out = ("unable to write trace events to '" + path + "': " +
+                  ec.message()).str();
+    return false;
+  }
+
+  uint64_t processID = uint64_t(::getpid());
+  uint64_t numDropped = 0;
+  bool first = true;
+  os << "{\"traceEvents\":[\n";
+  auto& registry = tracing::getRegistry();
+  {
+    std::lock_guard<std::mutex> guard(registry.mutex);
+    for (auto& buffer: registry.buffers) {
+      // Check whether the thread has exited before reading its events, so
+      // that none are missed when its buffer is freed below.
+      bool hasExited = buffer->hasExited.load(std::memory_order_acquire);
+      uint64_t end = buffer->numEvents.load(std::memory_order_acquire);
+      uint64_t start = buffer->numWrittenEvents;
+      if (end - start > tracing::eventsPerThread) {
+        numDropped += end - tracing::eventsPerThread - start;
+        start = end - tracing::eventsPerThread;
+      }
+      for (uint64_t i = start; i != end; ++i) {
+        if (!first)
+          os << ",\n";
+        first = false;
+        writeEvent(os, buffer->events[i % tracing::eventsPerThread],
+                   processID, buffer->threadID);
+      }
+      buffer->numWrittenEvents = end;
+      if (hasExited)
+        buffer.reset();
+    }
+    registry.buffers.erase(
+        std::remove(registry.buffers.begin(), registry.buffers.end(), nullptr),
+        registry.buffers.end());
+  }
+  os << "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"droppedEvents\":"
+     << numDropped << "}}\n";
+
+  os.close();
+  if (os.has_error()) {
+    os.clear_error();
+    *error_out = ("unable to write trace events to '" + path + "'").str();
+    return false;
+  }
+  return true;
+}
+
+#else
+
 bool TracingEnabled = false;
 
+bool TracingWriteEvents(std::string* error_out) {
+  return true;
+}
+
+#endif
+
 }
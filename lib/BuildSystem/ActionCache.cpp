@@ -0,0 +1,296 @@
+//===-- ActionCache.cpp ---------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/BuildSystem/ActionCache.h"
+
+#include "llbuild/Basic/FileSystem.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdio>
+
+using namespace llbuild;
+using namespace llbuild::basic;
+using namespace llbuild::buildsystem;
+
+/// The version of the action key format, mixed into every key so that a change
+/// to the format invalidates existing entries.
+static const char* const actionKeyVersion = "llbuild-action-v2";
+
+static std::string computeDigest(StringRef contents) {
+  llvm::MD5 hash;
+  hash.update(contents);
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  return result.digest().str();
+}
+
+/// Atomically write \arg contents to \arg path, via a temporary file in the
+/// same directory.
+static bool writeFileAtomically(StringRef path, StringRef contents,
+                                uint64_t mode) {
+  int fd;
+  SmallString<256> tempPath;
+  if (llvm::sys::fs::createUniqueFile(path + ".tmp-%%%%%%%%", fd, tempPath))
+    return false;
+
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os << contents;
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      (void) llvm::sys::fs::remove(tempPath);
+      return false;
+    }
+  }
+
+  if (mode != 0 &&
+      llvm::sys::fs::setPermissions(
+          tempPath, llvm::sys::fs::perms(mode & llvm::sys::fs::all_perms))) {
+    (void) llvm::sys::fs::remove(tempPath);
+    return false;
+  }
+
+  if (llvm::sys::fs::rename(tempPath, path)) {
+    (void) llvm::sys::fs::remove(tempPath);
+    return false;
+  }
+
+  return true;
+}
+
+std::unique_ptr<ActionCache> ActionCache::create(StringRef path,
+                                                 StringRef rootPath,
+                                                 bool useHardLinks,
+                                                 std::string* error_out) {
+  for (const char* subdir: { "objects", "actions" }) {
+    SmallString<256> subpath(path);
+    llvm::sys::path::append(subpath, subdir);
+    if (auto ec = llvm::sys::fs::create_directories(subpath)) {
+      *error_out = "unable to create action cache directory '" +
+        subpath.str().str() + "': " + ec.message();
+      return nullptr;
+    }
+  }
+
+  SmallString<256> root(rootPath);
+  if (auto ec = llvm::sys::fs::make_absolute(root)) {
+    *error_out = "unable to resolve action cache root '" + rootPath.str() +
+      "': " + ec.message();
+    return nullptr;
+  }
+  llvm::sys::path::remove_dots(root, /*remove_dot_dot=*/true);
+  while (root.size() > 1 && llvm::sys::path::is_separator(root.back()))
+    root.pop_back();
+
+  return std::unique_ptr<ActionCache>(
+      new ActionCache(path, root, useHardLinks));
+}
+
+std::string ActionCache::relocate(StringRef value) const {
+  // The file system root (or no root at all) leaves nothing to relocate.
+  if (rootPath.size() <= 1)
+    return value;
+
+  std::string result;
+  while (true) {
+    auto pos = value.find(rootPath);
+    if (pos == StringRef::npos)
+      break;
+
+    // Only replace the root as a whole path, not a prefix of a longer name.
+    auto end = pos + rootPath.size();
+    if (end == value.size() || llvm::sys::path::is_separator(value[end])) {
+      result += value.substr(0, pos);
+      result += "<root>";
+    } else {
+      result += value.substr(0, end);
+    }
+    value = value.substr(end);
+  }
+  result += value;
+  return result;
+}
+
+llvm::Optional<std::string>
+ActionCache::getInputDigest(FileSystem& fileSystem, const std::string& path) {
+  auto info = fileSystem.getFileInfo(path);
+  if (info.isMissing() || info.isDirectory())
+    return llvm::None;
+
+  // Check if we have already digested this version of the file.
+  {
+    std::lock_guard<std::mutex> guard(inputDigestsMutex);
+    auto it = inputDigests.find(path);
+    if (it != inputDigests.end() && it->second.first == info)
+      return it->second.second;
+  }
+
+  auto buffer = fileSystem.getFileContents(path);
+  if (!buffer)
+    return llvm::None;
+  auto digest = computeDigest(buffer->getBuffer());
+
+  std::lock_guard<std::mutex> guard(inputDigestsMutex);
+  inputDigests[path] = std::make_pair(info, digest);
+  return digest;
+}
+
+llvm::Optional<std::string>
+ActionCache::computeActionKey(FileSystem& fileSystem,
+                              CommandSignature signature,
+                              ArrayRef<std::string> inputPaths) {
+  llvm::MD5 hash;
+  hash.update(actionKeyVersion);
+  basic::BinaryEncoder encodedSignature;
+  encodedSignature.write(signature);
+  hash.update(ArrayRef<uint8_t>(encodedSignature.data(),
+                                encodedSignature.size()));
+  for (const auto& inputPath: inputPaths) {
+    auto digest = getInputDigest(fileSystem, inputPath);
+    if (!digest.hasValue())
+      return llvm::None;
+
+    // Include the terminating NUL of each string, to keep them unambiguous.
+    auto relocatedPath = relocate(inputPath);
+    hash.update(StringRef(relocatedPath.c_str(), relocatedPath.size() + 1));
+    hash.update(StringRef(digest->c_str(), digest->size() + 1));
+  }
+
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  return result.digest().str().str();
+}
+
+llvm::Optional<std::string> ActionCache::storeObject(StringRef contents,
+                                                     uint64_t mode) {
+  auto digest = computeDigest(contents);
+
+  SmallString<256> objectPath(path);
+  llvm::sys::path::append(objectPath, "objects", digest);
+
+  // Objects are immutable, so if it already exists we are done.
+  if (llvm::sys::fs::exists(objectPath))
+    return digest;
+
+  if (!writeFileAtomically(objectPath, contents, mode))
+    return llvm::None;
+
+  return digest;
+}
+
+bool ActionCache::restoreOutputs(StringRef actionKey,
+                                 ArrayRef<std::string> outputPaths) {
+  SmallString<256> entryPath(path);
+  llvm::sys::path::append(entryPath, "actions", actionKey);
+
+  auto entryOrError = llvm::MemoryBuffer::getFile(entryPath);
+  if (!entryOrError) {
+    ++numMisses;
+    return false;
+  }
+
+  // Parse the entry, which has one "<digest> <mode>" line per output.
+  SmallVector<StringRef, 8> lines;
+  entryOrError.get()->getBuffer().split(lines, '\n', /*MaxSplit=*/-1,
+                                        /*KeepEmpty=*/false);
+  if (lines.size() != outputPaths.size()) {
+    ++numMisses;
+    return false;
+  }
+
+  SmallVector<std::pair<std::string, unsigned>, 8> objects;
+  for (auto line: lines) {
+    auto fields = line.split(' ');
+    unsigned mode;
+    if (fields.first.empty() || fields.second.getAsInteger(8, mode)) {
+      ++numMisses;
+      return false;
+    }
+
+    SmallString<256> objectPath(path);
+    llvm::sys::path::append(objectPath, "objects", fields.first);
+    objects.push_back({ objectPath.str(), mode });
+  }
+
+  for (unsigned i = 0, e = outputPaths.size(); i != e; ++i) {
+    const auto& outputPath = outputPaths[i];
+    const auto& objectPath = objects[i].first;
+    auto mode = llvm::sys::fs::perms(objects[i].second &
+                                     llvm::sys::fs::all_perms);
+
+    // Remove any existing output, so that we never write through a link.
+    (void) llvm::sys::fs::remove(outputPath);
+
+    // Prefer a hard link, if the object already has the right permissions.
+    if (useHardLinks) {
+      llvm::sys::fs::file_status status;
+      if (!llvm::sys::fs::status(objectPath, status) &&
+          status.permissions() == mode &&
+          !llvm::sys::fs::create_hard_link(objectPath, outputPath))
+        continue;
+    }
+
+    if (llvm::sys::fs::copy_file(objectPath, outputPath) ||
+        llvm::sys::fs::setPermissions(outputPath, mode)) {
+      // If we fail part way through, don't leave behind partial results.
+      for (unsigned j = 0; j <= i; ++j)
+        (void) llvm::sys::fs::remove(outputPaths[j]);
+      ++numMisses;
+      return false;
+    }
+  }
+
+  ++numHits;
+  return true;
+}
+
+bool ActionCache::storeOutputs(FileSystem& fileSystem, StringRef actionKey,
+                               ArrayRef<std::string> outputPaths) {
+  std::string entry;
+  for (const auto& outputPath: outputPaths) {
+    auto info = fileSystem.getFileInfo(outputPath);
+    if (info.isMissing() || info.isDirectory())
+      return false;
+
+    auto buffer = fileSystem.getFileContents(outputPath);
+    if (!buffer)
+      return false;
+
+    auto mode = unsigned(info.mode & 07777);
+    auto digest = storeObject(buffer->getBuffer(), mode);
+    if (!digest.hasValue())
+      return false;
+
+    char modeString[16];
+    snprintf(modeString, sizeof(modeString), "%o", mode);
+    entry += *digest;
+    entry += ' ';
+    entry += modeString;
+    entry += '\n';
+  }
+
+  SmallString<256> entryPath(path);
+  llvm::sys::path::append(entryPath, "actions", actionKey);
+  if (!writeFileAtomically(entryPath, entry, 0))
+    return false;
+
+  ++numStores;
+  return true;
+}
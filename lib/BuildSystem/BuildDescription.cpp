@@ -23,6 +23,13 @@ basic::CommandSignature Command::getSignature() const {
   return basic::CommandSignature().combine(name);
 }
 
+basic::JobResources Command::getResources() const {
+  basic::JobResources resources;
+  resources.memory = estimatedMemory;
+  resources.pool = pool;
+  return resources;
+}
+
 
 Tool::~Tool() {}
 
@@ -12,6 +12,7 @@
 
 #include "llbuild/BuildSystem/BuildFile.h"
 
+#include "llbuild/Basic/ExecutionQueue.h"
 #include "llbuild/Basic/FileSystem.h"
 #include "llbuild/Basic/LLVM.h"
 #include "llbuild/BuildSystem/BuildDescription.h"
@@ -113,6 +114,9 @@ class BuildFileImpl {
 
   /// The set of all declared commands.
   BuildDescription::command_set commands;
+
+  /// The set of all declared pools.
+  BuildDescription::pool_set pools;
   
   /// The number of parsing errors.
   int numErrors = 0;
@@ -274,6 +278,20 @@ class BuildFileImpl {
       ++it;
     }
 
+    // Parse the pools mapping, if present.
+    if (it != mapping->end() && nodeIsScalarString(it->getKey(), "pools")) {
+      if (it->getValue()->getType() != llvm::yaml::Node::NK_Mapping) {
+        error(it->getValue(), "unexpected 'pools' value (expected map)");
+        return false;
+      }
+
+      if (!parsePoolsMapping(
+              static_cast<llvm::yaml::MappingNode*>(it->getValue()))) {
+        return false;
+      }
+      ++it;
+    }
+
     // Parse the commands mapping, if present.
     if (it != mapping->end() && nodeIsScalarString(it->getKey(), "commands")) {
       if (it->getValue()->getType() != llvm::yaml::Node::NK_Mapping) {
@@ -605,6 +623,63 @@ class BuildFileImpl {
     return true;
   }
 
+  bool parsePoolsMapping(llvm::yaml::MappingNode* map) {
+    for (auto& entry: *map) {
+      // Every key must be scalar.
+      if (entry.getKey()->getType() != llvm::yaml::Node::NK_Scalar) {
+        error(entry.getKey(), "invalid key type in 'pools' map");
+        continue;
+      }
+      // Every value must be a mapping.
+      if (entry.getValue()->getType() != llvm::yaml::Node::NK_Mapping) {
+        error(entry.getValue(), "invalid value type in 'pools' map");
+        continue;
+      }
+
+      std::string name = stringFromScalarNode(
+          static_cast<llvm::yaml::ScalarNode*>(entry.getKey()));
+      llvm::yaml::MappingNode* attrs = static_cast<llvm::yaml::MappingNode*>(
+          entry.getValue());
+
+      // Check that the pool is not a duplicate.
+      if (pools.count(name) != 0) {
+        error(entry.getKey(), "duplicate pool in 'pools' map");
+        continue;
+      }
+
+      // Parse the pool attributes.
+      unsigned depth = 0;
+      bool hasDepth = false;
+      for (auto& valueEntry: *attrs) {
+        auto key = valueEntry.getKey();
+        auto value = valueEntry.getValue();
+        if (!nodeIsScalarString(key, "depth")) {
+          error(key, "unexpected attribute for pool in 'pools' map");
+          continue;
+        }
+        hasDepth = true;
+        if (value->getType() != llvm::yaml::Node::NK_Scalar ||
+            StringRef(stringFromScalarNode(
+                static_cast<llvm::yaml::ScalarNode*>(value))).getAsInteger(
+                    10, depth) || depth == 0) {
+          error(value, "invalid 'depth' value for pool in 'pools' map");
+          depth = 0;
+          continue;
+        }
+      }
+      if (!hasDepth) {
+        error(entry.getKey(), "missing 'depth' for pool in 'pools' map");
+        continue;
+      }
+      if (depth == 0)
+        continue;
+
+      pools[name] = llvm::make_unique<basic::JobPool>(name, depth);
+    }
+
+    return true;
+  }
+
   bool parseCommandsMapping(llvm::yaml::MappingNode* map) {
     for (auto& entry: *map) {
       // Every key must be scalar.
@@ -732,6 +807,19 @@ class BuildFileImpl {
           command->configureDescription(
               getContext(key), stringFromScalarNode(
                   static_cast<llvm::yaml::ScalarNode*>(value)));
+        } else if (nodeIsScalarString(key, "pool")) {
+          if (value->getType() != llvm::yaml::Node::NK_Scalar) {
+            error(value, "invalid value type for 'pool' command key");
+            continue;
+          }
+
+          auto poolIt = pools.find(stringFromScalarNode(
+              static_cast<llvm::yaml::ScalarNode*>(value)));
+          if (poolIt == pools.end()) {
+            error(value, "unknown pool for 'pool' command key");
+            continue;
+          }
+          command->setPool(poolIt->second.get());
         } else {
           // Otherwise, it should be an attribute assignment.
           
@@ -878,6 +966,7 @@ public:
     std::swap(description->getDefaultTarget(), defaultTarget);
     std::swap(description->getCommands(), commands);
     std::swap(description->getTools(), tools);
+    std::swap(description->getPools(), pools);
     return description;
   }
 };
@@ -20,6 +20,22 @@
 using namespace llbuild;
 using namespace llbuild::buildsystem;
 
+char BuildKey::kindCodeForKind(BuildKey::Kind kind) {
+  switch (kind) {
+  case Kind::Command: return 'C';
+  case Kind::CustomTask: return 'X';
+  case Kind::DirectoryContents: return 'D';
+  case Kind::FilteredDirectoryContents: return 'd';
+  case Kind::DirectoryTreeSignature: return 'S';
+  case Kind::DirectoryTreeStructureSignature: return 's';
+  case Kind::Node: return 'N';
+  case Kind::Stat: return 'I';
+  case Kind::Target: return 'T';
+  case Kind::Unknown: break;
+  }
+  return '\0';
+}
+
 StringRef BuildKey::stringForKind(BuildKey::Kind kind) {
   switch (kind) {
 #define CASE(kind) case Kind::kind: return #kind
@@ -100,6 +100,17 @@ bool BuildNode::configureAttribute(const ConfigureContext& ctx, StringRef name,
       return false;
     }
     return true;
+  } else if (name == "compare-contents") {
+    if (value == "true") {
+      contentCompared = true;
+    } else if (value == "false") {
+      contentCompared = false;
+    } else {
+      ctx.error("invalid value: '" + value + "' for attribute '"
+                + name + "'");
+      return false;
+    }
+    return true;
   } else if (name == "content-exclusion-patterns") {
     exclusionPatterns = basic::StringList(value);
     return true;
@@ -142,7 +153,11 @@ FileInfo BuildNode::getLinkInfo(basic::FileSystem& fileSystem) const {
 
 basic::CommandSignature BuildNode::getSignature() const {
   basic::CommandSignature sig;
-  sig.combine(static_cast<unsigned int>(type));
+  sig.combine(static_cast<uint64_t>(type));
+  // The value of a node compared by content is not comparable with one which
+  // is not.
+  if (contentCompared)
+    sig.combine(true);
   // We include the name of all producer rules in the signature to ensure that
   // we properly pick up changes in build graph structure.  For example, a node
   // that was previously a plain input that has changed to become a produced
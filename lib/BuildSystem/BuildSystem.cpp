@@ -16,6 +16,7 @@
 #include "llbuild/BuildSystem/BuildSystemFrontend.h"
 #include "llbuild/BuildSystem/BuildSystemHandlers.h"
 
+#include "llbuild/Basic/ContentDigest.h"
 #include "llbuild/Basic/CrossPlatformCompatibility.h"
 #include "llbuild/Basic/ExecutionQueue.h"
 #include "llbuild/Basic/FileInfo.h"
@@ -24,6 +25,7 @@
 #include "llbuild/Basic/LLVM.h"
 #include "llbuild/Basic/PlatformUtility.h"
 #include "llbuild/Basic/ShellUtility.h"
+#include "llbuild/BuildSystem/ActionCache.h"
 #include "llbuild/BuildSystem/BuildFile.h"
 #include "llbuild/BuildSystem/BuildKey.h"
 #include "llbuild/BuildSystem/BuildNode.h"
@@ -165,13 +167,15 @@ public:
   /// The internal schema version.
   ///
   /// Version History:
+  /// * 11: Changed how values are mixed into CommandSignature
+  /// * 10: Switched CommandSignature to 128-bit stable hashes
   /// * 9: Added filters to Directory* BuildKeys
   /// * 8: Added DirectoryTreeStructureSignature to BuildValue
   /// * 7: Added StaleFileRemoval to BuildValue
   /// * 6: Added DirectoryContents to BuildKey
   /// * 5: Switch BuildValue to be BinaryCoding based
   /// * 4: Pre-history
-  static const uint32_t internalSchemaVersion = 9;
+  static const uint32_t internalSchemaVersion = 11;
 
 private:
   BuildSystem& buildSystem;
@@ -182,6 +186,10 @@ private:
   /// The file system used by the build system
   std::unique_ptr<basic::FileSystem> fileSystem;
 
+  /// The wrapper remembering the directories known to exist during the build,
+  /// which is always installed beneath any others.
+  basic::DirectoryCachingFileSystem* directoryCache = nullptr;
+
   /// The name of the main input file.
   std::string mainFilename;
 
@@ -212,6 +220,30 @@ private:
 
   /// Cache of instantiated shell command handlers.
   llvm::StringMap<std::unique_ptr<ShellCommandHandler>> shellHandlers;
+
+  /// The action cache, if enabled.
+  std::unique_ptr<ActionCache> actionCache;
+
+  /// The stat cache wrapping the file system, if enabled.
+  basic::StatCachingFileSystem* statCache = nullptr;
+
+  /// The digests of the contents of nodes compared by content.
+  basic::ContentDigestCache contentDigests;
+
+  /// The path the content digests are saved to, if any.
+  std::string contentDigestsPath;
+
+  /// The attached build database (owned by the engine), if any.
+  core::BuildDB* db = nullptr;
+
+  /// The number of builds of command telemetry to retain, or 0 to disable it.
+  unsigned commandTelemetryHistory = 10;
+
+  /// Whether to estimate the resources used by commands from their telemetry.
+  bool commandResourceEstimation = false;
+
+  /// Estimate the memory use of each command from its recorded telemetry.
+  void estimateCommandResources();
   
   /// @name BuildSystemCommandInterface Implementation
   /// @{
@@ -281,7 +313,12 @@ public:
       : buildSystem(buildSystem), delegate(delegate),
         fileSystem(std::move(fileSystem)),
         fileDelegate(*this), engineDelegate(*this), buildEngine(engineDelegate),
-        executionQueue() {}
+        executionQueue() {
+    auto newFS = llvm::make_unique<basic::DirectoryCachingFileSystem>(
+        std::move(this->fileSystem));
+    directoryCache = newFS.get();
+    this->fileSystem = std::move(newFS);
+  }
 
   BuildSystem& getBuildSystem() {
     return buildSystem;
@@ -295,6 +332,29 @@ public:
     return *fileSystem;
   }
 
+  ActionCache* getActionCache() override {
+    return actionCache.get();
+  }
+
+  basic::ContentDigestCache& getContentDigests() {
+    return contentDigests;
+  }
+
+  void recordCommandTelemetry(Command* command,
+                              core::CommandTelemetry telemetry) override {
+    if (!db || commandTelemetryHistory == 0)
+      return;
+
+    telemetry.iteration = buildEngine.getCurrentTimestamp();
+    std::string dbError;
+    if (!db->recordCommandTelemetry(
+            BuildKey::makeCommand(command->getName()).toData(), telemetry,
+            commandTelemetryHistory, &dbError)) {
+      error(getMainFilename(), "unable to record command telemetry: " +
+            dbError);
+    }
+  }
+
   // FIXME: We should eliminate this, it isn't well formed when loading
   // descriptions not from a file. We currently only use that for unit testing,
   // though.
@@ -359,21 +419,65 @@ public:
     buildDescription = std::move(description);
   }
 
-  bool attachDB(StringRef filename, std::string* error_out) {
+  bool attachDB(StringRef filename, std::string* error_out, bool useWAL) {
     // FIXME: How do we pass the client schema version here, if we haven't
     // loaded the file yet.
+    auto mode = useWAL ? core::SQLiteBuildDBMode::WAL
+                       : core::SQLiteBuildDBMode::Exclusive;
     std::unique_ptr<core::BuildDB> db(
-                                      core::createSQLiteBuildDB(filename, getMergedSchemaVersion(), /* recreateUnmatchedVersion = */ true, error_out));
+                                      core::createSQLiteBuildDB(filename, getMergedSchemaVersion(), /* recreateUnmatchedVersion = */ true, error_out, mode));
     if (!db)
       return false;
 
-    return buildEngine.attachDB(std::move(db), error_out);
+    auto* dbPtr = db.get();
+    if (!buildEngine.attachDB(std::move(db), error_out))
+      return false;
+    this->db = dbPtr;
+
+    // Keep the content digests alongside the database. They are only an
+    // optimization, so an unusable saved cache is simply discarded.
+    contentDigestsPath = (filename + ".digests").str();
+    std::string digestsError;
+    if (!contentDigests.load(contentDigestsPath, &digestsError))
+      contentDigests.clear();
+    return true;
+  }
+
+  void setCommandTelemetryHistory(unsigned numBuilds) {
+    commandTelemetryHistory = numBuilds;
+  }
+
+  void enableCommandResourceEstimation() {
+    commandResourceEstimation = true;
   }
 
   bool enableTracing(StringRef filename, std::string* error_out) {
     return buildEngine.enableTracing(filename, error_out);
   }
 
+  bool enableActionCache(StringRef path, StringRef rootPath, bool useHardLinks,
+                         std::string* error_out) {
+    actionCache = ActionCache::create(path, rootPath, useHardLinks, error_out);
+    return actionCache != nullptr;
+  }
+
+  void enableStatCache() {
+    if (statCache)
+      return;
+    auto newFS = llvm::make_unique<basic::StatCachingFileSystem>(
+        std::move(fileSystem));
+    statCache = newFS.get();
+    fileSystem = std::move(newFS);
+  }
+
+  basic::StatCachingFileSystem* getStatCache() {
+    return statCache;
+  }
+
+  basic::DirectoryCachingFileSystem& getDirectoryCache() {
+    return *directoryCache;
+  }
+
   /// Build the given key, and return the result and an indication of success.
   llvm::Optional<BuildValue> build(BuildKey key);
   
@@ -420,6 +524,11 @@ static BuildSystemImpl& getBuildSystem(BuildEngine& engine) {
       engine.getDelegate())->getBuildSystem();
 }
 
+/// Get the bytes of an encoded value, for combining into a signature.
+static StringRef getValueBytes(const core::ValueType& value) {
+  return StringRef(reinterpret_cast<const char*>(value.data()), value.size());
+}
+
 
 FileSystem& BuildSystemFileDelegate::getFileSystem() {
   return system.getFileSystem();
@@ -523,6 +632,18 @@ class FileInputNodeTask : public Task {
                             const ValueType& value) override {
   }
 
+  /// Get the information representing the current state of the node, which
+  /// stands in for its contents if it is compared by content.
+  static FileInfo getInputInfo(BuildEngine& engine, const BuildNode& node) {
+    auto& system = getBuildSystem(engine);
+    auto info = node.getFileInfo(system.getFileSystem());
+    if (node.isContentCompared()) {
+      info = system.getContentDigests().getContentInfo(
+          system.getFileSystem(), node.getName(), info);
+    }
+    return info;
+  }
+
   virtual void inputsAvailable(BuildEngine& engine) override {    
     // FIXME: We should do this work in the background.
 
@@ -531,8 +652,7 @@ class FileInputNodeTask : public Task {
     // FIXME: This needs to delegate, since we want to have a notion of
     // different node types.
     assert(!node.isVirtual());
-    auto info = node.getFileInfo(
-        getBuildSystem(engine).getFileSystem());
+    auto info = getInputInfo(engine, node);
     if (info.isMissing()) {
       engine.taskIsComplete(this, BuildValue::makeMissingInput().toData());
       return;
@@ -562,8 +682,7 @@ public:
     // redundant in the case where we have never built the node before (or need
     // to rebuild it), and thus the additional stat is only one small part of
     // the work we need to perform.
-    auto info = node.getFileInfo(
-        getBuildSystem(engine).getFileSystem());
+    auto info = getInputInfo(engine, node);
     if (info.isMissing()) {
       return value.isMissingInput();
     } else {
@@ -1207,31 +1326,26 @@ class DirectoryTreeSignatureTask : public Task {
 
   virtual void inputsAvailable(BuildEngine& engine) override {
     // Compute the signature across all of the inputs.
-    using llvm::hash_combine;
-    llvm::hash_code code = hash_value(path);
+    CommandSignature code(path);
 
     // Add the signature for the actual input path.
-    code = hash_combine(
-        code, hash_combine_range(directoryValue.begin(), directoryValue.end()));
+    code.combine(getValueBytes(directoryValue));
 
     // For now, we represent this task as the aggregation of all the inputs.
     for (const auto& info: childResults) {
       // We merge the children by simply combining their encoded representation.
-      code = hash_combine(
-          code, hash_combine_range(info.value.begin(), info.value.end()));
+      code.combine(getValueBytes(info.value));
       if (info.directorySignatureValue.hasValue()) {
-        auto& data = info.directorySignatureValue.getValue();
-        code = hash_combine(
-            code, hash_combine_range(data.begin(), data.end()));
+        code.combine(getValueBytes(info.directorySignatureValue.getValue()));
       } else {
         // Combine a random number to represent nil.
-        code = hash_combine(code, 0XC183979C3E98722E);
+        code.combine(uint64_t(0XC183979C3E98722E));
       }
     }
 
     // Compute the signature.
     engine.taskIsComplete(this, BuildValue::makeDirectoryTreeSignature(
-                              CommandSignature(uint64_t(code))).toData());
+                              code).toData());
   }
 
 public:
@@ -1346,8 +1460,7 @@ class DirectoryTreeStructureSignatureTask : public Task {
 
   virtual void inputsAvailable(BuildEngine& engine) override {
     // Compute the signature across all of the inputs.
-    using llvm::hash_combine;
-    llvm::hash_code code = hash_value(path);
+    CommandSignature code(path);
 
     // Only merge the structure information on the directory itself.
     {
@@ -1355,11 +1468,9 @@ class DirectoryTreeStructureSignatureTask : public Task {
       // it changes type.
       auto value = BuildValue::fromData(directoryValue);
       if (value.isDirectoryContents()) {
-        code = hash_combine(code, value.getOutputInfo().mode);
+        code.combine(value.getOutputInfo().mode);
       } else {
-        code = hash_combine(
-            code, hash_combine_range(directoryValue.begin(),
-                                     directoryValue.end()));
+        code.combine(getValueBytes(directoryValue));
       }
     }
     
@@ -1367,30 +1478,28 @@ class DirectoryTreeStructureSignatureTask : public Task {
     for (const auto& info: childResults) {
       // We only merge the "structural" information on a child; i.e. its
       // filename and type.
-      code = hash_combine(code, info.filename);
+      code.combine(info.filename);
       auto value = BuildValue::fromData(info.value);
       if (value.isExistingInput()) {
-        code = hash_combine(code, value.getOutputInfo().mode);
+        code.combine(value.getOutputInfo().mode);
       } else {
         // If this node has been modified to report a non-file value, just merge
         // the encoded representation.
-        code = hash_combine(
-            code, hash_combine_range(info.value.begin(), info.value.end()));
+        code.combine(getValueBytes(info.value));
       }
       
       if (info.directoryStructureSignatureValue.hasValue()) {
-        auto& data = info.directoryStructureSignatureValue.getValue();
-        code = hash_combine(
-            code, hash_combine_range(data.begin(), data.end()));
+        code.combine(getValueBytes(
+                         info.directoryStructureSignatureValue.getValue()));
       } else {
         // Combine a random number to represent nil.
-        code = hash_combine(code, 0XC183979C3E98722E);
+        code.combine(uint64_t(0XC183979C3E98722E));
       }
     }
     
     // Compute the signature.
     engine.taskIsComplete(this, BuildValue::makeDirectoryTreeStructureSignature(
-                              CommandSignature(uint64_t(code))).toData());
+                              code).toData());
   }
 
 public:
@@ -1852,6 +1961,34 @@ BuildSystemImpl::lookupNode(StringRef name, bool isImplicit) {
   return BuildNode::makePlain(name);
 }
 
+void BuildSystemImpl::estimateCommandResources() {
+  if (!db || !buildDescription)
+    return;
+
+  // Use the largest peak memory use in each command's recorded history.
+  llvm::StringMap<uint64_t> peakMemory;
+  std::string dbError;
+  bool success = db->visitCommandTelemetry("", [&](
+          StringRef keyData, const core::CommandTelemetry& telemetry) {
+    auto key = BuildKey::fromData(keyData.str());
+    if (!key.isCommand())
+      return true;
+    auto& entry = peakMemory[key.getCommandName()];
+    entry = std::max(entry, telemetry.maxrss);
+    return true;
+  }, &dbError);
+  if (!success) {
+    error(getMainFilename(), "unable to read command telemetry: " + dbError);
+    return;
+  }
+
+  for (const auto& entry: buildDescription->getCommands()) {
+    auto it = peakMemory.find(entry.getKey());
+    if (it != peakMemory.end())
+      entry.getValue()->setEstimatedMemory(it->getValue());
+  }
+}
+
 llvm::Optional<BuildValue> BuildSystemImpl::build(BuildKey key) {
 
   if (basic::sys::raiseOpenFileLimit() != 0) {
@@ -1859,6 +1996,16 @@ llvm::Optional<BuildValue> BuildSystemImpl::build(BuildKey key) {
     return None;
   }
 
+  // Information cached during a previous build may be out of date. The known
+  // directories are not watched, so are only kept for a single build.
+  directoryCache->clear();
+  if (statCache)
+    statCache->synchronize();
+
+  // Estimate the resources used by commands, for use in admission control.
+  if (commandResourceEstimation)
+    estimateCommandResources();
+
   // Aquire lock and create execution queue.
   {
     std::lock_guard<std::mutex> guard(executionQueueMutex);
@@ -1892,6 +2039,13 @@ llvm::Optional<BuildValue> BuildSystemImpl::build(BuildKey key) {
   // multiple builds.
   shellHandlers.clear();
 
+  // Save any new content digests for the next build (failing which, the files
+  // will be read again).
+  if (!contentDigestsPath.empty()) {
+    std::string digestsError;
+    (void) contentDigests.save(contentDigestsPath, &digestsError);
+  }
+
   if (buildWasAborted)
     return None;
   return BuildValue::fromData(result);
@@ -3156,6 +3310,7 @@ class SymlinkCommand : public Command {
       }
     }
     bsci.getDelegate().commandFinished(this, success ? ProcessStatus::Succeeded : ProcessStatus::Failed);
+    bsci.getFileSystem().invalidate(outputPath);
     
     // Process the result.
     if (!success) {
@@ -3453,17 +3608,34 @@ class StaleFileRemovalCommand : public Command {
       return;
     }
 
-    std::vector<StringRef> priorValueList = priorValue.getStaleFileList();
-    std::set<std::string> priorNodes(priorValueList.begin(), priorValueList.end());
-    std::set<std::string> expectedNodes(expectedOutputs.begin(), expectedOutputs.end());
-
-    std::set_difference(priorNodes.begin(), priorNodes.end(),
-                        expectedNodes.begin(), expectedNodes.end(),
-                        std::back_inserter(filesToDelete));
+    // Look up each prior file in a hash set of the expected outputs, rather
+    // than sorting both lists. The (usually few) stale files are sorted, so
+    // that they are reported in a stable order.
+    llvm::StringMap<bool> expectedNodes;
+    for (const auto& output: expectedOutputs)
+      expectedNodes.insert({output, true});
+    llvm::StringMap<bool> staleNodes;
+    for (StringRef path: priorValue.getStaleFileList()) {
+      if (!expectedNodes.count(path) && staleNodes.insert({path, true}).second)
+        filesToDelete.push_back(path);
+    }
+    std::sort(filesToDelete.begin(), filesToDelete.end());
 
     computedFilesToDelete = true;
   }
 
+  /// Check whether the given stale file is beneath one of the roots.
+  bool isLocatedUnderRootPath(StringRef path) const {
+    // If no root paths are specified, any path is valid.
+    if (roots.empty())
+      return true;
+    for (const auto& root: roots) {
+      if (pathIsPrefixedByPath(path, root))
+        return true;
+    }
+    return false;
+  }
+
   virtual void execute(BuildSystemCommandInterface& bsci,
                        core::Task* task,
                        QueueJobContext* context,
@@ -3480,36 +3652,89 @@ class StaleFileRemovalCommand : public Command {
 
     bsci.getDelegate().commandStarted(this);
 
-    for (auto fileToDelete : filesToDelete) {
-      // If no root paths are specified, any path is valid.
-      bool isLocatedUnderRootPath = roots.size() == 0 ? true : false;
+    // Decide what to do with each stale file. Files beneath another stale file
+    // are left to its (recursive) removal, so that the rest can be removed
+    // together, in any order.
+    enum class Disposition { RelativePath, OutsideRoots, Nested, Remove };
+    const int notRemoved = -1;
+    std::vector<Disposition> dispositions(filesToDelete.size());
+    std::vector<size_t> ancestorIndices(filesToDelete.size());
+    std::vector<int> errors(filesToDelete.size(), notRemoved);
+    llvm::StringMap<size_t> removableIndices;
+    std::vector<std::string> pathsToRemove;
+    std::vector<size_t> removeIndices;
+    for (size_t i = 0, e = filesToDelete.size(); i != e; ++i) {
+      const auto& fileToDelete = filesToDelete[i];
 
       // If root paths are defined, stale file paths should be absolute.
       if (roots.size() > 0 &&
           pathSeparators.find(fileToDelete[0]) == std::string::npos) {
-        bsci.getDelegate().commandHadWarning(this, "Stale file '" + fileToDelete + "' has a relative path. This is invalid in combination with the root path attribute.\n");
+        dispositions[i] = Disposition::RelativePath;
         continue;
       }
 
-      // Check if the file is located under one of the allowed root paths.
-      for (auto root : roots) {
-        if (pathIsPrefixedByPath(fileToDelete, root)) {
-          isLocatedUnderRootPath = true;
+      if (!isLocatedUnderRootPath(fileToDelete)) {
+        dispositions[i] = Disposition::OutsideRoots;
+        continue;
+      }
+
+      // The files are sorted, so any stale ancestor has already been seen.
+      dispositions[i] = Disposition::Remove;
+      for (StringRef ancestor = llvm::sys::path::parent_path(fileToDelete);
+           !ancestor.empty();
+           ancestor = llvm::sys::path::parent_path(ancestor)) {
+        auto it = removableIndices.find(ancestor);
+        if (it != removableIndices.end()) {
+          dispositions[i] = Disposition::Nested;
+          ancestorIndices[i] = it->second;
+          break;
         }
       }
+      removableIndices.insert({fileToDelete, i});
+      if (dispositions[i] == Disposition::Remove) {
+        pathsToRemove.push_back(fileToDelete);
+        removeIndices.push_back(i);
+      }
+    }
 
-      if (!isLocatedUnderRootPath) {
-        bsci.getDelegate().commandHadWarning(this, "Stale file '" + fileToDelete + "' is located outside of the allowed root paths.\n");
+    auto& fileSystem = getBuildSystem(bsci.getBuildEngine()).getFileSystem();
+    auto removeErrors = fileSystem.removePaths(pathsToRemove);
+    for (size_t i = 0, e = removeIndices.size(); i != e; ++i)
+      errors[removeIndices[i]] = removeErrors[i];
+
+    // Nested files are already gone, unless their ancestor could not be
+    // removed.
+    for (size_t i = 0, e = filesToDelete.size(); i != e; ++i) {
+      if (dispositions[i] != Disposition::Nested)
         continue;
+      int ancestorError = errors[ancestorIndices[i]];
+      if (ancestorError == 0 || ancestorError == ENOENT) {
+        errors[i] = ENOENT;
+      } else {
+        errno = 0;
+        bool removed = fileSystem.remove(filesToDelete[i]);
+        errors[i] = removed ? 0 : (errno ? errno : EIO);
       }
+    }
 
-      if (getBuildSystem(bsci.getBuildEngine()).getFileSystem().remove(fileToDelete)) {
-        bsci.getDelegate().commandHadNote(this, "Removed stale file '" + fileToDelete + "'\n");
-      } else {
-        // Do not warn if the file has already been deleted.
-        if (errno != ENOENT) {
-          bsci.getDelegate().commandHadWarning(this, "cannot remove stale file '" + fileToDelete + "': " + strerror(errno) + "\n");
+    for (size_t i = 0, e = filesToDelete.size(); i != e; ++i) {
+      const auto& fileToDelete = filesToDelete[i];
+      switch (dispositions[i]) {
+      case Disposition::RelativePath:
+        bsci.getDelegate().commandHadWarning(this, "Stale file '" + fileToDelete + "' has a relative path. This is invalid in combination with the root path attribute.\n");
+        break;
+      case Disposition::OutsideRoots:
+        bsci.getDelegate().commandHadWarning(this, "Stale file '" + fileToDelete + "' is located outside of the allowed root paths.\n");
+        break;
+      case Disposition::Nested:
+      case Disposition::Remove:
+        if (errors[i] == 0) {
+          bsci.getDelegate().commandHadNote(this, "Removed stale file '" + fileToDelete + "'\n");
+        } else if (errors[i] != ENOENT) {
+          // Do not warn if the file has already been deleted.
+          bsci.getDelegate().commandHadWarning(this, "cannot remove stale file '" + fileToDelete + "': " + strerror(errors[i]) + "\n");
         }
+        break;
       }
     }
 
@@ -3679,8 +3904,8 @@ void BuildSystem::loadDescription(
 }
 
 bool BuildSystem::attachDB(StringRef path,
-                                std::string* error_out) {
-  return static_cast<BuildSystemImpl*>(impl)->attachDB(path, error_out);
+                                std::string* error_out, bool useWAL) {
+  return static_cast<BuildSystemImpl*>(impl)->attachDB(path, error_out, useWAL);
 }
 
 bool BuildSystem::enableTracing(StringRef path,
@@ -3688,6 +3913,37 @@ bool BuildSystem::enableTracing(StringRef path,
   return static_cast<BuildSystemImpl*>(impl)->enableTracing(path, error_out);
 }
 
+bool BuildSystem::enableActionCache(StringRef path, StringRef rootPath,
+                                    bool useHardLinks,
+                                    std::string* error_out) {
+  return static_cast<BuildSystemImpl*>(impl)->enableActionCache(
+      path, rootPath, useHardLinks, error_out);
+}
+
+ActionCache* BuildSystem::getActionCache() {
+  return static_cast<BuildSystemImpl*>(impl)->getActionCache();
+}
+
+void BuildSystem::enableStatCache() {
+  static_cast<BuildSystemImpl*>(impl)->enableStatCache();
+}
+
+basic::StatCachingFileSystem* BuildSystem::getStatCache() {
+  return static_cast<BuildSystemImpl*>(impl)->getStatCache();
+}
+
+basic::DirectoryCachingFileSystem& BuildSystem::getDirectoryCache() {
+  return static_cast<BuildSystemImpl*>(impl)->getDirectoryCache();
+}
+
+void BuildSystem::setCommandTelemetryHistory(unsigned numBuilds) {
+  static_cast<BuildSystemImpl*>(impl)->setCommandTelemetryHistory(numBuilds);
+}
+
+void BuildSystem::enableCommandResourceEstimation() {
+  static_cast<BuildSystemImpl*>(impl)->enableCommandResourceEstimation();
+}
+
 llvm::Optional<BuildValue> BuildSystem::build(BuildKey key) {
   return static_cast<BuildSystemImpl*>(impl)->build(key);
 }
@@ -3711,18 +3967,17 @@ uint32_t BuildSystem::getSchemaVersion() {
 }
 
 // This function checks if the given path is prefixed by another path.
-bool llbuild::buildsystem::pathIsPrefixedByPath(std::string path,
-                                                std::string prefixPath) {
+bool llbuild::buildsystem::pathIsPrefixedByPath(StringRef path,
+                                                StringRef prefixPath) {
   std::string pathSeparators = llbuild::basic::sys::getPathSeparators();
   // Note: GCC 4.8 doesn't support the mismatch(first1, last1, first2, last2)
   // overload, just mismatch(first1, last1, first2), so we have to handle the
   // case where prefixPath is longer than path.
-  if (prefixPath.length() > path.length()) {
+  if (prefixPath.size() > path.size()) {
     // The only case where the prefix can be longer and still be a valid prefix
     // is "/foo/" is a prefix of "/foo"
-    return prefixPath.substr(0, prefixPath.length() - 1) == path &&
-           pathSeparators.find(prefixPath[prefixPath.length() - 1]) !=
-               std::string::npos;
+    return prefixPath.drop_back() == path &&
+           pathSeparators.find(prefixPath.back()) != std::string::npos;
   }
   auto res = std::mismatch(prefixPath.begin(), prefixPath.end(), path.begin());
   // Check if `prefixPath` has been exhausted or just a separator remains.
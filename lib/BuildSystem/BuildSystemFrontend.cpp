@@ -14,14 +14,16 @@
 
 #include "llbuild/Basic/ExecutionQueue.h"
 #include "llbuild/Basic/FileSystem.h"
+#include "llbuild/Basic/JobServer.h"
 #include "llbuild/Basic/LLVM.h"
 #include "llbuild/Basic/PlatformUtility.h"
+#include "llbuild/Basic/SpawnServer.h"
 #include "llbuild/BuildSystem/BuildDescription.h"
 #include "llbuild/BuildSystem/BuildFile.h"
 #include "llbuild/BuildSystem/BuildKey.h"
 #include "llbuild/BuildSystem/BuildValue.h"
 
-#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/Support/Format.h"
@@ -30,14 +32,22 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <atomic>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 
 using namespace llbuild;
 using namespace llbuild::basic;
 using namespace llbuild::buildsystem;
 
+#if !defined(_WIN32)
+extern "C" {
+  extern char **environ;
+}
+#endif
+
 #pragma mark - BuildSystemInvocation implementation
 
 void BuildSystemInvocation::getUsage(int optionWidth, raw_ostream& os) {
@@ -49,12 +59,34 @@ void BuildSystemInvocation::getUsage(int optionWidth, raw_ostream& os) {
     { "-C <PATH>, --chdir <PATH>", "change directory to PATH before building" },
     { "--no-db", "disable use of a build database" },
     { "--db <PATH>", "enable building against the database at PATH" },
+    { "--db-wal", "allow reading the database while building" },
+    { "--telemetry-history <N>",
+      "keep command telemetry for N builds (0 to disable)" },
     { "-f <PATH>", "load the build task file at PATH" },
     { "--serial", "do not build in parallel" },
     { "--scheduler <SCHEDULER>", "set scheduler algorithm" },
+    { "--work-stealing", "schedule jobs using per-lane queues" },
+    { "--process-reactor", "supervise subprocesses from a shared thread" },
+    { "--spawn-server", "launch subprocesses from a pre-forked helper" },
+    { "--jobserver", "share concurrency with make using its jobserver" },
+    { "--pin-lanes", "pin the subprocesses of each lane to a CPU" },
     { "-j,--jobs <JOBS>", "set how many concurrent jobs (lanes) to run" },
+    { "--memory-budget <MB>", "limit the memory used by concurrent jobs" },
+    { "--cpu-budget <CPUS>", "limit the CPUs used by concurrent jobs" },
+    { "--min-jobs <JOBS>",
+      "let the number of concurrent jobs float down to JOBS with the load" },
+    { "-l,--max-load <LOAD>",
+      "run fewer concurrent jobs while the load average exceeds LOAD" },
     { "-v, --verbose", "show verbose status information" },
     { "--trace <PATH>", "trace build engine operation to PATH" },
+    { "--action-cache <PATH>", "reuse command outputs from the cache at PATH" },
+    { "--action-cache-root <PATH>",
+      "key cached commands by their paths relative to PATH" },
+    { "--action-cache-hardlinks", "restore cached outputs using hard links" },
+    { "--stat-cache", "memoize file information during each build" },
+    { "--watch-files",
+      "keep file information between builds, watching for changes" },
+    { "--remote-worker <ADDRESS>", "run commands on the worker at ADDRESS" },
   };
   
   for (const auto& entry: options) {
@@ -101,6 +133,17 @@ void BuildSystemInvocation::parse(llvm::ArrayRef<std::string> args,
       }
       dbPath = args[0];
       args = args.slice(1);
+    } else if (option == "--db-wal") {
+      dbUseWAL = true;
+    } else if (option == "--telemetry-history") {
+      if (args.empty()) {
+        error("missing argument to '" + option + "'");
+        break;
+      }
+      if (StringRef(args[0]).getAsInteger(10, telemetryHistory)) {
+        error("invalid argument '" + args[0] + "' to '" + option + "'");
+      }
+      args = args.slice(1);
     } else if (option == "-C" || option == "--chdir") {
       if (args.empty()) {
         error("missing argument to '" + option + "'");
@@ -132,6 +175,16 @@ void BuildSystemInvocation::parse(llvm::ArrayRef<std::string> args,
         break;
       }
       args = args.slice(1);
+    } else if (option == "--work-stealing") {
+      useWorkStealing = true;
+    } else if (option == "--process-reactor") {
+      useProcessReactor = true;
+    } else if (option == "--spawn-server") {
+      useSpawnServer = true;
+    } else if (option == "--jobserver") {
+      useJobServer = true;
+    } else if (option == "--pin-lanes") {
+      pinLanes = true;
     } else if (option == "-j" || option == "--jobs") {
       if (args.empty()) {
         error("missing argument to '" + option + "'");
@@ -149,6 +202,49 @@ void BuildSystemInvocation::parse(llvm::ArrayRef<std::string> args,
       if (*end != '\0') {
         error("invalid argument to '-j'");
       }
+    } else if (option == "--memory-budget") {
+      if (args.empty()) {
+        error("missing argument to '" + option + "'");
+        break;
+      }
+      // The budget is given in MB.
+      const uint64_t scale = 1024 * 1024;
+      if (StringRef(args[0]).getAsInteger(10, memoryBudget) ||
+          memoryBudget > std::numeric_limits<uint64_t>::max() / scale) {
+        error("invalid argument '" + args[0] + "' to '" + option + "'");
+        memoryBudget = 0;
+      }
+      memoryBudget *= scale;
+      args = args.slice(1);
+    } else if (option == "--cpu-budget") {
+      if (args.empty()) {
+        error("missing argument to '" + option + "'");
+        break;
+      }
+      if (StringRef(args[0]).getAsInteger(10, cpuBudget)) {
+        error("invalid argument '" + args[0] + "' to '" + option + "'");
+      }
+      args = args.slice(1);
+    } else if (option == "--min-jobs") {
+      if (args.empty()) {
+        error("missing argument to '" + option + "'");
+        break;
+      }
+      if (StringRef(args[0]).getAsInteger(10, minLanes) || minLanes == 0) {
+        error("invalid argument '" + args[0] + "' to '" + option + "'");
+      }
+      args = args.slice(1);
+    } else if (option == "-l" || option == "--max-load") {
+      if (args.empty()) {
+        error("missing argument to '" + option + "'");
+        break;
+      }
+      char *end;
+      maxLoad = ::strtod(args[0].c_str(), &end);
+      if (*end != '\0' || maxLoad <= 0) {
+        error("invalid argument '" + args[0] + "' to '" + option + "'");
+      }
+      args = args.slice(1);
     } else if (option == "-v" || option == "--verbose") {
       showVerboseStatus = true;
     } else if (option == "--trace") {
@@ -158,6 +254,33 @@ void BuildSystemInvocation::parse(llvm::ArrayRef<std::string> args,
       }
       traceFilePath = args[0];
       args = args.slice(1);
+    } else if (option == "--action-cache") {
+      if (args.empty()) {
+        error("missing argument to '" + option + "'");
+        break;
+      }
+      actionCachePath = args[0];
+      args = args.slice(1);
+    } else if (option == "--action-cache-root") {
+      if (args.empty()) {
+        error("missing argument to '" + option + "'");
+        break;
+      }
+      actionCacheRootPath = args[0];
+      args = args.slice(1);
+    } else if (option == "--action-cache-hardlinks") {
+      actionCacheUseHardLinks = true;
+    } else if (option == "--stat-cache") {
+      useStatCache = true;
+    } else if (option == "--watch-files") {
+      useFileWatcher = true;
+    } else if (option == "--remote-worker") {
+      if (args.empty()) {
+        error("missing argument to '" + option + "'");
+        break;
+      }
+      remoteWorkers.push_back(args[0]);
+      args = args.slice(1);
     } else {
       error("invalid option '" + option + "'");
       break;
@@ -283,6 +406,75 @@ public:
   }
 };
 
+/// The buffered output of a command's process, which is kept in memory up to
+/// a limit and spilled to a temporary file beyond it.
+class ProcessOutputBuffer {
+  /// The most output kept in memory.
+  static const size_t maxInMemorySize = 1 << 20;
+
+  /// The output which has not been spilled, which follows any output in the
+  /// spill file.
+  std::vector<uint8_t> data;
+
+  /// The file the output has been spilled to, if any.
+  FILE* spillFile = nullptr;
+
+  /// Whether the output could not be spilled, in which case the remaining
+  /// output is kept in memory.
+  bool spillFailed = false;
+
+  ProcessOutputBuffer(const ProcessOutputBuffer&) LLBUILD_DELETED_FUNCTION;
+  void operator=(const ProcessOutputBuffer&) LLBUILD_DELETED_FUNCTION;
+
+public:
+  ProcessOutputBuffer() {}
+  ~ProcessOutputBuffer() {
+    if (spillFile)
+      fclose(spillFile);
+  }
+
+  void append(StringRef output) {
+    // If we are unable to spill the output, just keep it in memory.
+    if (!spillFile && !spillFailed &&
+        data.size() + output.size() > maxInMemorySize) {
+      spillFile = tmpfile();
+      if (!spillFile) {
+        spillFailed = true;
+      } else {
+        // Write unbuffered, so that any failed write is noticed immediately.
+        setvbuf(spillFile, nullptr, _IONBF, 0);
+        size_t numWritten = fwrite(data.data(), 1, data.size(), spillFile);
+        data.erase(data.begin(), data.begin() + numWritten);
+        if (data.empty())
+          std::vector<uint8_t>().swap(data);
+        else
+          spillFailed = true;
+      }
+    }
+
+    if (spillFile && !spillFailed) {
+      size_t numWritten = fwrite(output.data(), 1, output.size(), spillFile);
+      if (numWritten == output.size())
+        return;
+      spillFailed = true;
+      output = output.drop_front(numWritten);
+    }
+    data.insert(data.end(), output.begin(), output.end());
+  }
+
+  /// Write the output to \arg os.
+  void writeTo(FILE* os) {
+    if (spillFile) {
+      rewind(spillFile);
+      char buffer[65536];
+      size_t numBytes;
+      while ((numBytes = fread(buffer, 1, sizeof(buffer), spillFile)) != 0)
+        fwrite(buffer, numBytes, 1, os);
+    }
+    fwrite(data.data(), data.size(), 1, os);
+  }
+};
+
 struct BuildSystemFrontendDelegateImpl {
 
   /// The status of delegate.
@@ -306,10 +498,16 @@ struct BuildSystemFrontendDelegateImpl {
   BuildSystem* system = nullptr;
 
   /// The set of active command output buffers, by process handle.
-  llvm::DenseMap<uintptr_t, std::vector<uint8_t>> processOutputBuffers;
+  std::unordered_map<uintptr_t, std::unique_ptr<ProcessOutputBuffer>>
+    processOutputBuffers;
 
-  /// The lock protecting `processOutputBuffers`.
+  /// The lock protecting `processOutputBuffers` (but not the buffers
+  /// themselves, which are only used by their process's thread).
   std::mutex processOutputBuffersMutex;
+
+  /// The lock serializing the writing of command output, so that the output of
+  /// each process is kept together.
+  std::mutex outputMutex;
   
   BuildSystemFrontendDelegateImpl(llvm::SourceMgr& sourceMgr,
                                   const BuildSystemInvocation& invocation)
@@ -450,6 +648,21 @@ BuildSystemFrontendDelegate::createExecutionQueue() {
                                       impl->invocation.schedulerAlgorithm,
                                       impl->invocation.environment));
   }
+
+  // Use the remote workers, if requested.
+  if (!impl->invocation.remoteWorkers.empty()) {
+    std::string error;
+    auto* queue = createRemoteExecutionQueue(
+        impl->executionQueueDelegate, impl->invocation.remoteWorkers,
+        impl->invocation.schedulerAlgorithm, impl->invocation.environment,
+        &error);
+    if (queue)
+      return std::unique_ptr<ExecutionQueue>(queue);
+
+    // Report the failure (which fails the build), but still return a local
+    // queue so that the build can run to completion.
+    this->error("unable to use remote workers: " + error);
+  }
     
   // Get the number of CPUs to use.
   unsigned numLanes = impl->invocation.schedulerLanes;
@@ -463,10 +676,39 @@ BuildSystemFrontendDelegate::createExecutionQueue() {
     }
   }
     
+  // Join the jobserver of a parent make, if there is one, and otherwise
+  // provide one to our own processes.
+  std::unique_ptr<JobServer> jobServer;
+  if (impl->invocation.useJobServer) {
+    std::string error;
+    const char* const* environment = impl->invocation.environment;
+#if !defined(_WIN32)
+    if (!environment)
+      environment = const_cast<const char* const*>(environ);
+#endif
+    jobServer = JobServer::connect(environment, &error);
+    if (!jobServer && error.empty())
+      jobServer = JobServer::create(numLanes, &error);
+    if (!jobServer)
+      this->error("unable to use jobserver: " + error);
+  }
+
+  LaneBasedExecutionQueueOptions options;
+  options.workStealing = impl->invocation.useWorkStealing;
+  options.budget.memory = impl->invocation.memoryBudget;
+  options.budget.cpus = impl->invocation.cpuBudget;
+  options.budget.minLanes = impl->invocation.minLanes;
+  options.budget.maxLoad = impl->invocation.maxLoad;
+  if (options.budget.maxLoad != 0 && options.budget.minLanes == 0)
+    options.budget.minLanes = 1;
+  options.useProcessReactor = impl->invocation.useProcessReactor;
+  options.jobServer = std::move(jobServer);
+  options.pinLanes = impl->invocation.pinLanes;
   return std::unique_ptr<ExecutionQueue>(
       createLaneBasedExecutionQueue(impl->executionQueueDelegate, numLanes,
                                     impl->invocation.schedulerAlgorithm,
-                                    impl->invocation.environment));
+                                    impl->invocation.environment,
+                                    std::move(options)));
 }
 
 void BuildSystemFrontendDelegate::cancel() {
@@ -635,28 +877,38 @@ void BuildSystemFrontendDelegate::
 commandProcessHadOutput(Command* command, ProcessHandle handle,
                         StringRef data) {
   auto impl = static_cast<BuildSystemFrontendDelegateImpl*>(this->impl);
-  std::unique_lock<std::mutex> lock(impl->processOutputBuffersMutex);
+  ProcessOutputBuffer* buffer;
+  {
+    std::lock_guard<std::mutex> lock(impl->processOutputBuffersMutex);
+    auto& entry = impl->processOutputBuffers[handle.id];
+    if (!entry)
+      entry = llvm::make_unique<ProcessOutputBuffer>();
+    buffer = entry.get();
+  }
 
-  // Append to the output buffer.
-  auto& buffer = impl->processOutputBuffers[handle.id];
-  buffer.insert(buffer.end(), data.begin(), data.end());
+  // Append to the output buffer, which may write it to disk. A process's
+  // output is reported in order and before it finishes, so this needs no lock.
+  buffer->append(data);
 }
 
 void BuildSystemFrontendDelegate::
 commandProcessFinished(Command*, ProcessHandle handle,
                        const ProcessResult& result) {
   auto impl = static_cast<BuildSystemFrontendDelegateImpl*>(this->impl);
-  std::unique_lock<std::mutex> lock(impl->processOutputBuffersMutex);
+  std::unique_ptr<ProcessOutputBuffer> buffer;
+  {
+    std::lock_guard<std::mutex> lock(impl->processOutputBuffersMutex);
+    auto it = impl->processOutputBuffers.find(handle.id);
+    if (it == impl->processOutputBuffers.end())
+      return;
+    buffer = std::move(it->second);
+    impl->processOutputBuffers.erase(it);
+  }
 
   // If there was an output buffer, flush it.
-  auto it = impl->processOutputBuffers.find(handle.id);
-  if (it == impl->processOutputBuffers.end())
-    return;
-
-  fwrite(it->second.data(), it->second.size(), 1, stdout);
+  std::lock_guard<std::mutex> lock(impl->outputMutex);
+  buffer->writeTo(stdout);
   fflush(stdout);
-
-  impl->processOutputBuffers.erase(it);  
 }
 
 #pragma mark - BuildSystemFrontend implementation
@@ -673,6 +925,14 @@ BuildSystemFrontend(BuildSystemFrontendDelegate& delegate,
   delegateImpl->frontend = this;
 }
 
+BuildSystemFrontend::~BuildSystemFrontend() {
+  // Stop the spawn server once the build system (and any processes it is
+  // launching) is gone.
+  buildSystem.reset();
+  if (startedSpawnServer)
+    stopSpawnServer();
+}
+
 bool BuildSystemFrontend::initialize() {
   if (!invocation.chdirPath.empty()) {
     if (!sys::chdir(invocation.chdirPath.c_str())) {
@@ -681,6 +941,16 @@ bool BuildSystemFrontend::initialize() {
     }
   }
 
+  // Start the spawn server while we are still small.
+  if (invocation.useSpawnServer && !startedSpawnServer) {
+    std::string error;
+    if (!startSpawnServer(&error)) {
+      getDelegate().error(Twine("unable to start spawn server: ") + error);
+      return false;
+    }
+    startedSpawnServer = true;
+  }
+
   // Create the build system.
   buildSystem.emplace(delegate, std::move(fileSystem));
 
@@ -695,6 +965,17 @@ bool BuildSystemFrontend::initialize() {
   if (!buildSystem->loadDescription(invocation.buildFilePath))
     return false;
 
+  // Enable the stat cache, if requested.
+  if (invocation.useStatCache || invocation.useFileWatcher)
+    buildSystem->enableStatCache();
+  if (invocation.useFileWatcher) {
+    std::string error;
+    if (!buildSystem->getStatCache()->enableWatching(&error)) {
+      getDelegate().error(Twine("unable to watch files: ") + error);
+      return false;
+    }
+  }
+
   // Enable tracing, if requested.
   if (!invocation.traceFilePath.empty()) {
     const auto dir = llvm::sys::path::parent_path(invocation.traceFilePath);
@@ -725,10 +1006,27 @@ bool BuildSystemFrontend::initialize() {
     }
     
     std::string error;
-    if (!buildSystem->attachDB(dbPath, &error)) {
+    if (!buildSystem->attachDB(dbPath, &error, invocation.dbUseWAL)) {
       getDelegate().error(Twine("unable to attach DB: ") + error);
       return false;
     }
+    buildSystem->setCommandTelemetryHistory(invocation.telemetryHistory);
+
+    // Commands which don't declare their memory use are sized from history.
+    if (invocation.memoryBudget != 0)
+      buildSystem->enableCommandResourceEstimation();
+  }
+
+  // Enable the action cache, if requested.
+  if (!invocation.actionCachePath.empty()) {
+    std::string error;
+    if (!buildSystem->enableActionCache(invocation.actionCachePath,
+                                        invocation.actionCacheRootPath,
+                                        invocation.actionCacheUseHardLinks,
+                                        &error)) {
+      getDelegate().error(Twine("unable to enable action cache: ") + error);
+      return false;
+    }
   }
 
   return true;
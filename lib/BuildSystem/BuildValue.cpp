@@ -16,6 +16,7 @@
 
 #include "llvm/ADT/Hashing.h"
 
+#include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace llbuild;
@@ -50,7 +51,9 @@ StringRef BuildValue::stringForKind(BuildValue::Kind kind) {
 void BuildValue::dump(raw_ostream& os) const {
   os << "BuildValue(" << stringForKind(kind);
   if (kindHasSignature()) {
-    os << ", signature=" << signature.value;
+    os << ", signature="
+       << llvm::format_hex_no_prefix(signature.value.high, 16)
+       << llvm::format_hex_no_prefix(signature.value.low, 16);
   }
   if (kindHasOutputInfo()) {
     os << ", outputInfos=[";
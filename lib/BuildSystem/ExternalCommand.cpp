@@ -15,11 +15,13 @@
 #include "llbuild/Basic/Hashing.h"
 #include "llbuild/Basic/ExecutionQueue.h"
 #include "llbuild/Basic/FileSystem.h"
+#include "llbuild/BuildSystem/ActionCache.h"
 #include "llbuild/BuildSystem/BuildFile.h"
 #include "llbuild/BuildSystem/BuildKey.h"
 #include "llbuild/BuildSystem/BuildNode.h"
 #include "llbuild/BuildSystem/BuildSystemCommandInterface.h"
 #include "llbuild/BuildSystem/BuildValue.h"
+#include "llbuild/Core/BuildDB.h"
 
 #include "llbuild/Basic/FileInfo.h"
 #include "llbuild/Basic/LLVM.h"
@@ -30,17 +32,33 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <chrono>
+#include <limits>
+
 using namespace llbuild;
 using namespace llbuild::basic;
 using namespace llbuild::buildsystem;
 
 CommandSignature ExternalCommand::getSignature() const {
-  CommandSignature code(getName());
+  return getExternalSignature(nullptr);
+}
+
+CommandSignature
+ExternalCommand::getActionSignature(const ActionCache&) const {
+  return getSignature();
+}
+
+CommandSignature
+ExternalCommand::getExternalSignature(const ActionCache* actionCache) const {
+  auto relocate = [actionCache](StringRef path) -> std::string {
+    return actionCache ? actionCache->relocate(path) : path.str();
+  };
+  CommandSignature code(relocate(getName()));
   for (const auto* input: inputs) {
-    code = code.combine(input->getName());
+    code = code.combine(relocate(input->getName()));
   }
   for (const auto* output: outputs) {
-    code = code.combine(output->getName());
+    code = code.combine(relocate(output->getName()));
   }
   return code
       .combine(allowMissingInputs)
@@ -97,11 +115,62 @@ configureAttribute(const ConfigureContext& ctx, StringRef name,
     }
     alwaysOutOfDate = value == "true";
     return true;
+  } else if (name == "cacheable") {
+    if (value != "true" && value != "false") {
+      ctx.error("invalid value: '" + value + "' for attribute '" +
+                name + "'");
+      return false;
+    }
+    cacheable = value == "true";
+    return true;
+  } else if (name == "memory") {
+    // Accept a byte count with an optional binary suffix, e.g. "512M".
+    uint64_t multiplier = 1;
+    StringRef digits = value;
+    switch (value.empty() ? '\0' : value.back()) {
+    case 'K': multiplier = 1ULL << 10; break;
+    case 'M': multiplier = 1ULL << 20; break;
+    case 'G': multiplier = 1ULL << 30; break;
+    default: break;
+    }
+    if (multiplier != 1)
+      digits = value.drop_back();
+    if (digits.getAsInteger(10, declaredMemory) ||
+        declaredMemory > std::numeric_limits<uint64_t>::max() / multiplier) {
+      ctx.error("invalid value: '" + value + "' for attribute '" +
+                name + "'");
+      return false;
+    }
+    declaredMemory *= multiplier;
+    return true;
+  } else if (name == "cpus") {
+    if (value.getAsInteger(10, declaredCPUs) || declaredCPUs == 0) {
+      ctx.error("invalid value: '" + value + "' for attribute '" +
+                name + "'");
+      return false;
+    }
+    return true;
+  } else if (name == "qos") {
+    if (value == "default") {
+      qualityOfService = QualityOfService::Normal;
+    } else if (value == "user-initiated") {
+      qualityOfService = QualityOfService::UserInitiated;
+    } else if (value == "utility") {
+      qualityOfService = QualityOfService::Utility;
+    } else if (value == "background") {
+      qualityOfService = QualityOfService::Background;
+    } else {
+      ctx.error("invalid value: '" + value + "' for attribute '" +
+                name + "'");
+      return false;
+    }
+    return true;
   } else {
     ctx.error("unexpected attribute: '" + name + "'");
     return false;
   }
 }
+
 bool ExternalCommand::
 configureAttribute(const ConfigureContext& ctx, StringRef name,
                    ArrayRef<StringRef> values) {
@@ -115,6 +184,15 @@ bool ExternalCommand::configureAttribute(
   return false;
 }
 
+basic::JobResources ExternalCommand::getResources() const {
+  auto resources = Command::getResources();
+  if (declaredMemory != 0)
+    resources.memory = declaredMemory;
+  if (declaredCPUs != 0)
+    resources.cpus = declaredCPUs;
+  return resources;
+}
+
 BuildValue ExternalCommand::
 getResultForOutput(Node* node, const BuildValue& value) {
   // If the value was a failed or cancelled command, propagate the failure.
@@ -165,6 +243,7 @@ bool ExternalCommand::isResultValid(BuildSystem& system,
     return false;
     
   // Check the timestamps on each of the outputs.
+  auto infos = getOutputInfos(system.getFileSystem());
   for (unsigned i = 0, e = outputs.size(); i != e; ++i) {
     auto* node = outputs[i];
 
@@ -186,7 +265,7 @@ bool ExternalCommand::isResultValid(BuildSystem& system,
     // could enforce and error on the missing output if not annotated, and we
     // could enable behavior to remove such output files if annotated prior to
     // running the command.
-    auto info = node->getFileInfo(system.getFileSystem());
+    const auto& info = infos[i];
 
     // If this output is mutated by the build, we can't rely on equivalence,
     // only existence.
@@ -310,13 +389,69 @@ bool ExternalCommand::canUpdateIfNewerWithResult(const BuildValue& result) {
   return true;
 }
 
+bool ExternalCommand::
+getActionCachePaths(std::vector<std::string>& inputPaths_out,
+                    std::vector<std::string>& outputPaths_out) {
+  if (!cacheable || allowModifiedOutputs || alwaysOutOfDate ||
+      !canCacheOutputs())
+    return false;
+
+  // Every input must be a file whose contents we can digest; we
+  // conservatively refuse to cache commands with virtual or directory inputs,
+  // since those may stand for arbitrary content the command reads.
+  for (auto* node: inputs) {
+    if (node->isVirtual() || node->isDirectory() ||
+        node->isDirectoryStructure())
+      return false;
+    inputPaths_out.push_back(node->getName());
+  }
+
+  // Virtual outputs need no restoring, but there must be at least one file
+  // output and none may be mutated by other commands.
+  for (auto* node: outputs) {
+    if (node->isMutated() || node->isDirectory() ||
+        node->isDirectoryStructure())
+      return false;
+    if (!node->isVirtual())
+      outputPaths_out.push_back(node->getName());
+  }
+  return !outputPaths_out.empty();
+}
+
+std::vector<FileInfo>
+ExternalCommand::getOutputInfos(basic::FileSystem& fileSystem) {
+  std::vector<std::string> paths;
+  std::vector<unsigned> indices;
+  for (unsigned i = 0, e = outputs.size(); i != e; ++i) {
+    if (!outputs[i]->isVirtual()) {
+      paths.push_back(outputs[i]->getName());
+      indices.push_back(i);
+    }
+  }
+
+  std::vector<FileInfo> infos(outputs.size());
+  auto pathInfos = fileSystem.getFileInfos(paths);
+  for (unsigned i = 0, e = indices.size(); i != e; ++i)
+    infos[indices[i]] = pathInfos[i];
+  return infos;
+}
+
+void ExternalCommand::invalidateOutputs(BuildSystemCommandInterface& bsci) {
+  for (auto* node: outputs) {
+    if (!node->isVirtual() && !node->isCommandTimestamp())
+      bsci.getFileSystem().invalidate(node->getName());
+  }
+}
+
 BuildValue
 ExternalCommand::computeCommandResult(BuildSystemCommandInterface& bsci) {
   // Capture the file information for each of the output nodes.
   //
   // FIXME: We need to delegate to the node here.
   SmallVector<FileInfo, 8> outputInfos;
-  for (auto* node: outputs) {
+  auto infos = getOutputInfos(bsci.getFileSystem());
+  for (unsigned i = 0, e = outputs.size(); i != e; ++i) {
+    auto* node = outputs[i];
     if (node->isCommandTimestamp()) {
       // FIXME: We currently have to shoehorn the timestamp into a fake file
       // info, but need to refactor the command result to just store the node
@@ -327,8 +462,7 @@ ExternalCommand::computeCommandResult(BuildSystemCommandInterface& bsci) {
     } else if (node->isVirtual()) {
       outputInfos.push_back(FileInfo{});
     } else {
-      outputInfos.push_back(node->getFileInfo(
-                                bsci.getFileSystem()));
+      outputInfos.push_back(infos[i]);
     }
   }
   return BuildValue::makeSuccessfulCommand(outputInfos);
@@ -365,8 +499,9 @@ void ExternalCommand::execute(BuildSystemCommandInterface& bsci,
 
   // Create the directories for the directories containing file outputs.
   //
-  // FIXME: Implement a shared cache for this, to reduce the number of
-  // syscalls required to make this happen.
+  // The build system's file system remembers the directories created during
+  // the build, so this only makes system calls for the first output in each
+  // directory.
   for (auto* node: outputs) {
     if (!node->isVirtual()) {
       // Attempt to create the directory; we ignore errors here under the
@@ -379,12 +514,70 @@ void ExternalCommand::execute(BuildSystemCommandInterface& bsci,
       }
     }
   }
+
+  // If the action cache is enabled, check whether we can restore the outputs
+  // from a previous execution.
+  ActionCache* actionCache = bsci.getActionCache();
+  std::string actionKey;
+  std::vector<std::string> cachedOutputPaths;
+  if (actionCache) {
+    std::vector<std::string> cachedInputPaths;
+    if (getActionCachePaths(cachedInputPaths, cachedOutputPaths)) {
+      auto key = actionCache->computeActionKey(
+          bsci.getFileSystem(), getActionSignature(*actionCache),
+          cachedInputPaths);
+      if (key.hasValue()) {
+        actionKey = std::move(key.getValue());
+      }
+    }
+  }
+  if (!actionKey.empty()) {
+    bool hit = actionCache->restoreOutputs(actionKey, cachedOutputPaths);
+    bsci.getDelegate().commandActionCacheLookup(this, hit);
+    if (hit) {
+      invalidateOutputs(bsci);
+      resultFn(computeCommandResult(bsci));
+      return;
+    }
+
+    // Remove the existing outputs, so the command never writes through a
+    // hard link into the cache.
+    for (const auto& path: cachedOutputPaths) {
+      (void) bsci.getFileSystem().remove(path);
+    }
+  }
     
   // Invoke the external command.
   bsci.getDelegate().commandStarted(this);
-  executeExternalCommand(bsci, task, context, {[this, &bsci, resultFn](ProcessResult result){
+  auto startTime = std::chrono::steady_clock::now();
+  executeExternalCommand(bsci, task, context, {[this, &bsci, resultFn, actionCache, actionKey, cachedOutputPaths, startTime](ProcessResult result){
     bsci.getDelegate().commandFinished(this, result.status);
 
+    // The command may have modified its outputs, even if it failed.
+    invalidateOutputs(bsci);
+
+    // Record the execution telemetry for commands which actually ran.
+    if (result.status == ProcessStatus::Succeeded ||
+        result.status == ProcessStatus::Failed) {
+      core::CommandTelemetry telemetry;
+      telemetry.wallTime =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - startTime).count();
+      telemetry.utime = result.utime;
+      telemetry.stime = result.stime;
+      telemetry.maxrss = result.maxrss;
+      telemetry.outputSize = result.outputSize;
+      telemetry.status = uint32_t(result.status);
+      telemetry.exitCode = result.exitCode;
+      bsci.recordCommandTelemetry(this, telemetry);
+    }
+
+    // Store the outputs of successful commands in the action cache.
+    if (result.status == ProcessStatus::Succeeded && !actionKey.empty()) {
+      (void) actionCache->storeOutputs(bsci.getFileSystem(), actionKey,
+                                       cachedOutputPaths);
+    }
+
     // Process the result.
     switch (result.status) {
     case ProcessStatus::Failed:
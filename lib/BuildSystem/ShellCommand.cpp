@@ -13,8 +13,10 @@
 #include "llbuild/BuildSystem/ShellCommand.h"
 
 #include "llbuild/Basic/FileSystem.h"
+#include "llbuild/BuildSystem/ActionCache.h"
 #include "llbuild/BuildSystem/BuildFile.h"
 #include "llbuild/BuildSystem/BuildKey.h"
+#include "llbuild/BuildSystem/BuildNode.h"
 #include "llbuild/BuildSystem/BuildSystemCommandInterface.h"
 #include "llbuild/Core/DependencyInfoParser.h"
 #include "llbuild/Core/MakefileDepsParser.h"
@@ -42,34 +44,54 @@ void ShellCommand::start(BuildSystemCommandInterface& bsci,
 }
 
 CommandSignature ShellCommand::getSignature() const {
+  std::lock_guard<std::mutex> guard(cachedSignatureMutex);
   CommandSignature signature = cachedSignature;
   if (!signature.isNull())
     return signature;
 
-  auto code = ExternalCommand::getSignature();
+  signature = computeSignature(nullptr);
+  cachedSignature = signature;
+  return signature;
+}
+
+CommandSignature
+ShellCommand::getActionSignature(const ActionCache& actionCache) const {
+  return computeSignature(&actionCache);
+}
+
+CommandSignature
+ShellCommand::computeSignature(const ActionCache* actionCache) const {
+  auto relocate = [actionCache](StringRef value) -> std::string {
+    return actionCache ? actionCache->relocate(value) : value.str();
+  };
+  auto code = getExternalSignature(actionCache);
   if (!signatureData.empty()) {
     code = code.combine(signatureData);
   } else {
     for (const auto& arg: args) {
-      code = code.combine(arg);
+      code = code.combine(relocate(arg));
     }
     for (const auto& entry: env) {
       code = code.combine(entry.first);
-      code = code.combine(entry.second);
+      code = code.combine(relocate(entry.second));
     }
     for (const auto& path: depsPaths) {
-      code = code.combine(path);
+      code = code.combine(relocate(path));
     }
-    code = code.combine(int(depsStyle));
-    code = code.combine(int(inheritEnv));
-    code = code.combine(int(canSafelyInterrupt));
+    code = code.combine(uint64_t(depsStyle));
+    code = code.combine(inheritEnv);
+    code = code.combine(canSafelyInterrupt);
   }
-  signature = code;
-  if (signature.isNull()) {
-    signature = CommandSignature(1);
+  if (code.isNull()) {
+    code = CommandSignature(1);
   }
-  cachedSignature = signature;
-  return signature;
+  return code;
+}
+
+bool ShellCommand::canCacheOutputs() const {
+  // Commands with discovered dependencies read files which are not part of the
+  // action key, and commands run by a handler may behave arbitrarily.
+  return depsStyle == DepsStyle::Unused && handler == nullptr;
 }
 
 bool ShellCommand::processDiscoveredDependencies(BuildSystemCommandInterface& bsci,
@@ -379,10 +401,26 @@ void ShellCommand::executeExternalCommand(
     return;
   }
 
+  // Collect the file inputs and outputs, for queues which execute remotely.
+  std::vector<std::string> inputPaths;
+  for (auto* node: getInputs()) {
+    if (!node->isVirtual())
+      inputPaths.push_back(node->getName());
+  }
+  std::vector<std::string> outputPaths;
+  for (auto* node: getOutputs()) {
+    if (!node->isVirtual())
+      outputPaths.push_back(node->getName());
+  }
+
   // Execute the command.
+  ProcessAttributes attributes{canSafelyInterrupt, workingDirectory,
+                               controlEnabled};
+  attributes.inputs = inputPaths;
+  attributes.outputs = outputPaths;
+  attributes.qualityOfService = getQualityOfService();
   bsci.getExecutionQueue().executeProcess(
       context, args, env,
-      /*inheritEnvironment=*/inheritEnv,
-      {canSafelyInterrupt, workingDirectory, controlEnabled},
+      /*inheritEnvironment=*/inheritEnv, attributes,
       /*completionFn=*/{commandCompletionFn});
 }
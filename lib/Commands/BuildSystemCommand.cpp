@@ -588,7 +588,25 @@ static int executeBuildCommand(std::vector<std::string> args) {
   BasicBuildSystemFrontendDelegate delegate(sourceMgr, invocation);
   BuildSystemFrontend frontend(delegate, invocation,
                                basic::createLocalFileSystem());
-  if (!frontend.build(targetToBuild)) {
+  bool success = frontend.build(targetToBuild);
+
+  // Report the effectiveness of the file system caches, if requested.
+  if (invocation.showVerboseStatus && frontend.getBuildSystem()) {
+    fprintf(stdout, "%llu directory creations skipped\n",
+            (unsigned long long)frontend.getBuildSystem()
+              ->getDirectoryCache().getNumHits());
+    if (auto* statCache = frontend.getBuildSystem()->getStatCache()) {
+      uint64_t numHits = statCache->getNumHits();
+      uint64_t numLookups = numHits + statCache->getNumMisses();
+      fprintf(stdout, "stat cache: %llu hits, %llu lookups (%.1f%%), "
+              "%llu invalidations\n", (unsigned long long)numHits,
+              (unsigned long long)numLookups,
+              numLookups ? 100.0 * numHits / numLookups : 0.0,
+              (unsigned long long)statCache->getNumInvalidations());
+    }
+  }
+
+  if (!success) {
     // If there were failed commands, report the count and return an error.
     if (delegate.getNumFailedCommands()) {
       delegate.error("build had " + Twine(delegate.getNumFailedCommands()) +
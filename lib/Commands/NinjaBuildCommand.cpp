@@ -155,7 +155,7 @@ private:
   BuildValue &operator=(BuildValue&& rhs) LLBUILD_DELETED_FUNCTION;
 
 public:
-  static const int currentSchemaVersion = 3;
+  static const int currentSchemaVersion = 5;
 
 private:
   enum class BuildValueKind : uint32_t {
@@ -18,3 +18,39 @@ using namespace llbuild::core;
 BuildDBDelegate::~BuildDBDelegate() { }
 
 BuildDB::~BuildDB() { }
+
+bool BuildDB::visitKeys(StringRef prefix, bool includeResults,
+                        llvm::function_ref<bool(const BuildDBKeyEntry&)> visitor,
+                        std::string* error_out) {
+  // By default, enumerate via the materialized key list; results are not
+  // available without an engine key ID mapping.
+  std::vector<KeyType> keys;
+  if (!getKeys(keys, error_out))
+    return false;
+
+  for (const auto& key: keys) {
+    if (!StringRef(key).startswith(prefix))
+      continue;
+
+    BuildDBKeyEntry entry;
+    entry.key = key;
+    if (!visitor(entry))
+      break;
+  }
+
+  return true;
+}
+
+bool BuildDB::recordCommandTelemetry(const KeyType& key,
+                                     const CommandTelemetry& telemetry,
+                                     unsigned historyLimit,
+                                     std::string* error_out) {
+  return true;
+}
+
+bool BuildDB::visitCommandTelemetry(
+    StringRef key,
+    llvm::function_ref<bool(StringRef, const CommandTelemetry&)> visitor,
+    std::string* error_out) {
+  return true;
+}
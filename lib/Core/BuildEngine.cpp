@@ -13,6 +13,7 @@
 #include "llbuild/Core/BuildEngine.h"
 
 #include "llbuild/Basic/Defer.h"
+#include "llbuild/Basic/Probes.h"
 #include "llbuild/Basic/Tracing.h"
 #include "llbuild/Core/BuildDB.h"
 
@@ -525,6 +526,7 @@ private:
     // Inform the task it should start.
     {
       TracingEngineTaskCallback i(EngineTaskCallbackKind::Start, ruleInfo.keyID);
+      LLBUILD_PROBE1(task_started, ruleInfo.keyID);
       task->start(buildEngine);
     }
 
@@ -561,6 +563,8 @@ private:
     if (!ruleInfo.isScanning())
       return;
 
+    LLBUILD_PROBE2(rule_scanned, ruleInfo.keyID, uint64_t(request.inputIndex));
+
     // Process each of the remaining inputs.
     do {
       // Look up the input rule info, if not yet cached.
@@ -861,6 +865,7 @@ private:
 
         RuleInfo* ruleInfo = taskInfo->forRuleInfo;
         assert(taskInfo == ruleInfo->getPendingTaskInfo());
+        LLBUILD_PROBE1(task_finished, ruleInfo->keyID);
 
         // The task was changed if was computed in the current iteration.
         if (trace) {
@@ -904,8 +909,10 @@ private:
         // Update the database record, if attached.
         if (db) {
           std::string error;
+          LLBUILD_PROBE1(db_write_start, ruleInfo->keyID);
           bool result = db->setRuleResult(
               ruleInfo->keyID, ruleInfo->rule, ruleInfo->result, &error);
+          LLBUILD_PROBE2(db_write_done, ruleInfo->keyID, result);
           if (!result) {
             delegate.error(error);
             cancelRemainingTasks();
@@ -1384,7 +1391,9 @@ public:
     RuleInfo& ruleInfo = result.first->second;
     if (db) {
       std::string error;
+      LLBUILD_PROBE1(db_read_start, ruleInfo.keyID);
       db->lookupRuleResult(ruleInfo.keyID, ruleInfo.rule, &ruleInfo.result, &error);
+      LLBUILD_PROBE2(db_read_done, ruleInfo.keyID, ruleInfo.result.builtAt);
       if (!error.empty()) {
         // FIXME: Investigate changing the database error handling model to
         // allow builds to proceed without the database.
@@ -1456,6 +1465,13 @@ public:
     if (trace)
       trace->buildEnded();
 
+    // Write out the events recorded by the tracing points, if enabled.
+    if (TracingEnabled) {
+      std::string error;
+      if (!TracingWriteEvents(&error))
+        delegate.error(error);
+    }
+
     // Clear the rule scan free-lists.
     //
     // FIXME: Introduce a per-build context object to hold this.
@@ -1560,7 +1576,9 @@ public:
 
     // Lookup the rule for this task.
     RuleInfo* ruleInfo = &getRuleInfoForKey(key);
-    
+    LLBUILD_PROBE2(input_requested, taskInfo->forRuleInfo->keyID,
+                   ruleInfo->keyID);
+
     inputRequests.push_back({ taskInfo, ruleInfo, inputID });
     taskInfo->waitCount++;
   }
@@ -22,6 +22,7 @@
 
 #include <cassert>
 #include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <mutex>
 
@@ -54,6 +55,20 @@ template<> struct ::llvm::DenseMapInfo<DBKeyID> {
   }
 };
 
+/// Get the signature stored in the given column of the current row.
+static basic::CommandSignature getSignatureColumn(sqlite3_stmt* stmt,
+                                                  int column) {
+  basic::CommandSignature signature;
+  const void* bytes = sqlite3_column_blob(stmt, column);
+  int numBytes = sqlite3_column_bytes(stmt, column);
+  if (numBytes == 16) {
+    basic::BinaryDecoder decoder(StringRef((const char*)bytes, numBytes));
+    decoder.read(signature);
+    decoder.finish();
+  }
+  return signature;
+}
+
 // Helper macro checking and returning error messages for failed SQLite calls
 #define checkSQLiteResultOKReturnFalse(result) \
 if (result != SQLITE_OK) { \
@@ -66,6 +81,8 @@ namespace {
 
 class SQLiteBuildDB : public BuildDB {
   /// Version History:
+  /// * 12: Store 128-bit result signatures
+  /// * 11: Add command telemetry
   /// * 10: Add result signature
   /// * 9: Add filtered directory contents, related build key changes
   /// * 8: Remove ID from rule results
@@ -73,7 +90,7 @@ class SQLiteBuildDB : public BuildDB {
   /// * 6: Added `ordinal` field for dependencies.
   /// * 5: Switched to using `WITHOUT ROWID` for dependencies.
   /// * 4: Pre-history
-  static const int currentSchemaVersion = 10;
+  static const int currentSchemaVersion = 12;
 
   std::string path;
   uint32_t clientSchemaVersion;
@@ -81,6 +98,19 @@ class SQLiteBuildDB : public BuildDB {
   /// If `false`, it will not be re-created but returns an error instead.
   bool recreateOnUnmatchedVersion;
 
+  /// The journaling and locking behavior of the connection.
+  SQLiteBuildDBMode mode;
+
+  /// The number of results written since the last batch commit (WAL mode).
+  unsigned numUncommittedResults = 0;
+
+  /// The time at which the current batch was started (WAL mode).
+  std::chrono::steady_clock::time_point batchStartTime;
+
+  /// Whether the build's transaction is open (in WAL mode, this is the current
+  /// batch's transaction).
+  bool inTransaction = false;
+
   sqlite3 *db = nullptr;
 
   /// The mutex to protect all access to the database and statements.
@@ -126,10 +156,20 @@ class SQLiteBuildDB : public BuildDB {
         }
     }
 
-    int result = sqlite3_open(path.c_str(), &db);
+    int result;
+    if (mode == SQLiteBuildDBMode::ReadOnly) {
+      result = sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY,
+                               nullptr);
+    } else {
+      result = sqlite3_open(path.c_str(), &db);
+    }
     if (result != SQLITE_OK) {
       *error_out = "unable to open database: " + std::string(
           sqlite3_errstr(result));
+      if (db) {
+        sqlite3_close(db);
+        db = nullptr;
+      }
       return false;
     }
 
@@ -169,8 +209,9 @@ class SQLiteBuildDB : public BuildDB {
       // Close the database before we try to recreate it.
       sqlite3_close(db);
       
-      if (!recreateOnUnmatchedVersion) {
+      if (!recreateOnUnmatchedVersion || mode == SQLiteBuildDBMode::ReadOnly) {
         // We don't re-create the database in this case and return an error
+        db = nullptr;
         *error_out = std::string("Version mismatch. (database-schema: ") + std::to_string(version) + std::string(" requested schema: ") + std::to_string(currentSchemaVersion) + std::string(". database-client: ") + std::to_string(clientVersion) + std::string(" requested client: ") + std::to_string(clientSchemaVersion) + std::string(")");
         return false;
       }
@@ -185,6 +226,11 @@ class SQLiteBuildDB : public BuildDB {
           return false;
         }
       } else {
+        // Remove any write-ahead log left behind by the old database, it must
+        // never be replayed against the new one.
+        (void)basic::sys::unlink((path + "-wal").c_str());
+        (void)basic::sys::unlink((path + "-shm").c_str());
+
         // If the remove was successful, reopen the database.
         int result = sqlite3_open(path.c_str(), &db);
         if (result != SQLITE_OK) {
@@ -225,7 +271,7 @@ class SQLiteBuildDB : public BuildDB {
           db, ("CREATE TABLE rule_results ("
                "key_id INTEGER PRIMARY KEY, "
                "value BLOB, "
-               "signature INTEGER, "
+               "signature BLOB, "
                "built_at INTEGER, "
                "computed_at INTEGER, "
                "dependencies BLOB, "
@@ -233,6 +279,24 @@ class SQLiteBuildDB : public BuildDB {
           nullptr, nullptr, &cError);
       }
 
+      if (result == SQLITE_OK) {
+        result = sqlite3_exec(
+          db, ("CREATE TABLE command_telemetry ("
+               "key_id INTEGER, "
+               "iteration INTEGER, "
+               "wall_time INTEGER, "
+               "utime INTEGER, "
+               "stime INTEGER, "
+               "maxrss INTEGER, "
+               "output_size INTEGER, "
+               "status INTEGER, "
+               "exit_code INTEGER, "
+               "PRIMARY KEY(key_id, iteration), "
+               "FOREIGN KEY(key_id) REFERENCES key_names(id)) "
+               "WITHOUT ROWID;"),
+          nullptr, nullptr, &cError);
+      }
+
       // Create the indices on the rule tables.
       if (result == SQLITE_OK) {
         // Create an index to be used for efficiently looking up rule
@@ -256,6 +320,20 @@ class SQLiteBuildDB : public BuildDB {
       }
     }
 
+    // Switch to write-ahead logging, if requested. This is persistent, but we
+    // set it on every open in case the database was created in another mode.
+    if (mode == SQLiteBuildDBMode::WAL) {
+      result = sqlite3_exec(db, "PRAGMA journal_mode = WAL;",
+                            nullptr, nullptr, nullptr);
+      checkSQLiteResultOKReturnFalse(result);
+
+      // Only the WAL needs to be synced on commit, which keeps the periodic
+      // batch commits cheap while still being safe against process crashes.
+      result = sqlite3_exec(db, "PRAGMA synchronous = NORMAL;",
+                            nullptr, nullptr, nullptr);
+      checkSQLiteResultOKReturnFalse(result);
+    }
+
     // Initialize prepared statements.
     result = sqlite3_prepare_v2(
       db, findKeyIDForKeyStmtSQL,
@@ -292,6 +370,19 @@ class SQLiteBuildDB : public BuildDB {
       -1, &fastFindRuleResultStmt, nullptr);
     checkSQLiteResultOKReturnFalse(result);
 
+    // The telemetry statements are only used when writing.
+    if (mode != SQLiteBuildDBMode::ReadOnly) {
+      result = sqlite3_prepare_v2(
+        db, insertIntoCommandTelemetryStmtSQL,
+        -1, &insertIntoCommandTelemetryStmt, nullptr);
+      checkSQLiteResultOKReturnFalse(result);
+
+      result = sqlite3_prepare_v2(
+        db, pruneCommandTelemetryStmtSQL,
+        -1, &pruneCommandTelemetryStmt, nullptr);
+      checkSQLiteResultOKReturnFalse(result);
+    }
+
     return true;
   }
 
@@ -313,14 +404,20 @@ class SQLiteBuildDB : public BuildDB {
     insertIntoKeysStmt = nullptr;
     sqlite3_finalize(insertIntoRuleResultsStmt);
     insertIntoRuleResultsStmt = nullptr;
+    sqlite3_finalize(insertIntoCommandTelemetryStmt);
+    insertIntoCommandTelemetryStmt = nullptr;
+    sqlite3_finalize(pruneCommandTelemetryStmt);
+    pruneCommandTelemetryStmt = nullptr;
 
     sqlite3_close(db);
     db = nullptr;
   }
 
 public:
-  SQLiteBuildDB(StringRef path, uint32_t clientSchemaVersion, bool recreateOnUnmatchedVersion)
-    : path(path), clientSchemaVersion(clientSchemaVersion), recreateOnUnmatchedVersion(recreateOnUnmatchedVersion) { }
+  SQLiteBuildDB(StringRef path, uint32_t clientSchemaVersion, bool recreateOnUnmatchedVersion,
+                SQLiteBuildDBMode mode)
+    : path(path), clientSchemaVersion(clientSchemaVersion), recreateOnUnmatchedVersion(recreateOnUnmatchedVersion),
+      mode(mode) { }
 
   virtual ~SQLiteBuildDB() {
     std::lock_guard<std::mutex> guard(dbMutex);
@@ -474,8 +571,7 @@ public:
       dependencyBytes = sqlite3_column_blob(fastFindRuleResultStmt, 4);
 
       // Extract the signature
-      result_out->signature =
-        basic::CommandSignature(sqlite3_column_int64(fastFindRuleResultStmt, 5));
+      result_out->signature = getSignatureColumn(fastFindRuleResultStmt, 5);
     } else {
       // KeyID is not known, perform the 'normal' search using the key value
 
@@ -517,8 +613,7 @@ public:
       dependencyBytes = sqlite3_column_blob(findRuleResultStmt, 4);
 
       // Extract the signature
-      result_out->signature =
-        basic::CommandSignature(sqlite3_column_int64(findRuleResultStmt, 5));
+      result_out->signature = getSignatureColumn(findRuleResultStmt, 5);
     }
 
 
@@ -613,8 +708,12 @@ public:
                                ruleResult.value.size(),
                                SQLITE_STATIC);
     checkSQLiteResultOKReturnFalse(result);
-    result = sqlite3_bind_int64(insertIntoRuleResultsStmt, /*index=*/3,
-                               ruleResult.signature.value);
+    basic::BinaryEncoder signatureEncoder{};
+    signatureEncoder.write(ruleResult.signature);
+    result = sqlite3_bind_blob(insertIntoRuleResultsStmt, /*index=*/3,
+                               signatureEncoder.data(),
+                               signatureEncoder.size(),
+                               SQLITE_STATIC);
     checkSQLiteResultOKReturnFalse(result);
     result = sqlite3_bind_int64(insertIntoRuleResultsStmt, /*index=*/4,
                                 ruleResult.builtAt);
@@ -633,6 +732,124 @@ public:
       return false;
     }
 
+    if (mode == SQLiteBuildDBMode::WAL) {
+      return commitBatchIfNeeded(error_out);
+    }
+
+    return true;
+  }
+
+  static constexpr const char *insertIntoCommandTelemetryStmtSQL =
+    "INSERT OR REPLACE INTO command_telemetry VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);";
+  sqlite3_stmt* insertIntoCommandTelemetryStmt = nullptr;
+
+  // Delete all but the most recent `?2` runs of the command `?1`.
+  static constexpr const char *pruneCommandTelemetryStmtSQL = (
+      "DELETE FROM command_telemetry WHERE key_id == ?1 AND iteration <= "
+      "(SELECT iteration FROM command_telemetry WHERE key_id == ?1 "
+      "ORDER BY iteration DESC LIMIT 1 OFFSET ?2);");
+  sqlite3_stmt* pruneCommandTelemetryStmt = nullptr;
+
+  virtual bool recordCommandTelemetry(const KeyType& key,
+                                      const CommandTelemetry& telemetry,
+                                      unsigned historyLimit,
+                                      std::string *error_out) override {
+    std::lock_guard<std::mutex> guard(dbMutex);
+    int result;
+
+    if (!open(error_out)) {
+      return false;
+    }
+    if (mode == SQLiteBuildDBMode::ReadOnly) {
+      *error_out = "unable to record command telemetry: database is read-only";
+      return false;
+    }
+
+    auto dbKeyID = getKeyIDForKeyFromDB(key, error_out);
+    if (!error_out->empty()) {
+      return false;
+    }
+
+    result = sqlite3_reset(insertIntoCommandTelemetryStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_clear_bindings(insertIntoCommandTelemetryStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    const int64_t values[] = {
+      int64_t(dbKeyID.value), int64_t(telemetry.iteration),
+      int64_t(telemetry.wallTime), int64_t(telemetry.utime),
+      int64_t(telemetry.stime), int64_t(telemetry.maxrss),
+      int64_t(telemetry.outputSize), int64_t(telemetry.status),
+      int64_t(telemetry.exitCode) };
+    for (int i = 0; i != int(llvm::array_lengthof(values)); ++i) {
+      result = sqlite3_bind_int64(insertIntoCommandTelemetryStmt,
+                                  /*index=*/i + 1, values[i]);
+      checkSQLiteResultOKReturnFalse(result);
+    }
+    result = sqlite3_step(insertIntoCommandTelemetryStmt);
+    if (result != SQLITE_DONE) {
+      *error_out = getCurrentErrorMessage();
+      return false;
+    }
+
+    // Drop the runs which have fallen out of the history.
+    result = sqlite3_reset(pruneCommandTelemetryStmt);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_bind_int64(pruneCommandTelemetryStmt, /*index=*/1,
+                                dbKeyID.value);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_bind_int64(pruneCommandTelemetryStmt, /*index=*/2,
+                                historyLimit);
+    checkSQLiteResultOKReturnFalse(result);
+    result = sqlite3_step(pruneCommandTelemetryStmt);
+    if (result != SQLITE_DONE) {
+      *error_out = getCurrentErrorMessage();
+      return false;
+    }
+
+    if (mode == SQLiteBuildDBMode::WAL) {
+      return commitBatchIfNeeded(error_out);
+    }
+
+    return true;
+  }
+
+  /// Commit the current batch of results once it is large or old enough, and
+  /// start a new one.
+  ///
+  /// This method is not thread-safe. The caller must protect access via the
+  /// dbMutex.
+  bool commitBatchIfNeeded(std::string *error_out) {
+    // The maximum number of results, and the maximum age, of a batch.
+    const unsigned maxBatchSize = 1000;
+    const std::chrono::milliseconds maxBatchAge(500);
+
+    // If a new batch could not be started, the failure has been reported and
+    // there is nothing to commit.
+    if (!inTransaction)
+      return true;
+
+    auto now = std::chrono::steady_clock::now();
+    if (++numUncommittedResults < maxBatchSize &&
+        now - batchStartTime < maxBatchAge)
+      return true;
+
+    int result = sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    if (result != SQLITE_OK) {
+      *error_out = getCurrentErrorMessage();
+      return false;
+    }
+    inTransaction = false;
+    numUncommittedResults = 0;
+    batchStartTime = now;
+
+    // The write lock is released between batches, so another build may have
+    // taken it in the meantime.
+    result = sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+    if (result != SQLITE_OK) {
+      *error_out = getCurrentErrorMessage();
+      return false;
+    }
+    inTransaction = true;
     return true;
   }
 
@@ -642,16 +859,31 @@ public:
     if (!open(error_out))
       return false;
 
-    // Execute the entire build inside a single transaction.
-    //
-    // FIXME: We should revist this, as we probably wouldn't want a crash in the
-    // build system to totally lose all build results.
-    int result = sqlite3_exec(db, "BEGIN EXCLUSIVE;", nullptr, nullptr, nullptr);
+    // Read-only connections never hold a lock across the build.
+    if (mode == SQLiteBuildDBMode::ReadOnly)
+      return true;
+
+    int result;
+    if (mode == SQLiteBuildDBMode::WAL) {
+      // Take the write lock, but leave the database readable; results are
+      // committed in periodic batches. The lock is released between batches,
+      // so another build can only write to the database between them.
+      numUncommittedResults = 0;
+      batchStartTime = std::chrono::steady_clock::now();
+      result = sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+    } else {
+      // Execute the entire build inside a single transaction.
+      //
+      // FIXME: We should revist this, as we probably wouldn't want a crash in
+      // the build system to totally lose all build results.
+      result = sqlite3_exec(db, "BEGIN EXCLUSIVE;", nullptr, nullptr, nullptr);
+    }
 
     if (result != SQLITE_OK) {
       *error_out = getCurrentErrorMessage();
       return false;
     }
+    inTransaction = true;
 
     return true;
   }
@@ -660,9 +892,12 @@ public:
     std::lock_guard<std::mutex> guard(dbMutex);
 
     // Sync changes to disk.
-    int result = sqlite3_exec(db, "END;", nullptr, nullptr, nullptr);
-    assert(result == SQLITE_OK);
-    (void)result;
+    if (inTransaction) {
+      int result = sqlite3_exec(db, "END;", nullptr, nullptr, nullptr);
+      assert(result == SQLITE_OK);
+      (void)result;
+      inTransaction = false;
+    }
 
     // We close the connection whenever a build completes so that we release
     // any locks that we may have on the file.
@@ -696,6 +931,149 @@ public:
     return true;
   }
 
+  virtual bool visitKeys(StringRef prefix, bool includeResults,
+                         llvm::function_ref<bool(const BuildDBKeyEntry&)> visitor,
+                         std::string* error_out) override {
+    std::lock_guard<std::mutex> guard(dbMutex);
+
+    if (!open(error_out))
+      return false;
+
+    // The prefix filter is expressed as a range over the key, so that it is
+    // answered using the unique index on `key_names.key`. The upper bound is
+    // the smallest string greater than all strings with the prefix, if any.
+    std::string upperBound = prefix;
+    while (!upperBound.empty() && (uint8_t)upperBound.back() == 0xFF)
+      upperBound.pop_back();
+    if (!upperBound.empty())
+      upperBound.back() = (char)((uint8_t)upperBound.back() + 1);
+
+    std::string query = includeResults
+      ? ("SELECT key, rule_results.key_id IS NOT NULL, value, signature, "
+         "built_at, computed_at FROM key_names "
+         "LEFT JOIN rule_results ON rule_results.key_id = key_names.id")
+      : "SELECT key FROM key_names";
+    if (!prefix.empty()) {
+      query += " WHERE key >= ?1";
+      if (!upperBound.empty())
+        query += " AND key < ?2";
+    }
+    query += ";";
+
+    int result;
+    sqlite3_stmt* stmt;
+    result = sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr);
+    checkSQLiteResultOKReturnFalse(result);
+
+    if (!prefix.empty()) {
+      // Bind as text, to compare in the same storage class as the keys.
+      result = sqlite3_bind_text(stmt, /*index=*/1, prefix.data(),
+                                 prefix.size(), SQLITE_STATIC);
+      if (result == SQLITE_OK && !upperBound.empty()) {
+        result = sqlite3_bind_text(stmt, /*index=*/2, upperBound.data(),
+                                   upperBound.size(), SQLITE_STATIC);
+      }
+      if (result != SQLITE_OK) {
+        *error_out = getCurrentErrorMessage();
+        sqlite3_finalize(stmt);
+        return false;
+      }
+    }
+
+    while (true) {
+      result = sqlite3_step(stmt);
+      if (result == SQLITE_DONE)
+        break;
+      if (result != SQLITE_ROW) {
+        *error_out = getCurrentErrorMessage();
+        sqlite3_finalize(stmt);
+        return false;
+      }
+
+      BuildDBKeyEntry entry;
+      entry.key = StringRef((const char*)sqlite3_column_text(stmt, 0),
+                            sqlite3_column_bytes(stmt, 0));
+      if (includeResults && sqlite3_column_int(stmt, 1)) {
+        assert(sqlite3_column_count(stmt) == 6);
+        entry.hasResult = true;
+        entry.value = StringRef((const char*)sqlite3_column_blob(stmt, 2),
+                                sqlite3_column_bytes(stmt, 2));
+        entry.signature = getSignatureColumn(stmt, 3);
+        entry.builtAt = sqlite3_column_int64(stmt, 4);
+        entry.computedAt = sqlite3_column_int64(stmt, 5);
+      }
+
+      if (!visitor(entry))
+        break;
+    }
+
+    sqlite3_finalize(stmt);
+    return true;
+  }
+
+  virtual bool visitCommandTelemetry(
+      StringRef key,
+      llvm::function_ref<bool(StringRef, const CommandTelemetry&)> visitor,
+      std::string* error_out) override {
+    std::lock_guard<std::mutex> guard(dbMutex);
+
+    if (!open(error_out))
+      return false;
+
+    std::string query =
+      "SELECT key, iteration, wall_time, utime, stime, maxrss, output_size, "
+      "status, exit_code FROM command_telemetry "
+      "INNER JOIN key_names ON key_names.id = command_telemetry.key_id";
+    if (!key.empty())
+      query += " WHERE key == ?1";
+    query += " ORDER BY key, iteration DESC;";
+
+    int result;
+    sqlite3_stmt* stmt;
+    result = sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr);
+    checkSQLiteResultOKReturnFalse(result);
+
+    if (!key.empty()) {
+      result = sqlite3_bind_text(stmt, /*index=*/1, key.data(), key.size(),
+                                 SQLITE_STATIC);
+      if (result != SQLITE_OK) {
+        *error_out = getCurrentErrorMessage();
+        sqlite3_finalize(stmt);
+        return false;
+      }
+    }
+
+    while (true) {
+      result = sqlite3_step(stmt);
+      if (result == SQLITE_DONE)
+        break;
+      if (result != SQLITE_ROW) {
+        *error_out = getCurrentErrorMessage();
+        sqlite3_finalize(stmt);
+        return false;
+      }
+
+      assert(sqlite3_column_count(stmt) == 9);
+      StringRef entryKey((const char*)sqlite3_column_text(stmt, 0),
+                         sqlite3_column_bytes(stmt, 0));
+      CommandTelemetry telemetry;
+      telemetry.iteration = sqlite3_column_int64(stmt, 1);
+      telemetry.wallTime = sqlite3_column_int64(stmt, 2);
+      telemetry.utime = sqlite3_column_int64(stmt, 3);
+      telemetry.stime = sqlite3_column_int64(stmt, 4);
+      telemetry.maxrss = sqlite3_column_int64(stmt, 5);
+      telemetry.outputSize = sqlite3_column_int64(stmt, 6);
+      telemetry.status = sqlite3_column_int(stmt, 7);
+      telemetry.exitCode = sqlite3_column_int(stmt, 8);
+
+      if (!visitor(entryKey, telemetry))
+        break;
+    }
+
+    sqlite3_finalize(stmt);
+    return true;
+  }
+
   virtual void dump(raw_ostream& os) override {
     std::lock_guard<std::mutex> guard(dbMutex);
 
@@ -783,6 +1161,15 @@ private:
   // return a DBKeyID for the given engine KeyID. This should really only be
   // used by the above cached getKeyID() method.
   DBKeyID getKeyIDFromDB(KeyID keyID, std::string *error_out) {
+    return getKeyIDForKeyFromDB(delegate->getKeyForID(keyID), error_out);
+  }
+
+  /// Search and update the key_names table as needed to return a DBKeyID for
+  /// the given key.
+  ///
+  /// This method is not thread-safe. The caller must protect access via the
+  /// dbMutex.
+  DBKeyID getKeyIDForKeyFromDB(const KeyType& key, std::string *error_out) {
 #define checkSQLiteResultOKReturnDBKeyID(result) \
 if (result != SQLITE_OK) { \
   *error_out = getCurrentErrorMessage(); \
@@ -792,7 +1179,6 @@ if (result != SQLITE_OK) { \
     int result;
 
     // Search for the key in the key_names table
-    auto key = delegate->getKeyForID(keyID);
     result = sqlite3_reset(findKeyIDForKeyStmt);
     checkSQLiteResultOKReturnDBKeyID(result);
     result = sqlite3_clear_bindings(findKeyIDForKeyStmt);
@@ -882,8 +1268,10 @@ if (result != SQLITE_OK) { \
 std::unique_ptr<BuildDB> core::createSQLiteBuildDB(StringRef path,
                                                    uint32_t clientSchemaVersion,
                                                    bool recreateUnmatchedVersion,
-                                                   std::string *error_out) {
-  return llvm::make_unique<SQLiteBuildDB>(path, clientSchemaVersion, recreateUnmatchedVersion);
+                                                   std::string *error_out,
+                                                   SQLiteBuildDBMode mode) {
+  return llvm::make_unique<SQLiteBuildDB>(path, clientSchemaVersion, recreateUnmatchedVersion,
+                                          mode);
 }
 
 #undef checkSQLiteResultOKReturnFalse
@@ -11,9 +11,11 @@
 //===----------------------------------------------------------------------===//
 
 #import "llbuild/Basic/BinaryCoding.h"
+#import "llbuild/Basic/FileInfo.h"
 
 #import <XCTest/XCTest.h>
 
+using namespace llbuild;
 using namespace llbuild::basic;
 
 @interface BinaryCodingPerfTests : XCTestCase
@@ -63,4 +65,86 @@ using namespace llbuild::basic;
     }];
 }
 
+/// Check encoding 100MB of FileInfo arrays.
+- (void)testEncoding_FileInfoArray_100MB {
+    std::vector<FileInfo> infos((1 << 20) / sizeof(FileInfo));
+    for (size_t i = 0; i != infos.size(); ++i) {
+        infos[i] = FileInfo{ 1, i, 0100644, i * 10, { i, 0 } };
+    }
+    [self measureBlock:^{
+        // We do 100 iterations to sum to 100 MBs.
+        for (int j = 0; j != 100; ++j) {
+            BinaryEncoder coder;
+            coder.writeArray(ArrayRef<FileInfo>(infos));
+            XCTAssertEqual(coder.size(), infos.size() * sizeof(FileInfo));
+        }
+    }];
+}
+
+/// Check decoding 1000MB of FileInfo arrays.
+- (void)testDecoding_FileInfoArray_1000MB {
+    std::vector<FileInfo> infos((1 << 20) / sizeof(FileInfo));
+    for (size_t i = 0; i != infos.size(); ++i) {
+        infos[i] = FileInfo{ 1, i, 0100644, i * 10, { i, 0 } };
+    }
+    BinaryEncoder coder;
+    coder.writeArray(ArrayRef<FileInfo>(infos));
+    auto data = coder.contents();
+
+    [self measureBlock:^{
+        // We do 1000 iterations to sum to 1000 MBs.
+        std::vector<FileInfo> decoded(infos.size());
+        for (int j = 0; j != 1000; ++j) {
+            BinaryDecoder decoder(data);
+            decoder.readArray(MutableArrayRef<FileInfo>(decoded));
+            decoder.finish();
+        }
+        XCTAssertEqual(decoded.back().inode, infos.back().inode);
+    }];
+}
+
+/// Check decoding 1000MB of small varints.
+- (void)testDecoding_VarInt_1000MB {
+    BinaryEncoder coder;
+    for (auto i = 0; i != (1 << 20) / 2; ++i) {
+        coder.writeVarInt(uint64_t(i % 0x4000));
+    }
+    auto data = coder.contents();
+
+    [self measureBlock:^{
+        // We do 1000 iterations to sum to 1000 MBs.
+        for (int j = 0; j != 1000; ++j) {
+            BinaryDecoder decoder(data);
+            for (auto i = 0; i != (1 << 20) / 2; ++i) {
+                uint64_t value;
+                decoder.readVarInt(value);
+                if (value != uint64_t(i % 0x4000)) abort();
+            }
+            decoder.finish();
+        }
+    }];
+}
+
+/// Check decoding 100MB of strings, without copying them.
+- (void)testDecoding_StringRef_100MB {
+    BinaryEncoder coder;
+    for (auto i = 0; i != (1 << 20) / 32; ++i) {
+        coder.writeString("/path/to/some/source/file.c");
+    }
+    auto data = coder.contents();
+
+    [self measureBlock:^{
+        // We do 100 iterations to sum to 100 MBs.
+        for (int j = 0; j != 100; ++j) {
+            BinaryDecoder decoder(data);
+            for (auto i = 0; i != (1 << 20) / 32; ++i) {
+                StringRef value;
+                decoder.readString(value);
+                if (value.size() != 27) abort();
+            }
+            decoder.finish();
+        }
+    }];
+}
+
 @end
@@ -0,0 +1,74 @@
+//===- HashingPerfTests.mm ------------------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#import "llbuild/Basic/Hashing.h"
+
+#import <XCTest/XCTest.h>
+
+#import <string>
+#import <vector>
+
+using namespace llbuild::basic;
+
+@interface HashingPerfTests : XCTestCase
+
+@end
+
+@implementation HashingPerfTests
+
+/// Get a 16KB command line made of arguments of the given size.
+static std::vector<std::string> getCommandLine(size_t argSize) {
+    std::vector<std::string> args;
+    for (size_t i = 0; i != (16 << 10) / argSize; ++i) {
+        args.push_back(std::string(argSize, char('a' + i % 26)));
+    }
+    return args;
+}
+
+/// Check hashing 1000MB of contiguous data.
+- (void)testHashBytes128_1000MB {
+    std::string data(1 << 20, 'x');
+    [self measureBlock:^{
+        // We do 1000 iterations to sum to 1000 MBs.
+        uint64_t result = 0;
+        for (int j = 0; j != 1000; ++j) {
+            result ^= hashBytes128(data, j).low;
+        }
+        XCTAssertNotEqual(result, 0);
+    }];
+}
+
+/// Check the signatures of 10,000 16KB command lines of short arguments.
+- (void)testCommandSignature_ShortArgs_160MB {
+    auto args = getCommandLine(8);
+    [self measureBlock:^{
+        for (int j = 0; j != 10000; ++j) {
+            CommandSignature signature("command");
+            signature.combine(args);
+            XCTAssertFalse(signature.isNull());
+        }
+    }];
+}
+
+/// Check the signatures of 10,000 16KB command lines of long arguments.
+- (void)testCommandSignature_LongArgs_160MB {
+    auto args = getCommandLine(256);
+    [self measureBlock:^{
+        for (int j = 0; j != 10000; ++j) {
+            CommandSignature signature("command");
+            signature.combine(args);
+            XCTAssertFalse(signature.isNull());
+        }
+    }];
+}
+
+@end
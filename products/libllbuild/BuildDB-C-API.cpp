@@ -49,13 +49,13 @@ namespace {
     
     std::unique_ptr<BuildDB> _db;
     
-    CAPIBuildDB(StringRef path, uint32_t clientSchemaVersion, std::string *error_out) {
-      _db = createSQLiteBuildDB(path, clientSchemaVersion, /* recreateUnmatchedVersion = */ false, error_out);
+    CAPIBuildDB(StringRef path, uint32_t clientSchemaVersion, SQLiteBuildDBMode mode, std::string *error_out) {
+      _db = createSQLiteBuildDB(path, clientSchemaVersion, /* recreateUnmatchedVersion = */ false, error_out, mode);
     }
     
   public:
-    static CAPIBuildDB *create(StringRef path, uint32_t clientSchemaVersion, std::string *error_out) {
-      auto databaseObject = new CAPIBuildDB(path, clientSchemaVersion, error_out);
+    static CAPIBuildDB *create(StringRef path, uint32_t clientSchemaVersion, SQLiteBuildDBMode mode, std::string *error_out) {
+      auto databaseObject = new CAPIBuildDB(path, clientSchemaVersion, mode, error_out);
       if (databaseObject->_db == nullptr || !error_out->empty() || !databaseObject->buildStarted(error_out)) {
         delete databaseObject;
         return nullptr;
@@ -103,17 +103,30 @@ namespace {
     const bool getKeys(std::vector<KeyType>& keys_out, std::string *error_out) {
       return _db.get()->getKeys(keys_out, error_out);
     }
+    
+    const bool visitKeys(StringRef prefix, bool includeResults,
+                         llvm::function_ref<bool(const BuildDBKeyEntry&)> visitor,
+                         std::string *error_out) {
+      return _db.get()->visitKeys(prefix, includeResults, visitor, error_out);
+    }
+
+    const bool visitCommandTelemetry(
+        StringRef key,
+        llvm::function_ref<bool(StringRef, const CommandTelemetry&)> visitor,
+        std::string *error_out) {
+      return _db.get()->visitCommandTelemetry(key, visitor, error_out);
+    }
   };
 
 }
 
-const llb_database_t* llb_database_open(
-                                        char *path,
-                                        uint32_t clientSchemaVersion,
-                                        llb_data_t *error_out) {
+static const llb_database_t* openDatabase(char *path,
+                                          uint32_t clientSchemaVersion,
+                                          SQLiteBuildDBMode mode,
+                                          llb_data_t *error_out) {
   std::string error;
   
-  auto database = CAPIBuildDB::create(StringRef(path), clientSchemaVersion, &error);
+  auto database = CAPIBuildDB::create(StringRef(path), clientSchemaVersion, mode, &error);
   
   if (!error.empty()) {
     error_out->length = error.size();
@@ -125,6 +138,20 @@ const llb_database_t* llb_database_open(
   return (llb_database_t *)database;
 }
 
+const llb_database_t* llb_database_open(
+                                        char *path,
+                                        uint32_t clientSchemaVersion,
+                                        llb_data_t *error_out) {
+  return openDatabase(path, clientSchemaVersion, SQLiteBuildDBMode::Exclusive, error_out);
+}
+
+const llb_database_t* llb_database_open_read_only(
+                                        char *path,
+                                        uint32_t clientSchemaVersion,
+                                        llb_data_t *error_out) {
+  return openDatabase(path, clientSchemaVersion, SQLiteBuildDBMode::ReadOnly, error_out);
+}
+
 void llb_database_destroy(llb_database_t *database) {
   auto db = (CAPIBuildDB *)database;
   db->buildComplete();
@@ -167,3 +194,63 @@ const bool llb_database_get_keys(llb_database_t *database, llb_database_result_k
   return success;
 }
 
+
+const bool llb_database_visit_keys(llb_database_t *database, const llb_data_t *prefix, bool includeResults, void *context, llb_database_key_visitor_fn visitor, llb_data_t *error_out) {
+  auto db = (CAPIBuildDB *)database;
+  
+  StringRef prefixRef;
+  if (prefix) {
+    prefixRef = StringRef((const char*)prefix->data, prefix->length);
+  }
+  
+  std::string error;
+  auto success = db->visitKeys(prefixRef, includeResults, [&](const BuildDBKeyEntry& entry) {
+    llb_database_key_entry_t cEntry;
+    cEntry.key = llb_data_t{ entry.key.size(), (const uint8_t*)entry.key.data() };
+    cEntry.hasResult = entry.hasResult;
+    cEntry.value = llb_data_t{ entry.value.size(), (const uint8_t*)entry.value.data() };
+    cEntry.signature = entry.signature.value.low;
+    cEntry.signatureHigh = entry.signature.value.high;
+    cEntry.builtAt = entry.builtAt;
+    cEntry.computedAt = entry.computedAt;
+    return visitor(context, &cEntry);
+  }, &error);
+  
+  if (!error.empty() && error_out) {
+    error_out->length = error.size();
+    error_out->data = (const uint8_t*)strdup(error.c_str());
+  }
+  
+  return success;
+}
+
+const bool llb_database_visit_command_telemetry(llb_database_t *database, const llb_data_t *key, void *context, llb_database_command_telemetry_visitor_fn visitor, llb_data_t *error_out) {
+  auto db = (CAPIBuildDB *)database;
+  
+  StringRef keyRef;
+  if (key) {
+    keyRef = StringRef((const char*)key->data, key->length);
+  }
+  
+  std::string error;
+  auto success = db->visitCommandTelemetry(keyRef, [&](StringRef entryKey, const CommandTelemetry& telemetry) {
+    llb_database_command_telemetry_t cEntry;
+    cEntry.key = llb_data_t{ entryKey.size(), (const uint8_t*)entryKey.data() };
+    cEntry.iteration = telemetry.iteration;
+    cEntry.wallTime = telemetry.wallTime;
+    cEntry.utime = telemetry.utime;
+    cEntry.stime = telemetry.stime;
+    cEntry.maxrss = telemetry.maxrss;
+    cEntry.outputSize = telemetry.outputSize;
+    cEntry.status = telemetry.status;
+    cEntry.exitCode = telemetry.exitCode;
+    return visitor(context, &cEntry);
+  }, &error);
+  
+  if (!error.empty() && error_out) {
+    error_out->length = error.size();
+    error_out->data = (const uint8_t*)strdup(error.c_str());
+  }
+  
+  return success;
+}
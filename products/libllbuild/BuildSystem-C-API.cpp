@@ -110,6 +110,15 @@ public:
     return result;
   }
 
+  virtual std::vector<basic::FileInfo>
+  getFileInfos(ArrayRef<std::string> paths) override {
+    if (!cAPIDelegate.fs_get_file_info) {
+      return localFileSystem->getFileInfos(paths);
+    }
+
+    return basic::FileSystem::getFileInfos(paths);
+  }
+
   virtual basic::FileInfo getLinkInfo(const std::string& path) override {
     if (!cAPIDelegate.fs_get_link_info && !cAPIDelegate.fs_get_file_info) {
       return localFileSystem->getLinkInfo(path);
@@ -133,6 +142,15 @@ public:
     result.modTime.nanoseconds = file_info.mod_time.nanoseconds;
     return result;
   }
+
+  virtual bool getFileDigest(const std::string& path,
+                             basic::HashValue128& digest_out) override {
+    if (!cAPIDelegate.fs_get_file_contents) {
+      return localFileSystem->getFileDigest(path, digest_out);
+    }
+
+    return basic::FileSystem::getFileDigest(path, digest_out);
+  }
 };
   
 class CAPIBuildSystemFrontendDelegate : public BuildSystemFrontendDelegate {
@@ -248,6 +266,15 @@ public:
     }
   }
 
+  virtual void commandActionCacheLookup(Command* command, bool hit) override {
+    if (cAPIDelegate.command_action_cache_lookup) {
+      cAPIDelegate.command_action_cache_lookup(
+          cAPIDelegate.context,
+          (llb_buildsystem_command_t*) command,
+          hit);
+    }
+  }
+
   virtual void commandHadError(Command* command, StringRef message) override {
     if (cAPIDelegate.command_had_error) {
       llb_data_t cMessage { message.size(), (const uint8_t*) message.data() };
@@ -575,6 +602,24 @@ public:
     invocation.useSerialBuild = cAPIInvocation.useSerialBuild;
     invocation.showVerboseStatus = cAPIInvocation.showVerboseStatus;
     invocation.schedulerLanes = cAPIInvocation.schedulerLanes;
+    invocation.dbUseWAL = cAPIInvocation.dbUseWAL;
+    invocation.actionCachePath = (
+        cAPIInvocation.actionCachePath ? cAPIInvocation.actionCachePath : "");
+    invocation.actionCacheRootPath = (
+        cAPIInvocation.actionCacheRootPath ?
+        cAPIInvocation.actionCacheRootPath : "");
+    invocation.actionCacheUseHardLinks = cAPIInvocation.actionCacheUseHardLinks;
+    invocation.useWorkStealing = cAPIInvocation.useWorkStealing;
+    invocation.useProcessReactor = cAPIInvocation.useProcessReactor;
+    invocation.useSpawnServer = cAPIInvocation.useSpawnServer;
+    invocation.useJobServer = cAPIInvocation.useJobServer;
+    invocation.memoryBudget = cAPIInvocation.memoryBudget;
+    invocation.cpuBudget = cAPIInvocation.cpuBudget;
+    invocation.minLanes = cAPIInvocation.minLanes;
+    invocation.maxLoad = cAPIInvocation.maxLoad;
+    invocation.pinLanes = cAPIInvocation.pinLanes;
+    invocation.useStatCache = cAPIInvocation.useStatCache;
+    invocation.useFileWatcher = cAPIInvocation.useFileWatcher;
 
     // Register a custom diagnostic handler with the source manager.
     sourceMgr.setDiagHandler([](const llvm::SMDiagnostic& diagnostic,
@@ -236,6 +236,93 @@ struct llb_buildsystem_invocation_t_ {
   llb_scheduler_algorithm_t schedulerAlgorithm;
 
   uint32_t schedulerLanes;
+
+  /// Whether the database should use write-ahead logging, allowing it to be
+  /// read (e.g., via \see llb_database_open_read_only) while building.
+  bool dbUseWAL;
+
+  /// The path of the action cache directory to use, if any.
+  ///
+  /// When set, the outputs of cacheable commands are stored in (and restored
+  /// from) a content-addressed cache keyed by the command signature and input
+  /// contents, which can be shared across checkouts.
+  const char* actionCachePath;
+
+  /// The root directory of the tree being built, which the action cache keys
+  /// paths relative to (so that checkouts at other paths share entries), or
+  /// null for the current working directory.
+  const char* actionCacheRootPath;
+
+  /// Whether outputs restored from the action cache should be hard linked to
+  /// the cached objects (when possible), rather than copied.
+  bool actionCacheUseHardLinks;
+
+  /// Whether each lane should keep its own queue of ready jobs, stealing from
+  /// the other lanes when it runs out, rather than sharing a single queue.
+  ///
+  /// This reduces scheduling overhead for builds with many short commands,
+  /// but the scheduler algorithm then only orders jobs within each queue.
+  bool useWorkStealing;
+
+  /// The memory budget for concurrently running commands, in bytes, or 0 for
+  /// no limit.
+  ///
+  /// Commands are only started while the sum of their expected peak memory
+  /// use (declared via the `memory` attribute, or estimated from previous
+  /// builds) fits within the budget and the memory available on the system.
+  uint64_t memoryBudget;
+
+  /// The number of CPUs which concurrently running commands (as declared via
+  /// the `cpus` attribute, 1 by default) may use, or 0 for no limit.
+  uint32_t cpuBudget;
+
+  /// Whether subprocesses should be supervised by a single shared thread
+  /// (where supported), rather than each blocking the thread of its lane.
+  ///
+  /// Lanes remain in use until their processes complete, but no longer each
+  /// need a thread, which makes large lane counts practical. Currently only
+  /// supported on Linux.
+  bool useProcessReactor;
+
+  /// Whether subprocesses should be launched by a small helper process, forked
+  /// when the build system is created, rather than by the client itself.
+  ///
+  /// This keeps the cost of launching processes independent of the size of
+  /// the client. Currently only supported on Linux.
+  bool useSpawnServer;
+
+  /// Whether the number of concurrently running commands should be limited by
+  /// the GNU make jobserver advertised in the MAKEFLAGS environment variable.
+  ///
+  /// If there is none, a new jobserver is created and advertised to the
+  /// build's subprocesses, so that recursive invocations of make share the
+  /// build's lanes. Not supported on Windows.
+  bool useJobServer;
+
+  /// The minimum number of concurrently running commands, or 0 to always use
+  /// all of the lanes.
+  ///
+  /// When set, the number of lanes in use floats between this minimum and the
+  /// lane count, following the load on the system: it grows while the CPUs
+  /// are idle or threads are blocked on I/O, and shrinks under contention.
+  uint32_t minLanes;
+
+  /// The load average above which fewer commands are run concurrently, or 0
+  /// for no limit. Implies a minimum of one lane, if none is set.
+  double maxLoad;
+
+  /// Whether the subprocesses of each lane should be pinned to one of the CPUs
+  /// the client may run on, in turn. Currently only supported on Linux.
+  bool pinLanes;
+
+  /// Whether the file information read during each build should be memoized,
+  /// rather than read from the file system each time it is needed.
+  bool useStatCache;
+
+  /// Whether the memoized file information should be kept between builds,
+  /// watching the file system for changes to it (implies useStatCache).
+  /// Currently only supported on Linux.
+  bool useFileWatcher;
 };
   
 /// Delegate structure for callbacks required by the build system.
@@ -487,6 +574,16 @@ typedef struct llb_buildsystem_delegate_t_ {
                                   uint64_t rule_count,
                                   llb_build_key_t candidate_rule,
                                   llb_cycle_action_t action);
+
+  /// Called to report the result of looking up a command in the action cache.
+  ///
+  /// On a hit, the command's outputs were restored from the cache, and the
+  /// command will not be started.
+  ///
+  /// Xparam hit Whether the outputs were restored from the cache.
+  void (*command_action_cache_lookup)(void* context,
+                                      llb_buildsystem_command_t* command,
+                                      bool hit);
   
   /// @}
 } llb_buildsystem_delegate_t;
@@ -710,6 +807,12 @@ LLBUILD_EXPORT llb_quality_of_service_t
 llb_get_quality_of_service();
 
 /// Set the global quality of service level to use for processing.
+///
+/// This applies to the lanes and to the processes they launch, unless a
+/// command requests its own level (via its `qos` attribute). On Linux, the
+/// utility and background levels lower the nice value, scheduling policy and
+/// I/O priority used; since these can't be raised again without privileges,
+/// this should be set before the build starts.
 LLBUILD_EXPORT void
 llb_set_quality_of_service(llb_quality_of_service_t level);
 
@@ -272,6 +272,10 @@ LLBUILD_EXPORT llb_task_t*
 llb_task_create(llb_task_delegate_t delegate);
 
 /// Enable tracing points.
+///
+/// On Linux, the events are written (as Chrome trace event JSON) at the end of
+/// each build, to the path in the LLBUILD_TRACE_EVENTS environment variable, or
+/// else to "llbuild-trace-<pid>.json" in the temporary directory.
 LLBUILD_EXPORT void
 llb_enable_tracing();
 
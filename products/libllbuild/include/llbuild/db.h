@@ -31,6 +31,9 @@ typedef struct llb_database_t_ llb_database_t;
 /// Open the database that's saved at the given path by creating a llb_database_t instance. If the creation fails due to an error, nullptr will be returned.
 LLBUILD_EXPORT const llb_database_t *_Nullable llb_database_open(char *path, uint32_t clientSchemaVersion, llb_data_t *error_out);
 
+/// Open the database that's saved at the given path for read-only access. Unlike \see llb_database_open, this does not lock the database, so it can be used to inspect results while a build using write-ahead logging is running. If the creation fails due to an error, nullptr will be returned.
+LLBUILD_EXPORT const llb_database_t *_Nullable llb_database_open_read_only(char *path, uint32_t clientSchemaVersion, llb_data_t *error_out);
+
 /// Destroy a build system instance
 LLBUILD_EXPORT void
 llb_database_destroy(llb_database_t *database);
@@ -54,4 +57,72 @@ llb_database_destroy_result_keys(llb_database_result_keys_t *result);
 LLBUILD_EXPORT const bool
 llb_database_get_keys(llb_database_t *database, llb_database_result_keys_t *_Nullable *_Nonnull keysResult_out, llb_data_t *_Nullable error_out);
 
+/// A key (and optionally its stored result) visited by \see llb_database_visit_keys. The data is only valid for the duration of the visitor callback.
+typedef struct llb_database_key_entry_t_ {
+  /// The key.
+  llb_data_t key;
+
+  /// Whether the database has a stored result for the key (only set when results were requested).
+  bool hasResult;
+
+  /// The stored result value.
+  llb_data_t value;
+
+  /// The low 64 bits of the signature of the stored result.
+  uint64_t signature;
+
+  /// The iteration the result was last built at.
+  uint64_t builtAt;
+
+  /// The iteration the result was last computed at.
+  uint64_t computedAt;
+
+  /// The high 64 bits of the signature of the stored result.
+  uint64_t signatureHigh;
+} llb_database_key_entry_t;
+
+/// Visitor for \see llb_database_visit_keys. Return false to stop the enumeration.
+typedef bool (*llb_database_key_visitor_fn)(void *_Nullable context, const llb_database_key_entry_t *entry);
+
+/// Visit the keys in the database (and optionally, their results) without materializing them. If a prefix is given, only keys starting with it are visited; for build system keys, the first byte is the key kind code (e.g., "C" for commands, "N" for nodes). The visitor must not call back into the database.
+LLBUILD_EXPORT const bool
+llb_database_visit_keys(llb_database_t *database, const llb_data_t *_Nullable prefix, bool includeResults, void *_Nullable context, llb_database_key_visitor_fn visitor, llb_data_t *_Nullable error_out);
+
+/// The execution telemetry of a command, visited by \see llb_database_visit_command_telemetry. The data is only valid for the duration of the visitor callback.
+typedef struct llb_database_command_telemetry_t_ {
+  /// The key of the command.
+  llb_data_t key;
+
+  /// The iteration of the build in which the command ran.
+  uint64_t iteration;
+
+  /// The wall clock time the command took, in microseconds.
+  uint64_t wallTime;
+
+  /// The user CPU time used by the command, in microseconds.
+  uint64_t utime;
+
+  /// The system CPU time used by the command, in microseconds.
+  uint64_t stime;
+
+  /// The peak resident set size of the command, as reported by the platform.
+  uint64_t maxrss;
+
+  /// The number of bytes of output produced by the command.
+  uint64_t outputSize;
+
+  /// The status of the command (see \see llb_buildsystem_command_result_t).
+  uint32_t status;
+
+  /// The exit status of the command.
+  int32_t exitCode;
+} llb_database_command_telemetry_t;
+
+/// Visitor for \see llb_database_visit_command_telemetry. Return false to stop the enumeration.
+typedef bool (*llb_database_command_telemetry_visitor_fn)(void *_Nullable context, const llb_database_command_telemetry_t *entry);
+
+/// Visit the recorded command telemetry, ordered by key and then from the most recent build. If a key is given, only the telemetry for that command is visited. The visitor must not call back into the database.
+LLBUILD_EXPORT const bool
+llb_database_visit_command_telemetry(llb_database_t *database, const llb_data_t *_Nullable key, void *_Nullable context, llb_database_command_telemetry_visitor_fn visitor, llb_data_t *_Nullable error_out);
+
 LLBUILD_ASSUME_NONNULL_END
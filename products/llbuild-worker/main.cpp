@@ -0,0 +1,102 @@
+//===-- llbuild-worker.cpp - Remote Execution Worker ----------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/RemoteExecution.h"
+#include "llbuild/Basic/Version.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Signals.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+static void usage(int exitCode) {
+  int optionWidth = 20;
+  fprintf(stderr, "Usage: llbuild-worker [options] --listen <ADDRESS>\n");
+  fprintf(stderr, "\nExecutes build commands on behalf of remote llbuild "
+          "clients.\n");
+  fprintf(stderr, "\nOptions:\n");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--help",
+          "show this help message and exit");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--version",
+          "show the tool version");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--listen <ADDRESS>",
+          "listen on a Unix socket path, or HOST:PORT");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--slots <N>",
+          "run at most N processes at once [default: CPU count]");
+  fprintf(stderr, "  %-*s %s\n", optionWidth, "--no-shared-fs",
+          "return output file contents to the client");
+  ::exit(exitCode);
+}
+
+int main(int argc, const char** argv) {
+  // Print stacks on error.
+  llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
+
+  std::string address;
+  unsigned numSlots = std::thread::hardware_concurrency();
+  bool sharedFileSystem = true;
+  for (int i = 1; i != argc; ++i) {
+    StringRef option(argv[i]);
+    if (option == "--help") {
+      usage(0);
+    } else if (option == "--version") {
+      printf("%s\n", getLLBuildFullVersion("llbuild-worker").c_str());
+      return 0;
+    } else if (option == "--listen") {
+      if (++i == argc) {
+        fprintf(stderr, "error: missing argument to '%s'\n", argv[i - 1]);
+        usage(1);
+      }
+      address = argv[i];
+    } else if (option == "--slots") {
+      if (++i == argc || StringRef(argv[i]).getAsInteger(10, numSlots) ||
+          numSlots == 0) {
+        fprintf(stderr, "error: invalid argument to '--slots'\n");
+        usage(1);
+      }
+    } else if (option == "--no-shared-fs") {
+      sharedFileSystem = false;
+    } else {
+      fprintf(stderr, "error: invalid option '%s'\n", argv[i]);
+      usage(1);
+    }
+  }
+  if (address.empty()) {
+    fprintf(stderr, "error: no address specified\n");
+    usage(1);
+  }
+  if (numSlots == 0)
+    numSlots = 1;
+
+  // Write failures are reported through the connection, not by signal.
+  ::signal(SIGPIPE, SIG_IGN);
+
+  RemoteExecutionWorker worker(numSlots, sharedFileSystem);
+  std::string error, boundAddress;
+  if (!worker.listen(address, &error, &boundAddress)) {
+    fprintf(stderr, "error: %s\n", error.c_str());
+    return 1;
+  }
+  fprintf(stderr, "llbuild-worker: listening on %s with %u slots\n",
+          boundAddress.c_str(), numSlots);
+
+  worker.serve();
+  return 0;
+}
@@ -121,7 +121,8 @@ public final class BuildDB {
     /// Initializes the build database at a given path
     /// If the database at this path doesn't exist, it will created
     /// If the clientSchemaVersion is different to the one in the database at this path, its content will be automatically erased!
-    public init(path: String, clientSchemaVersion: UInt32) throws {
+    /// If readOnly is true, the database is opened without taking a lock, so it can be inspected while a build is running
+    public init(path: String, clientSchemaVersion: UInt32, readOnly: Bool = false) throws {
         // Safety check that we have linked against a compatibile llbuild framework version
         if llb_get_api_version() != LLBUILD_C_API_VERSION {
             throw Error.couldNotOpenDB(error: "llbuild C API version mismatch, found \(llb_get_api_version()), expect \(LLBUILD_C_API_VERSION)")
@@ -137,7 +138,8 @@ public final class BuildDB {
         }
         
         let errorPtr = MutableStringPointer()
-        guard let database = llb_database_open(strdup(path), clientSchemaVersion, &errorPtr.ptr) else {
+        let open = readOnly ? llb_database_open_read_only : llb_database_open
+        guard let database = open(strdup(path), clientSchemaVersion, &errorPtr.ptr) else {
             throw Error.couldNotOpenDB(error: errorPtr.msg ?? "Unknown error.")
         }
         
@@ -16,5 +16,9 @@ class Database(object):
     _databases = {}
     
     def __init__(self, db_path):
-        self.engine = sqlalchemy.create_engine("sqlite:///" + db_path)
+        # Open the database read-only, so we never take a write lock. This
+        # allows inspecting a database (built with `--db-wal`) while a build
+        # is still running.
+        self.engine = sqlalchemy.create_engine(
+            "sqlite:///file:%s?mode=ro&uri=true" % (db_path,))
         self.session_factory = sqlalchemy.orm.sessionmaker(bind=self.engine)
@@ -78,8 +78,9 @@ class BuildValue(object):
 
         # The next item is the signature, if used.
         if self.hasCommandSignature:
-            self.signature = struct.unpack("<Q", bytes[:8])[0]
-            bytes = bytes[8:]
+            low, high = struct.unpack("<QQ", bytes[:16])
+            self.signature = low | (high << 64)
+            bytes = bytes[16:]
         else:
             self.signature = None
             
@@ -11,6 +11,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "llbuild/Basic/BinaryCoding.h"
+#include "llbuild/Basic/FileInfo.h"
 
 #include "gtest/gtest.h"
 
@@ -110,4 +111,128 @@ TEST(BinaryCodingTests, customType) {
   checkRoundtrip(CustomType{ 0xABCD, 0x1234 });
 }
 
+TEST(BinaryCodingTests, littleEndian) {
+  // Integers are encoded little-endian, on any host.
+  EXPECT_EQ(encode(uint16_t(0x0102)), std::vector<uint8_t>({ 2, 1 }));
+  EXPECT_EQ(encode(uint32_t(0x01020304)),
+            std::vector<uint8_t>({ 4, 3, 2, 1 }));
+  EXPECT_EQ(encode(uint64_t(0x0102030405060708ULL)),
+            std::vector<uint8_t>({ 8, 7, 6, 5, 4, 3, 2, 1 }));
+}
+
+TEST(BinaryCodingTests, strings) {
+  BinaryEncoder encoder;
+  encoder.write(std::string("hello"));
+  encoder.writeString("world");
+  auto result = encoder.contents();
+
+  // Strings may be decoded either way, whichever way they were encoded.
+  BinaryDecoder decoder(result);
+  StringRef s1;
+  std::string s2;
+  decoder.readString(s1);
+  decoder.read(s2);
+  decoder.finish();
+  EXPECT_EQ(s1, StringRef("hello"));
+  EXPECT_EQ(s2, "world");
+
+  // The decoded references point into the encoded data.
+  EXPECT_EQ(s1.data(), (const char*)result.data() + 4);
+}
+
+TEST(BinaryCodingTests, varInts) {
+  std::vector<uint64_t> values = {
+    0, 1, 0x7F, 0x80, 0x3FFF, 0x4000, 0xFFFFFFFFULL, ~0ULL };
+  BinaryEncoder encoder;
+  for (auto value: values)
+    encoder.writeVarInt(value);
+  auto result = encoder.contents();
+
+  // Each byte holds seven bits.
+  EXPECT_EQ(1 + 1 + 1 + 2 + 2 + 3 + 5 + 10, int(result.size()));
+  EXPECT_EQ(0x80, result[3]);
+  EXPECT_EQ(0x01, result[4]);
+
+  BinaryDecoder decoder(result);
+  for (auto value: values) {
+    uint64_t decoded;
+    decoder.readVarInt(decoded);
+    EXPECT_EQ(value, decoded);
+  }
+  decoder.finish();
+}
+
+TEST(BinaryCodingTests, arrays) {
+  // Bitwise arrays are encoded as their elements would be.
+  std::vector<uint32_t> integers = { 1, 2, 0xABCD0123 };
+  BinaryEncoder bulkEncoder, elementEncoder;
+  bulkEncoder.writeArray(ArrayRef<uint32_t>(integers));
+  for (auto value: integers)
+    elementEncoder.write(value);
+  EXPECT_EQ(bulkEncoder.contents(), elementEncoder.contents());
+
+  auto data = bulkEncoder.contents();
+  BinaryDecoder decoder(data);
+  std::vector<uint32_t> decoded(integers.size());
+  decoder.readArray(MutableArrayRef<uint32_t>(decoded));
+  decoder.finish();
+  EXPECT_EQ(integers, decoded);
+
+  std::vector<FileInfo> infos(2);
+  infos[0] = FileInfo{ 1, 2, 3, 4, { 5, 6 } };
+  infos[1] = FileInfo{ 7, 8, 9, 10, { 11, 12 } };
+  BinaryEncoder bulkInfoEncoder, elementInfoEncoder;
+  bulkInfoEncoder.writeArray(ArrayRef<FileInfo>(infos));
+  for (const auto& info: infos)
+    elementInfoEncoder.write(info);
+  EXPECT_EQ(bulkInfoEncoder.contents(), elementInfoEncoder.contents());
+
+  // As are other arrays.
+  std::vector<CustomType> customs = { { 1, 2 }, { 3, 4 } };
+  BinaryEncoder customEncoder;
+  customEncoder.writeArray(ArrayRef<CustomType>(customs));
+  auto customData = customEncoder.contents();
+  EXPECT_EQ(16u, customData.size());
+  BinaryDecoder customDecoder(customData);
+  std::vector<CustomType> decodedCustoms(customs.size());
+  customDecoder.readArray(MutableArrayRef<CustomType>(decodedCustoms));
+  customDecoder.finish();
+  EXPECT_EQ(customs, decodedCustoms);
+}
+
+TEST(BinaryCodingTests, overrun) {
+  // A string whose length runs past the end of the data.
+  BinaryEncoder encoder;
+  encoder.write(uint32_t(0xFFFFFFFF));
+  encoder.write(uint8_t('x'));
+  auto result = encoder.contents();
+
+  BinaryDecoder decoder(result);
+  std::string s;
+  decoder.read(s);
+  EXPECT_TRUE(decoder.hasOverrun());
+  EXPECT_EQ("", s);
+  EXPECT_TRUE(decoder.isEmpty());
+
+  // All further reads produce zero values.
+  uint8_t byte = 1;
+  uint64_t integer = 1, varInt = 1;
+  std::vector<uint32_t> integers(2, 1);
+  decoder.read(byte);
+  decoder.read(integer);
+  decoder.readVarInt(varInt);
+  decoder.readArray(MutableArrayRef<uint32_t>(integers));
+  EXPECT_EQ(0, byte);
+  EXPECT_EQ(0u, integer);
+  EXPECT_EQ(0u, varInt);
+  EXPECT_EQ(std::vector<uint32_t>({ 0, 0 }), integers);
+
+  // A truncated integer.
+  BinaryDecoder truncatedDecoder(StringRef("abc"));
+  uint32_t value = 1;
+  truncatedDecoder.read(value);
+  EXPECT_TRUE(truncatedDecoder.hasOverrun());
+  EXPECT_EQ(0u, value);
+}
+
 }
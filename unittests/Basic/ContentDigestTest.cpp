@@ -0,0 +1,213 @@
+//===- unittests/Basic/ContentDigestTest.cpp ------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/ContentDigest.h"
+#include "llbuild/Basic/FileSystem.h"
+#include "../BuildSystem/TempDir.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+#if !defined(_WIN32)
+
+namespace {
+
+/// Write the given contents to a file, and set its modification time to the
+/// given number of seconds in the past.
+void writeFile(StringRef path, StringRef contents, int age = 60) {
+  std::error_code ec;
+  {
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_None);
+    ASSERT_FALSE(ec);
+    os << contents;
+  }
+
+  int fd;
+  ASSERT_FALSE(llvm::sys::fs::openFileForWrite(
+                   path, fd, llvm::sys::fs::CD_OpenExisting,
+                   llvm::sys::fs::F_Append));
+  auto time = std::chrono::time_point_cast<llvm::sys::TimePoint<>::duration>(
+      std::chrono::system_clock::now() - std::chrono::seconds(age));
+  EXPECT_FALSE(llvm::sys::fs::setLastModificationAndAccessTime(fd, time));
+  ::close(fd);
+}
+
+TEST(ContentDigestTest, getFileDigest) {
+  TmpDir tempDir{"ContentDigestTest"};
+  std::string small = tempDir.str() + "/small";
+  std::string large = tempDir.str() + "/large";
+  std::string largeContents(100000, 'x');
+  largeContents += "end";
+  writeFile(small, "contents");
+  writeFile(large, largeContents);
+
+  // Both small (read at once) and large (read in chunks) files are digested.
+  auto fs = createLocalFileSystem();
+  HashValue128 digest;
+  ASSERT_TRUE(fs->getFileDigest(small, digest));
+  EXPECT_EQ(hashBytes128("contents"), digest);
+  ASSERT_TRUE(fs->getFileDigest(large, digest));
+  EXPECT_EQ(hashBytes128(largeContents), digest);
+
+  // Missing files and directories cannot be.
+  EXPECT_FALSE(fs->getFileDigest(tempDir.str() + "/missing", digest));
+  EXPECT_FALSE(fs->getFileDigest(tempDir.str(), digest));
+}
+
+TEST(ContentDigestTest, getFileDigestWhileTruncated) {
+  TmpDir tempDir{"ContentDigestTest"};
+  std::string path = tempDir.str() + "/large";
+  std::string contents(4 * 1024 * 1024, 'x');
+  writeFile(path, contents);
+
+  // A file truncated while it is digested is either digested, or reported as
+  // unreadable (and never crashes the process).
+  std::atomic<bool> isDone{false};
+  std::thread truncator([&]() {
+    while (!isDone) {
+      (void) ::truncate(path.c_str(), 0);
+      (void) ::truncate(path.c_str(), contents.size());
+    }
+  });
+  auto fs = createLocalFileSystem();
+  for (unsigned i = 0; i != 50; ++i) {
+    HashValue128 digest;
+    (void) fs->getFileDigest(path, digest);
+  }
+  isDone = true;
+  truncator.join();
+}
+
+TEST(ContentDigestTest, cache) {
+  TmpDir tempDir{"ContentDigestTest"};
+  std::string file = tempDir.str() + "/file";
+  std::string recent = tempDir.str() + "/recent";
+  auto fs = createLocalFileSystem();
+  writeFile(file, "a");
+  writeFile(recent, "a", /*age=*/0);
+
+  ContentDigestCache cache;
+  HashValue128 digest;
+  ASSERT_TRUE(cache.getDigest(*fs, file, fs->getFileInfo(file), digest));
+  EXPECT_EQ(hashBytes128("a"), digest);
+  ASSERT_TRUE(cache.getDigest(*fs, file, fs->getFileInfo(file), digest));
+  EXPECT_EQ(1u, cache.getNumHits());
+  EXPECT_EQ(1u, cache.getNumMisses());
+
+  // Recently modified files are read each time.
+  ASSERT_TRUE(cache.getDigest(*fs, recent, fs->getFileInfo(recent), digest));
+  ASSERT_TRUE(cache.getDigest(*fs, recent, fs->getFileInfo(recent), digest));
+  EXPECT_EQ(1u, cache.getNumHits());
+  EXPECT_EQ(3u, cache.getNumMisses());
+  EXPECT_EQ(1u, cache.size());
+
+  // A modified file is read again.
+  writeFile(file, "b", /*age=*/30);
+  ASSERT_TRUE(cache.getDigest(*fs, file, fs->getFileInfo(file), digest));
+  EXPECT_EQ(hashBytes128("b"), digest);
+  EXPECT_EQ(4u, cache.getNumMisses());
+
+  // The information for a file stands in for its contents.
+  auto info = cache.getContentInfo(*fs, file, fs->getFileInfo(file));
+  EXPECT_EQ(0u, info.device);
+  EXPECT_EQ(0u, info.inode);
+  EXPECT_EQ(1u, info.size);
+  EXPECT_EQ(digest.low, info.modTime.seconds);
+  EXPECT_EQ(digest.high, info.modTime.nanoseconds);
+  writeFile(file, "b", /*age=*/10);
+  EXPECT_EQ(info, cache.getContentInfo(*fs, file, fs->getFileInfo(file)));
+  writeFile(file, "c", /*age=*/10);
+  EXPECT_NE(info, cache.getContentInfo(*fs, file, fs->getFileInfo(file)));
+
+  // Missing files, and directories, are left as they are.
+  std::string missing = tempDir.str() + "/missing";
+  EXPECT_TRUE(cache.getContentInfo(*fs, missing,
+                                   fs->getFileInfo(missing)).isMissing());
+  auto dirInfo = fs->getFileInfo(tempDir.str());
+  auto dirContentInfo = cache.getContentInfo(*fs, tempDir.str(), dirInfo);
+  EXPECT_EQ(dirInfo.modTime, dirContentInfo.modTime);
+}
+
+TEST(ContentDigestTest, saveAndLoad) {
+  TmpDir tempDir{"ContentDigestTest"};
+  std::string file = tempDir.str() + "/file";
+  std::string saved = tempDir.str() + "/digests";
+  auto fs = createLocalFileSystem();
+  writeFile(file, "a");
+
+  // There is no saved cache to begin with.
+  std::string error;
+  ContentDigestCache cache;
+  ASSERT_TRUE(cache.load(saved, &error)) << error;
+  HashValue128 digest;
+  ASSERT_TRUE(cache.getDigest(*fs, file, fs->getFileInfo(file), digest));
+  ASSERT_TRUE(cache.save(saved, &error)) << error;
+
+  // The file is not read again in the next build.
+  ContentDigestCache loaded;
+  ASSERT_TRUE(loaded.load(saved, &error)) << error;
+  EXPECT_EQ(1u, loaded.size());
+  HashValue128 loadedDigest;
+  ASSERT_TRUE(loaded.getDigest(*fs, file, fs->getFileInfo(file),
+                               loadedDigest));
+  EXPECT_EQ(digest, loadedDigest);
+  EXPECT_EQ(1u, loaded.getNumHits());
+  EXPECT_EQ(0u, loaded.getNumMisses());
+
+  // Damaged caches are rejected.
+  writeFile(saved, "llbuild-content-digests-v1 garbage garbage");
+  EXPECT_FALSE(loaded.load(saved, &error));
+  EXPECT_NE(std::string::npos, error.find("malformed")) << error;
+  EXPECT_EQ(1u, loaded.size());
+}
+
+TEST(ContentDigestTest, fileSystem) {
+  TmpDir tempDir{"ContentDigestTest"};
+  std::string file = tempDir.str() + "/file";
+  writeFile(file, "a");
+
+  ContentDigestFileSystem fs(createLocalFileSystem());
+  auto info = fs.getFileInfo(file);
+  EXPECT_FALSE(info.isMissing());
+
+  // Touching the file does not change its information.
+  writeFile(file, "a", /*age=*/10);
+  EXPECT_EQ(info, fs.getFileInfo(file));
+  auto infos = fs.getFileInfos({ file, tempDir.str() + "/missing" });
+  ASSERT_EQ(2u, infos.size());
+  EXPECT_EQ(info, infos[0]);
+  EXPECT_TRUE(infos[1].isMissing());
+
+  writeFile(file, "b", /*age=*/10);
+  EXPECT_NE(info, fs.getFileInfo(file));
+  EXPECT_EQ(1u, fs.getDigestCache().size());
+}
+
+}
+
+#endif
@@ -24,6 +24,8 @@
 
 #include "gtest/gtest.h"
 
+#include <cerrno>
+
 using namespace llbuild;
 using namespace llbuild::basic;
 
@@ -154,6 +156,112 @@ TEST(FileSystemTest, testRecursiveRemovalDoesNotFollowSymlinks) {
   EXPECT_EQ(0, sys::stat(otherFile.c_str(), &statbuf));
 }
 
+/// Write the given contents to a file.
+void writeFile(StringRef path, StringRef contents) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_Text);
+  EXPECT_FALSE(ec);
+  os << contents;
+}
+
+#if !defined(_WIN32)
+TEST(FileSystemTest, removePaths) {
+  TmpDir tempDir{"FileSystemTest"};
+  std::string dir = tempDir.str() + "/dir";
+  std::string emptyDir = tempDir.str() + "/empty";
+  std::string fullDir = tempDir.str() + "/full";
+  ASSERT_FALSE(llvm::sys::fs::create_directories(dir));
+  ASSERT_FALSE(llvm::sys::fs::create_directories(emptyDir));
+  ASSERT_FALSE(llvm::sys::fs::create_directories(fullDir + "/nested"));
+  writeFile(fullDir + "/nested/file", "a");
+
+  // Enough files to be removed in parallel, along with directories (removed
+  // recursively), missing paths, and paths not relative to a directory.
+  std::vector<std::string> paths;
+  for (unsigned i = 0; i != 1000; ++i) {
+    paths.push_back(dir + "/file-" + std::to_string(i));
+    writeFile(paths.back(), "a");
+  }
+  paths.push_back(emptyDir);
+  paths.push_back(fullDir + "/");
+  paths.push_back(tempDir.str() + "/missing");
+  paths.push_back(dir + "/missing/file");
+
+  auto fs = createLocalFileSystem();
+  auto errors = fs->removePaths(paths);
+  ASSERT_EQ(paths.size(), errors.size());
+  for (unsigned i = 0; i != 1002; ++i) {
+    EXPECT_EQ(0, errors[i]) << paths[i];
+    EXPECT_FALSE(llvm::sys::fs::exists(paths[i])) << paths[i];
+  }
+  EXPECT_FALSE(llvm::sys::fs::exists(fullDir));
+  EXPECT_EQ(ENOENT, errors[1002]);
+  EXPECT_EQ(ENOENT, errors[1003]);
+
+  // The batch is removed through a stat cache.
+  StatCachingFileSystem cachingFS(createLocalFileSystem());
+  EXPECT_TRUE(cachingFS.getFileInfo(dir).isDirectory());
+  EXPECT_EQ(std::vector<int>{ 0 }, cachingFS.removePaths({ dir }));
+  EXPECT_TRUE(cachingFS.getFileInfo(dir).isMissing());
+}
+#endif
+
+TEST(FileSystemTest, getFileInfos) {
+  TmpDir tempDir{"FileSystemTest"};
+  std::string dir = tempDir.str() + "/dir";
+  auto fs = createLocalFileSystem();
+  ASSERT_TRUE(fs->createDirectory(dir));
+
+  // Include enough paths to be examined in parallel, along with paths which
+  // cannot be examined relative to their parent.
+  std::vector<std::string> paths;
+  for (int i = 0; i != 1000; ++i) {
+    std::string path = dir + "/file" + std::to_string(i);
+    if (i % 100 == 0)
+      writeFile(path, std::string(i, 'x'));
+    paths.push_back(path);
+  }
+  paths.push_back(dir + "/");
+  paths.push_back(dir + "/..");
+  paths.push_back(dir + "//file100");
+  paths.push_back(tempDir.str() + "/missing/file");
+  paths.push_back(tempDir.str() + "/missing/file2");
+  paths.push_back("relative-missing-file");
+  ASSERT_EQ(0, sys::symlink("file0", (dir + "/link").c_str()));
+  paths.push_back(dir + "/link");
+
+  auto infos = fs->getFileInfos(paths);
+  ASSERT_EQ(paths.size(), infos.size());
+  for (size_t i = 0, e = paths.size(); i != e; ++i) {
+    EXPECT_EQ(fs->getFileInfo(paths[i]), infos[i]) << paths[i];
+  }
+  EXPECT_EQ(100u, infos[100].size);
+  EXPECT_TRUE(infos[4].isMissing());
+  EXPECT_TRUE(infos[1000].isDirectory());
+  EXPECT_FALSE(infos.back().isMissing());
+  EXPECT_TRUE(fs->getFileInfos({}).empty());
+
+  // The cache answers batches from the cache, where possible.
+  StatCachingFileSystem cachingFS(createLocalFileSystem());
+  EXPECT_EQ(infos[100], cachingFS.getFileInfo(paths[100]));
+  auto cachedInfos = cachingFS.getFileInfos(paths);
+  EXPECT_EQ(infos, cachedInfos);
+  EXPECT_EQ(1u, cachingFS.getNumHits());
+  EXPECT_EQ(paths.size(), cachingFS.getNumMisses());
+  EXPECT_EQ(infos, cachingFS.getFileInfos(paths));
+  EXPECT_EQ(paths.size() + 1, cachingFS.getNumHits());
+
+  // Device agnostic file systems hide the device and inode.
+  auto agnosticInfos = DeviceAgnosticFileSystem::from(
+      createLocalFileSystem())->getFileInfos(paths);
+  EXPECT_EQ(0u, agnosticInfos[100].device);
+  EXPECT_EQ(0u, agnosticInfos[100].inode);
+  EXPECT_EQ(infos[100].size, agnosticInfos[100].size);
+
+  // The temporary directory cannot be removed if it contains a dangling link.
+  sys::unlink((dir + "/link").c_str());
+}
+
 TEST(DeviceAgnosticFileSystemTest, basic) {
   // Check basic sanity of the local filesystem object.
   auto fs = DeviceAgnosticFileSystem::from(createLocalFileSystem());
@@ -188,4 +296,142 @@ TEST(DeviceAgnosticFileSystemTest, basic) {
   EXPECT_FALSE(ec);
 }
 
+
+TEST(StatCachingFileSystemTest, basic) {
+  TmpDir tempDir{"StatCachingFileSystemTest"};
+  std::string file = tempDir.str() + "/file";
+  writeFile(file, "a");
+
+  StatCachingFileSystem fs(createLocalFileSystem());
+
+  // Repeated lookups are answered from the cache.
+  auto info = fs.getFileInfo(file);
+  EXPECT_FALSE(info.isMissing());
+  EXPECT_EQ(1u, info.size);
+  EXPECT_EQ(info, fs.getFileInfo(file));
+  EXPECT_EQ(1u, fs.getNumHits());
+  EXPECT_EQ(1u, fs.getNumMisses());
+
+  // File and link information are cached separately.
+  EXPECT_EQ(info, fs.getLinkInfo(file));
+  EXPECT_EQ(2u, fs.getNumMisses());
+
+  // Modifications made by other means are not seen until invalidated.
+  writeFile(file, "abc");
+  EXPECT_EQ(1u, fs.getFileInfo(file).size);
+  fs.invalidate(file);
+  EXPECT_EQ(1u, fs.getNumInvalidations());
+  EXPECT_EQ(3u, fs.getFileInfo(file).size);
+  EXPECT_EQ(3u, fs.getLinkInfo(file).size);
+
+  // Clearing the cache discards everything.
+  writeFile(file, "abcd");
+  fs.clear();
+  EXPECT_EQ(4u, fs.getFileInfo(file).size);
+}
+
+TEST(StatCachingFileSystemTest, modifications) {
+  TmpDir tempDir{"StatCachingFileSystemTest"};
+  std::string dir = tempDir.str() + "/dir";
+  std::string subdir = dir + "/subdir";
+  std::string file = subdir + "/file";
+  std::string sibling = tempDir.str() + "/dir-sibling";
+  writeFile(sibling, "a");
+
+  StatCachingFileSystem fs(createLocalFileSystem());
+
+  // Created directories are seen, along with the changes to their parents.
+  EXPECT_TRUE(fs.getFileInfo(dir).isMissing());
+  EXPECT_TRUE(fs.getFileInfo(tempDir.str()).isDirectory());
+  EXPECT_TRUE(fs.createDirectories(subdir));
+  EXPECT_TRUE(fs.getFileInfo(dir).isDirectory());
+  EXPECT_TRUE(fs.getFileInfo(subdir).isDirectory());
+  auto numMisses = fs.getNumMisses();
+  EXPECT_TRUE(fs.getFileInfo(tempDir.str()).isDirectory());
+  EXPECT_EQ(numMisses + 1, fs.getNumMisses());
+  EXPECT_EQ(0u, fs.getNumInvalidations());
+
+  // Removal discards everything beneath the path, but not its siblings.
+  writeFile(file, "a");
+  EXPECT_FALSE(fs.getFileInfo(file).isMissing());
+  EXPECT_FALSE(fs.getFileInfo(sibling).isMissing());
+  EXPECT_TRUE(fs.remove(dir));
+  EXPECT_TRUE(fs.getFileInfo(file).isMissing());
+  EXPECT_TRUE(fs.getFileInfo(subdir).isMissing());
+  EXPECT_TRUE(fs.getFileInfo(dir).isMissing());
+  auto numHits = fs.getNumHits();
+  EXPECT_FALSE(fs.getFileInfo(sibling).isMissing());
+  EXPECT_EQ(numHits + 1, fs.getNumHits());
+}
+
+TEST(DirectoryCachingFileSystemTest, knownDirectories) {
+  TmpDir tempDir{"DirectoryCachingFileSystemTest"};
+  std::string dir = tempDir.str() + "/dir";
+  std::string subdir = dir + "/subdir";
+  std::string other = dir + "/other";
+  auto exists = [](StringRef path) { return llvm::sys::fs::exists(path); };
+
+  DirectoryCachingFileSystem fs(createLocalFileSystem());
+
+  // Directories created through the wrapper (and their ancestors) are not
+  // created again, so one removed by other means is not noticed.
+  EXPECT_TRUE(fs.createDirectories(subdir));
+  EXPECT_EQ(0u, fs.getNumHits());
+  EXPECT_FALSE(llvm::sys::fs::remove(subdir));
+  EXPECT_TRUE(fs.createDirectories(subdir));
+  EXPECT_TRUE(fs.createDirectory(dir));
+  EXPECT_EQ(2u, fs.getNumHits());
+  EXPECT_FALSE(exists(subdir));
+
+  // Until it is invalidated.
+  fs.invalidate(subdir);
+  EXPECT_TRUE(fs.createDirectories(subdir));
+  EXPECT_TRUE(exists(subdir));
+  EXPECT_EQ(2u, fs.getNumHits());
+
+  // Directories seen by lookups are also known.
+  EXPECT_FALSE(llvm::sys::fs::create_directory(other));
+  EXPECT_TRUE(fs.getFileInfo(other).isDirectory());
+  EXPECT_TRUE(fs.createDirectories(other));
+  EXPECT_EQ(3u, fs.getNumHits());
+
+  // Removing a directory through the wrapper forgets everything beneath it.
+  EXPECT_TRUE(fs.remove(dir));
+  EXPECT_TRUE(fs.createDirectories(subdir));
+  EXPECT_TRUE(exists(subdir));
+  EXPECT_EQ(3u, fs.getNumHits());
+
+  // The known directories are kept until they are cleared.
+  EXPECT_FALSE(llvm::sys::fs::remove(subdir));
+  fs.clear();
+  EXPECT_TRUE(fs.createDirectories(subdir));
+  EXPECT_TRUE(exists(subdir));
+  EXPECT_EQ(3u, fs.getNumHits());
+}
+
+TEST(StatCachingFileSystemTest, createDirectories) {
+  TmpDir tempDir{"StatCachingFileSystemTest"};
+  std::string dir = tempDir.str() + "/dir";
+  std::string subdir = dir + "/subdir";
+
+  // Creating directories beneath the stat cache updates its information, even
+  // when the directories are already known beneath it.
+  auto directoryCache = llvm::make_unique<DirectoryCachingFileSystem>(
+      createLocalFileSystem());
+  auto& directories = *directoryCache;
+  StatCachingFileSystem fs(std::move(directoryCache));
+  EXPECT_TRUE(fs.getFileInfo(dir).isMissing());
+  EXPECT_TRUE(fs.getFileInfo(subdir).isMissing());
+  EXPECT_TRUE(fs.createDirectories(subdir));
+  EXPECT_TRUE(fs.getFileInfo(dir).isDirectory());
+  EXPECT_TRUE(fs.getFileInfo(subdir).isDirectory());
+
+  // Directories cached as such stay cached.
+  uint64_t numMisses = fs.getNumMisses();
+  EXPECT_TRUE(fs.createDirectories(subdir));
+  EXPECT_EQ(1u, directories.getNumHits());
+  EXPECT_TRUE(fs.getFileInfo(subdir).isDirectory());
+  EXPECT_EQ(numMisses, fs.getNumMisses());
+}
+
 }
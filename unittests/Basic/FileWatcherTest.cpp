@@ -0,0 +1,164 @@
+//===- unittests/Basic/FileWatcherTest.cpp --------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/FileWatcher.h"
+#include "llbuild/Basic/FileSystem.h"
+#include "../BuildSystem/TempDir.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+#if defined(__linux__)
+
+namespace {
+  /// Write the given contents to a file.
+  void writeFile(StringRef path, StringRef contents) {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_Text);
+    EXPECT_FALSE(ec);
+    os << contents;
+  }
+
+  /// Read the changes from the watcher, and check whether the given path is
+  /// among them.
+  bool readChangesIncluding(FileWatcher& watcher, StringRef path) {
+    std::vector<std::string> changedPaths;
+    EXPECT_TRUE(watcher.readChanges(changedPaths));
+    return std::find(changedPaths.begin(), changedPaths.end(), path) !=
+      changedPaths.end();
+  }
+
+  TEST(FileWatcherTest, basic) {
+    TmpDir tempDir{"FileWatcherTest"};
+    std::string dir = tempDir.str() + "/dir";
+    std::string file = dir + "/file";
+    ASSERT_TRUE(llvm::sys::fs::create_directory(dir) ==
+                std::error_code());
+    writeFile(file, "a");
+
+    std::string error;
+    auto watcher = FileWatcher::create(&error);
+    ASSERT_TRUE(watcher) << error;
+    watcher->watchPath(file);
+    std::vector<std::string> changedPaths;
+    EXPECT_TRUE(watcher->readChanges(changedPaths));
+    EXPECT_TRUE(changedPaths.empty());
+
+    // Modifications to the path are reported.
+    writeFile(file, "ab");
+    EXPECT_TRUE(readChangesIncluding(*watcher, file));
+
+    // Paths which do not exist yet are reported once created.
+    std::string missing = dir + "/missing/file";
+    watcher->watchPath(missing);
+    ASSERT_TRUE(llvm::sys::fs::create_directory(dir + "/missing") ==
+                std::error_code());
+    EXPECT_TRUE(readChangesIncluding(*watcher, dir + "/missing"));
+
+    // Renaming an ancestor is reported.
+    ASSERT_EQ(0, rename(dir.c_str(), (dir + "-moved").c_str()));
+    EXPECT_TRUE(readChangesIncluding(*watcher, dir));
+    ASSERT_EQ(0, rename((dir + "-moved").c_str(), dir.c_str()));
+    EXPECT_TRUE(readChangesIncluding(*watcher, dir));
+  }
+
+  TEST(FileWatcherTest, symbolicLinks) {
+    TmpDir tempDir{"FileWatcherTest"};
+    std::string targetDir = tempDir.str() + "/target";
+    std::string target = targetDir + "/file";
+    std::string link = tempDir.str() + "/link";
+    std::string dirLink = tempDir.str() + "/dir-link";
+    ASSERT_TRUE(llvm::sys::fs::create_directory(targetDir) ==
+                std::error_code());
+    writeFile(target, "a");
+    ASSERT_EQ(0, symlink(target.c_str(), link.c_str()));
+    ASSERT_EQ(0, symlink(targetDir.c_str(), dirLink.c_str()));
+
+    std::string error;
+    auto watcher = FileWatcher::create(&error);
+    ASSERT_TRUE(watcher) << error;
+    watcher->watchPath(link);
+    watcher->watchPath(dirLink + "/file");
+
+    // Modifications to the targets of links are reported as the link.
+    writeFile(target, "ab");
+    std::vector<std::string> changedPaths;
+    EXPECT_TRUE(watcher->readChanges(changedPaths));
+    EXPECT_NE(std::find(changedPaths.begin(), changedPaths.end(), link),
+              changedPaths.end());
+    EXPECT_NE(std::find(changedPaths.begin(), changedPaths.end(),
+                        dirLink + "/file"), changedPaths.end());
+
+    // As is renaming the target's directory.
+    ASSERT_EQ(0, rename(targetDir.c_str(), (targetDir + "-moved").c_str()));
+    EXPECT_TRUE(readChangesIncluding(*watcher, link));
+    ASSERT_EQ(0, rename((targetDir + "-moved").c_str(), targetDir.c_str()));
+    ASSERT_EQ(0, unlink(link.c_str()));
+    ASSERT_EQ(0, unlink(dirLink.c_str()));
+  }
+
+  TEST(FileWatcherTest, statCache) {
+    TmpDir tempDir{"FileWatcherTest"};
+    std::string file = tempDir.str() + "/file";
+    writeFile(file, "a");
+
+    StatCachingFileSystem fs(createLocalFileSystem());
+    std::string error;
+    ASSERT_TRUE(fs.enableWatching(&error)) << error;
+
+    // Unchanged paths are answered from the cache across builds.
+    EXPECT_EQ(1u, fs.getFileInfo(file).size);
+    fs.synchronize();
+    EXPECT_EQ(1u, fs.getFileInfo(file).size);
+    EXPECT_EQ(1u, fs.getNumHits());
+    EXPECT_EQ(1u, fs.getNumMisses());
+
+    // Changed paths are read again.
+    writeFile(file, "abc");
+    fs.synchronize();
+    EXPECT_EQ(3u, fs.getFileInfo(file).size);
+    EXPECT_EQ(2u, fs.getNumMisses());
+    EXPECT_EQ(0u, fs.getNumRescans());
+
+    // Everything is read again if changes are lost.
+    unsigned maxQueuedEvents = 16384;
+    if (FILE* limit = fopen("/proc/sys/fs/inotify/max_queued_events", "r")) {
+      EXPECT_EQ(1, fscanf(limit, "%u", &maxQueuedEvents));
+      fclose(limit);
+    }
+    if (maxQueuedEvents > 100000)
+      return;
+    std::string dir = tempDir.str() + "/dir";
+    ASSERT_TRUE(llvm::sys::fs::create_directory(dir) == std::error_code());
+    EXPECT_EQ(0u, fs.getFileInfo(dir + "/file").size);
+    for (unsigned i = 0; i <= maxQueuedEvents; ++i)
+      writeFile(dir + "/file" + std::to_string(i), "");
+    fs.synchronize();
+    EXPECT_EQ(1u, fs.getNumRescans());
+    EXPECT_EQ(3u, fs.getFileInfo(file).size);
+    EXPECT_EQ(4u, fs.getNumMisses());
+  }
+}
+
+#endif
@@ -0,0 +1,158 @@
+//===- unittests/Basic/HashingTest.cpp ------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/Hashing.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include "gtest/gtest.h"
+
+#include <set>
+#include <string>
+#include <utility>
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+namespace {
+
+/// Get a string of the given size, cycling through the alphabet.
+std::string getAlphabetString(size_t size) {
+  std::string result;
+  for (size_t i = 0; i != size; ++i)
+    result.push_back(char('a' + i % 26));
+  return result;
+}
+
+void checkHash(uint64_t low, uint64_t high, HashValue128 value) {
+  EXPECT_EQ(low, value.low);
+  EXPECT_EQ(high, value.high);
+}
+
+TEST(HashingTest, hashBytes128Stable) {
+  // The hash is persisted, so must never change (on any platform, or with any
+  // implementation).
+  checkHash(0xc19b68d6efffcdb8ULL, 0xfec70c3a1860f2fbULL, hashBytes128(""));
+  checkHash(0xaffc37d567d9732cULL, 0xc77f49054b2dff18ULL, hashBytes128("a"));
+  checkHash(0x8a6d1d745706b9a9ULL, 0xefcfe5136d1ed98eULL, hashBytes128("abc"));
+  checkHash(0x95558cfccb2bebd1ULL, 0xe7625f7d5be96aefULL,
+            hashBytes128("abc", /*seed=*/1));
+  checkHash(0x7c98dae4084be0c1ULL, 0x4ac96284da0e0721ULL,
+            hashBytes128(getAlphabetString(64)));
+  checkHash(0xf34d9b3217ad89baULL, 0x96a428ff930ffe45ULL,
+            hashBytes128(getAlphabetString(3000)));
+}
+
+TEST(HashingTest, hashBytes128Distinct) {
+  std::set<std::pair<uint64_t, uint64_t>> hashes;
+  auto insert = [&](StringRef data, uint64_t seed = 0) {
+    auto hash = hashBytes128(data, seed);
+    EXPECT_TRUE(hashes.insert({hash.low, hash.high}).second)
+      << "collision for " << data.size() << " bytes";
+  };
+
+  // Trailing zeros are distinguished from the padding of partial stripes.
+  std::string data = getAlphabetString(2100);
+  for (size_t size = 0; size <= data.size(); ++size)
+    insert(StringRef(data).take_front(size));
+  for (size_t size: {1, 63, 64, 65, 1024, 1025})
+    insert(std::string(size, '\0'));
+
+  // Each byte of every stripe (including across blocks) contributes.
+  for (size_t i = 0; i != data.size(); i += 7) {
+    std::string modified = data;
+    modified[i] ^= 1;
+    insert(modified);
+  }
+
+  // Exchanging stripes changes the hash.
+  std::string swapped = data.substr(64, 64) + data.substr(0, 64) +
+    data.substr(128);
+  insert(swapped);
+
+  // The seed varies the hash.
+  insert(data, 1);
+  insert(data, ~uint64_t(0));
+}
+
+TEST(HashingTest, hashBuilder128) {
+  // Taking in the bytes in pieces gives the same hash as all at once.
+  std::string data = getAlphabetString(5000);
+  for (size_t size: {0, 1, 63, 64, 65, 1023, 1024, 1025, 2048, 5000}) {
+    StringRef bytes = StringRef(data).take_front(size);
+    for (size_t pieceSize: {1, 7, 64, 1000, 1024, 4096}) {
+      HashBuilder128 builder(3);
+      for (size_t offset = 0; offset < size; offset += pieceSize)
+        builder.update(bytes.substr(offset, pieceSize));
+      EXPECT_EQ(hashBytes128(bytes, 3), builder.getHash())
+        << size << " bytes in pieces of " << pieceSize;
+    }
+  }
+
+  // The hash so far can be taken before taking in more.
+  HashBuilder128 builder;
+  builder.update("abc");
+  EXPECT_EQ(hashBytes128("abc"), builder.getHash());
+  builder.update(data);
+  EXPECT_EQ(hashBytes128("abc" + data), builder.getHash());
+}
+
+TEST(HashingTest, commandSignatureStable) {
+  // Signatures are persisted in the build database, so must never change.
+  auto signature = CommandSignature("command")
+    .combine("arg").combine(getAlphabetString(100)).combine(uint64_t(42));
+  checkHash(0x2557120d63d02660ULL, 0x31149f61913c30e4ULL, signature.value);
+}
+
+TEST(HashingTest, commandSignatureDistinct) {
+  std::set<std::pair<uint64_t, uint64_t>> signatures;
+  auto insert = [&](const CommandSignature& signature) {
+    EXPECT_TRUE(signatures.insert({signature.value.low,
+                                   signature.value.high}).second);
+  };
+
+  // Short and long strings, and strings which differ only by trailing zeros.
+  std::string data = getAlphabetString(40);
+  for (size_t size = 0; size <= data.size(); ++size)
+    insert(CommandSignature().combine(StringRef(data).take_front(size)));
+  for (size_t size: {1, 8, 15, 16})
+    insert(CommandSignature().combine(std::string(size, '\0')));
+
+  // Integers are distinguished from strings of their bytes.
+  insert(CommandSignature().combine(uint64_t(0)));
+  insert(CommandSignature().combine(uint64_t(0x61)));
+  insert(CommandSignature().combine(~uint64_t(0)));
+
+  // The order of the combined values matters.
+  insert(CommandSignature().combine("a").combine("b"));
+  insert(CommandSignature().combine("b").combine("a"));
+  insert(CommandSignature().combine("ab").combine(""));
+  insert(CommandSignature().combine(data).combine("a"));
+  insert(CommandSignature().combine("a").combine(data));
+
+  // No value cancels the prior state of the signature, including those which
+  // match the keys it is mixed with.
+  for (uint64_t key: { 0x32e230e18071ab94ULL, 0x22d9514ae4861dbeULL,
+                       0x8957dd2e0bf84e5aULL, 0xce61d882046f88e2ULL }) {
+    HashValue128 highOnly;
+    highOnly.high = 1;
+    insert(CommandSignature(uint64_t(1)).combine(key));
+    insert(CommandSignature(uint64_t(2)).combine(key));
+    insert(CommandSignature(highOnly).combine(key));
+  }
+
+  // Booleans are combined as integers.
+  EXPECT_EQ(CommandSignature().combine(uint64_t(1)),
+            CommandSignature().combine(true));
+}
+
+}
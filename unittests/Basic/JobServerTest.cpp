@@ -0,0 +1,160 @@
+//===- unittests/Basic/JobServerTest.cpp ----------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/JobServer.h"
+#include "../BuildSystem/TempDir.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <string>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+#if !defined(_WIN32)
+
+namespace {
+  /// Start acquiring a token on another thread, and check whether it is still
+  /// waiting for one shortly afterwards.
+  bool acquireWouldBlock(JobServer& server, std::future<bool>& result_out) {
+    result_out = std::async(std::launch::async,
+                            [&server]() { return server.acquire(); });
+    return result_out.wait_for(std::chrono::milliseconds(100)) ==
+      std::future_status::timeout;
+  }
+
+  TEST(JobServerTest, create) {
+    std::string error;
+    auto server = JobServer::create(3, &error);
+    ASSERT_TRUE(server) << error;
+
+    int readFd, writeFd;
+    ASSERT_EQ(2, sscanf(server->getMakeFlags().str().c_str(),
+                        "-j3 --jobserver-auth=%d,%d", &readFd, &writeFd));
+
+    // The implicit token and the two in the pipe are available.
+    EXPECT_TRUE(server->acquire());
+    EXPECT_TRUE(server->acquire());
+    EXPECT_TRUE(server->acquire());
+
+    // Further jobs wait until a token is released.
+    std::future<bool> waiting;
+    EXPECT_TRUE(acquireWouldBlock(*server, waiting));
+    server->release();
+    EXPECT_TRUE(waiting.get());
+
+    // The implicit token also wakes waiters.
+    for (int i = 0; i != 3; ++i)
+      server->release();
+    EXPECT_FALSE(acquireWouldBlock(*server, waiting));
+    EXPECT_TRUE(waiting.get());
+    server->release();
+
+    // Cancellation wakes waiters, and fails further requests.
+    EXPECT_TRUE(server->acquire());
+    EXPECT_TRUE(server->acquire());
+    EXPECT_TRUE(server->acquire());
+    EXPECT_TRUE(acquireWouldBlock(*server, waiting));
+    server->cancel();
+    EXPECT_FALSE(waiting.get());
+    EXPECT_FALSE(server->acquire());
+    for (int i = 0; i != 3; ++i)
+      server->release();
+  }
+
+  TEST(JobServerTest, connect) {
+    std::string error;
+
+    // No jobserver is advertised.
+    {
+      const char* environment[] = { "PATH=/bin", "MAKEFLAGS=k -j", nullptr };
+      EXPECT_FALSE(JobServer::connect(environment, &error));
+      EXPECT_EQ("", error);
+    }
+
+    // The advertised descriptors are not open.
+    {
+      const char* environment[] = {
+        "MAKEFLAGS= -j4 --jobserver-auth=1000,1001", nullptr };
+      EXPECT_FALSE(JobServer::connect(environment, &error));
+      EXPECT_NE(std::string::npos, error.find("are not open"));
+    }
+
+    // Participants share the tokens in the pipe, and each have their own
+    // implicit token.
+    auto parent = JobServer::create(2, &error);
+    ASSERT_TRUE(parent) << error;
+    std::string makeFlags = "MAKEFLAGS=k " + parent->getMakeFlags().str();
+    const char* environment[] = { makeFlags.c_str(), nullptr };
+    auto child = JobServer::connect(environment, &error);
+    ASSERT_TRUE(child) << error;
+    EXPECT_EQ("", child->getMakeFlags());
+
+    EXPECT_TRUE(parent->acquire());
+    EXPECT_TRUE(child->acquire());
+    EXPECT_TRUE(child->acquire());
+    std::future<bool> waiting;
+    EXPECT_TRUE(acquireWouldBlock(*parent, waiting));
+    child->release();
+    EXPECT_TRUE(waiting.get());
+    parent->release();
+    parent->release();
+    child->release();
+  }
+
+  TEST(JobServerTest, connectFifo) {
+    TmpDir tempDir{"JobServerTest"};
+    std::string path = tempDir.str() + "/jobserver";
+    ASSERT_EQ(0, mkfifo(path.c_str(), 0600));
+
+    // Keep the fifo open, holding one token.
+    int fd = open(path.c_str(), O_RDWR);
+    ASSERT_NE(-1, fd);
+    ASSERT_EQ(1, write(fd, "+", 1));
+
+    std::string makeFlags = "MAKEFLAGS=-j2 --jobserver-auth=fifo:" + path;
+    const char* environment[] = { makeFlags.c_str(), nullptr };
+    std::string error;
+    auto server = JobServer::connect(environment, &error);
+    ASSERT_TRUE(server) << error;
+
+    EXPECT_TRUE(server->acquire());
+    EXPECT_TRUE(server->acquire());
+    std::future<bool> waiting;
+    EXPECT_TRUE(acquireWouldBlock(*server, waiting));
+    server->release();
+    EXPECT_TRUE(waiting.get());
+    server->release();
+    server->release();
+
+    // The token is back in the fifo.
+    char token;
+    EXPECT_EQ(1, read(fd, &token, 1));
+    EXPECT_EQ('+', token);
+    close(fd);
+    server.reset();
+    unlink(path.c_str());
+  }
+}
+
+#endif
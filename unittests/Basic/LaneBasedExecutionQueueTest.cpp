@@ -12,6 +12,7 @@
 
 #include "llbuild/Basic/FileSystem.h"
 #include "llbuild/Basic/ExecutionQueue.h"
+#include "llbuild/Basic/PlatformUtility.h"
 #include "../BuildSystem/TempDir.h"
 
 #include "llvm/ADT/ArrayRef.h"
@@ -21,11 +22,15 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <ctime>
 #include <future>
 #include <mutex>
+#include <set>
+#include <thread>
 
 using namespace llbuild;
 using namespace llbuild::basic;
@@ -175,4 +180,425 @@ namespace {
     EXPECT_EQ(executions, 2);
   }
 
+  TEST(LaneBasedExecutionQueueTest, workStealingRunsAllJobs) {
+    DummyDelegate delegate;
+    LaneBasedExecutionQueueOptions options;
+    options.workStealing = true;
+    auto queue = std::unique_ptr<ExecutionQueue>(
+        createLaneBasedExecutionQueue(delegate, 4,
+                                      SchedulerAlgorithm::NamePriority,
+                                      /*environment=*/nullptr,
+                                      std::move(options)));
+
+    // Add jobs both from outside of the lanes and from the lanes themselves
+    // (which go to the lane's own queue, and must be stolen by the others).
+    const int numOuterJobs = 100, numInnerJobs = 10;
+    std::atomic<int> executions { 0 };
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    auto jobDone = [&]() {
+      if (++executions == numOuterJobs * (numInnerJobs + 1)) {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        doneCondition.notify_all();
+      }
+    };
+
+    DummyCommand dummyCommand;
+    for (int i = 0; i != numOuterJobs; ++i) {
+      queue->addJob(QueueJob(&dummyCommand, [&](QueueJobContext* context) {
+        for (int j = 0; j != numInnerJobs; ++j) {
+          queue->addJob(QueueJob(&dummyCommand, [&](QueueJobContext*) {
+            jobDone();
+          }));
+        }
+        jobDone();
+      }));
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(doneMutex);
+      EXPECT_TRUE(doneCondition.wait_for(lock, std::chrono::seconds(30), [&]() {
+        return executions == numOuterJobs * (numInnerJobs + 1);
+      }));
+    }
+    queue.reset();
+    EXPECT_EQ(executions, numOuterJobs * (numInnerJobs + 1));
+  }
+
+  class SizedCommand : public DummyCommand {
+    JobResources resources;
+
+  public:
+    SizedCommand(uint64_t memory, unsigned cpus,
+                 const JobPool* pool = nullptr) {
+      resources.memory = memory;
+      resources.cpus = cpus;
+      resources.pool = pool;
+    }
+
+    virtual JobResources getResources() const override { return resources; }
+  };
+
+  /// Run jobs of the given size through a queue with the given budget, and
+  /// return the maximum number which ran at once.
+  int runSizedJobs(ResourceBudget budget, uint64_t memory, unsigned cpus,
+                   const JobPool* pool = nullptr) {
+    DummyDelegate delegate;
+    LaneBasedExecutionQueueOptions options;
+    options.budget = budget;
+    auto queue = std::unique_ptr<ExecutionQueue>(
+        createLaneBasedExecutionQueue(delegate, 4,
+                                      SchedulerAlgorithm::NamePriority,
+                                      /*environment=*/nullptr,
+                                      std::move(options)));
+
+    const int numJobs = 12;
+    std::atomic<int> running { 0 }, maxRunning { 0 }, executions { 0 };
+    std::promise<void> done;
+    SizedCommand command(memory, cpus, pool);
+    for (int i = 0; i != numJobs; ++i) {
+      queue->addJob(QueueJob(&command, [&](QueueJobContext*) {
+        int current = ++running;
+        int max = maxRunning;
+        while (current > max && !maxRunning.compare_exchange_weak(max, current))
+          ;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        --running;
+        if (++executions == numJobs)
+          done.set_value();
+      }));
+    }
+    done.get_future().wait();
+    queue.reset();
+
+    EXPECT_EQ(executions, numJobs);
+    return maxRunning;
+  }
+
+  TEST(LaneBasedExecutionQueueTest, resourceBudget) {
+    // Jobs are limited by the CPU budget.
+    {
+      ResourceBudget budget;
+      budget.cpus = 4;
+      EXPECT_LE(runSizedJobs(budget, 0, 2), 2);
+    }
+
+    // Jobs are limited by the memory budget.
+    {
+      ResourceBudget budget;
+      budget.memory = 1000;
+      EXPECT_EQ(runSizedJobs(budget, 600, 1), 1);
+    }
+
+    // Jobs larger than the budget still run, one at a time.
+    {
+      ResourceBudget budget;
+      budget.cpus = 2;
+      EXPECT_EQ(runSizedJobs(budget, 0, 3), 1);
+    }
+  }
+
+  TEST(LaneBasedExecutionQueueTest, pools) {
+    // Jobs are limited by the depth of their pool.
+    JobPool link("link", 1);
+    EXPECT_EQ(runSizedJobs({}, 0, 1, &link), 1);
+
+    JobPool compile("compile", 2);
+    EXPECT_LE(runSizedJobs({}, 0, 1, &compile), 2);
+  }
+
+  TEST(LaneBasedExecutionQueueTest, poolsWithBudget) {
+    // Jobs from several pools, which also wait for the budget, all run within
+    // the depth of their pool.
+    JobPool link("link", 1);
+    JobPool compile("compile", 3);
+    SizedCommand linkCommand(0, 1, &link), compileCommand(0, 1, &compile);
+    LaneBasedExecutionQueueOptions options;
+    options.budget.cpus = 2;
+    DummyDelegate delegate;
+    auto queue = std::unique_ptr<ExecutionQueue>(
+        createLaneBasedExecutionQueue(delegate, 4,
+                                      SchedulerAlgorithm::FIFO,
+                                      /*environment=*/nullptr,
+                                      std::move(options)));
+
+    const int numJobs = 24;
+    std::mutex mutex;
+    int running = 0, runningLinks = 0, maxRunning = 0, maxRunningLinks = 0;
+    std::atomic<int> executions { 0 };
+    std::promise<void> done;
+    for (int i = 0; i != numJobs; ++i) {
+      bool isLink = i % 3 == 0;
+      queue->addJob(QueueJob(isLink ? &linkCommand : &compileCommand,
+                             [&, isLink](QueueJobContext*) {
+        {
+          std::lock_guard<std::mutex> guard(mutex);
+          maxRunning = std::max(maxRunning, ++running);
+          if (isLink)
+            maxRunningLinks = std::max(maxRunningLinks, ++runningLinks);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        {
+          std::lock_guard<std::mutex> guard(mutex);
+          --running;
+          if (isLink)
+            --runningLinks;
+        }
+        if (++executions == numJobs)
+          done.set_value();
+      }));
+    }
+    done.get_future().wait();
+    queue.reset();
+
+    EXPECT_EQ(executions, numJobs);
+    EXPECT_LE(maxRunning, 2);
+    EXPECT_EQ(maxRunningLinks, 1);
+  }
+
+  /// Delegate which tracks the number of processes running at once, and their
+  /// output.
+  class CountingDelegate : public DummyDelegate {
+  public:
+    std::mutex mutex;
+    int running = 0;
+    int maxRunning = 0;
+    std::string output;
+
+    virtual void processStarted(ProcessContext*, ProcessHandle) override {
+      std::lock_guard<std::mutex> guard(mutex);
+      maxRunning = std::max(maxRunning, ++running);
+    }
+    virtual void processHadOutput(ProcessContext*, ProcessHandle,
+                                  StringRef data) override {
+      std::lock_guard<std::mutex> guard(mutex);
+      output += data;
+    }
+    virtual void processFinished(ProcessContext*, ProcessHandle,
+                                 const ProcessResult& result) override {
+      std::lock_guard<std::mutex> guard(mutex);
+      --running;
+    }
+  };
+
+  /// Run a shell command for each of the given number of jobs through a queue
+  /// using the process reactor, and return the number which succeeded.
+  ///
+  /// \param numJobThreads_out If given, set to the number of distinct threads
+  /// which ran the jobs.
+  int runReactorJobs(CountingDelegate& delegate, unsigned numLanes,
+                     int numJobs, StringRef command,
+                     size_t* numJobThreads_out = nullptr) {
+    LaneBasedExecutionQueueOptions options;
+    options.useProcessReactor = true;
+    auto queue = std::unique_ptr<ExecutionQueue>(
+        createLaneBasedExecutionQueue(delegate, numLanes,
+                                      SchedulerAlgorithm::NamePriority,
+                                      /*environment=*/nullptr,
+                                      std::move(options)));
+
+    std::atomic<int> completed { 0 }, succeeded { 0 };
+    std::promise<void> done;
+    std::mutex jobThreadsMutex;
+    std::set<std::thread::id> jobThreads;
+    DummyCommand dummyCommand;
+    for (int i = 0; i != numJobs; ++i) {
+      queue->addJob(QueueJob(&dummyCommand, [&](QueueJobContext* context) {
+        {
+          std::lock_guard<std::mutex> guard(jobThreadsMutex);
+          jobThreads.insert(std::this_thread::get_id());
+        }
+        std::vector<StringRef> commandLine({ "/bin/sh", "-c", command });
+        queue->executeProcess(context, commandLine, {}, true, {true},
+                              {[&](ProcessResult result) {
+          if (result.status == ProcessStatus::Succeeded)
+            ++succeeded;
+          if (++completed == numJobs)
+            done.set_value();
+        }});
+      }));
+    }
+    done.get_future().wait();
+    queue.reset();
+    if (numJobThreads_out)
+      *numJobThreads_out = jobThreads.size();
+    return succeeded;
+  }
+
+  TEST(LaneBasedExecutionQueueTest, processReactor) {
+    if (!isProcessReactorSupported())
+      return;
+
+    // Processes still hold their lane while running.
+    {
+      CountingDelegate delegate;
+      EXPECT_EQ(runReactorJobs(delegate, 2, 6, "sleep 0.1"), 6);
+      EXPECT_LE(delegate.maxRunning, 2);
+    }
+
+    // Lane counts well beyond the number of threads are practical.
+    {
+      const unsigned numLanes = 300;
+      CountingDelegate delegate;
+      size_t numJobThreads = 0;
+      auto start = std::chrono::steady_clock::now();
+      EXPECT_EQ(runReactorJobs(delegate, numLanes, numLanes,
+                               "echo $LLBUILD_LANE_ID; sleep 1",
+                               &numJobThreads),
+                int(numLanes));
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      EXPECT_LT(elapsed, std::chrono::seconds(30));
+
+      // The jobs are run by only as many threads as the reactor path starts,
+      // and more of their processes run at once than there are threads (which
+      // would otherwise each wait for their process to complete).
+      unsigned numThreads = std::min(
+          numLanes, std::max(std::thread::hardware_concurrency(), 4u));
+      EXPECT_LE(numJobThreads, size_t(numThreads));
+      if (numThreads < numLanes) {
+        EXPECT_GT(delegate.maxRunning, int(numThreads));
+      }
+
+      // Every lane ID is in range.
+      StringRef output(delegate.output);
+      while (!output.empty()) {
+        auto line = output.split('\n');
+        unsigned laneID;
+        EXPECT_FALSE(line.first.getAsInteger(10, laneID));
+        EXPECT_LT(laneID, numLanes);
+        output = line.second;
+      }
+    }
+  }
+
+  TEST(LaneBasedExecutionQueueTest, jobServer) {
+#if !defined(_WIN32)
+    std::string error;
+    auto jobServer = JobServer::create(2, &error);
+    ASSERT_TRUE(jobServer) << error;
+    std::string makeFlags = jobServer->getMakeFlags();
+
+    CountingDelegate delegate;
+    LaneBasedExecutionQueueOptions options;
+    options.jobServer = std::move(jobServer);
+    auto queue = std::unique_ptr<ExecutionQueue>(
+        createLaneBasedExecutionQueue(delegate, 4,
+                                      SchedulerAlgorithm::NamePriority,
+                                      /*environment=*/nullptr,
+                                      std::move(options)));
+
+    // Jobs are limited by the jobserver, rather than the lane count, and
+    // processes are given the jobserver.
+    const int numJobs = 6;
+    std::atomic<int> completed { 0 };
+    std::promise<void> done;
+    DummyCommand dummyCommand;
+    for (int i = 0; i != numJobs; ++i) {
+      queue->addJob(QueueJob(&dummyCommand, [&](QueueJobContext* context) {
+        queue->executeShellCommand(context, "echo \"$MAKEFLAGS\"; sleep 0.1");
+        if (++completed == numJobs)
+          done.set_value();
+      }));
+    }
+    done.get_future().wait();
+    queue.reset();
+
+    EXPECT_LE(delegate.maxRunning, 2);
+    StringRef output(delegate.output);
+    for (int i = 0; i != numJobs; ++i) {
+      auto line = output.split('\n');
+      EXPECT_TRUE(line.first.endswith(makeFlags)) << line.first.str();
+      output = line.second;
+    }
+#endif
+  }
+
+  TEST(LaneBasedExecutionQueueTest, elasticLanes) {
+    unsigned numCPUs = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // Lanes are added while jobs wait and the CPUs are idle, up to the lane
+    // count (the load is given, so the test does not depend on the host).
+    const unsigned numLanes = numCPUs + 2;
+    ResourceBudget budget;
+    budget.minLanes = 1;
+    budget.sampleLoad = [](double& loadAverage, int& runnableThreads,
+                           int& blockedThreads) {
+      // Only the sampling thread is runnable.
+      loadAverage = 0;
+      runnableThreads = 1;
+      blockedThreads = 0;
+      return true;
+    };
+    CountingDelegate delegate;
+    LaneBasedExecutionQueueOptions options;
+    options.budget = budget;
+    auto queue = std::unique_ptr<ExecutionQueue>(
+        createLaneBasedExecutionQueue(delegate, numLanes,
+                                      SchedulerAlgorithm::NamePriority,
+                                      /*environment=*/nullptr,
+                                      std::move(options)));
+
+    const int numJobs = 4 * numLanes;
+    std::atomic<int> completed { 0 };
+    std::promise<void> done;
+    DummyCommand dummyCommand;
+    for (int i = 0; i != numJobs; ++i) {
+      queue->addJob(QueueJob(&dummyCommand, [&](QueueJobContext* context) {
+        queue->executeShellCommand(context, "sleep 0.3");
+        if (++completed == numJobs)
+          done.set_value();
+      }));
+    }
+    done.get_future().wait();
+    queue.reset();
+
+    EXPECT_LE(delegate.maxRunning, int(numLanes));
+    EXPECT_GT(delegate.maxRunning, int(numCPUs));
+  }
+
+  /// Run a number of trivial jobs through a queue, and return the elapsed
+  /// time.
+  std::chrono::nanoseconds runTrivialJobs(unsigned numLanes, int numJobs,
+                                          bool workStealing) {
+    DummyDelegate delegate;
+    LaneBasedExecutionQueueOptions options;
+    options.workStealing = workStealing;
+    auto queue = std::unique_ptr<ExecutionQueue>(
+        createLaneBasedExecutionQueue(delegate, numLanes,
+                                      SchedulerAlgorithm::NamePriority,
+                                      /*environment=*/nullptr,
+                                      std::move(options)));
+
+    std::atomic<int> executions { 0 };
+    std::promise<void> done;
+    DummyCommand dummyCommand;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i != numJobs; ++i) {
+      queue->addJob(QueueJob(&dummyCommand, [&](QueueJobContext*) {
+        if (++executions == numJobs)
+          done.set_value();
+      }));
+    }
+    done.get_future().wait();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    queue.reset();
+
+    EXPECT_EQ(executions, numJobs);
+    return elapsed;
+  }
+
+  TEST(LaneBasedExecutionQueueTest, workStealingThroughputBenchmark) {
+    // Compare the throughput for many short jobs, which is dominated by the
+    // cost of scheduling them.
+    const unsigned numLanes = 64;
+    const int numJobs = 50000;
+    for (bool workStealing: { false, true }) {
+      auto elapsed = runTrivialJobs(numLanes, numJobs, workStealing);
+      double seconds = std::chrono::duration<double>(elapsed).count();
+      fprintf(stderr, "%s queue: %d jobs on %u lanes in %.3fs (%.0f jobs/s)\n",
+              workStealing ? "work stealing" : "shared", numJobs, numLanes,
+              seconds, numJobs / seconds);
+    }
+  }
+
 }
@@ -14,6 +14,12 @@
 
 #include "gtest/gtest.h"
 
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+
 using namespace llbuild;
 using namespace llbuild::basic;
 
@@ -31,4 +37,103 @@ TEST(POSIXEnvironmentTest, basic) {
   EXPECT_EQ(result[2], nullptr);
 #endif
   }
+
+TEST(POSIXEnvironmentTest, blocks) {
+  const char* base[] = { "a=aBase", "c=cBase", "d=dBase", nullptr };
+  std::vector<std::pair<StringRef, StringRef>> assignments{
+    { "b", "bValue" }, { "c", "cValue" } };
+  auto block = std::make_shared<EnvironmentBlock>(assignments, base);
+  EXPECT_EQ(4u, block->getAssignments().size());
+  EXPECT_EQ(1, block->find("c"));
+  EXPECT_EQ(-1, block->find("e"));
+
+  // Earlier assignments take precedence over the block, and the block over
+  // later assignments.
+  POSIXEnvironment env;
+  env.setIfMissing("a", "aValue");
+  env.addBlock(block);
+  env.setIfMissing("d", "NOT HERE");
+  env.setIfMissing("e", "eValue");
+
+#if !defined(_WIN32)
+  auto result = env.getEnvp();
+  EXPECT_EQ(StringRef(result[0]), "a=aValue");
+  EXPECT_EQ(StringRef(result[1]), "e=eValue");
+  EXPECT_EQ(StringRef(result[2]), "b=bValue");
+  EXPECT_EQ(StringRef(result[3]), "c=cValue");
+  EXPECT_EQ(StringRef(result[4]), "d=dBase");
+  EXPECT_EQ(result[5], nullptr);
+#endif
+}
+
+TEST(POSIXEnvironmentTest, blockCache) {
+  const char* base[] = { "a=aBase", nullptr };
+  EnvironmentBlockCache cache(base);
+  std::vector<std::pair<StringRef, StringRef>> assignments{ { "b", "b" } };
+  std::vector<std::pair<StringRef, StringRef>> otherAssignments{
+    { "b", "other" } };
+
+  auto block = cache.get(assignments, true);
+  EXPECT_EQ(block, cache.get(assignments, true));
+  EXPECT_NE(block, cache.get(assignments, false));
+  EXPECT_NE(block, cache.get(otherAssignments, true));
+  EXPECT_EQ(2u, block->getAssignments().size());
+  EXPECT_EQ(1u, cache.get(assignments, false)->getAssignments().size());
+}
+
+/// Compare building the environment for each process directly against using
+/// the block cache, for a typically sized base environment.
+TEST(POSIXEnvironmentTest, blockCachePerformance) {
+  const unsigned numProcesses = 10000;
+  std::vector<std::string> baseStorage;
+  for (unsigned i = 0; i != 200; ++i) {
+    baseStorage.push_back("VARIABLE_" + std::to_string(i) +
+                          "=/some/reasonably/long/value/" + std::to_string(i));
+  }
+  std::vector<const char*> base;
+  for (const auto& entry: baseStorage)
+    base.push_back(entry.c_str());
+  base.push_back(nullptr);
+  std::vector<std::pair<StringRef, StringRef>> assignments{
+    { "TOOLCHAIN", "/usr" }, { "SDK", "/" } };
+
+  auto measure = [&](std::function<void(POSIXEnvironment&)> build) {
+    auto start = std::chrono::steady_clock::now();
+    size_t numAssignments = 0;
+    for (unsigned i = 0; i != numProcesses; ++i) {
+      POSIXEnvironment env;
+      env.setIfMissing("LLBUILD_LANE_ID", "0");
+      build(env);
+      env.setIfMissing("LLBUILD_TASK_ID", "1");
+#if !defined(_WIN32)
+      for (auto p = env.getEnvp(); *p; ++p)
+        ++numAssignments;
+#else
+      (void) env.getWindowsEnvp();
+#endif
+    }
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+#if !defined(_WIN32)
+    EXPECT_EQ(numProcesses * (base.size() - 1 + 4), numAssignments);
+#endif
+    return elapsed.count() * 1e6 / numProcesses;
+  };
+
+  double directTime = measure([&](POSIXEnvironment& env) {
+    for (const auto& entry: assignments)
+      env.setIfMissing(entry.first, entry.second);
+    for (const char* const* p = base.data(); *p != nullptr; ++p) {
+      auto pair = StringRef(*p).split('=');
+      env.setIfMissing(pair.first, pair.second);
+    }
+  });
+  EnvironmentBlockCache cache(base.data());
+  double cachedTime = measure([&](POSIXEnvironment& env) {
+    env.addBlock(cache.get(assignments, true));
+  });
+
+  fprintf(stderr, "note: built environments in %.2fus directly, and %.2fus "
+          "using the block cache\n", directTime, cachedTime);
+}
 }
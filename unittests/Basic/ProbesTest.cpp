@@ -0,0 +1,124 @@
+//===- unittests/Basic/ProbesTest.cpp -------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/LLVM.h"
+#include "llbuild/Basic/Probes.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <string>
+
+#if defined(LLBUILD_HAS_PROBES)
+#include <elf.h>
+#endif
+
+using namespace llbuild;
+
+#if defined(LLBUILD_HAS_PROBES)
+
+namespace {
+
+/// The probes of the running executable, from their name to their argument
+/// descriptions.
+typedef llvm::StringMap<std::string> ProbeMap;
+
+/// Read the probes described by the ".note.stapsdt" section of the running
+/// executable.
+void readProbes(ProbeMap& probes_out) {
+  auto buffer = llvm::MemoryBuffer::getFile("/proc/self/exe", /*FileSize=*/-1,
+                                            /*RequiresNullTerminator=*/false);
+  ASSERT_TRUE(bool(buffer));
+  StringRef data = (*buffer)->getBuffer();
+  ASSERT_GE(data.size(), sizeof(Elf64_Ehdr));
+  Elf64_Ehdr header;
+  memcpy(&header, data.data(), sizeof(header));
+  ASSERT_EQ(0, memcmp(header.e_ident, ELFMAG, SELFMAG));
+  ASSERT_EQ(ELFCLASS64, header.e_ident[EI_CLASS]);
+
+  auto getSection = [&](unsigned index) {
+    Elf64_Shdr section;
+    memcpy(&section, data.data() + header.e_shoff +
+           index * header.e_shentsize, sizeof(section));
+    return section;
+  };
+  Elf64_Shdr names = getSection(header.e_shstrndx);
+  for (unsigned i = 0; i != header.e_shnum; ++i) {
+    Elf64_Shdr section = getSection(i);
+    if (StringRef(data.data() + names.sh_offset + section.sh_name) !=
+        ".note.stapsdt")
+      continue;
+
+    // Each note is a header, the "stapsdt" owner, and then the addresses of
+    // the probe, the base and the semaphore, followed by the provider, name
+    // and arguments strings.
+    StringRef notes = data.substr(section.sh_offset, section.sh_size);
+    while (notes.size() >= sizeof(Elf64_Nhdr)) {
+      Elf64_Nhdr note;
+      memcpy(&note, notes.data(), sizeof(note));
+      auto align = [](size_t size) { return (size + 3) & ~size_t(3); };
+      StringRef owner = notes.substr(sizeof(note), note.n_namesz);
+      StringRef desc = notes.substr(sizeof(note) + align(note.n_namesz),
+                                    note.n_descsz);
+      notes = notes.drop_front(sizeof(note) + align(note.n_namesz) +
+                               align(note.n_descsz));
+      EXPECT_EQ(3u, note.n_type);
+      if (owner.rtrim('\0') != "stapsdt")
+        continue;
+
+      SmallVector<StringRef, 3> strings;
+      desc.drop_front(3 * 8).split(strings, '\0');
+      ASSERT_GE(strings.size(), 3u);
+      if (strings[0] == "llbuild")
+        probes_out[strings[1]] = strings[2];
+    }
+  }
+}
+
+/// A function with a probe, which is not inlined (so that its arguments are
+/// in registers).
+__attribute__((noinline))
+void fireTestProbe(uint64_t keyID, int32_t lane) {
+  LLBUILD_PROBE2(test_probe, keyID, lane);
+}
+
+TEST(ProbesTest, notes) {
+  fireTestProbe(1, 2);
+
+  ProbeMap probes;
+  readProbes(probes);
+
+  // The arguments are described by their size (negated for signed values) and
+  // where to find them.
+  ASSERT_EQ(1u, probes.count("test_probe"));
+  SmallVector<StringRef, 2> args;
+  StringRef(probes["test_probe"]).split(args, ' ');
+  ASSERT_EQ(2u, args.size());
+  EXPECT_TRUE(args[0].startswith("8@")) << args[0].str();
+  EXPECT_TRUE(args[1].startswith("-4@")) << args[1].str();
+
+  // The execution queue and subprocess probes are linked in.
+  for (const char* name: { "job_queued", "job_started", "job_finished",
+                           "process_spawned", "process_exited" }) {
+    EXPECT_EQ(1u, probes.count(name)) << name;
+  }
+  EXPECT_EQ(3u, StringRef(probes["process_exited"]).count('@'));
+}
+
+}
+
+#endif
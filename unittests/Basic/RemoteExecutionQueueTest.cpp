@@ -0,0 +1,354 @@
+//===- unittests/Basic/RemoteExecutionQueueTest.cpp -----------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/BinaryCoding.h"
+#include "llbuild/Basic/ExecutionQueue.h"
+#include "llbuild/Basic/RemoteExecution.h"
+#include "../BuildSystem/TempDir.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+#if !defined(_WIN32)
+
+namespace {
+  class CapturingDelegate : public ExecutionQueueDelegate {
+  public:
+    std::mutex mutex;
+    std::string output;
+    std::string errors;
+
+    virtual void queueJobStarted(JobDescriptor*) override {}
+    virtual void queueJobFinished(JobDescriptor*) override {}
+    virtual void processStarted(ProcessContext*, ProcessHandle) override {}
+    virtual void processHadError(ProcessContext*, ProcessHandle,
+                                 const Twine& message) override {
+      std::lock_guard<std::mutex> guard(mutex);
+      errors += message.str();
+    }
+    virtual void processHadOutput(ProcessContext*, ProcessHandle,
+                                  StringRef data) override {
+      std::lock_guard<std::mutex> guard(mutex);
+      output += data;
+    }
+    virtual void processFinished(ProcessContext*, ProcessHandle,
+                                 const ProcessResult& result) override {}
+  };
+
+  class DummyCommand : public JobDescriptor {
+  public:
+    virtual StringRef getOrdinalName() const override { return ""; }
+    virtual void getShortDescription(
+        SmallVectorImpl<char> &result) const override {}
+    virtual void getVerboseDescription(
+        SmallVectorImpl<char> &result) const override {}
+  };
+
+  /// Runs a worker on a background thread for the duration of a test.
+  class WorkerFixture {
+    RemoteExecutionWorker worker;
+    std::thread thread;
+
+  public:
+    std::string address;
+
+    WorkerFixture(StringRef path, unsigned numSlots, bool sharedFileSystem)
+        : worker(numSlots, sharedFileSystem) {
+      std::string error;
+      EXPECT_TRUE(worker.listen(path, &error, &address)) << error;
+      thread = std::thread([this]() { worker.serve(); });
+    }
+
+    ~WorkerFixture() {
+      worker.shutdown();
+      thread.join();
+    }
+  };
+
+  /// A worker which answers a single request with the given message, to test
+  /// the handling of misbehaving workers.
+  class FakeWorker {
+    int listenFD;
+    std::thread thread;
+
+  public:
+    std::string address;
+
+    FakeWorker(StringRef path, RemoteMessageKind replyKind,
+               std::string replyPayload) : address(path) {
+      listenFD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      struct sockaddr_un addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+      EXPECT_EQ(0, ::bind(listenFD, (struct sockaddr*)&addr, sizeof(addr)));
+      EXPECT_EQ(0, ::listen(listenFD, 1));
+
+      thread = std::thread([this, replyKind, replyPayload]() {
+        int fd = ::accept(listenFD, nullptr, nullptr);
+        if (fd < 0)
+          return;
+        RemoteConnection connection(fd);
+        RemoteMessageKind kind;
+        std::string payload;
+        if (!connection.receive(kind, payload))
+          return;
+        RemoteHelloReply reply;
+        reply.numSlots = 1;
+        reply.sharedFileSystem = false;
+        if (!connection.sendValue(RemoteMessageKind::HelloReply, reply) ||
+            !connection.receive(kind, payload))
+          return;
+        connection.send(replyKind, replyPayload);
+
+        // Wait for the client to go away.
+        while (connection.receive(kind, payload)) {}
+      });
+    }
+
+    ~FakeWorker() {
+      thread.join();
+      ::close(listenFD);
+      ::unlink(address.c_str());
+    }
+  };
+
+  /// Run a shell command through the queue, and return its result.
+  ProcessResult runCommand(ExecutionQueue& queue, StringRef command,
+                           ArrayRef<std::string> outputs = {}) {
+    std::promise<ProcessResult> promise;
+    DummyCommand dummyCommand;
+    queue.addJob(QueueJob(&dummyCommand, [&](QueueJobContext* context) {
+      std::vector<StringRef> commandLine({ "/bin/sh", "-c", command });
+      ProcessAttributes attributes{true};
+      attributes.outputs = outputs;
+      queue.executeProcess(context, commandLine, {}, true, attributes,
+                           {[&promise](ProcessResult result) {
+        promise.set_value(result);
+      }});
+    }));
+    return promise.get_future().get();
+  }
+
+  TEST(RemoteExecutionQueueTest, basic) {
+    TmpDir tempDir{"RemoteExecutionQueueTest"};
+    WorkerFixture worker(tempDir.str() + "/worker.sock", 2,
+                         /*sharedFileSystem=*/true);
+
+    CapturingDelegate delegate;
+    std::string error;
+    std::vector<std::string> addresses{ worker.address };
+    std::unique_ptr<ExecutionQueue> queue(createRemoteExecutionQueue(
+        delegate, addresses, SchedulerAlgorithm::NamePriority,
+        /*environment=*/nullptr, &error));
+    ASSERT_TRUE(queue != nullptr) << error;
+
+    auto result = runCommand(*queue, "echo hello-$LLBUILD_LANE_ID");
+    EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+    EXPECT_EQ(0, result.exitCode);
+    EXPECT_TRUE(delegate.output == "hello-0\n" ||
+                delegate.output == "hello-1\n") << delegate.output;
+
+    result = runCommand(*queue, "exit 3");
+    EXPECT_EQ(ProcessStatus::Failed, result.status);
+    EXPECT_NE(0, result.exitCode);
+    EXPECT_EQ("", delegate.errors);
+  }
+
+  TEST(RemoteExecutionQueueTest, returnedOutputs) {
+    TmpDir tempDir{"RemoteExecutionQueueTest"};
+    WorkerFixture worker(tempDir.str() + "/worker.sock", 1,
+                         /*sharedFileSystem=*/false);
+
+    CapturingDelegate delegate;
+    std::string error;
+    std::vector<std::string> addresses{ worker.address };
+    std::unique_ptr<ExecutionQueue> queue(createRemoteExecutionQueue(
+        delegate, addresses, SchedulerAlgorithm::NamePriority,
+        /*environment=*/nullptr, &error));
+    ASSERT_TRUE(queue != nullptr) << error;
+
+    std::string outputPath = tempDir.str() + "/output.txt";
+    std::vector<std::string> outputs{ outputPath };
+    auto result = runCommand(*queue, "printf contents >" + outputPath,
+                             outputs);
+    EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+
+    auto buffer = llvm::MemoryBuffer::getFile(outputPath);
+    ASSERT_TRUE(bool(buffer));
+    EXPECT_EQ("contents", buffer.get()->getBuffer());
+  }
+
+  TEST(RemoteExecutionQueueTest, closedConnections) {
+#if defined(__linux__)
+    TmpDir tempDir{"RemoteExecutionQueueTest"};
+    WorkerFixture worker(tempDir.str() + "/worker.sock", 1,
+                         /*sharedFileSystem=*/true);
+
+    auto countOpenFiles = []() {
+      unsigned count = 0;
+      std::error_code ec;
+      for (llvm::sys::fs::directory_iterator it("/proc/self/fd", ec), end;
+           it != end && !ec; it.increment(ec))
+        ++count;
+      return count;
+    };
+
+    // The worker does not hold on to the connections clients have closed.
+    std::string error;
+    unsigned numOpenFiles = countOpenFiles();
+    for (int i = 0; i != 20; ++i) {
+      auto connection = RemoteConnection::connect(worker.address, &error);
+      ASSERT_TRUE(connection != nullptr) << error;
+      connection.reset();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_LT(countOpenFiles(), numOpenFiles + 10);
+#endif
+  }
+
+  TEST(RemoteExecutionQueueTest, malformedRequest) {
+    // A list count beyond the size of the message is not trusted.
+    BinaryEncoder encoder;
+    encoder.write(uint32_t(0xFFFFFFFF));
+    encoder.write(uint32_t(0));
+    encoder.write(std::string());
+    encoder.write(true);
+    encoder.write(uint32_t(0));
+    encoder.write(uint32_t(0));
+    auto data = encoder.contents();
+
+    RemoteExecuteRequest request;
+    request.commandLine.push_back("stale");
+    BinaryDecoder decoder(data);
+    decoder.read(request);
+    EXPECT_TRUE(request.commandLine.empty());
+    EXPECT_TRUE(decoder.isEmpty());
+    EXPECT_TRUE(decoder.hasOverrun());
+  }
+
+  TEST(RemoteExecutionQueueTest, truncatedMessages) {
+    RemoteExecuteRequest request;
+    request.commandLine = { "echo", "hello" };
+    request.outputs = { "output" };
+    BinaryEncoder encoder;
+    encoder.write(request);
+    auto data = encoder.contents();
+    StringRef payload((const char*)data.data(), data.size());
+
+    RemoteExecuteRequest decoded;
+    EXPECT_TRUE(decodeRemoteValue(payload, decoded));
+    EXPECT_EQ(request.commandLine, decoded.commandLine);
+
+    // Truncated or extended messages are rejected.
+    for (size_t size = 0; size != payload.size(); ++size)
+      EXPECT_FALSE(decodeRemoteValue(payload.take_front(size), decoded));
+    EXPECT_FALSE(decodeRemoteValue(payload.str() + "x", decoded));
+
+    // As are strings which run past the end of the message.
+    BinaryEncoder stringEncoder;
+    stringEncoder.write(uint32_t(0xFFFFFFFF));
+    stringEncoder.write(uint8_t('x'));
+    auto stringData = stringEncoder.contents();
+    std::string message;
+    EXPECT_FALSE(decodeRemoteValue(
+        StringRef((const char*)stringData.data(), stringData.size()), message));
+  }
+
+  TEST(RemoteExecutionQueueTest, malformedReply) {
+    TmpDir tempDir{"RemoteExecutionQueueTest"};
+    BinaryEncoder encoder;
+    encoder.write(uint32_t(0xFFFFFFFF));
+    FakeWorker worker(tempDir.str() + "/worker.sock",
+                      RemoteMessageKind::Output,
+                      std::string((const char*)encoder.data(),
+                                  encoder.size()));
+
+    CapturingDelegate delegate;
+    std::string error;
+    std::vector<std::string> addresses{ worker.address };
+    std::unique_ptr<ExecutionQueue> queue(createRemoteExecutionQueue(
+        delegate, addresses, SchedulerAlgorithm::NamePriority,
+        /*environment=*/nullptr, &error));
+    ASSERT_TRUE(queue != nullptr) << error;
+
+    auto result = runCommand(*queue, "true");
+    EXPECT_EQ(ProcessStatus::Failed, result.status);
+    EXPECT_EQ("", delegate.output);
+    EXPECT_EQ("malformed message from remote worker", delegate.errors);
+  }
+
+  TEST(RemoteExecutionQueueTest, unexpectedOutputs) {
+    TmpDir tempDir{"RemoteExecutionQueueTest"};
+    std::string outputPath = tempDir.str() + "/output.txt";
+    std::string unexpectedPath = tempDir.str() + "/unexpected.txt";
+    RemoteExecuteResult reply;
+    reply.status = ProcessStatus::Succeeded;
+    reply.exitCode = 0;
+    reply.outputs.resize(1);
+    reply.outputs[0].path = unexpectedPath;
+    reply.outputs[0].contents = "contents";
+    BinaryEncoder encoder;
+    encoder.write(reply);
+    FakeWorker worker(tempDir.str() + "/worker.sock",
+                      RemoteMessageKind::Result,
+                      std::string((const char*)encoder.data(),
+                                  encoder.size()));
+
+    CapturingDelegate delegate;
+    std::string error;
+    std::vector<std::string> addresses{ worker.address };
+    std::unique_ptr<ExecutionQueue> queue(createRemoteExecutionQueue(
+        delegate, addresses, SchedulerAlgorithm::NamePriority,
+        /*environment=*/nullptr, &error));
+    ASSERT_TRUE(queue != nullptr) << error;
+
+    // Only the outputs of the request are written.
+    std::vector<std::string> outputs{ outputPath };
+    auto result = runCommand(*queue, "true", outputs);
+    EXPECT_EQ(ProcessStatus::Failed, result.status);
+    EXPECT_NE(std::string::npos, delegate.errors.find("unexpected output"));
+    EXPECT_FALSE(llvm::sys::fs::exists(unexpectedPath));
+  }
+
+  TEST(RemoteExecutionQueueTest, connectionFailure) {
+    TmpDir tempDir{"RemoteExecutionQueueTest"};
+    CapturingDelegate delegate;
+    std::string error;
+    std::vector<std::string> addresses{ tempDir.str() + "/missing.sock" };
+    std::unique_ptr<ExecutionQueue> queue(createRemoteExecutionQueue(
+        delegate, addresses, SchedulerAlgorithm::NamePriority,
+        /*environment=*/nullptr, &error));
+    EXPECT_TRUE(queue == nullptr);
+    EXPECT_NE(std::string::npos, error.find("unable to connect"));
+  }
+}
+
+#endif
@@ -0,0 +1,266 @@
+//===- unittests/Basic/SpawnServerTest.cpp --------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/SpawnServer.h"
+#include "llbuild/Basic/Subprocess.h"
+#include "../BuildSystem/TempDir.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+#if defined(__linux__)
+
+namespace {
+  class CapturingDelegate : public ProcessDelegate {
+  public:
+    std::mutex mutex;
+    std::string output;
+    std::string errors;
+
+    virtual void processStarted(ProcessContext*, ProcessHandle) override {}
+    virtual void processHadError(ProcessContext*, ProcessHandle,
+                                 const Twine& message) override {
+      std::lock_guard<std::mutex> guard(mutex);
+      errors += message.str();
+    }
+    virtual void processHadOutput(ProcessContext*, ProcessHandle,
+                                  StringRef data) override {
+      std::lock_guard<std::mutex> guard(mutex);
+      output += data;
+    }
+    virtual void processFinished(ProcessContext*, ProcessHandle,
+                                 const ProcessResult&) override {}
+  };
+
+  /// Stops the spawn server at the end of a test.
+  struct SpawnServerScope {
+    SpawnServerScope() {
+      std::string error;
+      EXPECT_TRUE(startSpawnServer(&error)) << error;
+    }
+    ~SpawnServerScope() { stopSpawnServer(); }
+  };
+
+  /// Run a command, and return its result.
+  ProcessResult runCommand(CapturingDelegate& delegate,
+                           ArrayRef<StringRef> commandLine,
+                           StringRef workingDir = {},
+                           ProcessAttributes attributes = {true}) {
+    ProcessGroup pgrp;
+    POSIXEnvironment environment;
+    environment.setIfMissing("PATH", "/usr/bin:/bin");
+    attributes.workingDir = workingDir;
+    ProcessResult result = ProcessResult::makeFailed();
+    spawnProcess(delegate, nullptr, pgrp, ProcessHandle{0}, commandLine,
+                 environment, attributes,
+                 [](std::function<void()>&& processWait) { processWait(); },
+                 [&result](ProcessResult value) { result = value; });
+    return result;
+  }
+
+  TEST(SpawnServerTest, basic) {
+    TmpDir tempDir{"SpawnServerTest"};
+    std::vector<StringRef> commandLine{
+      "/bin/sh", "-c",
+      "echo out; echo err >&2; pwd; "
+      "test -w /dev/fd/$LLBUILD_CONTROL_FD && echo control; exit 3" };
+
+    // Run the command directly for reference.
+    CapturingDelegate direct;
+    auto directResult = runCommand(direct, commandLine, tempDir.str());
+
+    SpawnServerScope server;
+    ASSERT_TRUE(isSpawnServerRunning());
+    CapturingDelegate delegate;
+    auto result = runCommand(delegate, commandLine, tempDir.str());
+    EXPECT_EQ("", delegate.errors);
+    EXPECT_EQ(direct.output, delegate.output);
+    EXPECT_NE(std::string::npos, delegate.output.find("control"));
+    EXPECT_EQ(directResult.status, result.status);
+    EXPECT_EQ(ProcessStatus::Failed, result.status);
+    EXPECT_EQ(directResult.exitCode, result.exitCode);
+    EXPECT_NE(0, result.pid);
+
+    // Signals are reported as for direct children.
+    result = runCommand(delegate, {"/bin/sh", "-c", "kill -9 $$"});
+    EXPECT_EQ(ProcessStatus::Cancelled, result.status);
+
+    // Spawn failures are reported as errors.
+    result = runCommand(delegate, {"/does/not/exist"});
+    EXPECT_EQ(ProcessStatus::Failed, result.status);
+    EXPECT_NE(std::string::npos,
+              delegate.errors.find("unable to spawn process"));
+  }
+
+  TEST(SpawnServerTest, signals) {
+    SpawnServerScope server;
+    CapturingDelegate delegate;
+    ProcessGroup pgrp;
+    ProcessResult result = ProcessResult::makeFailed();
+    std::thread thread([&]() {
+      POSIXEnvironment environment;
+      environment.setIfMissing("PATH", "/usr/bin:/bin");
+      spawnProcess(delegate, nullptr, pgrp, ProcessHandle{0},
+                   {"/bin/sh", "-c", "echo started; exec sleep 30"},
+                   environment, {true},
+                   [](std::function<void()>&& processWait) { processWait(); },
+                   [&result](ProcessResult value) { result = value; });
+    });
+
+    // Processes are signalled through the server.
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::seconds(10);
+    while (std::chrono::steady_clock::now() < deadline) {
+      {
+        std::lock_guard<std::mutex> guard(delegate.mutex);
+        if (!delegate.output.empty())
+          break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    pgrp.signalAll(SIGKILL);
+    thread.join();
+    EXPECT_EQ(ProcessStatus::Cancelled, result.status);
+    EXPECT_LT(std::chrono::steady_clock::now() - start,
+              std::chrono::seconds(20));
+  }
+
+  TEST(SpawnServerTest, serverExit) {
+    SpawnServerScope server;
+    CapturingDelegate delegate;
+    auto result = runCommand(delegate, {"/bin/sh", "-c", "echo $PPID"});
+    ASSERT_EQ(ProcessStatus::Succeeded, result.status);
+    pid_t serverPID = atoi(delegate.output.c_str());
+    ASSERT_GT(serverPID, 0);
+
+    // Processes are launched directly once the server has gone away.
+    ASSERT_EQ(0, ::kill(serverPID, SIGKILL));
+    ASSERT_EQ(serverPID, ::waitpid(serverPID, nullptr, 0));
+    EXPECT_FALSE(isSpawnServerRunning());
+    delegate.output.clear();
+    result = runCommand(delegate, {"/bin/sh", "-c", "echo $PPID"});
+    EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+    EXPECT_EQ(std::to_string(::getpid()) + "\n", delegate.output);
+  }
+
+  TEST(SpawnServerTest, resourceUsage) {
+    SpawnServerScope server;
+    CapturingDelegate delegate;
+    auto result = runCommand(
+        delegate, {"/bin/sh", "-c", "i=0; while [ $i -lt 20000 ]; do "
+                   "i=$((i+1)); done"});
+    EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+    EXPECT_GT(result.utime + result.stime, 0u);
+    EXPECT_GT(result.maxrss, 0u);
+  }
+
+  TEST(SpawnServerTest, largeCommandLine) {
+    // Each argument is kept under the system limit on a single argument, but
+    // together they are far larger than a single request datagram can be.
+    const unsigned numArgs = 8;
+    const size_t argSize = 64 << 10;
+    std::vector<std::string> argsStorage;
+    std::vector<StringRef> commandLine{
+      "/bin/sh", "-c", "echo $# ${#1} $PPID", "sh" };
+    for (unsigned i = 0; i != numArgs; ++i)
+      argsStorage.push_back(std::string(argSize, 'a' + i));
+    for (const auto& arg: argsStorage)
+      commandLine.push_back(arg);
+
+    SpawnServerScope server;
+    CapturingDelegate delegate;
+    auto result = runCommand(delegate, commandLine);
+    EXPECT_EQ("", delegate.errors);
+    EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+
+    // The process was launched by the server.
+    unsigned count = 0, size = 0;
+    pid_t parent = 0;
+    ASSERT_EQ(3, sscanf(delegate.output.c_str(), "%u %u %d", &count, &size,
+                        &parent));
+    EXPECT_EQ(numArgs, count);
+    EXPECT_EQ(argSize, size);
+    EXPECT_NE(::getpid(), parent);
+  }
+
+  TEST(SpawnServerTest, scheduling) {
+    SpawnServerScope server;
+    ProcessAttributes attributes{true};
+    attributes.qualityOfService = QualityOfService::Background;
+    attributes.cpu = sched_getcpu();
+
+    // The attributes are applied before the process is created, so they are
+    // inherited by the processes it starts straight away (which report their
+    // own nice value, scheduling policy and allowed CPUs here).
+    CapturingDelegate delegate;
+    auto result = runCommand(
+        delegate, {"/bin/sh", "-c",
+                   "sed 's/.*) //' /proc/self/stat | cut -d' ' -f17,39; "
+                   "grep Cpus_allowed_list /proc/self/status | cut -f2"},
+        {}, attributes);
+    EXPECT_EQ("", delegate.errors);
+    EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+    EXPECT_EQ(std::string("19 ") + std::to_string(SCHED_IDLE) + "\n" +
+                std::to_string(attributes.cpu) + "\n",
+              delegate.output);
+  }
+
+  /// Measure the rate at which processes can be spawned.
+  double measureSpawnRate(unsigned numProcesses) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i != numProcesses; ++i) {
+      CapturingDelegate delegate;
+      auto result = runCommand(delegate, {"/bin/true"});
+      EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+    }
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    return numProcesses / elapsed.count();
+  }
+
+  TEST(SpawnServerTest, spawnRate) {
+    const unsigned numProcesses = 200;
+
+    // Start the server while we are small, and then grow, as a build client
+    // does once it has loaded its build description and database.
+    SpawnServerScope server;
+    const size_t heapSize = 256 << 20;
+    std::unique_ptr<char[]> heap(new char[heapSize]);
+    memset(heap.get(), 1, heapSize);
+
+    double serverRate = measureSpawnRate(numProcesses);
+
+    stopSpawnServer();
+    double directRate = measureSpawnRate(numProcesses);
+
+    fprintf(stderr, "note: spawned %.0f processes/sec directly, and %.0f "
+            "processes/sec using the spawn server\n", directRate, serverRate);
+  }
+}
+
+#endif
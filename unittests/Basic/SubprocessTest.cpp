@@ -0,0 +1,185 @@
+//===- unittests/Basic/SubprocessTest.cpp ---------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/Subprocess.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+
+#include "gtest/gtest.h"
+
+#include <future>
+#include <mutex>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+using namespace llbuild;
+using namespace llbuild::basic;
+
+#if !defined(_WIN32)
+
+namespace {
+  class CapturingDelegate : public ProcessDelegate {
+  public:
+    std::mutex mutex;
+    std::vector<std::string> outputs;
+    std::string errors;
+
+    virtual void processStarted(ProcessContext*, ProcessHandle) override {}
+    virtual void processHadError(ProcessContext*, ProcessHandle,
+                                 const Twine& message) override {
+      std::lock_guard<std::mutex> guard(mutex);
+      errors += message.str();
+    }
+    virtual void processHadOutput(ProcessContext*, ProcessHandle,
+                                  StringRef data) override {
+      std::lock_guard<std::mutex> guard(mutex);
+      outputs.push_back(data);
+    }
+    virtual void processFinished(ProcessContext*, ProcessHandle,
+                                 const ProcessResult&) override {}
+
+    std::string getOutput() {
+      std::string result;
+      for (const auto& output: outputs)
+        result += output;
+      return result;
+    }
+  };
+
+  /// Run a shell command, and return its result.
+  ProcessResult runCommand(CapturingDelegate& delegate, StringRef command,
+                           bool async, ProcessAttributes attributes = {true}) {
+    ProcessGroup pgrp;
+    POSIXEnvironment environment;
+    environment.setIfMissing("PATH", "/usr/bin:/bin");
+    std::vector<StringRef> commandLine{ "/bin/sh", "-c", command };
+    std::promise<ProcessResult> promise;
+    ProcessCompletionFn completionFn = [&promise](ProcessResult result) {
+      promise.set_value(result);
+    };
+    if (async) {
+      spawnProcessAsync(delegate, nullptr, pgrp, ProcessHandle{0},
+                        commandLine, environment, attributes, {},
+                        std::move(completionFn));
+    } else {
+      spawnProcess(delegate, nullptr, pgrp, ProcessHandle{0}, commandLine,
+                   environment, attributes,
+                   [](std::function<void()>&& processWait) { processWait(); },
+                   std::move(completionFn));
+    }
+    return promise.get_future().get();
+  }
+
+  void testOutputCoalescing(bool async) {
+    // Many small writes are delivered together.
+    {
+      CapturingDelegate delegate;
+      auto result = runCommand(
+          delegate, "i=0; while [ $i -lt 2000 ]; do echo line$i; i=$((i+1)); "
+          "done", async);
+      EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+      EXPECT_EQ("", delegate.errors);
+      std::string output = delegate.getOutput();
+      EXPECT_EQ(0u, output.find("line0\n"));
+      EXPECT_NE(std::string::npos, output.find("line1999\n"));
+      EXPECT_EQ(output.size(), result.outputSize);
+      EXPECT_LT(delegate.outputs.size(), 2000u / 4);
+    }
+
+    // Output is not held back while the process is quiet.
+    {
+      CapturingDelegate delegate;
+      auto result = runCommand(delegate, "echo a; sleep 0.5; echo b", async);
+      EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+      ASSERT_EQ(2u, delegate.outputs.size());
+      EXPECT_EQ("a\n", delegate.outputs[0]);
+      EXPECT_EQ("b\n", delegate.outputs[1]);
+    }
+
+    // Large output is delivered in bounded pieces.
+    {
+      CapturingDelegate delegate;
+      auto result = runCommand(delegate, "head -c 1000000 /dev/zero", async);
+      EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+      EXPECT_EQ(1000000u, delegate.getOutput().size());
+      for (const auto& output: delegate.outputs)
+        EXPECT_LE(output.size(), 65536u);
+    }
+  }
+
+  TEST(SubprocessTest, outputCoalescing) {
+    testOutputCoalescing(/*async=*/false);
+  }
+
+  TEST(SubprocessTest, outputCoalescingAsync) {
+    if (!isProcessReactorSupported())
+      return;
+    testOutputCoalescing(/*async=*/true);
+  }
+
+#if defined(__linux__)
+  /// Run a shell command with the given attributes, and return the nice
+  /// value, scheduling policy and allowed CPUs of the shell.
+  std::string getProcessScheduling(ProcessAttributes attributes) {
+    // The attributes are applied once the process is launched.
+    CapturingDelegate delegate;
+    auto result = runCommand(
+        delegate, "sleep 0.1; set -- $(cat /proc/$$/stat | sed 's/.*) //'); "
+        "shift 16; nice=$1; shift 22; echo $nice $1 "
+        "$(grep Cpus_allowed_list /proc/$$/status | cut -f2)",
+        /*async=*/false, attributes);
+    EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+    EXPECT_EQ("", delegate.errors);
+    return delegate.getOutput();
+  }
+
+  TEST(SubprocessTest, qualityOfService) {
+    std::string normal = getProcessScheduling({true});
+
+    ProcessAttributes attributes{true};
+    attributes.qualityOfService = QualityOfService::Utility;
+    EXPECT_EQ(0u, getProcessScheduling(attributes).find(
+                      std::string("10 ") + std::to_string(SCHED_BATCH) + " "));
+
+    attributes.qualityOfService = QualityOfService::Background;
+    EXPECT_EQ(0u, getProcessScheduling(attributes).find(
+                      std::string("19 ") + std::to_string(SCHED_IDLE) + " "));
+
+    // Higher levels leave the process unchanged.
+    attributes.qualityOfService = QualityOfService::UserInitiated;
+    EXPECT_EQ(normal, getProcessScheduling(attributes));
+
+    // Processes can be pinned to a CPU.
+    attributes = ProcessAttributes{true};
+    attributes.cpu = sched_getcpu();
+    EXPECT_EQ(normal.substr(0, normal.rfind(' ')) + " " +
+                std::to_string(attributes.cpu) + "\n",
+              getProcessScheduling(attributes));
+  }
+
+  TEST(SubprocessTest, peakMemory) {
+    // The peak RSS is reported in bytes.
+    CapturingDelegate delegate;
+    auto result = runCommand(
+        delegate, "grep VmHWM /proc/$$/status | tr -dc 0-9", /*async=*/false);
+    EXPECT_EQ(ProcessStatus::Succeeded, result.status);
+    uint64_t peakKB = std::stoull(delegate.getOutput());
+    EXPECT_GT(peakKB, 0u);
+    EXPECT_GE(result.maxrss, peakKB * 1024);
+  }
+#endif
+}
+
+#endif
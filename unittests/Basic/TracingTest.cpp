@@ -0,0 +1,92 @@
+//===- unittests/Basic/TracingTest.cpp ------------------------------------===//
+//
+// This source file is part of the Swift.org open source project
+//
+// Copyright (c) 2019 Apple Inc. and the Swift project authors
+// Licensed under Apache License v2.0 with Runtime Library Exception
+//
+// See http://swift.org/LICENSE.txt for license information
+// See http://swift.org/CONTRIBUTORS.txt for the list of Swift project authors
+//
+//===----------------------------------------------------------------------===//
+
+#include "llbuild/Basic/LLVM.h"
+#include "llbuild/Basic/Tracing.h"
+#include "../BuildSystem/TempDir.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+using namespace llbuild;
+
+#if defined(LLBUILD_TRACING_TRACE_EVENTS)
+
+namespace {
+
+TEST(TracingTest, writeEvents) {
+  TmpDir tempDir{"TracingTest"};
+  std::string path = tempDir.str() + "/trace.json";
+  ::setenv("LLBUILD_TRACE_EVENTS", path.c_str(), 1);
+  bool wasEnabled = TracingEnabled;
+  TracingEnabled = true;
+
+  // Record events on this thread, and on another which exits before the events
+  // are written.
+  {
+    TracingExecutionQueueJob job(3, "compile \"a.c\"");
+    TracingExecutionQueueDepth(7);
+  }
+  std::thread([]() {
+    std::string key(100, 'k');
+    TracingEngineQueueItemEvent event(EngineQueueItemKind::ReadyTask,
+                                      key.c_str());
+    TracingExecutionQueueSubprocessResult(1, -1, 10, 20, 30);
+  }).join();
+
+  std::string error;
+  ASSERT_TRUE(TracingWriteEvents(&error)) << error;
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  ASSERT_TRUE(bool(buffer));
+
+  // Only the events recorded since are written the next time.
+  TracingExecutionQueueDepth(9);
+  ASSERT_TRUE(TracingWriteEvents(&error)) << error;
+  TracingEnabled = wasEnabled;
+  ::unsetenv("LLBUILD_TRACE_EVENTS");
+  auto nextBuffer = llvm::MemoryBuffer::getFile(path);
+  ASSERT_TRUE(bool(nextBuffer));
+  StringRef nextContents = (*nextBuffer)->getBuffer();
+  EXPECT_NE(StringRef::npos, nextContents.find("\"args\":{\"depth\":9}"));
+  EXPECT_EQ(StringRef::npos, nextContents.find("\"args\":{\"depth\":7}"));
+  EXPECT_EQ(StringRef::npos, nextContents.find("execution_queue_job"));
+
+  StringRef contents = (*buffer)->getBuffer();
+  EXPECT_TRUE(contents.startswith("{\"traceEvents\":["));
+  EXPECT_TRUE(contents.endswith("\"droppedEvents\":0}}\n"));
+
+  // Arguments are labelled as in their format, and strings are escaped.
+  EXPECT_NE(StringRef::npos, contents.find(
+      "\"name\":\"execution_queue_job\",\"cat\":\"llbuild\",\"ph\":\"B\""));
+  EXPECT_NE(StringRef::npos, contents.find(
+      "\"args\":{\"lane\":3,\"command\":\"compile \\\"a.c\\\"\"}"));
+  EXPECT_NE(StringRef::npos, contents.find(
+      "\"name\":\"execution_queue_job\",\"cat\":\"llbuild\",\"ph\":\"E\""));
+  EXPECT_NE(StringRef::npos, contents.find("\"args\":{\"depth\":7}"));
+  EXPECT_NE(StringRef::npos, contents.find(
+      "\"args\":{\"lane\":1,\"pid\":-1,\"utime\":10,\"stime\":20,"
+      "\"maxrss\":30}"));
+
+  // Long strings are truncated.
+  EXPECT_NE(StringRef::npos, contents.find(
+      "{\"key\":\"" + std::string(60, 'k') + "\",\"kind\":3}"));
+}
+
+}
+
+#endif
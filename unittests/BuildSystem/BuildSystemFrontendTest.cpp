@@ -16,10 +16,12 @@
 #include "llbuild/BuildSystem/BuildDescription.h"
 #include "llbuild/BuildSystem/BuildFile.h"
 #include "llbuild/BuildSystem/BuildKey.h"
+#include "llbuild/BuildSystem/BuildSystem.h"
 #include "llbuild/BuildSystem/BuildSystemFrontend.h"
 
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Path.h"
@@ -27,9 +29,14 @@
 
 #include "gtest/gtest.h"
 
+#include <chrono>
 #include <unordered_set>
 #include <mutex>
 
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
 using namespace llbuild;
 using namespace llbuild::basic;
 using namespace llbuild::buildsystem;
@@ -512,6 +519,240 @@ client:
 }
 
 
+TEST_F(BuildSystemFrontendTest, largeCommandOutput) {
+  // The output is large enough to be spilled to a temporary file.
+  writeBuildFile(R"END(
+client:
+  name: client
+
+targets:
+  "": ["<output>"]
+
+commands:
+  output:
+    tool: shell
+    outputs: ["<output>"]
+    args: head -c 3000000 /dev/zero | tr '\0' x; echo end
+)END");
+
+  TestBuildSystemFrontendDelegate delegate(sourceMgr, invocation);
+  BuildSystemFrontend frontend(delegate, invocation, createLocalFileSystem());
+
+  testing::internal::CaptureStdout();
+  bool result = frontend.build("");
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_TRUE(result);
+  EXPECT_NE(std::string::npos,
+            output.find(std::string(3000000, 'x') + "end\n"));
+}
+
+/// Get a build file which copies \arg in to \arg a, and then \arg a twice to
+/// \arg b.
+std::string getCopyingBuildFile(StringRef in, StringRef a, StringRef b) {
+  return (R"END(
+client:
+  name: client
+
+targets:
+  "": [")END" + b + R"END("]
+
+commands:
+  C1:
+    tool: shell
+    inputs: [")END" + in + R"END("]
+    outputs: [")END" + a + R"END("]
+    args: cp )END" + in + " " + a + R"END(
+  C2:
+    tool: shell
+    inputs: [")END" + a + R"END("]
+    outputs: [")END" + b + R"END("]
+    args: cat )END" + a + " " + a + " > " + b + "\n").str();
+}
+
+TEST_F(BuildSystemFrontendTest, statCache) {
+  // The second command reads the output of the first, and both are rebuilt
+  // once the input changes.
+  std::string in = tempDir.str() + "/in";
+  std::string a = tempDir.str() + "/out/a";
+  std::string b = tempDir.str() + "/out/b";
+  writeBuildFile(getCopyingBuildFile(in, a, b));
+
+  auto writeInput = [&](StringRef contents) {
+    std::error_code ec;
+    raw_fd_ostream os(in, ec, llvm::sys::fs::F_Text);
+    ASSERT_FALSE(ec);
+    os << contents;
+  };
+  auto readOutput = [&]() -> std::string {
+    auto buffer = llvm::MemoryBuffer::getFile(b);
+    return buffer ? (*buffer)->getBuffer().str() : "";
+  };
+
+  invocation.useStatCache = true;
+  TestBuildSystemFrontendDelegate delegate(sourceMgr, invocation);
+  BuildSystemFrontend frontend(delegate, invocation, createLocalFileSystem());
+
+  writeInput("x\n");
+  ASSERT_TRUE(frontend.build(""));
+  EXPECT_EQ("x\nx\n", readOutput());
+  auto* statCache = frontend.getBuildSystem()->getStatCache();
+  ASSERT_TRUE(statCache);
+  EXPECT_EQ(2u, statCache->getNumInvalidations());
+
+  // A null build reuses the information read for each path.
+  auto numHits = statCache->getNumHits();
+  ASSERT_TRUE(frontend.build(""));
+  EXPECT_EQ(2u, statCache->getNumInvalidations());
+
+  writeInput("yy\n");
+  ASSERT_TRUE(frontend.build(""));
+  EXPECT_EQ("yy\nyy\n", readOutput());
+  EXPECT_EQ(4u, statCache->getNumInvalidations());
+  EXPECT_GT(statCache->getNumHits(), numHits);
+}
+
+#if !defined(_WIN32)
+TEST_F(BuildSystemFrontendTest, compareContents) {
+  std::string in = tempDir.str() + "/in";
+  std::string out = tempDir.str() + "/out";
+  std::string log = tempDir.str() + "/log";
+  writeBuildFile(R"END(
+client:
+  name: client
+
+targets:
+  "": [")END" + out + R"END("]
+
+nodes:
+  ")END" + in + R"END(":
+    compare-contents: true
+
+commands:
+  C1:
+    tool: shell
+    inputs: [")END" + in + R"END("]
+    outputs: [")END" + out + R"END("]
+    args: cp )END" + in + " " + out + " && echo run >> " + log + "\n");
+
+  auto writeInput = [&](StringRef contents) {
+    std::error_code ec;
+    raw_fd_ostream os(in, ec, llvm::sys::fs::F_Text);
+    ASSERT_FALSE(ec);
+    os << contents;
+  };
+  auto getNumRuns = [&]() -> size_t {
+    auto buffer = llvm::MemoryBuffer::getFile(log);
+    return buffer ? (*buffer)->getBuffer().count('\n') : 0;
+  };
+  auto build = [&]() {
+    TestBuildSystemFrontendDelegate delegate(sourceMgr, invocation);
+    BuildSystemFrontend frontend(delegate, invocation, createLocalFileSystem());
+    ASSERT_TRUE(frontend.build(""));
+  };
+
+  writeInput("x\n");
+  build();
+  EXPECT_EQ(1u, getNumRuns());
+
+  // Rewriting the input with the same contents (and an older timestamp) does
+  // not rerun the command.
+  writeInput("x\n");
+  {
+    int fd;
+    ASSERT_FALSE(llvm::sys::fs::openFileForWrite(
+                     in, fd, llvm::sys::fs::CD_OpenExisting,
+                     llvm::sys::fs::F_Append));
+    auto time = std::chrono::time_point_cast<llvm::sys::TimePoint<>::duration>(
+        std::chrono::system_clock::now() - std::chrono::seconds(100));
+    EXPECT_FALSE(llvm::sys::fs::setLastModificationAndAccessTime(fd, time));
+    ::close(fd);
+  }
+  build();
+  EXPECT_EQ(1u, getNumRuns());
+
+  // The digest was saved for the next build.
+  EXPECT_TRUE(llvm::sys::fs::exists(tempDir.str() + "/build.db.digests"));
+
+  writeInput("yy\n");
+  build();
+  EXPECT_EQ(2u, getNumRuns());
+}
+#endif
+
+#if defined(__linux__)
+TEST_F(BuildSystemFrontendTest, watchFiles) {
+  std::string in = tempDir.str() + "/in";
+  std::string a = tempDir.str() + "/out/a";
+  std::string b = tempDir.str() + "/out/b";
+  writeBuildFile(getCopyingBuildFile(in, a, b));
+
+  auto writeInput = [&](StringRef contents) {
+    std::error_code ec;
+    raw_fd_ostream os(in, ec, llvm::sys::fs::F_Text);
+    ASSERT_FALSE(ec);
+    os << contents;
+  };
+  auto readOutput = [&]() -> std::string {
+    auto buffer = llvm::MemoryBuffer::getFile(b);
+    return buffer ? (*buffer)->getBuffer().str() : "";
+  };
+
+  invocation.useFileWatcher = true;
+  TestBuildSystemFrontendDelegate delegate(sourceMgr, invocation);
+  BuildSystemFrontend frontend(delegate, invocation, createLocalFileSystem());
+
+  writeInput("x\n");
+  ASSERT_TRUE(frontend.build(""));
+  EXPECT_EQ("x\nx\n", readOutput());
+  auto* statCache = frontend.getBuildSystem()->getStatCache();
+  ASSERT_TRUE(statCache);
+
+  // Once the changes made by the commands are seen, null builds examine no
+  // paths at all.
+  ASSERT_TRUE(frontend.build(""));
+  auto numMisses = statCache->getNumMisses();
+  ASSERT_TRUE(frontend.build(""));
+  EXPECT_EQ(numMisses, statCache->getNumMisses());
+
+  writeInput("yy\n");
+  ASSERT_TRUE(frontend.build(""));
+  EXPECT_EQ("yy\nyy\n", readOutput());
+  EXPECT_EQ(0u, statCache->getNumRescans());
+}
+#endif
+
+
+#if defined(__linux__)
+TEST_F(BuildSystemFrontendTest, qualityOfService) {
+  // The level is applied once the process is launched, so check it after a
+  // short delay.
+  writeBuildFile(R"END(
+client:
+  name: client
+
+targets:
+  "": ["<output>"]
+
+commands:
+  output:
+    tool: shell
+    outputs: ["<output>"]
+    qos: background
+    args: sleep 0.1; set -- $(sed 's/.*) //' /proc/$$/stat); echo nice=${17}
+)END");
+
+  TestBuildSystemFrontendDelegate delegate(sourceMgr, invocation);
+  BuildSystemFrontend frontend(delegate, invocation, createLocalFileSystem());
+
+  testing::internal::CaptureStdout();
+  bool result = frontend.build("");
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_TRUE(result);
+  EXPECT_NE(std::string::npos, output.find("nice=19\n")) << output;
+}
+#endif
+
+
 TEST(BuildSystemInvocationTest, formatCycle) {
   BuildSystemInvocation invocation;
 
@@ -14,6 +14,7 @@
 #include "TempDir.h"
 
 #include "llbuild/Basic/LLVM.h"
+#include "llbuild/BuildSystem/ActionCache.h"
 #include "llbuild/BuildSystem/BuildDescription.h"
 #include "llbuild/BuildSystem/BuildFile.h"
 #include "llbuild/BuildSystem/BuildKey.h"
@@ -22,6 +23,7 @@
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -500,6 +502,255 @@ commands:
 #endif
 }
 
+// Check that command outputs are restored from the action cache when the
+// inputs return to previously built contents (e.g., after a branch switch).
+TEST(BuildSystemTaskTests, actionCache) {
+  TmpDir tempDir(__func__);
+
+  SmallString<256> inputFile{ tempDir.str() };
+  sys::path::append(inputFile, "input.txt");
+  SmallString<256> outputFile{ tempDir.str() };
+  sys::path::append(outputFile, "output.txt");
+  SmallString<256> cachePath{ tempDir.str() };
+  sys::path::append(cachePath, "cache");
+  SmallString<256> builddb{ tempDir.str() };
+  sys::path::append(builddb, "build.db");
+
+  SmallString<256> manifest{ tempDir.str() };
+  sys::path::append(manifest, "manifest.llbuild");
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(manifest, ec, llvm::sys::fs::F_Text);
+    assert(!ec);
+
+    os <<
+    "client:\n"
+    "  name: mock\n"
+    "\n"
+    "commands:\n"
+    "  C.1:\n"
+    "    tool: shell\n"
+    "    inputs: [\"" << inputFile << "\"]\n"
+    "    outputs: [\"" << outputFile << "\"]\n"
+    "    args: cp " << inputFile << " " << outputFile << "\n";
+  }
+
+  auto writeInput = [&](StringRef contents) {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(inputFile, ec, llvm::sys::fs::F_Text);
+    assert(!ec);
+    os << contents;
+  };
+  auto readOutput = [&]() -> std::string {
+    auto buffer = llvm::MemoryBuffer::getFile(outputFile);
+    return buffer ? buffer.get()->getBuffer().str() : "";
+  };
+  auto build = [&](uint64_t& numHits) {
+    MockBuildSystemDelegate delegate(/*trackAllMessages=*/true);
+    BuildSystem system(delegate, createLocalFileSystem());
+    system.attachDB(builddb.c_str(), nullptr);
+    std::string error;
+    EXPECT_TRUE(system.enableActionCache(cachePath, tempDir.str(),
+                                         /*useHardLinks=*/true, &error));
+    EXPECT_TRUE(system.loadDescription(manifest));
+    auto result = system.build(BuildKey::makeCommand("C.1"));
+    EXPECT_TRUE(result.hasValue() && result->isSuccessfulCommand());
+    numHits = system.getActionCache()->getNumHits();
+    return delegate.getMessages();
+  };
+
+  uint64_t numHits;
+  writeInput("first");
+  ASSERT_EQ(std::vector<std::string>({
+    "commandPreparing(C.1)",
+    "commandActionCacheLookup(C.1: miss)",
+    "commandStarted(C.1)",
+    "commandFinished(C.1: 0)",
+  }), build(numHits));
+  ASSERT_EQ(0U, numHits);
+  ASSERT_EQ("first", readOutput());
+
+  writeInput("second, longer");
+  ASSERT_EQ(std::vector<std::string>({
+    "commandPreparing(C.1)",
+    "commandActionCacheLookup(C.1: miss)",
+    "commandStarted(C.1)",
+    "commandFinished(C.1: 0)",
+  }), build(numHits));
+  ASSERT_EQ("second, longer", readOutput());
+
+  // Switching back to the original input should restore the output without
+  // running the command.
+  writeInput("first");
+  ASSERT_EQ(std::vector<std::string>({
+    "commandPreparing(C.1)",
+    "commandActionCacheLookup(C.1: hit)",
+  }), build(numHits));
+  ASSERT_EQ(1U, numHits);
+  ASSERT_EQ("first", readOutput());
+
+  // The restored result should be recorded in the database, so a null build
+  // does nothing.
+  ASSERT_EQ(std::vector<std::string>({}), build(numHits));
+}
+
+// Check that checkouts of a tree at different paths share the action cache.
+TEST(BuildSystemTaskTests, actionCacheAcrossCheckouts) {
+  TmpDir tempDir(__func__);
+
+  SmallString<256> cachePath{ tempDir.str() };
+  sys::path::append(cachePath, "cache");
+
+  // Build the same command, with absolute paths, in the given checkout.
+  auto build = [&](StringRef checkout, uint64_t& numHits) {
+    SmallString<256> root{ tempDir.str() };
+    sys::path::append(root, checkout);
+    SmallString<256> inputFile{ root };
+    sys::path::append(inputFile, "input.txt");
+    SmallString<256> outputFile{ root };
+    sys::path::append(outputFile, "output.txt");
+    SmallString<256> manifest{ root };
+    sys::path::append(manifest, "manifest.llbuild");
+    SmallString<256> builddb{ root };
+    sys::path::append(builddb, "build.db");
+    (void) sys::fs::create_directories(root);
+    {
+      std::error_code ec;
+      llvm::raw_fd_ostream os(inputFile, ec, llvm::sys::fs::F_Text);
+      assert(!ec);
+      os << "contents";
+    }
+    {
+      std::error_code ec;
+      llvm::raw_fd_ostream os(manifest, ec, llvm::sys::fs::F_Text);
+      assert(!ec);
+
+      os <<
+      "client:\n"
+      "  name: mock\n"
+      "\n"
+      "commands:\n"
+      "  C.1:\n"
+      "    tool: shell\n"
+      "    inputs: [\"" << inputFile << "\"]\n"
+      "    outputs: [\"" << outputFile << "\"]\n"
+      "    args: cp " << inputFile << " " << outputFile << "\n";
+    }
+
+    MockBuildSystemDelegate delegate(/*trackAllMessages=*/true);
+    BuildSystem system(delegate, createLocalFileSystem());
+    system.attachDB(builddb.c_str(), nullptr);
+    std::string error;
+    EXPECT_TRUE(system.enableActionCache(cachePath, root,
+                                         /*useHardLinks=*/false, &error));
+    EXPECT_TRUE(system.loadDescription(manifest));
+    auto result = system.build(BuildKey::makeCommand("C.1"));
+    EXPECT_TRUE(result.hasValue() && result->isSuccessfulCommand());
+    numHits = system.getActionCache()->getNumHits();
+
+    auto buffer = llvm::MemoryBuffer::getFile(outputFile);
+    EXPECT_EQ("contents", buffer ? buffer.get()->getBuffer().str() : "");
+    return delegate.getMessages();
+  };
+
+  uint64_t numHits;
+  ASSERT_EQ(std::vector<std::string>({
+    "commandPreparing(C.1)",
+    "commandActionCacheLookup(C.1: miss)",
+    "commandStarted(C.1)",
+    "commandFinished(C.1: 0)",
+  }), build("first", numHits));
+  ASSERT_EQ(0U, numHits);
+
+  // A second checkout restores the output built by the first.
+  ASSERT_EQ(std::vector<std::string>({
+    "commandPreparing(C.1)",
+    "commandActionCacheLookup(C.1: hit)",
+  }), build("second", numHits));
+  ASSERT_EQ(1U, numHits);
+}
+
+// Check that the parent directories of outputs are only created once per
+// build, without needing the stat cache.
+TEST(BuildSystemTaskTests, knownOutputDirectories) {
+  TmpDir tempDir(__func__);
+
+  SmallString<256> outputDir{ tempDir.str() };
+  sys::path::append(outputDir, "out");
+  SmallString<256> manifest{ tempDir.str() };
+  sys::path::append(manifest, "manifest.llbuild");
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(manifest, ec, llvm::sys::fs::F_Text);
+    assert(!ec);
+
+    os <<
+    "client:\n"
+    "  name: mock\n"
+    "\n"
+    "targets:\n"
+    "  \"\": [\"<all>\"]\n"
+    "\n"
+    "commands:\n";
+    for (int i = 0; i != 3; ++i) {
+      os <<
+      "  C" << i << ":\n"
+      "    tool: shell\n"
+      "    outputs: [\"" << outputDir << "/" << i << "\", \"<C" << i << ">\"]\n"
+      "    args: touch " << outputDir << "/" << i << "\n";
+    }
+    os <<
+    "  all:\n"
+    "    tool: phony\n"
+    "    inputs: [\"<C0>\", \"<C1>\", \"<C2>\"]\n"
+    "    outputs: [\"<all>\"]\n";
+  }
+
+  MockBuildSystemDelegate delegate(/*trackAllMessages=*/true);
+  BuildSystem system(delegate, createLocalFileSystem());
+  ASSERT_EQ(nullptr, system.getStatCache());
+  ASSERT_TRUE(system.loadDescription(manifest));
+  EXPECT_TRUE(system.build(""));
+  EXPECT_EQ(2U, system.getDirectoryCache().getNumHits());
+  EXPECT_TRUE(sys::fs::exists(outputDir + "/2"));
+}
+
+TEST(BuildSystemTaskTests, memoryAttribute) {
+  TmpDir tempDir(__func__);
+
+  // Load a manifest declaring the given memory use for a command, and return
+  // whether it was accepted.
+  auto loadWithMemory = [&](StringRef memory) {
+    SmallString<256> manifest{ tempDir.str() };
+    sys::path::append(manifest, "manifest.llbuild");
+    {
+      std::error_code ec;
+      llvm::raw_fd_ostream os(manifest, ec, llvm::sys::fs::F_Text);
+      assert(!ec);
+
+      os <<
+      "client:\n"
+      "  name: mock\n"
+      "\n"
+      "commands:\n"
+      "  C1:\n"
+      "    tool: shell\n"
+      "    outputs: [\"<C1>\"]\n"
+      "    args: true\n"
+      "    memory: " << memory << "\n";
+    }
+
+    MockBuildSystemDelegate delegate;
+    BuildSystem system(delegate, createLocalFileSystem());
+    return system.loadDescription(manifest);
+  };
+
+  EXPECT_TRUE(loadWithMemory("512M"));
+  EXPECT_TRUE(loadWithMemory("16777215G"));
+  EXPECT_FALSE(loadWithMemory("17179869184G"));
+  EXPECT_FALSE(loadWithMemory("18446744073709551616"));
+}
+
 // Tests the behaviour of StaleFileRemovalTool
 TEST(BuildSystemTaskTests, staleFileRemoval) {
   TmpDir tempDir(__func__);
@@ -973,6 +1224,78 @@ commands:
   ASSERT_FALSE(std::find(messages.begin(), messages.end(), "cannot remove stale file '" + linkFileList + "': No such file or directory") != messages.end());
 }
 
+TEST(BuildSystemTaskTests, staleFileRemovalNested) {
+  TmpDir tempDir(__func__);
+  std::string dir = tempDir.str() + "/dir";
+  std::string other = tempDir.str() + "/other";
+  std::string kept = tempDir.str() + "/kept";
+  ASSERT_FALSE(llvm::sys::fs::create_directories(dir + "/subdir"));
+  for (const auto& path: { dir + "/a", dir + "/subdir/b", other, kept }) {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_Text);
+    ASSERT_FALSE(ec);
+  }
+
+  SmallString<256> manifest{ tempDir.str() };
+  sys::path::append(manifest, "manifest.llbuild");
+  auto writeManifest = [&](StringRef expectedOutputs) {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(manifest, ec, llvm::sys::fs::F_Text);
+    assert(!ec);
+
+    os << R"END(
+client:
+  name: mock
+
+commands:
+    C.1:
+      tool: stale-file-removal
+      description: STALE-FILE-REMOVAL
+      expectedOutputs: [)END" << expectedOutputs << R"END(]
+      roots: [")END" << tempDir.str() << R"END("]
+)END";
+  };
+  writeManifest("\"" + dir + "\", \"" + dir + "/a\", \"" + dir +
+                "/subdir\", \"" + dir + "/subdir/b\", \"" + other + "\", \"" +
+                kept + "\", \"" + tempDir.str() + "/missing\"");
+
+  auto keyToBuild = BuildKey::makeCommand("C.1");
+
+  SmallString<256> builddb{ tempDir.str() };
+  sys::path::append(builddb, "build.db");
+
+  {
+    MockBuildSystemDelegate delegate(/*trackAllMessages=*/true);
+    BuildSystem system(delegate, createLocalFileSystem());
+    system.attachDB(builddb.c_str(), nullptr);
+    ASSERT_TRUE(system.loadDescription(manifest));
+    auto result = system.build(keyToBuild);
+    ASSERT_TRUE(result.hasValue());
+    ASSERT_EQ(7UL, result.getValue().getStaleFileList().size());
+  }
+
+  // The directory is removed along with everything beneath it, which is not
+  // reported separately, and missing files are not reported at all.
+  writeManifest("\"" + kept + "\"");
+  MockBuildSystemDelegate delegate(/*trackAllMessages=*/true);
+  BuildSystem system(delegate, createLocalFileSystem());
+  system.attachDB(builddb.c_str(), nullptr);
+  ASSERT_TRUE(system.loadDescription(manifest));
+  auto result = system.build(keyToBuild);
+  ASSERT_TRUE(result.hasValue());
+
+  EXPECT_FALSE(llvm::sys::fs::exists(dir));
+  EXPECT_FALSE(llvm::sys::fs::exists(other));
+  EXPECT_TRUE(llvm::sys::fs::exists(kept));
+  ASSERT_EQ(std::vector<std::string>({
+    "commandPreparing(C.1)",
+    "commandStarted(C.1)",
+    "commandNote(C.1) Removed stale file '" + dir + "'\n",
+    "commandNote(C.1) Removed stale file '" + other + "'\n",
+    "commandFinished(C.1: 0)",
+  }), delegate.getMessages());
+}
+
 TEST(BuildSystemTaskTests, staleFileRemovalPathIsPrefixedByPath) {
   ASSERT_TRUE(pathIsPrefixedByPath("/foo/bar", "/foo"));
   ASSERT_TRUE(pathIsPrefixedByPath("/foo", "/foo"));
@@ -151,6 +151,15 @@ public:
     }
   }
 
+  virtual void commandActionCacheLookup(Command* command, bool hit) {
+    if (trackAllMessages) {
+      std::unique_lock<std::mutex> lock(messagesMutex);
+      messages.push_back(
+          ("commandActionCacheLookup(" + command->getName() + ": " +
+           (hit ? "hit" : "miss") + ")").str());
+    }
+  }
+
   virtual void commandCannotBuildOutputDueToMissingInputs(Command * command, Node *output,
                                                           SmallPtrSet<Node *, 1> inputs) {
     std::string message = "cannot build '" + output->getName().str() + "' due to missing input: '" +
@@ -109,3 +109,272 @@ TEST(SQLiteBuildDBTest, LockedWhileBuilding) {
   ec = llvm::sys::fs::remove(dbPath.str());
   EXPECT_EQ(bool(ec), false);
 }
+
+namespace {
+
+/// Simple key/ID mapping delegate for exercising the database directly.
+class SimpleBuildDBDelegate : public BuildDBDelegate {
+  std::vector<KeyType> keys;
+
+public:
+  virtual const KeyID getKeyID(const KeyType& key) override {
+    for (KeyID i = 0; i != keys.size(); ++i) {
+      if (keys[i] == key)
+        return i;
+    }
+    keys.push_back(key);
+    return keys.size() - 1;
+  }
+
+  virtual KeyType getKeyForID(const KeyID key) override {
+    return keys[key];
+  }
+};
+
+}
+
+TEST(SQLiteBuildDBTest, ReadableWhileBuildingWithWAL) {
+  // Create a temporary file.
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+  fprintf(stderr, "using db: %s\n", dbPath.c_str());
+
+  std::string error;
+  SimpleBuildDBDelegate delegate;
+  std::unique_ptr<BuildDB> buildDB = createSQLiteBuildDB(
+      dbPath, 1, /* recreateUnmatchedVersion = */ true, &error,
+      SQLiteBuildDBMode::WAL);
+  EXPECT_TRUE(buildDB != nullptr);
+  EXPECT_EQ(error, "");
+  buildDB->attachDelegate(&delegate);
+
+  bool result = buildDB->buildStarted(&error);
+  EXPECT_TRUE(result);
+  EXPECT_EQ(error, "");
+
+  // A read-only connection can be opened (and "started") during the build.
+  SimpleBuildDBDelegate readerDelegate;
+  std::unique_ptr<BuildDB> readerDB = createSQLiteBuildDB(
+      dbPath, 1, /* recreateUnmatchedVersion = */ true, &error,
+      SQLiteBuildDBMode::ReadOnly);
+  EXPECT_TRUE(readerDB != nullptr);
+  readerDB->attachDelegate(&readerDelegate);
+  result = readerDB->buildStarted(&error);
+  EXPECT_TRUE(result);
+  EXPECT_EQ(error, "");
+
+  // Write more results than fit in a single batch.
+  const unsigned numResults = 1500;
+  for (unsigned i = 0; i != numResults; ++i) {
+    Rule rule;
+    rule.key = "key-" + std::to_string(i);
+    Result ruleResult;
+    ruleResult.value = { 1, 2, 3 };
+    ruleResult.builtAt = 1;
+    ruleResult.computedAt = 1;
+    result = buildDB->setRuleResult(delegate.getKeyID(rule.key), rule,
+                                    ruleResult, &error);
+    EXPECT_TRUE(result);
+    EXPECT_EQ(error, "");
+  }
+
+  // The reader observes the committed batch without blocking.
+  std::vector<KeyType> keys;
+  result = readerDB->getKeys(keys, &error);
+  EXPECT_TRUE(result);
+  EXPECT_EQ(error, "");
+  EXPECT_GE(keys.size(), 1000U);
+
+  // The reader cannot modify the database.
+  result = readerDB->setCurrentIteration(10, &error);
+  EXPECT_FALSE(result);
+
+  // Once the build completes, all results are visible.
+  buildDB->buildComplete();
+  readerDB->buildComplete();
+  keys.clear();
+  error.clear();
+  result = readerDB->getKeys(keys, &error);
+  EXPECT_TRUE(result);
+  EXPECT_EQ(keys.size(), numResults);
+
+  // Read-only connections never create (or recreate) a database.
+  std::unique_ptr<BuildDB> mismatchedDB = createSQLiteBuildDB(
+      dbPath, 2, /* recreateUnmatchedVersion = */ true, &error,
+      SQLiteBuildDBMode::ReadOnly);
+  bool success = true;
+  mismatchedDB->getCurrentIteration(&success, &error);
+  EXPECT_FALSE(success);
+
+  // Clean up database connections before unlinking
+  buildDB = nullptr;
+  readerDB = nullptr;
+  mismatchedDB = nullptr;
+
+  ec = llvm::sys::fs::remove(dbPath.str());
+  EXPECT_EQ(bool(ec), false);
+}
+
+TEST(SQLiteBuildDBTest, VisitKeys) {
+  // Create a temporary file.
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+  fprintf(stderr, "using db: %s\n", dbPath.c_str());
+
+  std::string error;
+  SimpleBuildDBDelegate delegate;
+  std::unique_ptr<BuildDB> buildDB = createSQLiteBuildDB(
+      dbPath, 1, /* recreateUnmatchedVersion = */ true, &error);
+  EXPECT_TRUE(buildDB != nullptr);
+  buildDB->attachDelegate(&delegate);
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+
+  // Store results for a few keys, and a key with no result (as a dependency).
+  for (auto name: { "Ca", "Cb", "Nc", "C\xff", "\xff\xff" }) {
+    Rule rule;
+    rule.key = name;
+    Result ruleResult;
+    ruleResult.value = { uint8_t(name[1]) };
+    ruleResult.signature = basic::CommandSignature(uint64_t(7));
+    ruleResult.builtAt = 2;
+    ruleResult.computedAt = 3;
+    if (rule.key == "Cb")
+      ruleResult.dependencies.push_back(delegate.getKeyID("Dx"));
+    EXPECT_TRUE(buildDB->setRuleResult(delegate.getKeyID(rule.key), rule,
+                                       ruleResult, &error));
+    EXPECT_EQ(error, "");
+  }
+
+  // Visit all keys.
+  std::vector<std::string> keys;
+  EXPECT_TRUE(buildDB->visitKeys("", false, [&](const BuildDBKeyEntry& entry) {
+        EXPECT_FALSE(entry.hasResult);
+        keys.push_back(entry.key);
+        return true;
+      }, &error));
+  std::sort(keys.begin(), keys.end());
+  EXPECT_EQ(std::vector<std::string>({
+        "Ca", "Cb", "C\xff", "Dx", "Nc", "\xff\xff" }), keys);
+
+  // Visit a prefix, with results.
+  keys.clear();
+  unsigned numResults = 0;
+  EXPECT_TRUE(buildDB->visitKeys("C", true, [&](const BuildDBKeyEntry& entry) {
+        keys.push_back(entry.key);
+        EXPECT_TRUE(entry.hasResult);
+        EXPECT_EQ(entry.value, entry.key.substr(1));
+        EXPECT_EQ(entry.signature, basic::CommandSignature(uint64_t(7)));
+        EXPECT_EQ(entry.builtAt, 2U);
+        EXPECT_EQ(entry.computedAt, 3U);
+        ++numResults;
+        return true;
+      }, &error));
+  std::sort(keys.begin(), keys.end());
+  EXPECT_EQ(std::vector<std::string>({ "Ca", "Cb", "C\xff" }), keys);
+  EXPECT_EQ(numResults, 3U);
+
+  // Keys without results are reported as such.
+  keys.clear();
+  EXPECT_TRUE(buildDB->visitKeys("D", true, [&](const BuildDBKeyEntry& entry) {
+        keys.push_back(entry.key);
+        EXPECT_FALSE(entry.hasResult);
+        return true;
+      }, &error));
+  EXPECT_EQ(std::vector<std::string>({ "Dx" }), keys);
+
+  // Prefixes with no successor string.
+  keys.clear();
+  EXPECT_TRUE(buildDB->visitKeys("\xff", false, [&](const BuildDBKeyEntry& entry) {
+        keys.push_back(entry.key);
+        return true;
+      }, &error));
+  EXPECT_EQ(std::vector<std::string>({ "\xff\xff" }), keys);
+
+  // The visitor can stop the enumeration.
+  unsigned numVisited = 0;
+  EXPECT_TRUE(buildDB->visitKeys("", true, [&](const BuildDBKeyEntry&) {
+        ++numVisited;
+        return false;
+      }, &error));
+  EXPECT_EQ(numVisited, 1U);
+  EXPECT_EQ(error, "");
+
+  buildDB->buildComplete();
+  buildDB = nullptr;
+
+  ec = llvm::sys::fs::remove(dbPath.str());
+  EXPECT_EQ(bool(ec), false);
+}
+
+TEST(SQLiteBuildDBTest, CommandTelemetry) {
+  // Create a temporary file.
+  llvm::SmallString<256> dbPath;
+  auto ec = llvm::sys::fs::createTemporaryFile("build", "db", dbPath);
+  EXPECT_EQ(bool(ec), false);
+  fprintf(stderr, "using db: %s\n", dbPath.c_str());
+
+  std::string error;
+  SimpleBuildDBDelegate delegate;
+  std::unique_ptr<BuildDB> buildDB = createSQLiteBuildDB(
+      dbPath, 1, /* recreateUnmatchedVersion = */ true, &error);
+  EXPECT_TRUE(buildDB != nullptr);
+  buildDB->attachDelegate(&delegate);
+  EXPECT_TRUE(buildDB->buildStarted(&error));
+
+  // Record five builds of telemetry for one command, keeping three, and a
+  // single build for another.
+  for (uint64_t iteration = 1; iteration <= 5; ++iteration) {
+    CommandTelemetry telemetry;
+    telemetry.iteration = iteration;
+    telemetry.wallTime = iteration * 100;
+    telemetry.utime = iteration * 10;
+    telemetry.stime = iteration;
+    telemetry.maxrss = 4096;
+    telemetry.outputSize = 12;
+    telemetry.status = 1;
+    telemetry.exitCode = 256;
+    EXPECT_TRUE(buildDB->recordCommandTelemetry("Ca", telemetry, 3, &error));
+    EXPECT_EQ(error, "");
+  }
+  {
+    CommandTelemetry telemetry;
+    telemetry.iteration = 5;
+    EXPECT_TRUE(buildDB->recordCommandTelemetry("Cb", telemetry, 3, &error));
+    EXPECT_EQ(error, "");
+  }
+
+  // Visit the telemetry for a single command, newest first.
+  std::vector<uint64_t> iterations;
+  EXPECT_TRUE(buildDB->visitCommandTelemetry("Ca", [&](
+          StringRef key, const CommandTelemetry& telemetry) {
+        EXPECT_EQ(key, "Ca");
+        EXPECT_EQ(telemetry.wallTime, telemetry.iteration * 100);
+        EXPECT_EQ(telemetry.utime, telemetry.iteration * 10);
+        EXPECT_EQ(telemetry.stime, telemetry.iteration);
+        EXPECT_EQ(telemetry.maxrss, 4096U);
+        EXPECT_EQ(telemetry.outputSize, 12U);
+        EXPECT_EQ(telemetry.status, 1U);
+        EXPECT_EQ(telemetry.exitCode, 256);
+        iterations.push_back(telemetry.iteration);
+        return true;
+      }, &error));
+  EXPECT_EQ(std::vector<uint64_t>({ 5, 4, 3 }), iterations);
+
+  // Visit all telemetry.
+  std::vector<std::string> keys;
+  EXPECT_TRUE(buildDB->visitCommandTelemetry("", [&](
+          StringRef key, const CommandTelemetry&) {
+        keys.push_back(key);
+        return true;
+      }, &error));
+  EXPECT_EQ(std::vector<std::string>({ "Ca", "Ca", "Ca", "Cb" }), keys);
+  EXPECT_EQ(error, "");
+
+  buildDB->buildComplete();
+  buildDB = nullptr;
+
+  ec = llvm::sys::fs::remove(dbPath.str());
+  EXPECT_EQ(bool(ec), false);
+}